@@ -0,0 +1,87 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef CAN_RX_RING_H_
+#define CAN_RX_RING_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "datatypes.h"
+
+/*
+ * Single producer (rx task), single consumer (process task) ring for
+ * received CAN frames. The indexes are free-running and only written by
+ * their owner, so no lock is needed.
+ *
+ * This file has no dependencies on FreeRTOS so that it can be tested on
+ * the host, see tools/can_rx_ring_test.c. twai_message_t must be defined
+ * before including it.
+ */
+
+// Settings
+#ifndef RXBUF_LEN
+#define RXBUF_LEN					64 // Must be a power of two
+#endif
+
+typedef struct {
+	twai_message_t buf[RXBUF_LEN];
+	volatile unsigned int write;
+	volatile unsigned int read;
+	can_rx_stats stats;
+} can_rx_ring;
+
+static inline bool rx_ring_push(can_rx_ring *ring, const twai_message_t *msg) {
+	CAN_ID_CLASS cls = msg->extd ? CAN_ID_CLASS_EXT : CAN_ID_CLASS_STD;
+	unsigned int write = ring->write;
+	unsigned int used = write - __atomic_load_n(&ring->read, __ATOMIC_ACQUIRE);
+
+	if (used >= RXBUF_LEN) {
+		// Frames lost after the ring are counted here too, from another task
+		__atomic_fetch_add(&ring->stats.drop_cnt[cls], 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	ring->buf[write % RXBUF_LEN] = *msg;
+	__atomic_store_n(&ring->write, write + 1, __ATOMIC_RELEASE);
+
+	ring->stats.rx_cnt[cls]++;
+	if ((used + 1) > ring->stats.high_water) {
+		ring->stats.high_water = used + 1;
+	}
+
+	return true;
+}
+
+// Returns the oldest message without removing it, or null if the ring is empty.
+static inline twai_message_t *rx_ring_peek(can_rx_ring *ring) {
+	unsigned int read = ring->read;
+
+	if (read == __atomic_load_n(&ring->write, __ATOMIC_ACQUIRE)) {
+		return 0;
+	}
+
+	return &ring->buf[read % RXBUF_LEN];
+}
+
+static inline void rx_ring_pop(can_rx_ring *ring) {
+	__atomic_store_n(&ring->read, ring->read + 1, __ATOMIC_RELEASE);
+}
+
+#endif /* CAN_RX_RING_H_ */
@@ -0,0 +1,392 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#include "can_win.h"
+#include "crc.h"
+
+#include <string.h>
+
+static bool map_get(const uint32_t *map, unsigned int ind) {
+	return (map[ind / 32] >> (ind % 32)) & 1;
+}
+
+static void map_set(uint32_t *map, unsigned int ind) {
+	map[ind / 32] |= 1u << (ind % 32);
+}
+
+static void map_clear(uint32_t *map, unsigned int ind) {
+	map[ind / 32] &= ~(1u << (ind % 32));
+}
+
+static void tx_send_frame(can_win_tx *tx, unsigned int seq, can_win_send_func send_func, void *arg) {
+	unsigned int offset = seq * CAN_WIN_FRAME_DATA;
+	unsigned int len = tx->len - offset;
+
+	if (len > CAN_WIN_FRAME_DATA) {
+		len = CAN_WIN_FRAME_DATA;
+	}
+
+	send_func(seq, tx->data + offset, len, arg);
+
+	if (tx->stats) {
+		tx->stats->tx_frames++;
+	}
+}
+
+static void tx_set_acked(can_win_tx *tx, unsigned int seq) {
+	map_set(tx->acked, seq);
+	map_clear(tx->resend, seq);
+}
+
+/**
+ * Prepare a windowed transfer.
+ *
+ * @param tx
+ * The transfer state.
+ *
+ * @param data
+ * The data to send. Must stay valid until the transfer is finished.
+ *
+ * @param len
+ * Length of data, at most CAN_WIN_MAX_LEN.
+ *
+ * @param window
+ * The maximum number of unacknowledged frames, clamped to CAN_WIN_MAX_WINDOW.
+ *
+ * @param stats
+ * Counters to update, or NULL.
+ *
+ * @return
+ * True on success, false if len is invalid.
+ */
+bool can_win_tx_init(can_win_tx *tx, const uint8_t *data, unsigned int len, unsigned int window, can_win_stats *stats) {
+	if (len == 0 || len > CAN_WIN_MAX_LEN) {
+		return false;
+	}
+
+	if (window < 1) {
+		window = 1;
+	} else if (window > CAN_WIN_MAX_WINDOW) {
+		window = CAN_WIN_MAX_WINDOW;
+	}
+
+	memset(tx, 0, sizeof(can_win_tx));
+	tx->data = data;
+	tx->len = len;
+	tx->frames = (len + CAN_WIN_FRAME_DATA - 1) / CAN_WIN_FRAME_DATA;
+	tx->window = window;
+	tx->nak_base = -1;
+	tx->status = CAN_WIN_STATUS_RUNNING;
+	tx->stats = stats;
+
+	return true;
+}
+
+int can_win_tx_encode_start(can_win_tx *tx, uint8_t sender, uint8_t send, uint8_t *buffer) {
+	unsigned short crc = crc16((unsigned char*)tx->data, tx->len);
+
+	int ind = 0;
+	buffer[ind++] = sender;
+	buffer[ind++] = send;
+	buffer[ind++] = tx->len >> 8;
+	buffer[ind++] = tx->len & 0xFF;
+	buffer[ind++] = crc >> 8;
+	buffer[ind++] = crc & 0xFF;
+	buffer[ind++] = tx->window;
+	return ind;
+}
+
+/**
+ * Send pending retransmissions and as many new frames as the window allows.
+ */
+void can_win_tx_fill(can_win_tx *tx, can_win_send_func send_func, void *arg) {
+	if (tx->status != CAN_WIN_STATUS_RUNNING) {
+		return;
+	}
+
+	for (unsigned int seq = tx->base;seq < tx->next;seq++) {
+		if (map_get(tx->resend, seq)) {
+			map_clear(tx->resend, seq);
+			tx_send_frame(tx, seq, send_func, arg);
+
+			if (tx->stats) {
+				tx->stats->tx_retransmits++;
+			}
+		}
+	}
+
+	// Everything is acknowledged, but the final status was lost. Sending
+	// the last frame again makes the receiver repeat it.
+	if (tx->probe) {
+		tx->probe = false;
+		tx_send_frame(tx, tx->frames - 1, send_func, arg);
+
+		if (tx->stats) {
+			tx->stats->tx_retransmits++;
+		}
+	}
+
+	while (tx->next < tx->frames && tx->next < (tx->base + tx->window)) {
+		tx_send_frame(tx, tx->next, send_func, arg);
+		tx->next++;
+	}
+}
+
+/**
+ * Process an ack frame from the receiver.
+ */
+void can_win_tx_ack(can_win_tx *tx, const uint8_t *data, unsigned int len) {
+	if (len < CAN_WIN_ACK_LEN || tx->status != CAN_WIN_STATUS_RUNNING) {
+		return;
+	}
+
+	unsigned int base = (unsigned int)data[1] << 8 | data[2];
+	uint8_t mask = data[3];
+	uint8_t status = data[4];
+
+	if (base > tx->next) {
+		return;
+	}
+
+	if (base > tx->base) {
+		tx->retries = 0;
+	}
+
+	while (tx->base < base) {
+		tx_set_acked(tx, tx->base);
+		tx->base++;
+	}
+
+	while (tx->base < tx->frames && map_get(tx->acked, tx->base)) {
+		tx->base++;
+	}
+
+	for (int i = 0;i < 8;i++) {
+		unsigned int seq = base + 1 + i;
+		if ((mask >> i) & 1 && seq < tx->next) {
+			tx_set_acked(tx, seq);
+		}
+	}
+
+	// Frames after base have arrived but base has not, so it was lost.
+	// Resend it and anything else missing before the last received frame,
+	// but only once per gap. Timeouts take care of lost retransmissions.
+	if (mask != 0 && tx->base < tx->next && (int)tx->base != tx->nak_base) {
+		unsigned int last = base + 1 + (31 - __builtin_clz(mask));
+		for (unsigned int seq = tx->base;seq < last && seq < tx->next;seq++) {
+			if (!map_get(tx->acked, seq)) {
+				map_set(tx->resend, seq);
+			}
+		}
+
+		tx->nak_base = tx->base;
+	}
+
+	if (status == CAN_WIN_STATUS_DONE || status == CAN_WIN_STATUS_CRC_ERROR) {
+		tx->status = status;
+	}
+}
+
+/**
+ * Call when no ack has arrived for a while. The first frame that is not
+ * acknowledged is sent again on the next fill, which makes the receiver
+ * respond with an ack whether it had that frame or not.
+ *
+ * @return
+ * False when the retry limit is exceeded and the transfer should be aborted.
+ */
+bool can_win_tx_timeout(can_win_tx *tx) {
+	if (tx->stats) {
+		tx->stats->tx_timeouts++;
+	}
+
+	tx->retries++;
+	if (tx->retries > CAN_WIN_MAX_RETRIES) {
+		return false;
+	}
+
+	tx->nak_base = -1;
+
+	if (tx->base >= tx->frames) {
+		tx->probe = true;
+	} else if (tx->base < tx->next) {
+		map_set(tx->resend, tx->base);
+	}
+
+	return true;
+}
+
+bool can_win_tx_finished(can_win_tx *tx) {
+	return tx->status != CAN_WIN_STATUS_RUNNING;
+}
+
+void can_win_rx_init(can_win_rx *rx, can_win_stats *stats) {
+	memset(rx, 0, sizeof(can_win_rx));
+	rx->nak_base = -1;
+	rx->stats = stats;
+}
+
+/**
+ * Process a start frame. Any transfer in progress is dropped.
+ *
+ * @return
+ * True if the transfer was accepted, in which case an ack should be sent.
+ */
+bool can_win_rx_start(can_win_rx *rx, const uint8_t *data, unsigned int len) {
+	if (len < CAN_WIN_START_LEN) {
+		return false;
+	}
+
+	unsigned int buf_len = (unsigned int)data[2] << 8 | data[3];
+	if (buf_len == 0 || buf_len > CAN_WIN_MAX_LEN) {
+		rx->active = false;
+		return false;
+	}
+
+	rx->active = true;
+	rx->sender = data[0];
+	rx->send = data[1];
+	rx->len = buf_len;
+	rx->frames = (buf_len + CAN_WIN_FRAME_DATA - 1) / CAN_WIN_FRAME_DATA;
+	rx->crc = (unsigned short)data[4] << 8 | data[5];
+	rx->window = data[6] > 0 ? data[6] : 1;
+	rx->base = 0;
+	rx->highest = 0;
+	rx->since_ack = 0;
+	rx->nak_base = -1;
+	rx->status = CAN_WIN_STATUS_RUNNING;
+	memset(rx->received, 0, sizeof(rx->received));
+
+	return true;
+}
+
+/**
+ * Process a data frame.
+ *
+ * @return
+ * What the caller should do. On CAN_WIN_RX_DONE the complete buffer is in
+ * rx->buffer and passed the CRC check.
+ */
+CAN_WIN_RX_RES can_win_rx_data(can_win_rx *rx, const uint8_t *data, unsigned int len) {
+	if (!rx->active || len < 2) {
+		return CAN_WIN_RX_NONE;
+	}
+
+	if (rx->stats) {
+		rx->stats->rx_frames++;
+	}
+
+	unsigned int seq = (unsigned int)data[0] << 8 | data[1];
+	data += 2;
+	len -= 2;
+
+	if (seq >= rx->frames) {
+		return CAN_WIN_RX_NONE;
+	}
+
+	// Already received, so the ack was probably lost
+	if (rx->status != CAN_WIN_STATUS_RUNNING || map_get(rx->received, seq)) {
+		if (rx->stats) {
+			rx->stats->rx_duplicates++;
+		}
+		return CAN_WIN_RX_ACK;
+	}
+
+	unsigned int offset = seq * CAN_WIN_FRAME_DATA;
+	unsigned int len_exp = rx->len - offset;
+	if (len_exp > CAN_WIN_FRAME_DATA) {
+		len_exp = CAN_WIN_FRAME_DATA;
+	}
+
+	if (len != len_exp) {
+		return CAN_WIN_RX_NONE;
+	}
+
+	memcpy(rx->buffer + offset, data, len);
+	map_set(rx->received, seq);
+	rx->since_ack++;
+
+	bool fills_gap = seq < rx->highest;
+	if (seq > rx->highest) {
+		rx->highest = seq;
+	}
+
+	while (rx->base < rx->frames && map_get(rx->received, rx->base)) {
+		rx->base++;
+	}
+
+	if (rx->base == rx->frames) {
+		if (crc16(rx->buffer, rx->len) == rx->crc) {
+			rx->status = CAN_WIN_STATUS_DONE;
+			if (rx->stats) {
+				rx->stats->rx_transfers++;
+			}
+			return CAN_WIN_RX_DONE;
+		} else {
+			rx->status = CAN_WIN_STATUS_CRC_ERROR;
+			if (rx->stats) {
+				rx->stats->rx_crc_errors++;
+			}
+			return CAN_WIN_RX_ACK;
+		}
+	}
+
+	// A frame arrived after a missing one, report the gap right away
+	if (seq > rx->base && (int)rx->base != rx->nak_base) {
+		rx->nak_base = rx->base;
+		rx->since_ack = 0;
+		return CAN_WIN_RX_ACK;
+	}
+
+	// Retransmitted frame, let the sender know where we are
+	if (fills_gap) {
+		rx->since_ack = 0;
+		return CAN_WIN_RX_ACK;
+	}
+
+	unsigned int ack_every = rx->window / 2;
+	if (ack_every < 1) {
+		ack_every = 1;
+	}
+
+	if (rx->since_ack >= ack_every) {
+		rx->since_ack = 0;
+		return CAN_WIN_RX_ACK;
+	}
+
+	return CAN_WIN_RX_NONE;
+}
+
+int can_win_rx_encode_ack(can_win_rx *rx, uint8_t receiver, uint8_t *buffer) {
+	uint8_t mask = 0;
+	for (int i = 0;i < 8;i++) {
+		unsigned int seq = rx->base + 1 + i;
+		if (seq < rx->frames && map_get(rx->received, seq)) {
+			mask |= 1 << i;
+		}
+	}
+
+	int ind = 0;
+	buffer[ind++] = receiver;
+	buffer[ind++] = rx->base >> 8;
+	buffer[ind++] = rx->base & 0xFF;
+	buffer[ind++] = mask;
+	buffer[ind++] = rx->status;
+	return ind;
+}
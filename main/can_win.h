@@ -0,0 +1,140 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+#ifndef CAN_WIN_H_
+#define CAN_WIN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "packet.h"
+
+/*
+ * Windowed buffer transfer over CAN. The sender announces the transfer with
+ * a start frame and then sends numbered data frames, keeping at most window
+ * frames in flight. The receiver acknowledges with the number of frames it
+ * has received in order and a bitmap of the frames after that, which lets
+ * the sender retransmit only what was lost.
+ *
+ * Start: [sender id, send, len 16, crc 16, window]
+ * Data:  [seq 16, up to 6 bytes]
+ * Ack:   [receiver id, base 16, bitmap of base + 1 to base + 8, status]
+ *
+ * This file has no dependencies on FreeRTOS so that it can be tested on
+ * the host, see tools/can_win_sim.c.
+ */
+
+// Settings
+#ifndef CAN_WIN_MAX_LEN
+#define CAN_WIN_MAX_LEN			PACKET_MAX_PL_LEN
+#endif
+
+#ifndef CAN_WIN_MAX_WINDOW
+#define CAN_WIN_MAX_WINDOW		32
+#endif
+
+#ifndef CAN_WIN_MAX_RETRIES
+#define CAN_WIN_MAX_RETRIES		5
+#endif
+
+#define CAN_WIN_FRAME_DATA		6
+#define CAN_WIN_MAX_FRAMES		((CAN_WIN_MAX_LEN + CAN_WIN_FRAME_DATA - 1) / CAN_WIN_FRAME_DATA)
+#define CAN_WIN_MAP_WORDS		((CAN_WIN_MAX_FRAMES + 31) / 32)
+
+#define CAN_WIN_START_LEN		7
+#define CAN_WIN_ACK_LEN			5
+
+// Types
+typedef enum {
+	CAN_WIN_STATUS_RUNNING = 0,
+	CAN_WIN_STATUS_DONE,
+	CAN_WIN_STATUS_CRC_ERROR
+} CAN_WIN_STATUS;
+
+typedef enum {
+	CAN_WIN_RX_NONE = 0, // Nothing to do
+	CAN_WIN_RX_ACK,      // Send an ack
+	CAN_WIN_RX_DONE,     // Process the buffer, then send an ack
+} CAN_WIN_RX_RES;
+
+typedef struct {
+	uint32_t tx_transfers;
+	uint32_t tx_bytes;
+	uint32_t tx_frames;
+	uint32_t tx_retransmits;
+	uint32_t tx_timeouts;
+	uint32_t tx_failed;
+	uint32_t tx_fallback;
+	uint32_t tx_time_ms;
+	uint32_t rx_transfers;
+	uint32_t rx_frames;
+	uint32_t rx_duplicates;
+	uint32_t rx_crc_errors;
+} can_win_stats;
+
+typedef struct {
+	const uint8_t *data;
+	unsigned int len;
+	unsigned int frames;
+	unsigned int window;
+	unsigned int base; // All frames before base are acknowledged
+	unsigned int next; // First frame that has not been sent yet
+	int retries;
+	int nak_base;
+	bool probe;
+	CAN_WIN_STATUS status;
+	uint32_t acked[CAN_WIN_MAP_WORDS];
+	uint32_t resend[CAN_WIN_MAP_WORDS];
+	can_win_stats *stats;
+} can_win_tx;
+
+typedef struct {
+	bool active;
+	uint8_t sender;
+	uint8_t send;
+	unsigned int len;
+	unsigned int frames;
+	unsigned int window;
+	unsigned short crc;
+	unsigned int base;
+	unsigned int highest;
+	unsigned int since_ack;
+	int nak_base;
+	CAN_WIN_STATUS status;
+	uint32_t received[CAN_WIN_MAP_WORDS];
+	uint8_t buffer[CAN_WIN_MAX_LEN];
+	can_win_stats *stats;
+} can_win_rx;
+
+typedef void(*can_win_send_func)(unsigned int seq, const uint8_t *data, unsigned int len, void *arg);
+
+// Functions
+bool can_win_tx_init(can_win_tx *tx, const uint8_t *data, unsigned int len, unsigned int window, can_win_stats *stats);
+int can_win_tx_encode_start(can_win_tx *tx, uint8_t sender, uint8_t send, uint8_t *buffer);
+void can_win_tx_fill(can_win_tx *tx, can_win_send_func send_func, void *arg);
+void can_win_tx_ack(can_win_tx *tx, const uint8_t *data, unsigned int len);
+bool can_win_tx_timeout(can_win_tx *tx);
+bool can_win_tx_finished(can_win_tx *tx);
+
+void can_win_rx_init(can_win_rx *rx, can_win_stats *stats);
+bool can_win_rx_start(can_win_rx *rx, const uint8_t *data, unsigned int len);
+CAN_WIN_RX_RES can_win_rx_data(can_win_rx *rx, const uint8_t *data, unsigned int len);
+int can_win_rx_encode_ack(can_win_rx *rx, uint8_t receiver, uint8_t *buffer);
+
+#endif /* CAN_WIN_H_ */
@@ -326,9 +326,7 @@ static void char1_write_handler(
 	write_attr(ble_chars[0].char_val, param);
 
 	if (ble_chars[0].char_val != NULL) {
-		for (int i = 0; i < param->write.len; ++i) {
-			packet_process_byte(param->write.value[i], packet_state);
-		}
+		packet_process_buffer(param->write.value, param->write.len, packet_state);
 	}
 
 	notify_gatts_if = gatts_if;
@@ -35,8 +35,11 @@
 #include "lispif.h"
 #include "bms.h"
 #include "utils.h"
+#include "can_win.h"
+#include "can_rx_ring.h"
 #include "soc/gpio_sig_map.h"
 #include <string.h>
+#include <stddef.h>
 
 #if CONFIG_IDF_TARGET_ESP32P4
 	#define VESC_TWAI_TX_IDX TWAI0_TX_PAD_OUT_IDX
@@ -49,21 +52,37 @@
 	#define VESC_TWAI_RX_IDX TWAI_RX_IDX
 #endif
 
-// Status messages
-static can_status_msg stat_msgs[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_2 stat_msgs_2[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_3 stat_msgs_3[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_4 stat_msgs_4[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_5 stat_msgs_5[CAN_STATUS_MSGS_TO_STORE];
-static can_status_msg_6 stat_msgs_6[CAN_STATUS_MSGS_TO_STORE];
-static io_board_adc_values io_board_adc_1_4[CAN_STATUS_MSGS_TO_STORE];
-static io_board_adc_values io_board_adc_5_8[CAN_STATUS_MSGS_TO_STORE];
-static io_board_digial_inputs io_board_digital_in[CAN_STATUS_MSGS_TO_STORE];
-static psw_status psw_stat[CAN_STATUS_MSGS_TO_STORE];
+// Status messages, one record per node. node_slot holds the record index
+// plus one for each controller id, or 0 if the id has no record. When all
+// records are in use the node that has been silent the longest is replaced.
+// The *_id getters copy the record under node_mux, so it can be replaced
+// as soon as they return.
+typedef struct {
+	int id;
+	uint32_t rx_time;
+	can_status_msg stat;
+	can_status_msg_2 stat_2;
+	can_status_msg_3 stat_3;
+	can_status_msg_4 stat_4;
+	can_status_msg_5 stat_5;
+	can_status_msg_6 stat_6;
+	io_board_adc_values adc_1_4;
+	io_board_adc_values adc_5_8;
+	io_board_digial_inputs digital_in;
+	psw_status psw;
+} can_node;
+
+#if CAN_STATUS_MSGS_TO_STORE > 255
+#error "CAN_STATUS_MSGS_TO_STORE must be 255 or less"
+#endif
+
+static can_node nodes[CAN_STATUS_MSGS_TO_STORE];
+static uint8_t node_slot[256];
+static uint32_t node_status_map[256 / 32]; // Ids that have sent CAN_PACKET_STATUS
+static portMUX_TYPE node_mux = portMUX_INITIALIZER_UNLOCKED;
 
 #define RX_BUFFER_NUM				3
 #define RX_BUFFER_SIZE				PACKET_MAX_PL_LEN
-#define RXBUF_LEN					50
 
 static twai_timing_config_t t_config = TWAI_TIMING_CONFIG_500KBITS();
 static const twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
@@ -87,22 +106,70 @@ static int rx_buffer_offset[RX_BUFFER_NUM];
 static volatile unsigned int rx_buffer_last_id;
 static volatile unsigned int rx_buffer_response_type = 1;
 
-static twai_message_t rx_buf[RXBUF_LEN];
-static volatile int rx_write = 0;
-static volatile int rx_read = 0;
+static can_rx_ring rx_ring;
 static volatile bool use_vesc_decoder = true;
 
 #ifdef CONFIG_IDF_TARGET_ESP32C6
 static volatile bool can2_use_vesc_dec   = true;
 
-static twai_message_t can2_rx_buf[RXBUF_LEN];
-static volatile int can2_rx_write = 0;
-static volatile int can2_rx_read = 0;
+static can_rx_ring can2_rx_ring;
 static volatile int can2_recovery_cnt = 0;
 #endif
 
 static volatile int rx_recovery_cnt = 0;
 
+// Windowed buffer transfers, see can_win.h. Only used when a window size
+// is set and the receiver answers the start frame.
+#define WIN_START_TIMEOUT_MS		10
+#define WIN_ACK_TIMEOUT_MS			20
+#define WIN_MIN_LEN					64
+
+static SemaphoreHandle_t win_mutex;
+static SemaphoreHandle_t win_ack_sem;
+static portMUX_TYPE win_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t process_task_handle = NULL;
+static volatile int win_size = 0;
+static volatile int win_tx_id = -1;
+static uint8_t win_ack[CAN_WIN_ACK_LEN];
+static uint32_t win_unsupported[256 / 32]; // Nodes that did not answer a start frame
+static can_win_stats win_stats;
+static can_win_rx win_rx;
+
+// Software acceptance filter for frames passed to LispBM. Standard ids are
+// looked up in a bitmap. Extended ids are looked up with a binary search in
+// a sorted table of non-overlapping ranges and then checked against a list
+// of mask/match pairs. When no filter is set all frames pass.
+#define FILTER_EXT_RANGES			32
+#define FILTER_EXT_MASKS			16
+
+typedef struct {
+	uint32_t first;
+	uint32_t last;
+} filter_range;
+
+typedef struct {
+	uint32_t mask;
+	uint32_t match;
+} filter_mask;
+
+typedef struct {
+	uint32_t std_map[2048 / 32];
+	filter_range ext[FILTER_EXT_RANGES];
+	int ext_num;
+	filter_mask ext_mask[FILTER_EXT_MASKS];
+	int ext_mask_num;
+} can_filter;
+
+// The filter is double buffered so that the RX path can read it without
+// locking. Updates are built in the buffer that is not in use and then
+// published by swapping filter_cur. Null means that no filter is set.
+static can_filter filter_buf[2];
+static can_filter *volatile filter_cur = 0;
+// Odd while process_task is reading the filter.
+static volatile uint32_t filter_read_cnt = 0;
+static volatile uint32_t filter_passed = 0;
+static volatile uint32_t filter_rejected = 0;
+
 // Private functions
 static void update_baud(CAN_BAUD baudrate);
 
@@ -110,6 +177,323 @@ static void send_packet_wrapper(unsigned char *data, unsigned int len) {
 	comm_can_send_buffer(rx_buffer_last_id, data, len, rx_buffer_response_type);
 }
 
+static bool filter_accept(uint32_t id, bool is_ext) {
+	__atomic_fetch_add(&filter_read_cnt, 1, __ATOMIC_SEQ_CST);
+	const can_filter *filter = __atomic_load_n(&filter_cur, __ATOMIC_SEQ_CST);
+
+	bool res = true;
+
+	if (filter && is_ext) {
+		int lo = 0;
+		int hi = filter->ext_num - 1;
+
+		res = false;
+		while (lo <= hi) {
+			int mid = (lo + hi) / 2;
+
+			if (id < filter->ext[mid].first) {
+				hi = mid - 1;
+			} else if (id > filter->ext[mid].last) {
+				lo = mid + 1;
+			} else {
+				res = true;
+				break;
+			}
+		}
+
+		for (int i = 0;!res && i < filter->ext_mask_num;i++) {
+			res = (id & filter->ext_mask[i].mask) == filter->ext_mask[i].match;
+		}
+	} else if (filter) {
+		id &= 0x7FF;
+		res = (filter->std_map[id / 32] >> (id % 32)) & 1;
+	}
+
+	__atomic_fetch_add(&filter_read_cnt, 1, __ATOMIC_RELEASE);
+
+	if (res) {
+		filter_passed++;
+	} else {
+		filter_rejected++;
+	}
+
+	return res;
+}
+
+// Add a range to the extended id table, merging it with overlapping and
+// adjacent ranges.
+static bool filter_insert_ext(can_filter *f, uint32_t first, uint32_t last) {
+	int lo = 0;
+	while (lo < f->ext_num && (f->ext[lo].last + 1) < first) {
+		lo++;
+	}
+
+	int hi = lo;
+	while (hi < f->ext_num && f->ext[hi].first <= (last + 1)) {
+		if (f->ext[hi].first < first) {
+			first = f->ext[hi].first;
+		}
+
+		if (f->ext[hi].last > last) {
+			last = f->ext[hi].last;
+		}
+
+		hi++;
+	}
+
+	int num_new = f->ext_num - (hi - lo) + 1;
+	if (num_new > FILTER_EXT_RANGES) {
+		return false;
+	}
+
+	memmove(&f->ext[lo + 1], &f->ext[hi], (f->ext_num - hi) * sizeof(filter_range));
+	f->ext[lo].first = first;
+	f->ext[lo].last = last;
+	f->ext_num = num_new;
+
+	return true;
+}
+
+// The filter is only updated from one thread at a time. Returns the buffer
+// that is not in use, filled with a copy of the current filter.
+static can_filter *filter_edit_begin(void) {
+	can_filter *cur = filter_cur;
+	can_filter *f = cur == &filter_buf[0] ? &filter_buf[1] : &filter_buf[0];
+
+	if (cur) {
+		*f = *cur;
+	} else {
+		memset(f, 0, sizeof(*f));
+	}
+
+	return f;
+}
+
+// Publish f, or no filter if f is null, and wait until process_task no
+// longer reads the previous one so that its buffer can be reused.
+static void filter_commit(can_filter *f) {
+	__atomic_store_n(&filter_cur, f, __ATOMIC_SEQ_CST);
+
+	uint32_t cnt = __atomic_load_n(&filter_read_cnt, __ATOMIC_SEQ_CST);
+	if (cnt & 1) {
+		while (__atomic_load_n(&filter_read_cnt, __ATOMIC_ACQUIRE) == cnt) {
+			vTaskDelay(1);
+		}
+	}
+}
+
+static void node_clear(can_node *node) {
+	node->id = -1;
+	node->stat.id = -1;
+	node->stat_2.id = -1;
+	node->stat_3.id = -1;
+	node->stat_4.id = -1;
+	node->stat_5.id = -1;
+	node->stat_6.id = -1;
+	node->adc_1_4.id = -1;
+	node->adc_5_8.id = -1;
+	node->digital_in.id = -1;
+	node->psw.id = -1;
+}
+
+static void nodes_reset(void) {
+	memset(node_slot, 0, sizeof(node_slot));
+	memset(node_status_map, 0, sizeof(node_status_map));
+
+	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+		node_clear(&nodes[i]);
+	}
+}
+
+static can_node *node_get(int id) {
+	if (id < 0 || id > 255 || node_slot[id] == 0) {
+		return 0;
+	}
+
+	return &nodes[node_slot[id] - 1];
+}
+
+/*
+ * Get the record for id, and assign a free record or the least recently
+ * updated record to it if it does not have one yet.
+ */
+static can_node *node_update(uint8_t id) {
+	uint32_t now = xTaskGetTickCount();
+	can_node *node = node_get(id);
+
+	if (!node) {
+		int slot = 0;
+		uint32_t age_max = 0;
+
+		portENTER_CRITICAL(&node_mux);
+
+		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+			if (nodes[i].id < 0) {
+				slot = i;
+				break;
+			}
+
+			uint32_t age = now - nodes[i].rx_time;
+			if (age > age_max) {
+				age_max = age;
+				slot = i;
+			}
+		}
+
+		node = &nodes[slot];
+
+		if (node->id >= 0) {
+			node_slot[node->id] = 0;
+			node_status_map[node->id / 32] &= ~(1u << (node->id % 32));
+		}
+
+		node_clear(node);
+		node->id = id;
+		node_slot[id] = slot + 1;
+
+		portEXIT_CRITICAL(&node_mux);
+	}
+
+	node->rx_time = now;
+	return node;
+}
+
+/*
+ * Copy size bytes at offset in the record for id to dst. The record cannot
+ * be given to another id while it is copied. With any_board and id 255 the
+ * first record where that message has been received is used. The message
+ * is expected to start with its id, and false is returned if id has no
+ * record or if the message has not been received from it.
+ */
+static bool node_copy(int id, bool any_board, size_t offset, size_t size, void *dst) {
+	bool res = false;
+
+	portENTER_CRITICAL(&node_mux);
+
+	if (any_board && id == 255) {
+		// Any board
+		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
+			if (*(int*)((uint8_t*)&nodes[i] + offset) >= 0) {
+				memcpy(dst, (uint8_t*)&nodes[i] + offset, size);
+				res = true;
+				break;
+			}
+		}
+	} else {
+		can_node *node = node_get(id);
+		if (node && *(int*)((uint8_t*)node + offset) == id) {
+			memcpy(dst, (uint8_t*)node + offset, size);
+			res = true;
+		}
+	}
+
+	portEXIT_CRITICAL(&node_mux);
+
+	return res;
+}
+
+#define NODE_COPY(id, any_board, field, dst) \
+	node_copy(id, any_board, offsetof(can_node, field), sizeof(((can_node*)0)->field), dst)
+
+static void process_buffer(uint8_t *data, int len, uint8_t commands_send, bool is_replaced) {
+	if (is_replaced) {
+		if (data[0] == COMM_JUMP_TO_BOOTLOADER ||
+				data[0] == COMM_ERASE_NEW_APP ||
+				data[0] == COMM_WRITE_NEW_APP_DATA ||
+				data[0] == COMM_WRITE_NEW_APP_DATA_LZO ||
+				data[0] == COMM_ERASE_BOOTLOADER) {
+			return;
+		}
+	}
+
+	switch (commands_send) {
+	case 0:
+	case 3:
+		commands_process_packet(data, len, send_packet_wrapper);
+		break;
+	case 1:
+		commands_send_packet_can_last(data, len);
+		break;
+	case 2:
+		commands_process_packet(data, len, 0);
+		break;
+	default:
+		break;
+	}
+}
+
+static void win_send_ack(void) {
+	uint8_t buffer[8];
+	int ind = can_win_rx_encode_ack(&win_rx, backup.config.controller_id, buffer);
+	comm_can_transmit_eid(win_rx.sender | ((uint32_t)CAN_PACKET_WIN_ACK << 8), buffer, ind);
+}
+
+static void win_send_frame(unsigned int seq, const uint8_t *data, unsigned int len, void *arg) {
+	uint8_t controller_id = *((uint8_t*)arg);
+	uint8_t buffer[8];
+	buffer[0] = seq >> 8;
+	buffer[1] = seq & 0xFF;
+	memcpy(buffer + 2, data, len);
+	comm_can_transmit_eid(controller_id | ((uint32_t)CAN_PACKET_WIN_DATA << 8), buffer, len + 2);
+}
+
+// Returns false if the receiver did not answer the start frame, in which
+// case the plain transfer should be used.
+static bool send_buffer_win(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
+	can_win_tx tx;
+	if (!can_win_tx_init(&tx, data, len, win_size, &win_stats)) {
+		return false;
+	}
+
+	xSemaphoreTake(win_mutex, portMAX_DELAY);
+
+	uint8_t buffer[8];
+	int ind = can_win_tx_encode_start(&tx, backup.config.controller_id, send, buffer);
+
+	win_tx_id = controller_id;
+	xSemaphoreTake(win_ack_sem, 0);
+	TickType_t time_start = xTaskGetTickCount();
+
+	comm_can_transmit_eid(controller_id | ((uint32_t)CAN_PACKET_WIN_START << 8), buffer, ind);
+
+	if (xSemaphoreTake(win_ack_sem, WIN_START_TIMEOUT_MS / portTICK_PERIOD_MS) != pdTRUE) {
+		win_stats.tx_fallback++;
+		win_unsupported[controller_id / 32] |= 1u << (controller_id % 32);
+		win_tx_id = -1;
+		xSemaphoreGive(win_mutex);
+		return false;
+	}
+
+	can_win_tx_fill(&tx, win_send_frame, &controller_id);
+
+	while (!can_win_tx_finished(&tx)) {
+		if (xSemaphoreTake(win_ack_sem, WIN_ACK_TIMEOUT_MS / portTICK_PERIOD_MS) == pdTRUE) {
+			portENTER_CRITICAL(&win_mux);
+			memcpy(buffer, win_ack, CAN_WIN_ACK_LEN);
+			portEXIT_CRITICAL(&win_mux);
+			can_win_tx_ack(&tx, buffer, CAN_WIN_ACK_LEN);
+		} else if (!can_win_tx_timeout(&tx)) {
+			break;
+		}
+
+		can_win_tx_fill(&tx, win_send_frame, &controller_id);
+	}
+
+	if (tx.status == CAN_WIN_STATUS_DONE) {
+		win_stats.tx_transfers++;
+		win_stats.tx_bytes += len;
+	} else {
+		win_stats.tx_failed++;
+	}
+
+	win_stats.tx_time_ms += (xTaskGetTickCount() - time_start) * portTICK_PERIOD_MS;
+
+	win_tx_id = -1;
+	xSemaphoreGive(win_mutex);
+
+	return true;
+}
+
 static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced) {
 	int32_t ind = 0;
 	uint8_t crc_low;
@@ -220,31 +604,7 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 			if (crc16(rx_buffer[buf_ind], rxbuf_len)
 					== ((unsigned short) crc_high << 8
 							| (unsigned short) crc_low)) {
-
-				if (is_replaced) {
-					if (rx_buffer[buf_ind][0] == COMM_JUMP_TO_BOOTLOADER ||
-							rx_buffer[buf_ind][0] == COMM_ERASE_NEW_APP ||
-							rx_buffer[buf_ind][0] == COMM_WRITE_NEW_APP_DATA ||
-							rx_buffer[buf_ind][0] == COMM_WRITE_NEW_APP_DATA_LZO ||
-							rx_buffer[buf_ind][0] == COMM_ERASE_BOOTLOADER) {
-						break;
-					}
-				}
-
-				switch (commands_send) {
-				case 0:
-				case 3:
-					commands_process_packet(rx_buffer[buf_ind], rxbuf_len, send_packet_wrapper);
-					break;
-				case 1:
-					commands_send_packet_can_last(rx_buffer[buf_ind], rxbuf_len);
-					break;
-				case 2:
-					commands_process_packet(rx_buffer[buf_ind], rxbuf_len, 0);
-					break;
-				default:
-					break;
-				}
+				process_buffer(rx_buffer[buf_ind], rxbuf_len, commands_send, is_replaced);
 			}
 		} break;
 
@@ -263,32 +623,47 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 				rx_buffer_response_type = 1;
 			}
 
-			if (is_replaced) {
-				if (data8[ind] == COMM_JUMP_TO_BOOTLOADER ||
-						data8[ind] == COMM_ERASE_NEW_APP ||
-						data8[ind] == COMM_WRITE_NEW_APP_DATA ||
-						data8[ind] == COMM_WRITE_NEW_APP_DATA_LZO ||
-						data8[ind] == COMM_ERASE_BOOTLOADER) {
-					break;
-				}
+			process_buffer(data8 + ind, len - ind, commands_send, is_replaced);
+			break;
+
+		case CAN_PACKET_WIN_START:
+			if (can_win_rx_start(&win_rx, data8, len)) {
+				win_send_ack();
 			}
+			break;
 
-			switch (commands_send) {
-			case 0:
-			case 3:
-				commands_process_packet(data8 + ind, len - ind, send_packet_wrapper);
+		case CAN_PACKET_WIN_DATA:
+			switch (can_win_rx_data(&win_rx, data8, len)) {
+			case CAN_WIN_RX_ACK:
+				win_send_ack();
 				break;
-			case 1:
-				commands_send_packet_can_last(data8 + ind, len - ind);
-				break;
-			case 2:
-				commands_process_packet(data8 + ind, len - ind, 0);
+
+			case CAN_WIN_RX_DONE:
+				// Ack first, processing can take a while
+				win_send_ack();
+
+				if (win_rx.send == 0 || win_rx.send == 3) {
+					rx_buffer_last_id = win_rx.sender;
+				}
+
+				rx_buffer_response_type = win_rx.send == 3 ? 0 : 1;
+				process_buffer(win_rx.buffer, win_rx.len, win_rx.send, is_replaced);
 				break;
+
 			default:
 				break;
 			}
 			break;
 
+		case CAN_PACKET_WIN_ACK:
+			if (len >= CAN_WIN_ACK_LEN && data8[0] == win_tx_id) {
+				portENTER_CRITICAL(&win_mux);
+				memcpy(win_ack, data8, CAN_WIN_ACK_LEN);
+				portEXIT_CRITICAL(&win_mux);
+				xSemaphoreGive(win_ack_sem);
+			}
+			break;
+
 			case CAN_PACKET_PING: {
 				uint8_t buffer[2];
 				buffer[0] = backup.config.controller_id;
@@ -314,165 +689,133 @@ static void decode_msg(uint32_t eid, uint8_t *data8, int len, bool is_replaced)
 	// The packets below are addressed to all devices, mainly containing status information.
 
 	switch (cmd) {
-	case CAN_PACKET_STATUS:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg *stat_tmp = &stat_msgs[i];
-			if (stat_tmp->id == id || stat_tmp->id == -1) {
-				ind = 0;
-				stat_tmp->id = id;
-				stat_tmp->rx_time = xTaskGetTickCount();
-				stat_tmp->rpm = (float)buffer_get_int32(data8, &ind);
-				stat_tmp->current = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp->duty = (float)buffer_get_int16(data8, &ind) / 1000.0;
-				break;
-			}
-		}
-		break;
+	case CAN_PACKET_STATUS: {
+		can_node *node = node_update(id);
 
-	case CAN_PACKET_STATUS_2:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_2 *stat_tmp_2 = &stat_msgs_2[i];
-			if (stat_tmp_2->id == id || stat_tmp_2->id == -1) {
-				ind = 0;
-				stat_tmp_2->id = id;
-				stat_tmp_2->rx_time = xTaskGetTickCount();
-				stat_tmp_2->amp_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
-				stat_tmp_2->amp_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
-				break;
-			}
-		}
-		break;
+		can_status_msg *stat_tmp = &node->stat;
+		ind = 0;
+		stat_tmp->id = id;
+		stat_tmp->rx_time = xTaskGetTickCount();
+		stat_tmp->rpm = (float)buffer_get_int32(data8, &ind);
+		stat_tmp->current = (float)buffer_get_int16(data8, &ind) / 10.0;
+		stat_tmp->duty = (float)buffer_get_int16(data8, &ind) / 1000.0;
+		node_status_map[id / 32] |= 1u << (id % 32);
+	} break;
 
-	case CAN_PACKET_STATUS_3:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_3 *stat_tmp_3 = &stat_msgs_3[i];
-			if (stat_tmp_3->id == id || stat_tmp_3->id == -1) {
-				ind = 0;
-				stat_tmp_3->id = id;
-				stat_tmp_3->rx_time = xTaskGetTickCount();
-				stat_tmp_3->watt_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
-				stat_tmp_3->watt_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
-				break;
-			}
-		}
-		break;
+	case CAN_PACKET_STATUS_2: {
+		can_node *node = node_update(id);
 
-	case CAN_PACKET_STATUS_4:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_4 *stat_tmp_4 = &stat_msgs_4[i];
-			if (stat_tmp_4->id == id || stat_tmp_4->id == -1) {
-				ind = 0;
-				stat_tmp_4->id = id;
-				stat_tmp_4->rx_time = xTaskGetTickCount();
-				stat_tmp_4->temp_fet = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp_4->temp_motor = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp_4->current_in = (float)buffer_get_int16(data8, &ind) / 10.0;
-				stat_tmp_4->pid_pos_now = (float)buffer_get_int16(data8, &ind) / 50.0;
-				break;
-			}
-		}
-		break;
+		can_status_msg_2 *stat_tmp_2 = &node->stat_2;
+		ind = 0;
+		stat_tmp_2->id = id;
+		stat_tmp_2->rx_time = xTaskGetTickCount();
+		stat_tmp_2->amp_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
+		stat_tmp_2->amp_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
+	} break;
 
-	case CAN_PACKET_STATUS_5:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_5 *stat_tmp_5 = &stat_msgs_5[i];
-			if (stat_tmp_5->id == id || stat_tmp_5->id == -1) {
-				ind = 0;
-				stat_tmp_5->id = id;
-				stat_tmp_5->rx_time = xTaskGetTickCount();
-				stat_tmp_5->tacho_value = buffer_get_int32(data8, &ind);
-				stat_tmp_5->v_in = (float)buffer_get_int16(data8, &ind) / 1e1;
-				break;
-			}
-		}
-		break;
+	case CAN_PACKET_STATUS_3: {
+		can_node *node = node_update(id);
 
-	case CAN_PACKET_STATUS_6:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg_6 *stat_tmp_6 = &stat_msgs_6[i];
-			if (stat_tmp_6->id == id || stat_tmp_6->id == -1) {
-				ind = 0;
-				stat_tmp_6->id = id;
-				stat_tmp_6->rx_time = xTaskGetTickCount();
-				stat_tmp_6->adc_1 = buffer_get_float16(data8, 1e3, &ind);
-				stat_tmp_6->adc_2 = buffer_get_float16(data8, 1e3, &ind);
-				stat_tmp_6->adc_3 = buffer_get_float16(data8, 1e3, &ind);
-				stat_tmp_6->ppm = buffer_get_float16(data8, 1e3, &ind);
-				break;
-			}
-		}
-		break;
+		can_status_msg_3 *stat_tmp_3 = &node->stat_3;
+		ind = 0;
+		stat_tmp_3->id = id;
+		stat_tmp_3->rx_time = xTaskGetTickCount();
+		stat_tmp_3->watt_hours = (float)buffer_get_int32(data8, &ind) / 1e4;
+		stat_tmp_3->watt_hours_charged = (float)buffer_get_int32(data8, &ind) / 1e4;
+	} break;
 
-	case CAN_PACKET_IO_BOARD_ADC_1_TO_4:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			io_board_adc_values *msg = &io_board_adc_1_4[i];
-			if (msg->id == id || msg->id == -1) {
-				ind = 0;
-				msg->id = id;
-				msg->rx_time = xTaskGetTickCount();
-				ind = 0;
-				int j = 0;
-				while (ind < len) {
-					msg->adc_voltages[j++] = buffer_get_float16(data8, 1e2, &ind);
-				}
-				break;
-			}
+	case CAN_PACKET_STATUS_4: {
+		can_node *node = node_update(id);
+
+		can_status_msg_4 *stat_tmp_4 = &node->stat_4;
+		ind = 0;
+		stat_tmp_4->id = id;
+		stat_tmp_4->rx_time = xTaskGetTickCount();
+		stat_tmp_4->temp_fet = (float)buffer_get_int16(data8, &ind) / 10.0;
+		stat_tmp_4->temp_motor = (float)buffer_get_int16(data8, &ind) / 10.0;
+		stat_tmp_4->current_in = (float)buffer_get_int16(data8, &ind) / 10.0;
+		stat_tmp_4->pid_pos_now = (float)buffer_get_int16(data8, &ind) / 50.0;
+	} break;
+
+	case CAN_PACKET_STATUS_5: {
+		can_node *node = node_update(id);
+
+		can_status_msg_5 *stat_tmp_5 = &node->stat_5;
+		ind = 0;
+		stat_tmp_5->id = id;
+		stat_tmp_5->rx_time = xTaskGetTickCount();
+		stat_tmp_5->tacho_value = buffer_get_int32(data8, &ind);
+		stat_tmp_5->v_in = (float)buffer_get_int16(data8, &ind) / 1e1;
+	} break;
+
+	case CAN_PACKET_STATUS_6: {
+		can_node *node = node_update(id);
+
+		can_status_msg_6 *stat_tmp_6 = &node->stat_6;
+		ind = 0;
+		stat_tmp_6->id = id;
+		stat_tmp_6->rx_time = xTaskGetTickCount();
+		stat_tmp_6->adc_1 = buffer_get_float16(data8, 1e3, &ind);
+		stat_tmp_6->adc_2 = buffer_get_float16(data8, 1e3, &ind);
+		stat_tmp_6->adc_3 = buffer_get_float16(data8, 1e3, &ind);
+		stat_tmp_6->ppm = buffer_get_float16(data8, 1e3, &ind);
+	} break;
+
+	case CAN_PACKET_IO_BOARD_ADC_1_TO_4: {
+		can_node *node = node_update(id);
+
+		io_board_adc_values *msg = &node->adc_1_4;
+		msg->id = id;
+		msg->rx_time = xTaskGetTickCount();
+		ind = 0;
+		int j = 0;
+		while (ind < len) {
+			msg->adc_voltages[j++] = buffer_get_float16(data8, 1e2, &ind);
 		}
-		break;
+	} break;
 
-	case CAN_PACKET_IO_BOARD_ADC_5_TO_8:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			io_board_adc_values *msg = &io_board_adc_5_8[i];
-			if (msg->id == id || msg->id == -1) {
-				ind = 0;
-				msg->id = id;
-				msg->rx_time = xTaskGetTickCount();
-				ind = 0;
-				int j = 0;
-				while (ind < len) {
-					msg->adc_voltages[j++] = buffer_get_float16(data8, 1e2, &ind);
-				}
-				break;
-			}
+	case CAN_PACKET_IO_BOARD_ADC_5_TO_8: {
+		can_node *node = node_update(id);
+
+		io_board_adc_values *msg = &node->adc_5_8;
+		msg->id = id;
+		msg->rx_time = xTaskGetTickCount();
+		ind = 0;
+		int j = 0;
+		while (ind < len) {
+			msg->adc_voltages[j++] = buffer_get_float16(data8, 1e2, &ind);
 		}
-		break;
+	} break;
 
-	case CAN_PACKET_IO_BOARD_DIGITAL_IN:
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			io_board_digial_inputs *msg = &io_board_digital_in[i];
-			if (msg->id == id || msg->id == -1) {
-				ind = 0;
-				msg->id = id;
-				msg->rx_time = xTaskGetTickCount();
-				msg->inputs = 0;
-				ind = 0;
-				while (ind < len) {
-					msg->inputs |= (uint64_t)data8[ind] << (ind * 8);
-					ind++;
-				}
-				break;
-			}
+	case CAN_PACKET_IO_BOARD_DIGITAL_IN: {
+		can_node *node = node_update(id);
+
+		io_board_digial_inputs *msg = &node->digital_in;
+		msg->id = id;
+		msg->rx_time = xTaskGetTickCount();
+		msg->inputs = 0;
+		ind = 0;
+		while (ind < len) {
+			msg->inputs |= (uint64_t)data8[ind] << (ind * 8);
+			ind++;
 		}
-		break;
+	} break;
 
 	case CAN_PACKET_PSW_STAT: {
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			psw_status *msg = &psw_stat[i];
-			if (msg->id == id || msg->id == -1) {
-				ind = 0;
-				msg->id = id;
-				msg->rx_time = xTaskGetTickCount();
-
-				msg->v_in = buffer_get_float16(data8, 10.0, &ind);
-				msg->v_out = buffer_get_float16(data8, 10.0, &ind);
-				msg->temp = buffer_get_float16(data8, 10.0, &ind);
-				msg->is_out_on = (data8[ind] >> 0) & 1;
-				msg->is_pch_on = (data8[ind] >> 1) & 1;
-				msg->is_dsc_on = (data8[ind] >> 2) & 1;
-				ind++;
-				break;
-			}
-		}
+		can_node *node = node_update(id);
+
+		psw_status *msg = &node->psw;
+		ind = 0;
+		msg->id = id;
+		msg->rx_time = xTaskGetTickCount();
+
+		msg->v_in = buffer_get_float16(data8, 10.0, &ind);
+		msg->v_out = buffer_get_float16(data8, 10.0, &ind);
+		msg->temp = buffer_get_float16(data8, 10.0, &ind);
+		msg->is_out_on = (data8[ind] >> 0) & 1;
+		msg->is_pch_on = (data8[ind] >> 1) & 1;
+		msg->is_dsc_on = (data8[ind] >> 2) & 1;
+		ind++;
 	} break;
 
 	case CAN_PACKET_GNSS_TIME: {
@@ -581,12 +924,7 @@ static void rx_task(void *arg) {
 		esp_err_t res = twai_receive(&rx_message, 2);
 
 		if (res == ESP_OK) {
-			rx_buf[rx_write] = rx_message;
-			rx_write++;
-			if (rx_write >= RXBUF_LEN) {
-				rx_write = 0;
-			}
-
+			rx_ring_push(&rx_ring, &rx_message);
 			xSemaphoreGive(proc_sem);
 		}
 
@@ -622,15 +960,12 @@ static void process_task(void *arg) {
 	for (;;) {
 		xSemaphoreTake(proc_sem, 10 / portTICK_PERIOD_MS);
 
-		while (rx_read != rx_write) {
-			twai_message_t *msg = &rx_buf[rx_read];
-			rx_read++;
-			if (rx_read >= RXBUF_LEN) {
-				rx_read = 0;
+		twai_message_t *msg;
+		while ((msg = rx_ring_peek(&rx_ring)) != 0) {
+			if (filter_accept(msg->identifier, msg->extd)) {
+				lispif_process_can(msg->identifier, msg->data, msg->data_length_code, msg->extd);
 			}
 
-			lispif_process_can(msg->identifier, msg->data, msg->data_length_code, msg->extd);
-
 			if (use_vesc_decoder) {
 				if (!bms_process_can_frame(msg->identifier, msg->data, msg->data_length_code, msg->extd)) {
 					if (msg->extd) {
@@ -638,18 +973,17 @@ static void process_task(void *arg) {
 					}
 				}
 			}
+
+			rx_ring_pop(&rx_ring);
 		}
 
 #ifdef CONFIG_IDF_TARGET_ESP32C6
-		while (can2_rx_read != can2_rx_write) {
-			twai_message_t *m = &can2_rx_buf[can2_rx_read];
-			can2_rx_read++;
-			if (can2_rx_read >= RXBUF_LEN) {
-				can2_rx_read = 0;
+		twai_message_t *m;
+		while ((m = rx_ring_peek(&can2_rx_ring)) != 0) {
+			if (filter_accept(m->identifier, m->extd)) {
+				lispif_process_can2(m->identifier, m->data, m->data_length_code, m->extd);
 			}
 
-			lispif_process_can2(m->identifier, m->data, m->data_length_code, m->extd);
-
 			if (can2_use_vesc_dec) {
 				if (!bms_process_can_frame(m->identifier, m->data, m->data_length_code, m->extd)) {
 					if (m->extd) {
@@ -657,8 +991,12 @@ static void process_task(void *arg) {
 					}
 				}
 			}
+
+			rx_ring_pop(&can2_rx_ring);
 		}
 #endif
+
+		lispif_process_can_batch_timeout();
 	}
 
 	vTaskDelete(NULL);
@@ -822,25 +1160,15 @@ void comm_can_start(int pin_tx, int pin_rx) {
 		return;
 	}
 
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		stat_msgs[i].id = -1;
-		stat_msgs_2[i].id = -1;
-		stat_msgs_3[i].id = -1;
-		stat_msgs_4[i].id = -1;
-		stat_msgs_5[i].id = -1;
-		stat_msgs_6[i].id = -1;
-
-		io_board_adc_1_4[i].id = -1;
-		io_board_adc_5_8[i].id = -1;
-		io_board_digital_in[i].id = -1;
-
-		psw_stat[i].id = -1;
-	}
+	nodes_reset();
 
 	if (!sem_init_done) {
 		ping_sem = xSemaphoreCreateBinary();
 		status_sem = xSemaphoreCreateBinary();
 		send_mutex = xSemaphoreCreateMutex();
+		win_mutex = xSemaphoreCreateMutex();
+		win_ack_sem = xSemaphoreCreateBinary();
+		can_win_rx_init(&win_rx, &win_stats);
 		sem_init_done = true;
 	}
 
@@ -849,7 +1177,7 @@ void comm_can_start(int pin_tx, int pin_rx) {
 
 		// The process-task is left running after the first init in case comm_can_stop
 		// is called from it.
-		xTaskCreatePinnedToCore(process_task, "can_proc", 3072, NULL, 8, NULL, tskNO_AFFINITY);
+		xTaskCreatePinnedToCore(process_task, "can_proc", 3072, NULL, 8, &process_task_handle, tskNO_AFFINITY);
 		proc_started = true;
 	}
 
@@ -895,6 +1223,206 @@ int comm_can_get_rx_recovery_cnt(void) {
 	return rx_recovery_cnt;
 }
 
+/**
+ * Get receive statistics for a CAN-bus.
+ *
+ * @param bus
+ * 1 for the first bus, 2 for the second bus (only on the ESP32-C6).
+ *
+ * @param stats
+ * The statistics are copied here.
+ *
+ * @return
+ * True on success, false if the bus does not exist.
+ */
+bool comm_can_get_rx_stats(int bus, can_rx_stats *stats) {
+	can_rx_ring *ring = 0;
+
+	if (bus == 1) {
+		ring = &rx_ring;
+	}
+
+#ifdef CONFIG_IDF_TARGET_ESP32C6
+	if (bus == 2) {
+		ring = &can2_rx_ring;
+	}
+#endif
+
+	if (!ring) {
+		return false;
+	}
+
+	*stats = ring->stats;
+	stats->size = RXBUF_LEN;
+	return true;
+}
+
+/**
+ * Count frames that were received but lost later, for example because
+ * a batch of them could not be delivered to LispBM. They are added to
+ * the same drop counters as frames that did not fit in the receive
+ * queue.
+ *
+ * @param bus
+ * 1 for the first CAN bus, 2 for the second.
+ *
+ * @param is_ext
+ * Whether the frames have extended ids.
+ *
+ * @param num
+ * Number of frames.
+ */
+void comm_can_add_rx_drops(int bus, bool is_ext, uint32_t num) {
+	can_rx_ring *ring = 0;
+
+	if (bus == 1) {
+		ring = &rx_ring;
+	}
+
+#ifdef CONFIG_IDF_TARGET_ESP32C6
+	if (bus == 2) {
+		ring = &can2_rx_ring;
+	}
+#endif
+
+	if (!ring || num == 0) {
+		return;
+	}
+
+	__atomic_fetch_add(&ring->stats.drop_cnt[is_ext ? CAN_ID_CLASS_EXT : CAN_ID_CLASS_STD],
+			num, __ATOMIC_RELAXED);
+}
+
+void comm_can_reset_rx_stats(void) {
+	memset(&rx_ring.stats, 0, sizeof(rx_ring.stats));
+#ifdef CONFIG_IDF_TARGET_ESP32C6
+	memset(&can2_rx_ring.stats, 0, sizeof(can2_rx_ring.stats));
+#endif
+}
+
+/**
+ * Let frames with ids in a range through to LispBM. Once a range or mask has
+ * been added, frames that do not match any of them are not passed to LispBM.
+ * This does not affect the VESC decoder.
+ *
+ * @param first
+ * First id in the range.
+ *
+ * @param last
+ * Last id in the range.
+ *
+ * @param is_ext
+ * Add the range for extended ids instead of standard ids.
+ *
+ * @return
+ * True on success, false if the range is invalid or the table is full.
+ */
+bool comm_can_filter_add_range(uint32_t first, uint32_t last, bool is_ext) {
+	uint32_t id_max = is_ext ? 0x1FFFFFFF : 0x7FF;
+
+	if (first > last || first > id_max) {
+		return false;
+	}
+
+	if (last > id_max) {
+		last = id_max;
+	}
+
+	can_filter *f = filter_edit_begin();
+
+	if (is_ext) {
+		if (!filter_insert_ext(f, first, last)) {
+			return false;
+		}
+	} else {
+		for (uint32_t i = first;i <= last;i++) {
+			f->std_map[i / 32] |= 1u << (i % 32);
+		}
+	}
+
+	filter_commit(f);
+	return true;
+}
+
+/**
+ * Same as comm_can_filter_add_range, but let through ids where the bits
+ * that are set in mask are equal to the bits in id.
+ *
+ * @return
+ * True on success, false if the list of extended id masks is full.
+ */
+bool comm_can_filter_add_mask(uint32_t id, uint32_t mask, bool is_ext) {
+	can_filter *f = filter_edit_begin();
+
+	if (is_ext) {
+		if (f->ext_mask_num >= FILTER_EXT_MASKS) {
+			return false;
+		}
+
+		mask &= 0x1FFFFFFF;
+		f->ext_mask[f->ext_mask_num].mask = mask;
+		f->ext_mask[f->ext_mask_num].match = id & mask;
+		f->ext_mask_num++;
+	} else {
+		for (uint32_t i = 0;i < 2048;i++) {
+			if ((i & mask) == (id & mask)) {
+				f->std_map[i / 32] |= 1u << (i % 32);
+			}
+		}
+	}
+
+	filter_commit(f);
+	return true;
+}
+
+void comm_can_filter_clear(void) {
+	filter_commit(0);
+}
+
+void comm_can_filter_get_stats(uint32_t *passed, uint32_t *rejected) {
+	*passed = filter_passed;
+	*rejected = filter_rejected;
+}
+
+void comm_can_filter_reset_stats(void) {
+	filter_passed = 0;
+	filter_rejected = 0;
+}
+
+/**
+ * Set the window size for buffer transfers. With a window size above 0,
+ * comm_can_send_buffer uses windowed transfers with acks and retransmission
+ * for larger buffers to nodes that support it, and the plain transfer to
+ * other nodes. Nodes that do not answer are remembered until the window
+ * size is set again.
+ *
+ * @param window
+ * Number of frames that can be in flight, or 0 to disable windowed
+ * transfers. Clamped to CAN_WIN_MAX_WINDOW.
+ */
+void comm_can_set_buffer_window(int window) {
+	if (window < 0) {
+		window = 0;
+	} else if (window > CAN_WIN_MAX_WINDOW) {
+		window = CAN_WIN_MAX_WINDOW;
+	}
+
+	memset(win_unsupported, 0, sizeof(win_unsupported));
+	win_size = window;
+}
+
+int comm_can_get_buffer_window(void) {
+	return win_size;
+}
+
+void comm_can_get_win_stats(can_win_stats *stats) {
+	*stats = win_stats;
+}
+
+void comm_can_reset_win_stats(void) {
+	memset(&win_stats, 0, sizeof(win_stats));
+}
+
 void comm_can_use_vesc_decoder(bool use_vesc_dec) {
 	use_vesc_decoder = use_vesc_dec;
 }
@@ -1057,6 +1585,14 @@ void comm_can_transmit_sid(uint32_t id, const uint8_t *data, uint8_t len) {
 void comm_can_send_buffer(uint8_t controller_id, uint8_t *data, unsigned int len, uint8_t send) {
 	uint8_t send_buffer[8];
 
+	// The acks are received by the process task, so it cannot wait for them
+	if (win_size > 0 && len >= WIN_MIN_LEN && controller_id != 255 && sem_init_done &&
+			!((win_unsupported[controller_id / 32] >> (controller_id % 32)) & 1) &&
+			xTaskGetCurrentTaskHandle() != process_task_handle &&
+			send_buffer_win(controller_id, data, len, send)) {
+		return;
+	}
+
 	if (len <= 6) {
 		uint32_t ind = 0;
 		send_buffer[ind++] = backup.config.controller_id;
@@ -1251,176 +1787,150 @@ void comm_can_send_update_baud(int kbits, int delay_msec) {
 
 can_status_msg *comm_can_get_status_msg_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs[index];
+		return &nodes[index].stat;
 	} else {
 		return 0;
 	}
 }
 
-can_status_msg *comm_can_get_status_msg_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs[i].id == id) {
-			return &stat_msgs[i];
+/**
+ * Get a copy of the latest status message from a controller. The other
+ * comm_can_get_*_id functions work the same way.
+ *
+ * @param id
+ * Controller id.
+ *
+ * @param msg
+ * The message is copied here.
+ *
+ * @return
+ * True on success, false if no such message has been received from id.
+ */
+bool comm_can_get_status_msg_id(int id, can_status_msg *msg) {
+	return NODE_COPY(id, false, stat, msg);
+}
+
+/**
+ * Get the next controller id that has sent a status message. This is
+ * faster than looping over all status messages by index, and the ids
+ * come in ascending order.
+ *
+ * @param id
+ * The id to continue after. Use -1 to get the first id.
+ *
+ * @return
+ * The next id, or -1 if there are no more.
+ */
+int comm_can_get_status_msg_next_id(int id) {
+	int i = id + 1;
+
+	while (i >= 0 && i < 256) {
+		uint32_t bits = node_status_map[i / 32] >> (i % 32);
+
+		if (bits) {
+			return i + __builtin_ctz(bits);
 		}
+
+		i = (i / 32 + 1) * 32;
 	}
 
-	return 0;
+	return -1;
 }
 
 can_status_msg_2 *comm_can_get_status_msg_2_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_2[index];
+		return &nodes[index].stat_2;
 	} else {
 		return 0;
 	}
 }
 
-can_status_msg_2 *comm_can_get_status_msg_2_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_2[i].id == id) {
-			return &stat_msgs_2[i];
-		}
-	}
-
-	return 0;
+bool comm_can_get_status_msg_2_id(int id, can_status_msg_2 *msg) {
+	return NODE_COPY(id, false, stat_2, msg);
 }
 
 can_status_msg_3 *comm_can_get_status_msg_3_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_3[index];
+		return &nodes[index].stat_3;
 	} else {
 		return 0;
 	}
 }
 
-can_status_msg_3 *comm_can_get_status_msg_3_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_3[i].id == id) {
-			return &stat_msgs_3[i];
-		}
-	}
-
-	return 0;
+bool comm_can_get_status_msg_3_id(int id, can_status_msg_3 *msg) {
+	return NODE_COPY(id, false, stat_3, msg);
 }
 
 can_status_msg_4 *comm_can_get_status_msg_4_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_4[index];
+		return &nodes[index].stat_4;
 	} else {
 		return 0;
 	}
 }
 
-can_status_msg_4 *comm_can_get_status_msg_4_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_4[i].id == id) {
-			return &stat_msgs_4[i];
-		}
-	}
-
-	return 0;
+bool comm_can_get_status_msg_4_id(int id, can_status_msg_4 *msg) {
+	return NODE_COPY(id, false, stat_4, msg);
 }
 
 can_status_msg_5 *comm_can_get_status_msg_5_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_5[index];
+		return &nodes[index].stat_5;
 	} else {
 		return 0;
 	}
 }
 
-can_status_msg_5 *comm_can_get_status_msg_5_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_5[i].id == id) {
-			return &stat_msgs_5[i];
-		}
-	}
-
-	return 0;
+bool comm_can_get_status_msg_5_id(int id, can_status_msg_5 *msg) {
+	return NODE_COPY(id, false, stat_5, msg);
 }
 
 can_status_msg_6 *comm_can_get_status_msg_6_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &stat_msgs_6[index];
+		return &nodes[index].stat_6;
 	} else {
 		return 0;
 	}
 }
 
-can_status_msg_6 *comm_can_get_status_msg_6_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (stat_msgs_6[i].id == id) {
-			return &stat_msgs_6[i];
-		}
-	}
-
-	return 0;
+bool comm_can_get_status_msg_6_id(int id, can_status_msg_6 *msg) {
+	return NODE_COPY(id, false, stat_6, msg);
 }
 
 io_board_adc_values *comm_can_get_io_board_adc_1_4_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE && io_board_adc_1_4[index].id >= 0) {
-		return &io_board_adc_1_4[index];
+	if (index < CAN_STATUS_MSGS_TO_STORE && nodes[index].adc_1_4.id >= 0) {
+		return &nodes[index].adc_1_4;
 	} else {
 		return 0;
 	}
 }
 
-io_board_adc_values *comm_can_get_io_board_adc_1_4_id(int id) {
-	if (id == 255 && io_board_adc_1_4[0].id >= 0) {
-		return &io_board_adc_1_4[0];
-	}
-
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (io_board_adc_1_4[i].id == id) {
-			return &io_board_adc_1_4[i];
-		}
-	}
-
-	return 0;
+bool comm_can_get_io_board_adc_1_4_id(int id, io_board_adc_values *msg) {
+	return NODE_COPY(id, true, adc_1_4, msg);
 }
 
 io_board_adc_values *comm_can_get_io_board_adc_5_8_index(int index) {
-	if (index < CAN_STATUS_MSGS_TO_STORE && io_board_adc_5_8[index].id >= 0) {
-		return &io_board_adc_5_8[index];
+	if (index < CAN_STATUS_MSGS_TO_STORE && nodes[index].adc_5_8.id >= 0) {
+		return &nodes[index].adc_5_8;
 	} else {
 		return 0;
 	}
 }
 
-io_board_adc_values *comm_can_get_io_board_adc_5_8_id(int id) {
-	if (id == 255 && io_board_adc_5_8[0].id >= 0) {
-		return &io_board_adc_5_8[0];
-	}
-
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (io_board_adc_5_8[i].id == id) {
-			return &io_board_adc_5_8[i];
-		}
-	}
-
-	return 0;
+bool comm_can_get_io_board_adc_5_8_id(int id, io_board_adc_values *msg) {
+	return NODE_COPY(id, true, adc_5_8, msg);
 }
 
 io_board_digial_inputs *comm_can_get_io_board_digital_in_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &io_board_digital_in[index];
+		return &nodes[index].digital_in;
 	} else {
 		return 0;
 	}
 }
 
-io_board_digial_inputs *comm_can_get_io_board_digital_in_id(int id) {
-	if (id == 255 && io_board_digital_in[0].id >= 0) {
-		return &io_board_digital_in[0];
-	}
-
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (io_board_digital_in[i].id == id) {
-			return &io_board_digital_in[i];
-		}
-	}
-
-	return 0;
+bool comm_can_get_io_board_digital_in_id(int id, io_board_digial_inputs *msg) {
+	return NODE_COPY(id, true, digital_in, msg);
 }
 
 void comm_can_io_board_set_output_digital(int id, int channel, bool on) {
@@ -1446,20 +1956,14 @@ void comm_can_io_board_set_output_pwm(int id, int channel, float duty) {
 
 psw_status *comm_can_get_psw_status_index(int index) {
 	if (index < CAN_STATUS_MSGS_TO_STORE) {
-		return &psw_stat[index];
+		return &nodes[index].psw;
 	} else {
 		return 0;
 	}
 }
 
-psw_status *comm_can_get_psw_status_id(int id) {
-	for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-		if (psw_stat[i].id == id) {
-			return &psw_stat[i];
-		}
-	}
-
-	return 0;
+bool comm_can_get_psw_status_id(int id, psw_status *msg) {
+	return NODE_COPY(id, false, psw, msg);
 }
 
 void comm_can_psw_switch(int id, bool is_on, bool plot) {
@@ -1515,11 +2019,7 @@ static void can2_rx_task(void *arg) {
 		esp_err_t res = twai_receive_v2(can2_handle, &msg, pdMS_TO_TICKS(2));
 
 		if (res == ESP_OK) {
-			can2_rx_buf[can2_rx_write] = msg;
-			can2_rx_write++;
-			if (can2_rx_write >= RXBUF_LEN) {
-				can2_rx_write = 0;
-			}
+			rx_ring_push(&can2_rx_ring, &msg);
 			xSemaphoreGive(proc_sem);
 		}
 
@@ -1585,7 +2085,7 @@ void comm_can2_start(int pin_tx, int pin_rx, int baud_kbits) {
 
 		// The process-task is left running after the first init in case comm_can_stop
 		// is called from it.
-		xTaskCreatePinnedToCore(process_task, "can_proc", 3072, NULL, 8, NULL, tskNO_AFFINITY);
+		xTaskCreatePinnedToCore(process_task, "can_proc", 3072, NULL, 8, &process_task_handle, tskNO_AFFINITY);
 		proc_started = true;
 	}
 
@@ -21,13 +21,29 @@
 #define MAIN_COMM_CAN_H_
 
 #include "datatypes.h"
+#include "can_win.h"
 
-#define CAN_STATUS_MSGS_TO_STORE	10
+// Number of nodes to store status messages from
+#ifndef CAN_STATUS_MSGS_TO_STORE
+#define CAN_STATUS_MSGS_TO_STORE	32
+#endif
 
 // Functions
 void comm_can_start(int pin_tx, int pin_rx);
 void comm_can_stop(void);
 int comm_can_get_rx_recovery_cnt(void);
+bool comm_can_get_rx_stats(int bus, can_rx_stats *stats);
+void comm_can_add_rx_drops(int bus, bool is_ext, uint32_t num);
+void comm_can_reset_rx_stats(void);
+bool comm_can_filter_add_range(uint32_t first, uint32_t last, bool is_ext);
+bool comm_can_filter_add_mask(uint32_t id, uint32_t mask, bool is_ext);
+void comm_can_filter_clear(void);
+void comm_can_filter_get_stats(uint32_t *passed, uint32_t *rejected);
+void comm_can_filter_reset_stats(void);
+void comm_can_set_buffer_window(int window);
+int comm_can_get_buffer_window(void);
+void comm_can_get_win_stats(can_win_stats *stats);
+void comm_can_reset_win_stats(void);
 void comm_can_use_vesc_decoder(bool use_vesc_dec);
 CAN_BAUD comm_can_kbits_to_baud(int kbits);
 void comm_can_update_baudrate(int delay_msec);
@@ -51,29 +67,30 @@ void comm_can_set_handbrake_rel(uint8_t controller_id, float current_rel);
 void comm_can_send_update_baud(int kbits, int delay_msec);
 
 can_status_msg *comm_can_get_status_msg_index(int index);
-can_status_msg *comm_can_get_status_msg_id(int id);
+bool comm_can_get_status_msg_id(int id, can_status_msg *msg);
+int comm_can_get_status_msg_next_id(int id);
 can_status_msg_2 *comm_can_get_status_msg_2_index(int index);
-can_status_msg_2 *comm_can_get_status_msg_2_id(int id);
+bool comm_can_get_status_msg_2_id(int id, can_status_msg_2 *msg);
 can_status_msg_3 *comm_can_get_status_msg_3_index(int index);
-can_status_msg_3 *comm_can_get_status_msg_3_id(int id);
+bool comm_can_get_status_msg_3_id(int id, can_status_msg_3 *msg);
 can_status_msg_4 *comm_can_get_status_msg_4_index(int index);
-can_status_msg_4 *comm_can_get_status_msg_4_id(int id);
+bool comm_can_get_status_msg_4_id(int id, can_status_msg_4 *msg);
 can_status_msg_5 *comm_can_get_status_msg_5_index(int index);
-can_status_msg_5 *comm_can_get_status_msg_5_id(int id);
+bool comm_can_get_status_msg_5_id(int id, can_status_msg_5 *msg);
 can_status_msg_6 *comm_can_get_status_msg_6_index(int index);
-can_status_msg_6 *comm_can_get_status_msg_6_id(int id);
+bool comm_can_get_status_msg_6_id(int id, can_status_msg_6 *msg);
 
 io_board_adc_values *comm_can_get_io_board_adc_1_4_index(int index);
-io_board_adc_values *comm_can_get_io_board_adc_1_4_id(int id);
+bool comm_can_get_io_board_adc_1_4_id(int id, io_board_adc_values *msg);
 io_board_adc_values *comm_can_get_io_board_adc_5_8_index(int index);
-io_board_adc_values *comm_can_get_io_board_adc_5_8_id(int id);
+bool comm_can_get_io_board_adc_5_8_id(int id, io_board_adc_values *msg);
 io_board_digial_inputs *comm_can_get_io_board_digital_in_index(int index);
-io_board_digial_inputs *comm_can_get_io_board_digital_in_id(int id);
+bool comm_can_get_io_board_digital_in_id(int id, io_board_digial_inputs *msg);
 void comm_can_io_board_set_output_digital(int id, int channel, bool on);
 void comm_can_io_board_set_output_pwm(int id, int channel, float duty);
 
 psw_status *comm_can_get_psw_status_index(int index);
-psw_status *comm_can_get_psw_status_id(int id);
+bool comm_can_get_psw_status_id(int id, psw_status *msg);
 void comm_can_psw_switch(int id, bool is_on, bool plot);
 void comm_can_update_pid_pos_offset(int id, float angle_now, bool store);
 
@@ -212,8 +212,8 @@ static void do_comm(const int sock, comm_state *comm) {
 	do {
 		len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
 
-		for (int i = 0;i < len;i++) {
-			packet_process_byte(rx_buffer[i], comm->packet);
+		if (len > 0) {
+			packet_process_buffer((uint8_t*)rx_buffer, len, comm->packet);
 		}
 	} while (len > 0);
 
@@ -901,11 +901,13 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		int32_t ind = 0;
 		int id = buffer_get_int16(data, &ind);
 
-		io_board_adc_values *adc_1_4 = comm_can_get_io_board_adc_1_4_id(id);
-		io_board_adc_values *adc_5_8 = comm_can_get_io_board_adc_5_8_id(id);
-		io_board_digial_inputs *digital_in = comm_can_get_io_board_digital_in_id(id);
+		io_board_adc_values adc_1_4, adc_5_8;
+		io_board_digial_inputs digital_in;
+		bool has_adc_1_4 = comm_can_get_io_board_adc_1_4_id(id, &adc_1_4);
+		bool has_adc_5_8 = comm_can_get_io_board_adc_5_8_id(id, &adc_5_8);
+		bool has_digital_in = comm_can_get_io_board_digital_in_id(id, &digital_in);
 
-		if (!adc_1_4 && !adc_5_8 && !digital_in) {
+		if (!has_adc_1_4 && !has_adc_5_8 && !has_digital_in) {
 			break;
 		}
 
@@ -914,29 +916,29 @@ void commands_process_packet(unsigned char *data, unsigned int len,
 		send_buffer[ind++] = packet_id;
 		buffer_append_int16(send_buffer, id, &ind);
 
-		if (adc_1_4) {
+		if (has_adc_1_4) {
 			send_buffer[ind++] = 1;
-			buffer_append_float32_auto(send_buffer, UTILS_AGE_S(adc_1_4->rx_time), &ind);
-			buffer_append_float16(send_buffer, adc_1_4->adc_voltages[0], 1e2, &ind);
-			buffer_append_float16(send_buffer, adc_1_4->adc_voltages[1], 1e2, &ind);
-			buffer_append_float16(send_buffer, adc_1_4->adc_voltages[2], 1e2, &ind);
-			buffer_append_float16(send_buffer, adc_1_4->adc_voltages[3], 1e2, &ind);
+			buffer_append_float32_auto(send_buffer, UTILS_AGE_S(adc_1_4.rx_time), &ind);
+			buffer_append_float16(send_buffer, adc_1_4.adc_voltages[0], 1e2, &ind);
+			buffer_append_float16(send_buffer, adc_1_4.adc_voltages[1], 1e2, &ind);
+			buffer_append_float16(send_buffer, adc_1_4.adc_voltages[2], 1e2, &ind);
+			buffer_append_float16(send_buffer, adc_1_4.adc_voltages[3], 1e2, &ind);
 		}
 
-		if (adc_5_8) {
+		if (has_adc_5_8) {
 			send_buffer[ind++] = 2;
-			buffer_append_float32_auto(send_buffer, UTILS_AGE_S(adc_1_4->rx_time), &ind);
-			buffer_append_float16(send_buffer, adc_5_8->adc_voltages[0], 1e2, &ind);
-			buffer_append_float16(send_buffer, adc_5_8->adc_voltages[1], 1e2, &ind);
-			buffer_append_float16(send_buffer, adc_5_8->adc_voltages[2], 1e2, &ind);
-			buffer_append_float16(send_buffer, adc_5_8->adc_voltages[3], 1e2, &ind);
+			buffer_append_float32_auto(send_buffer, UTILS_AGE_S(adc_5_8.rx_time), &ind);
+			buffer_append_float16(send_buffer, adc_5_8.adc_voltages[0], 1e2, &ind);
+			buffer_append_float16(send_buffer, adc_5_8.adc_voltages[1], 1e2, &ind);
+			buffer_append_float16(send_buffer, adc_5_8.adc_voltages[2], 1e2, &ind);
+			buffer_append_float16(send_buffer, adc_5_8.adc_voltages[3], 1e2, &ind);
 		}
 
-		if (digital_in) {
+		if (has_digital_in) {
 			send_buffer[ind++] = 3;
-			buffer_append_float32_auto(send_buffer, UTILS_AGE_S(adc_1_4->rx_time), &ind);
-			buffer_append_uint32(send_buffer, (digital_in->inputs >> 32) & 0xFFFFFFFF, &ind);
-			buffer_append_uint32(send_buffer, (digital_in->inputs >> 0) & 0xFFFFFFFF, &ind);
+			buffer_append_float32_auto(send_buffer, UTILS_AGE_S(digital_in.rx_time), &ind);
+			buffer_append_uint32(send_buffer, (digital_in.inputs >> 32) & 0xFFFFFFFF, &ind);
+			buffer_append_uint32(send_buffer, (digital_in.inputs >> 0) & 0xFFFFFFFF, &ind);
 		}
 
 		reply_func(send_buffer, ind);
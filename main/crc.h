@@ -22,6 +22,15 @@
 
 #include <stdint.h>
 
+// Settings
+
+// Number of lookup tables per CRC. More tables process more bytes per
+// iteration at the cost of flash: crc16 uses 512 bytes and crc32 uses
+// 1 kB per table. Valid values are 1, 4 and 8.
+#ifndef CRC_TABLE_SLICES
+#define CRC_TABLE_SLICES		4
+#endif
+
 /*
  * Functions
  */
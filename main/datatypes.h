@@ -369,6 +369,9 @@ typedef enum {
 	CAN_PACKET_BMS_STATUS_3					= 66,
 	CAN_PACKET_BMS_STATUS_4					= 67,
 	CAN_PACKET_BMS_STATUS_5					= 68,
+	CAN_PACKET_WIN_START					= 69,
+	CAN_PACKET_WIN_DATA						= 70,
+	CAN_PACKET_WIN_ACK						= 71,
 	CAN_PACKET_MAKE_ENUM_32_BITS = 0xFFFFFFFF,
 } CAN_PACKET_ID;
 
@@ -442,4 +445,17 @@ typedef struct {
 	bool is_dsc_on;
 } psw_status;
 
+typedef enum {
+	CAN_ID_CLASS_STD = 0,
+	CAN_ID_CLASS_EXT,
+	CAN_ID_CLASS_NUM
+} CAN_ID_CLASS;
+
+typedef struct {
+	uint32_t rx_cnt[CAN_ID_CLASS_NUM];
+	uint32_t drop_cnt[CAN_ID_CLASS_NUM];
+	uint32_t high_water;
+	uint32_t size;
+} can_rx_stats;
+
 #endif /* MAIN_DATATYPES_H_ */
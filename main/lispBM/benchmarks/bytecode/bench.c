@@ -0,0 +1,227 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of the bytecode compiler.
+ *
+ * Runs fibonacci, tak and q2 from benchmarks/stm32f4 and an insertion
+ * sort of 500 numbers first interpreted and then with the functions
+ * compiled by (compile f), on a heap of the same size as on the
+ * STM32F4, and reports the run times. sort500 in benchmarks/stm32f4
+ * uses the built in sort, which is not a closure, so the sort is
+ * written out in lisp here.
+ *
+ * Usage: bench <repetitions>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "extensions/runtime_extensions.h"
+
+#define HEAP_SIZE        4096
+#define GC_STACK_SIZE    256
+#define PRINT_STACK_SIZE 256
+#define EXTENSIONS       100
+#define IMAGE_WORDS      (32 * 1024)
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory[LBM_MEMORY_SIZE_16K];
+static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_16K];
+static lbm_extension_t extensions[EXTENSIONS];
+static uint32_t image[IMAGE_WORDS];
+
+static lbm_char_channel_t channel;
+static lbm_string_channel_state_t channel_state;
+static volatile bool done = false;
+static char result[24];
+
+typedef struct {
+  const char *name;
+  const char *defs;    // Definitions of the functions
+  const char *compile; // Replaces the definitions with compiled ones
+  const char *run;
+} bench_t;
+
+static const bench_t benches[] = {
+  {"fibonacci",
+   "(define fib (lambda (n) (if (> 2 n) n (+ (fib (- n 1)) (fib (- n 2))))))",
+   "(define fib (compile fib))",
+   "(fib 23)"},
+  {"tak",
+   "(define tak (lambda (x y z)"
+   "  (if (not (< y x)) z"
+   "    (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y)))))",
+   "(define tak (compile tak))",
+   "(tak 18 12 6)"},
+  {"q2",
+   "(define q2 (lambda (x y)"
+   "  (if (or (< x 1) (< y 1)) 1"
+   "    (+ (q2 (- x (q2 (- x 1) y)) y)"
+   "       (q2 x (- y (q2 x (- y 1))))))))",
+   "(define q2 (compile q2))",
+   "(q2 6 7)"},
+  {"sort500",
+   "(define random-list (map (lambda (i) (mod (* i 7919) 101)) (range 500)))"
+   "(define rev-onto (lambda (a l)"
+   "  (if (eq a nil) l (rev-onto (cdr a) (cons (car a) l)))))"
+   "(define insert (lambda (x l acc)"
+   "  (if (or (eq l nil) (<= x (car l))) (rev-onto acc (cons x l))"
+   "    (insert x (cdr l) (cons (car l) acc)))))"
+   "(define isort (lambda (l acc)"
+   "  (if (eq l nil) acc (isort (cdr l) (insert (car l) acc nil)))))",
+   "(define rev-onto (compile rev-onto))"
+   "(define insert (compile insert))"
+   "(define isort (compile isort))",
+   "(car (isort random-list nil))"},
+};
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static uint32_t timestamp_us(void) {
+  return (uint32_t)(now() * 1e6);
+}
+
+static void sleep_us(uint32_t us) {
+  struct timespec s = {0, (long)us * 1000};
+  nanosleep(&s, NULL);
+}
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  image[ix] = w;
+  return true;
+}
+
+static void ctx_done(eval_context_t *ctx) {
+  lbm_print_value(result, sizeof(result), ctx->r);
+  done = true;
+}
+
+static void *eval_thread(void *arg) {
+  (void)arg;
+  lbm_run_eval();
+  return NULL;
+}
+
+static void wait_paused(void) {
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+    sleep_us(100);
+  }
+}
+
+static bool run(const char *code) {
+  lbm_pause_eval();
+  wait_paused();
+  lbm_create_string_char_channel(&channel_state, &channel, (char*)code);
+  done = false;
+  if (lbm_load_and_eval_program(&channel, NULL) < 0) {
+    // The loader does not collect garbage itself.
+    lbm_perform_gc();
+    if (lbm_load_and_eval_program(&channel, NULL) < 0) return false;
+  }
+  lbm_continue_eval();
+  while (!done) {
+    sleep_us(10);
+  }
+  return true;
+}
+
+// Average run time in ms.
+static double time_run(const char *code, int reps) {
+  double t = 0.0;
+  for (int r = 0; r < reps; r ++) {
+    double t_start = now();
+    if (!run(code)) return -1.0;
+    t += now() - t_start;
+  }
+  return t * 1000.0 / reps;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("Usage: %s <repetitions>\n", argv[0]);
+    return 1;
+  }
+  int reps = atoi(argv[1]);
+
+  memset(image, 0xff, sizeof(image));
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory, LBM_MEMORY_SIZE_16K,
+                bitmap, LBM_MEMORY_BITMAP_SIZE_16K,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSIONS)) {
+    printf("Init failed\n");
+    return 1;
+  }
+  lbm_image_init(image, IMAGE_WORDS, image_write);
+  lbm_image_create("bench");
+  if (!lbm_image_boot()) {
+    printf("Image boot failed\n");
+    return 1;
+  }
+  lbm_add_eval_symbols();
+  lbm_runtime_extensions_init();
+
+  lbm_set_usleep_callback(sleep_us);
+  lbm_set_timestamp_us_callback(timestamp_us);
+  lbm_set_ctx_done_callback(ctx_done);
+  lbm_set_printf_callback(printf);
+
+  pthread_t thd;
+  if (pthread_create(&thd, NULL, eval_thread, NULL)) {
+    printf("Could not start the evaluator\n");
+    return 1;
+  }
+
+  printf("%-12s %14s %14s %8s  %s\n",
+         "program", "interp ms", "compiled ms", "speedup", "result");
+
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i ++) {
+    const bench_t *b = &benches[i];
+    if (!run(b->defs)) {
+      printf("Could not load %s\n", b->name);
+      return 1;
+    }
+    double t_interp = time_run(b->run, reps);
+    char interp_result[24];
+    memcpy(interp_result, result, sizeof(result));
+
+    if (!run(b->compile)) {
+      printf("Could not compile %s\n", b->name);
+      return 1;
+    }
+    double t_comp = time_run(b->run, reps);
+    if (t_interp < 0.0 || t_comp < 0.0) {
+      printf("Could not run %s\n", b->name);
+      return 1;
+    }
+    printf("%-12s %14.2f %14.2f %7.1fx  %s%s\n",
+           b->name, t_interp, t_comp, t_interp / t_comp, result,
+           strcmp(result, interp_result) ? " (differs)" : "");
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+#!/bin/bash
+# Builds and runs the bytecode benchmark (bench.c), which compares the
+# interpreted and compiled run times of fibonacci, tak, q2 and sort500.
+# Then runs the benchmarks/stm32f4 programs with the GC benchmark
+# (../gc/bench.c) built without and with LBM_LEXICAL_ADDRESSING, which
+# compiles the functions as they are defined.
+#
+# Usage:
+#   ./run.sh [repetitions]
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+LISPBM="$SCRIPT_DIR/../.."
+REPS=${1:-5}
+
+lispbm_var() {
+  make -s -C "$SCRIPT_DIR" -f - <<MK
+LISPBM := $LISPBM
+include \$(LISPBM)/lispbm.mk
+all:
+	@echo \$($1)
+MK
+}
+
+LISPBM_SRC=$(lispbm_var LISPBM_SRC)
+LISPBM_INC=$(lispbm_var LISPBM_INC)
+
+INC="$LISPBM_INC -I$LISPBM/platform/linux/include"
+FLAGS="-O2 -DLBM64 -DFULL_RTS_LIB"
+
+PLATFORM_SRC="$LISPBM/platform/linux/src/platform_mutex.c $LISPBM/platform/linux/src/platform_timestamp.c $LISPBM/platform/linux/src/platform_thread.c"
+PROGRAMS="$LISPBM/benchmarks/stm32f4/*.lisp"
+
+gcc $FLAGS "$SCRIPT_DIR/bench.c" $LISPBM_SRC $PLATFORM_SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench"
+gcc $FLAGS "$SCRIPT_DIR/../gc/bench.c" $LISPBM_SRC $PLATFORM_SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench_programs"
+gcc $FLAGS -DLBM_LEXICAL_ADDRESSING "$SCRIPT_DIR/../gc/bench.c" $LISPBM_SRC $PLATFORM_SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench_programs_lex"
+
+"$SCRIPT_DIR/bench" $REPS
+echo
+echo "Interpreted"
+"$SCRIPT_DIR/bench_programs" 0 $REPS $PROGRAMS
+echo
+echo "LBM_LEXICAL_ADDRESSING"
+"$SCRIPT_DIR/bench_programs_lex" 0 $REPS $PROGRAMS
@@ -0,0 +1,278 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of flattening and unflattening.
+ *
+ * Builds a small message, a long list, nested lisp arrays and a list
+ * that shares one sublist between all its elements, then times per
+ * value:
+ *   flatten   flatten_value, one pass into a growing buffer
+ *   sized     flatten_value_size, then flatten_value_c into a buffer
+ *             of exact size
+ *   unflatten lbm_unflatten_value of the flat value
+ * Times are the best of five batches in microseconds per operation,
+ * throughput is in flat MB/s.
+ *
+ * Usage: bench <repetitions>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "lbm_flat_value.h"
+#include "extensions/runtime_extensions.h"
+#include "extensions/lbm_dyn_lib.h"
+
+#define HEAP_SIZE        32768
+#define GC_STACK_SIZE    256
+#define PRINT_STACK_SIZE 256
+#define EXTENSIONS       100
+#define IMAGE_WORDS      (32 * 1024)
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory[LBM_MEMORY_SIZE_1M];
+static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_1M];
+static lbm_extension_t extensions[EXTENSIONS];
+static uint32_t image[IMAGE_WORDS];
+
+static lbm_char_channel_t channel;
+static lbm_string_channel_state_t channel_state;
+static volatile bool done = false;
+static lbm_value result;
+
+typedef struct {
+  const char *name;
+  const char *defs; // Defines the global bench-value.
+} bench_t;
+
+static const bench_t benches[] = {
+  {"message",
+   "(define bench-value (list 'pos 1.5 -2.25 3 \"name\" 100u32))"},
+  {"list",
+   "(define bench-value (range 1500))"},
+  {"arrays",
+   "(defun nest (d)"
+   "  (let ((a (mkarray 4)))"
+   "    (progn"
+   "      (looprange i 0 4 (setix a i (if (= d 0) (+ i 0.5) (nest (- d 1)))))"
+   "      a)))"
+   "(define bench-value (nest 4))"},
+  {"shared",
+   "(define bench-value"
+   "  (let ((x (list 1 2u32 3.0 'sym \"string\" (list 4 5 6))))"
+   "    (map (lambda (i) x) (range 150))))"},
+};
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static uint32_t timestamp_us(void) {
+  return (uint32_t)(now() * 1e6);
+}
+
+static void sleep_us(uint32_t us) {
+  struct timespec s = {0, (long)us * 1000};
+  nanosleep(&s, NULL);
+}
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  image[ix] = w;
+  return true;
+}
+
+static void ctx_done(eval_context_t *ctx) {
+  result = ctx->r;
+  done = true;
+}
+
+static void *eval_thread(void *arg) {
+  (void)arg;
+  lbm_run_eval();
+  return NULL;
+}
+
+static void wait_paused(void) {
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+    sleep_us(100);
+  }
+}
+
+static bool run(const char *code) {
+  lbm_pause_eval();
+  wait_paused();
+  lbm_create_string_char_channel(&channel_state, &channel, (char*)code);
+  done = false;
+  if (lbm_load_and_eval_program(&channel, NULL) < 0) return false;
+  lbm_continue_eval();
+  while (!done) {
+    sleep_us(10);
+  }
+  return true;
+}
+
+static bool flatten_op(lbm_value v) {
+  lbm_value arr = flatten_value(v);
+  if (!lbm_is_array_r(arr)) return false;
+  lbm_heap_explicit_free_array(arr);
+  return true;
+}
+
+static bool sized_op(lbm_value v) {
+  lbm_flat_value_t fv;
+  int n = flatten_value_size(v, false);
+  if (n <= 0 || !lbm_start_flatten(&fv, (lbm_uint)n)) return false;
+  bool ok = flatten_value_c(&fv, v) == FLATTEN_VALUE_OK;
+  lbm_free(fv.buf);
+  return ok;
+}
+
+// Best time per operation in seconds over BATCHES batches of reps.
+#define BATCHES 5
+
+static double time_op(bool (*op)(lbm_value), lbm_value v, int reps) {
+  double best = -1.0;
+  for (int b = 0; b < BATCHES; b ++) {
+    double t_start = now();
+    for (int r = 0; r < reps; r ++) {
+      if (!op(v)) return -1.0;
+    }
+    double t = (now() - t_start) / reps;
+    if (best < 0.0 || t < best) best = t;
+  }
+  return best;
+}
+
+// Unflattening fills the heap and lbm_memory, so it is timed one
+// operation at a time with a collection in between.
+static double time_unflatten(uint8_t *flat, int size, int reps) {
+  double best = -1.0;
+  for (int b = 0; b < BATCHES; b ++) {
+    double t = 0.0;
+    for (int r = 0; r < reps; r ++) {
+      lbm_flat_value_t fv;
+      fv.buf = flat;
+      fv.buf_size = (lbm_uint)size;
+      fv.buf_pos = 0;
+      lbm_value res;
+      lbm_perform_gc();
+      double t_start = now();
+      bool ok = lbm_unflatten_value(&fv, &res);
+      t += now() - t_start;
+      if (!ok) return -1.0;
+    }
+    t /= reps;
+    if (best < 0.0 || t < best) best = t;
+  }
+  return best;
+}
+
+// Runs with the evaluator paused. Values reachable from the global
+// environment survive the collections done here.
+static void bench(const bench_t *b, int reps) {
+  if (!run(b->defs) || !run("bench-value")) {
+    printf("Could not create %s\n", b->name);
+    return;
+  }
+  lbm_pause_eval();
+  wait_paused();
+  lbm_value v = result;
+
+  int size = flatten_value_size(v, false);
+  lbm_value arr = flatten_value(v);
+  lbm_array_header_t *header = lbm_dec_array_r(arr);
+  if (size <= 0 || !header) {
+    printf("Could not flatten %s (%d)\n", b->name, size);
+    return;
+  }
+  // Unflatten from a C copy, the flat array would not survive a GC.
+  uint8_t *flat = malloc((size_t)size);
+  if (!flat) return;
+  memcpy(flat, header->data, (size_t)size);
+  lbm_heap_explicit_free_array(arr);
+
+  double t_flatten = time_op(flatten_op, v, reps);
+  double t_sized = time_op(sized_op, v, reps);
+  double t_unflatten = time_unflatten(flat, size, reps);
+  free(flat);
+  if (t_flatten < 0.0 || t_sized < 0.0 || t_unflatten < 0.0) {
+    printf("%s failed\n", b->name);
+    return;
+  }
+
+  double mb = (double)size / 1e6;
+  printf("%-8s %8d %10.2f %10.2f %10.2f %10.1f %10.1f %10.1f\n",
+         b->name, size,
+         t_flatten * 1e6, t_sized * 1e6, t_unflatten * 1e6,
+         mb / t_flatten, mb / t_sized, mb / t_unflatten);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("Usage: %s <repetitions>\n", argv[0]);
+    return 1;
+  }
+  int reps = atoi(argv[1]);
+
+  memset(image, 0xff, sizeof(image));
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory, LBM_MEMORY_SIZE_1M,
+                bitmap, LBM_MEMORY_BITMAP_SIZE_1M,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSIONS)) {
+    printf("Init failed\n");
+    return 1;
+  }
+  lbm_image_init(image, IMAGE_WORDS, image_write);
+  lbm_image_create("bench");
+  if (!lbm_image_boot()) {
+    printf("Image boot failed\n");
+    return 1;
+  }
+  lbm_add_eval_symbols();
+  lbm_runtime_extensions_init();
+  lbm_dyn_lib_init();
+
+  lbm_set_usleep_callback(sleep_us);
+  lbm_set_timestamp_us_callback(timestamp_us);
+  lbm_set_ctx_done_callback(ctx_done);
+  lbm_set_printf_callback(printf);
+  lbm_set_dynamic_load_callback(lbm_dyn_lib_find);
+
+  pthread_t thd;
+  if (pthread_create(&thd, NULL, eval_thread, NULL)) {
+    printf("Could not start the evaluator\n");
+    return 1;
+  }
+
+  printf("%-8s %8s %10s %10s %10s %10s %10s %10s\n",
+         "value", "bytes", "flat us", "sized us", "unflat us",
+         "flat MB/s", "sized MB/s", "unflat MB/s");
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i ++) {
+    bench(&benches[i], reps);
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+#!/bin/bash
+# Builds and runs the flatten/unflatten benchmark (bench.c).
+#
+# Usage:
+#   ./run.sh [repetitions]
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+LISPBM="$SCRIPT_DIR/../.."
+REPS=${1:-1000}
+
+lispbm_var() {
+  make -s -C "$SCRIPT_DIR" -f - <<MK
+LISPBM := $LISPBM
+include \$(LISPBM)/lispbm.mk
+all:
+	@echo \$($1)
+MK
+}
+
+LISPBM_SRC=$(lispbm_var LISPBM_SRC)
+LISPBM_INC=$(lispbm_var LISPBM_INC)
+
+INC="$LISPBM_INC -I$LISPBM/platform/linux/include"
+FLAGS="-O2 -DLBM64 -DFULL_RTS_LIB -DLBM_USE_DYN_FUNS -DLBM_USE_DYN_MACROS -DLBM_USE_DYN_LOOPS"
+
+PLATFORM_SRC="$LISPBM/platform/linux/src/platform_mutex.c $LISPBM/platform/linux/src/platform_timestamp.c $LISPBM/platform/linux/src/platform_thread.c"
+
+gcc $FLAGS "$SCRIPT_DIR/bench.c" $LISPBM_SRC $PLATFORM_SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench"
+
+"$SCRIPT_DIR/bench" $REPS
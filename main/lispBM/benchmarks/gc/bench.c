@@ -0,0 +1,219 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of the garbage collector.
+ *
+ * Runs each of the given programs (the benchmarks/stm32f4 set) a number
+ * of times on a heap of the same size as on the STM32F4 and reports the
+ * run time, the number of collections and the time spent in GC. A list
+ * of live cells can be kept on the heap while the programs run, the way
+ * a firmware script keeps its state. Build with -DLBM_GC_GENERATIONAL
+ * to get the generational collector.
+ *
+ * Usage: bench <live cells> <repetitions> <program.lisp> ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "extensions/runtime_extensions.h"
+
+#define HEAP_SIZE        4096
+#define GC_STACK_SIZE    256
+#define PRINT_STACK_SIZE 256
+#define EXTENSIONS       100
+#define IMAGE_WORDS      (32 * 1024)
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory[LBM_MEMORY_SIZE_16K];
+static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_16K];
+// One extra word so that the array is not empty without GC bitmaps
+static lbm_uint gc_bitmaps[LBM_GC_BITMAP_SIZE(HEAP_SIZE) + 1];
+static lbm_extension_t extensions[EXTENSIONS];
+static uint32_t image[IMAGE_WORDS];
+
+static lbm_char_channel_t channel;
+static lbm_string_channel_state_t channel_state;
+static volatile bool done = false;
+static char result[24];
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static uint32_t timestamp_us(void) {
+  return (uint32_t)(now() * 1e6);
+}
+
+static void sleep_us(uint32_t us) {
+  struct timespec s = {0, (long)us * 1000};
+  nanosleep(&s, NULL);
+}
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  image[ix] = w;
+  return true;
+}
+
+static void ctx_done(eval_context_t *ctx) {
+  lbm_print_value(result, sizeof(result), ctx->r);
+  done = true;
+}
+
+static void *eval_thread(void *arg) {
+  (void)arg;
+  lbm_run_eval();
+  return NULL;
+}
+
+static void wait_paused(void) {
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+    sleep_us(100);
+  }
+}
+
+static bool run(char *code) {
+  lbm_pause_eval();
+  wait_paused();
+  lbm_create_string_char_channel(&channel_state, &channel, code);
+  done = false;
+  if (lbm_load_and_eval_program(&channel, NULL) < 0) {
+    // The loader does not collect garbage itself.
+    lbm_perform_gc();
+    if (lbm_load_and_eval_program(&channel, NULL) < 0) return false;
+  }
+  lbm_continue_eval();
+  while (!done) {
+    sleep_us(10);
+  }
+  return true;
+}
+
+static char *read_file(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) return NULL;
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *s = malloc((size_t)len + 1);
+  if (s) {
+    size_t n = fread(s, 1, (size_t)len, f);
+    s[n] = 0;
+  }
+  fclose(f);
+  return s;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    printf("Usage: %s <live cells> <repetitions> <program.lisp> ...\n", argv[0]);
+    return 1;
+  }
+  int live = atoi(argv[1]);
+  int reps = atoi(argv[2]);
+
+  memset(image, 0xff, sizeof(image));
+  lbm_heap_set_gc_bitmap_storage(gc_bitmaps, LBM_GC_BITMAP_SIZE(HEAP_SIZE));
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory, LBM_MEMORY_SIZE_16K,
+                bitmap, LBM_MEMORY_BITMAP_SIZE_16K,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSIONS)) {
+    printf("Init failed\n");
+    return 1;
+  }
+  lbm_image_init(image, IMAGE_WORDS, image_write);
+  lbm_image_create("bench");
+  if (!lbm_image_boot()) {
+    printf("Image boot failed\n");
+    return 1;
+  }
+  lbm_add_eval_symbols();
+  lbm_runtime_extensions_init();
+
+  lbm_set_usleep_callback(sleep_us);
+  lbm_set_timestamp_us_callback(timestamp_us);
+  lbm_set_ctx_done_callback(ctx_done);
+  lbm_set_printf_callback(printf);
+
+  pthread_t thd;
+  if (pthread_create(&thd, NULL, eval_thread, NULL)) {
+    printf("Could not start the evaluator\n");
+    return 1;
+  }
+
+  char setup[64];
+  snprintf(setup, sizeof(setup), "(define bench-live (range %d))", live);
+  if (!run(setup)) {
+    printf("Could not allocate the live data\n");
+    return 1;
+  }
+
+  printf("%-22s %10s %8s %8s %10s %10s  %s\n",
+         "program", "time ms", "gcs", "full", "gc ms", "pause us", "result");
+
+  for (int i = 3; i < argc; i ++) {
+    char *code = read_file(argv[i]);
+    if (!code) {
+      printf("Could not read %s\n", argv[i]);
+      return 1;
+    }
+    const char *name = strrchr(argv[i], '/');
+    name = name ? name + 1 : argv[i];
+
+    lbm_pause_eval();
+    wait_paused();
+    lbm_heap_state_t s0;
+    lbm_get_heap_state(&s0);
+    lbm_heap_state.gc_max_pause = 0;
+
+    double t = 0.0;
+    for (int r = 0; r < reps; r ++) {
+      double t_start = now();
+      if (!run(code)) {
+        printf("Could not load %s\n", argv[i]);
+        return 1;
+      }
+      t += now() - t_start;
+    }
+
+    lbm_pause_eval();
+    wait_paused();
+    lbm_heap_state_t s1;
+    lbm_get_heap_state(&s1);
+
+    printf("%-22s %10.2f %8lu %8lu %10.2f %10lu  %s\n",
+           name,
+           t * 1000.0 / reps,
+           (unsigned long)(s1.gc_num - s0.gc_num) / (unsigned long)reps,
+           (unsigned long)(s1.gc_full_num - s0.gc_full_num) / (unsigned long)reps,
+           (double)(uint32_t)(s1.gc_total_time - s0.gc_total_time) / 1000.0 / reps,
+           (unsigned long)s1.gc_max_pause,
+           result);
+    free(code);
+  }
+  return 0;
+}
@@ -0,0 +1,43 @@
+#!/bin/bash
+# Builds and runs the GC benchmark (bench.c) on the benchmarks/stm32f4
+# programs with the default and the generational collector, first on an
+# otherwise empty heap and then with a list of live cells on the heap.
+#
+# Usage:
+#   ./run.sh [repetitions] [live cells]
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+LISPBM="$SCRIPT_DIR/../.."
+REPS=${1:-5}
+LIVE=${2:-1000}
+
+lispbm_var() {
+  make -s -C "$SCRIPT_DIR" -f - <<MK
+LISPBM := $LISPBM
+include \$(LISPBM)/lispbm.mk
+all:
+	@echo \$($1)
+MK
+}
+
+LISPBM_SRC=$(lispbm_var LISPBM_SRC)
+LISPBM_INC=$(lispbm_var LISPBM_INC)
+
+SRC="$SCRIPT_DIR/bench.c $LISPBM_SRC $LISPBM/platform/linux/src/platform_mutex.c $LISPBM/platform/linux/src/platform_timestamp.c $LISPBM/platform/linux/src/platform_thread.c"
+INC="$LISPBM_INC -I$LISPBM/platform/linux/include"
+FLAGS="-O2 -DLBM64 -DFULL_RTS_LIB"
+PROGRAMS="$LISPBM/benchmarks/stm32f4/*.lisp"
+
+gcc $FLAGS $SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench_default"
+gcc $FLAGS -DLBM_GC_GENERATIONAL $SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench_generational"
+
+for live in 0 $LIVE; do
+  echo "Default GC, $live live cells"
+  "$SCRIPT_DIR/bench_default" $live $REPS $PROGRAMS
+  echo
+  echo "Generational GC, $live live cells"
+  "$SCRIPT_DIR/bench_generational" $live $REPS $PROGRAMS
+  echo
+done
@@ -0,0 +1,147 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of lbm_memory with and without the free-extent index.
+ *
+ * Each mix keeps a set of live allocations and replaces a random one
+ * per step, so memory stays at roughly the same fill level while it
+ * fragments. Reported per mix:
+ *   ops/s     allocations and frees per second
+ *   longest/s lbm_memory_longest_free calls per second
+ *   failed    allocations that did not fit
+ *   frag      1 - longest free / total free, averaged over the run
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lbm_memory.h"
+
+void lbm_request_gc(void) {
+}
+
+#define MEMORY_WORDS LBM_MEMORY_SIZE_BLOCKS_TO_WORDS(1024)
+#define BITMAP_WORDS LBM_MEMORY_BITMAP_SIZE(1024)
+#define INDEX_WORDS  LBM_MEMORY_INDEX_SIZE(MEMORY_WORDS)
+#define MAX_LIVE     4096
+
+static lbm_uint memory[MEMORY_WORDS];
+static lbm_uint bitmap[BITMAP_WORDS];
+static lbm_uint index_data[INDEX_WORDS];
+static lbm_uint *live[MAX_LIVE];
+
+typedef struct {
+  const char *name;
+  int live;             // Number of live allocations
+  lbm_uint small_max;   // Most allocations are 1 to small_max words
+  lbm_uint large_min;   // One in large_every is large_min to large_max words
+  lbm_uint large_max;
+  int large_every;
+} mix_t;
+
+static const mix_t mixes[] = {
+  {"small",  2048,   8,    0,    0, 0},
+  {"arrays", 1024,   8,   64,  512, 16},
+  {"large",   256,  16,   64, 1024, 2},
+};
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static lbm_uint mix_size(const mix_t *m) {
+  if (m->large_every && rand() % m->large_every == 0) {
+    return m->large_min + (lbm_uint)rand() % (m->large_max - m->large_min + 1);
+  }
+  return 1 + (lbm_uint)rand() % m->small_max;
+}
+
+static void run(const mix_t *m, bool use_index, int steps) {
+  lbm_memory_init(memory, MEMORY_WORDS, bitmap, BITMAP_WORDS);
+  lbm_memory_set_reserve(0);
+  if (use_index) {
+    lbm_memory_init_index(index_data, INDEX_WORDS);
+  }
+  memset(live, 0, sizeof(live));
+  srand(1234);
+
+  for (int i = 0; i < m->live; i ++) {
+    live[i] = lbm_memory_allocate(mix_size(m));
+  }
+
+  unsigned long ops = 0;
+  unsigned long failed = 0;
+  double frag = 0.0;
+  int frag_samples = 0;
+
+  double t_start = now();
+  for (int i = 0; i < steps; i ++) {
+    int k = rand() % m->live;
+    if (live[k]) {
+      lbm_memory_free(live[k]);
+      ops ++;
+    }
+    live[k] = lbm_memory_allocate(mix_size(m));
+    ops ++;
+    if (!live[k]) failed ++;
+
+    if ((i & 1023) == 0) {
+      lbm_uint free_words = lbm_memory_num_free();
+      if (free_words > 0) {
+        frag += 1.0 - (double)lbm_memory_longest_free() / (double)free_words;
+        frag_samples ++;
+      }
+    }
+  }
+  double t_ops = now() - t_start;
+
+  int longest_calls = 2000;
+  t_start = now();
+  volatile lbm_uint sink = 0;
+  for (int i = 0; i < longest_calls; i ++) {
+    sink += lbm_memory_longest_free();
+  }
+  double t_longest = now() - t_start;
+  (void)sink;
+
+  printf("%-8s %-6s %12.0f %12.0f %8lu %8.3f\n",
+         m->name, use_index ? "index" : "scan",
+         (double)ops / t_ops,
+         (double)longest_calls / t_longest,
+         failed,
+         frag_samples ? frag / frag_samples : 0.0);
+}
+
+int main(int argc, char **argv) {
+  int steps = 200000;
+  if (argc > 1) {
+    steps = atoi(argv[1]);
+  }
+
+  printf("Memory: %u words, index: %u words, steps: %d\n",
+         (unsigned int)MEMORY_WORDS, (unsigned int)INDEX_WORDS, steps);
+  printf("%-8s %-6s %12s %12s %8s %8s\n", "mix", "mode", "ops/s", "longest/s", "failed", "frag");
+  for (size_t i = 0; i < sizeof(mixes) / sizeof(mixes[0]); i ++) {
+    run(&mixes[i], false, steps);
+    run(&mixes[i], true, steps);
+  }
+  return 0;
+}
@@ -0,0 +1,23 @@
+#!/bin/bash
+# Builds and runs the lbm_memory allocation benchmark (bench.c) for 32
+# and 64 bit, comparing the linear bitmap scan with the free-extent index.
+#
+# Usage:
+#   ./run.sh [steps]
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+LISPBM="$SCRIPT_DIR/../.."
+
+SRC="$SCRIPT_DIR/bench.c $LISPBM/src/lbm_memory.c $LISPBM/platform/linux/src/platform_mutex.c"
+INC="-I$LISPBM/include -I$LISPBM/platform/linux/include"
+
+gcc -O2 -m32 $SRC $INC -lpthread -o "$SCRIPT_DIR/bench32"
+gcc -O2 -DLBM64 $SRC $INC -lpthread -o "$SCRIPT_DIR/bench64"
+
+echo "32 bit"
+"$SCRIPT_DIR/bench32" "$@"
+echo
+echo "64 bit"
+"$SCRIPT_DIR/bench64" "$@"
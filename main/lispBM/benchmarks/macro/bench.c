@@ -0,0 +1,219 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of the macro expansion cache.
+ *
+ * Runs programs that apply macros inside loops and recursive functions,
+ * on a heap of the same size as on the STM32F4, and reports the run
+ * time, the number of GCs and the expansion cache hits and misses.
+ * Build it with and without -DLBM_MACRO_CACHE_SIZE=0 to compare, as
+ * run.sh does.
+ *
+ * Usage: bench <repetitions>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "extensions/runtime_extensions.h"
+#include "extensions/lbm_dyn_lib.h"
+
+#define HEAP_SIZE        4096
+#define GC_STACK_SIZE    256
+#define PRINT_STACK_SIZE 256
+#define EXTENSIONS       100
+#define IMAGE_WORDS      (32 * 1024)
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory[LBM_MEMORY_SIZE_16K];
+static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_16K];
+static lbm_extension_t extensions[EXTENSIONS];
+static uint32_t image[IMAGE_WORDS];
+
+static lbm_char_channel_t channel;
+static lbm_string_channel_state_t channel_state;
+static volatile bool done = false;
+static char result[24];
+
+typedef struct {
+  const char *name;
+  const char *defs;
+  const char *run;
+} bench_t;
+
+static const bench_t benches[] = {
+  {"sq",
+   "(define sq (macro (x) `(* ,x ,x) memo))"
+   "(defun sum-sq (n acc) (if (= n 0) acc (sum-sq (- n 1) (+ acc (sq n)))))",
+   "(sum-sq 20000 0)"},
+  {"when",
+   "(define when (macro (c b) `(if ,c ,b nil) memo))"
+   "(define unless (macro (c b) `(if ,c nil ,b) memo))"
+   "(defun count-odd (n acc)"
+   "  (if (= n 0) acc"
+   "    (progn"
+   "      (when (= (mod n 2) 1) (setq acc (+ acc 1)))"
+   "      (unless (= n 0) (count-odd (- n 1) acc)))))",
+   "(count-odd 20000 0)"},
+  {"loopfor",
+   "(defun sum-to (n)"
+   "  (let ((s 0))"
+   "    (progn (loopfor i 0 (< i n) (+ i 1) (setq s (+ s i))) s)))",
+   "(let ((r 0)) (progn (looprange j 0 2000 (setq r (sum-to 10))) r))"},
+  {"defun",
+   "(define acc 0)",
+   "(progn (looprange j 0 5000 (progn (defun g (x) (+ x j)) (setq acc (g acc)))) acc)"},
+};
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static uint32_t timestamp_us(void) {
+  return (uint32_t)(now() * 1e6);
+}
+
+static void sleep_us(uint32_t us) {
+  struct timespec s = {0, (long)us * 1000};
+  nanosleep(&s, NULL);
+}
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  image[ix] = w;
+  return true;
+}
+
+static void ctx_done(eval_context_t *ctx) {
+  lbm_print_value(result, sizeof(result), ctx->r);
+  done = true;
+}
+
+static void *eval_thread(void *arg) {
+  (void)arg;
+  lbm_run_eval();
+  return NULL;
+}
+
+static void wait_paused(void) {
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+    sleep_us(100);
+  }
+}
+
+static bool run(const char *code) {
+  lbm_pause_eval();
+  wait_paused();
+  lbm_create_string_char_channel(&channel_state, &channel, (char*)code);
+  done = false;
+  if (lbm_load_and_eval_program(&channel, NULL) < 0) {
+    // The loader does not collect garbage itself.
+    lbm_perform_gc();
+    if (lbm_load_and_eval_program(&channel, NULL) < 0) return false;
+  }
+  lbm_continue_eval();
+  while (!done) {
+    sleep_us(10);
+  }
+  return true;
+}
+
+// Average run time in ms.
+static double time_run(const char *code, int reps) {
+  double t = 0.0;
+  for (int r = 0; r < reps; r ++) {
+    double t_start = now();
+    if (!run(code)) return -1.0;
+    t += now() - t_start;
+  }
+  return t * 1000.0 / reps;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    printf("Usage: %s <repetitions>\n", argv[0]);
+    return 1;
+  }
+  int reps = atoi(argv[1]);
+
+  memset(image, 0xff, sizeof(image));
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory, LBM_MEMORY_SIZE_16K,
+                bitmap, LBM_MEMORY_BITMAP_SIZE_16K,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSIONS)) {
+    printf("Init failed\n");
+    return 1;
+  }
+  lbm_image_init(image, IMAGE_WORDS, image_write);
+  lbm_image_create("bench");
+  if (!lbm_image_boot()) {
+    printf("Image boot failed\n");
+    return 1;
+  }
+  lbm_add_eval_symbols();
+  lbm_runtime_extensions_init();
+  lbm_dyn_lib_init();
+
+  lbm_set_usleep_callback(sleep_us);
+  lbm_set_timestamp_us_callback(timestamp_us);
+  lbm_set_ctx_done_callback(ctx_done);
+  lbm_set_printf_callback(printf);
+  lbm_set_dynamic_load_callback(lbm_dyn_lib_find);
+
+  pthread_t thd;
+  if (pthread_create(&thd, NULL, eval_thread, NULL)) {
+    printf("Could not start the evaluator\n");
+    return 1;
+  }
+
+  printf("cache size %d\n", LBM_MACRO_CACHE_SIZE);
+  printf("%-10s %10s %8s %10s %10s  %s\n",
+         "program", "ms", "gcs", "hits", "misses", "result");
+
+  for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i ++) {
+    const bench_t *b = &benches[i];
+    if (!run(b->defs)) {
+      printf("Could not load %s\n", b->name);
+      return 1;
+    }
+    lbm_macro_cache_stats_t s0, s1;
+    lbm_get_macro_cache_stats(&s0);
+    lbm_uint gc0 = lbm_heap_state.gc_num;
+    double t = time_run(b->run, reps);
+    if (t < 0.0) {
+      printf("Could not run %s\n", b->name);
+      return 1;
+    }
+    lbm_get_macro_cache_stats(&s1);
+    printf("%-10s %10.2f %8u %10u %10u  %s\n",
+           b->name, t,
+           (unsigned)((lbm_heap_state.gc_num - gc0) / (lbm_uint)reps),
+           (unsigned)((s1.hits - s0.hits) / (lbm_uint)reps),
+           (unsigned)((s1.misses - s0.misses) / (lbm_uint)reps),
+           result);
+  }
+  return 0;
+}
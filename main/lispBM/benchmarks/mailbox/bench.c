@@ -0,0 +1,194 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of message passing.
+ *
+ * Runs each of the given programs a number of times and reports the
+ * run time and the number of messages per second. A program returns
+ * the number of messages it sends. Build with -DLBM_MAILBOX_INDEX to
+ * get the mailbox tag index.
+ *
+ * Usage: bench <repetitions> <program.lisp> ...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "extensions/runtime_extensions.h"
+
+#define HEAP_SIZE        4096
+#define GC_STACK_SIZE    256
+#define PRINT_STACK_SIZE 256
+#define EXTENSIONS       100
+#define IMAGE_WORDS      (32 * 1024)
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory[LBM_MEMORY_SIZE_32K];
+static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE_32K];
+static lbm_extension_t extensions[EXTENSIONS];
+static uint32_t image[IMAGE_WORDS];
+
+static lbm_char_channel_t channel;
+static lbm_string_channel_state_t channel_state;
+static volatile bool done = false;
+static volatile lbm_cid program_cid = -1;
+static lbm_value result;
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static uint32_t timestamp_us(void) {
+  return (uint32_t)(now() * 1e6);
+}
+
+static void sleep_us(uint32_t us) {
+  struct timespec s = {0, (long)us * 1000};
+  nanosleep(&s, NULL);
+}
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  image[ix] = w;
+  return true;
+}
+
+static void ctx_done(eval_context_t *ctx) {
+  if (ctx->id == program_cid) {
+    result = ctx->r;
+    done = true;
+  }
+}
+
+static void *eval_thread(void *arg) {
+  (void)arg;
+  lbm_run_eval();
+  return NULL;
+}
+
+static void wait_paused(void) {
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+    sleep_us(100);
+  }
+}
+
+static bool run(char *code) {
+  lbm_pause_eval();
+  wait_paused();
+  lbm_create_string_char_channel(&channel_state, &channel, code);
+  done = false;
+  program_cid = lbm_load_and_eval_program(&channel, NULL);
+  if (program_cid < 0) return false;
+  lbm_continue_eval();
+  while (!done) {
+    sleep_us(10);
+  }
+  return true;
+}
+
+static char *read_file(const char *path) {
+  FILE *f = fopen(path, "r");
+  if (!f) return NULL;
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *s = malloc((size_t)len + 1);
+  if (s) {
+    size_t n = fread(s, 1, (size_t)len, f);
+    s[n] = 0;
+  }
+  fclose(f);
+  return s;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    printf("Usage: %s <repetitions> <program.lisp> ...\n", argv[0]);
+    return 1;
+  }
+  int reps = atoi(argv[1]);
+
+  memset(image, 0xff, sizeof(image));
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory, LBM_MEMORY_SIZE_32K,
+                bitmap, LBM_MEMORY_BITMAP_SIZE_32K,
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSIONS)) {
+    printf("Init failed\n");
+    return 1;
+  }
+  lbm_image_init(image, IMAGE_WORDS, image_write);
+  lbm_image_create("bench");
+  if (!lbm_image_boot()) {
+    printf("Image boot failed\n");
+    return 1;
+  }
+  lbm_add_eval_symbols();
+  lbm_runtime_extensions_init();
+
+  lbm_set_usleep_callback(sleep_us);
+  lbm_set_timestamp_us_callback(timestamp_us);
+  lbm_set_ctx_done_callback(ctx_done);
+  lbm_set_printf_callback(printf);
+
+  pthread_t thd;
+  if (pthread_create(&thd, NULL, eval_thread, NULL)) {
+    printf("Could not start the evaluator\n");
+    return 1;
+  }
+
+  printf("%-22s %10s %12s\n", "program", "time ms", "msgs/s");
+
+  for (int i = 2; i < argc; i ++) {
+    char *code = read_file(argv[i]);
+    if (!code) {
+      printf("Could not read %s\n", argv[i]);
+      return 1;
+    }
+    const char *name = strrchr(argv[i], '/');
+    name = name ? name + 1 : argv[i];
+
+    double t = 0.0;
+    for (int r = 0; r < reps; r ++) {
+      double t_start = now();
+      if (!run(code)) {
+        printf("Could not load %s\n", argv[i]);
+        return 1;
+      }
+      t += now() - t_start;
+    }
+
+    if (!lbm_is_number(result)) {
+      char buf[64];
+      lbm_print_value(buf, sizeof(buf), result);
+      printf("%-22s failed: %s\n", name, buf);
+    } else {
+      double msgs = (double)lbm_dec_as_u32(result) * reps;
+      printf("%-22s %10.2f %12.0f\n", name, t * 1000.0 / reps, msgs / t);
+    }
+    free(code);
+  }
+  return 0;
+}
@@ -0,0 +1,20 @@
+; Messages received in the order they are sent.
+; Returns the number of messages.
+
+(set-mailbox-size 100)
+
+(define fill (lambda (n)
+  (if (= n 0) nil
+    (progn (send (self) (list 'data n)) (fill (- n 1))))))
+
+(define drain (lambda (n)
+  (if (= n 0) nil
+    (progn (recv ((data (? x)) x)) (drain (- n 1))))))
+
+(define run (lambda (n)
+  (if (= n 0) nil
+    (progn (fill 100) (drain 100) (run (- n 1))))))
+
+(run 100)
+
+10000
@@ -0,0 +1,17 @@
+; A sender that outruns the receiver, the oldest message is dropped
+; from the full mailbox. Returns the number of messages.
+
+(set-mailbox-size 200)
+
+(define flood (lambda (n)
+  (if (= n 0) nil
+    (progn (send (self) n) (flood (- n 1))))))
+
+(define drain (lambda (n)
+  (if (= n 0) nil
+    (progn (recv ((? x) x)) (drain (- n 1))))))
+
+(flood 20000)
+(drain 200)
+
+20000
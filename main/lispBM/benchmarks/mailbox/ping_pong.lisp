@@ -0,0 +1,19 @@
+; Two threads passing a message back and forth.
+; Returns the number of messages.
+
+(define pong (lambda ()
+  (recv ((ping (? pid) (? n)) (progn (send pid (list 'pong n)) (pong)))
+        (stop nil))))
+
+(define pong-pid (spawn pong))
+
+(define ping (lambda (n)
+  (if (= n 0) nil
+    (progn (send pong-pid (list 'ping (self) n))
+           (recv ((pong (? k)) k))
+           (ping (- n 1))))))
+
+(ping 5000)
+(send pong-pid 'stop)
+
+10000
@@ -0,0 +1,38 @@
+#!/bin/bash
+# Builds and runs the message passing benchmark (bench.c) on the
+# programs in this directory, without and with the mailbox tag index.
+#
+# Usage:
+#   ./run.sh [repetitions]
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+LISPBM="$SCRIPT_DIR/../.."
+REPS=${1:-5}
+
+lispbm_var() {
+  make -s -C "$SCRIPT_DIR" -f - <<MK
+LISPBM := $LISPBM
+include \$(LISPBM)/lispbm.mk
+all:
+	@echo \$($1)
+MK
+}
+
+LISPBM_SRC=$(lispbm_var LISPBM_SRC)
+LISPBM_INC=$(lispbm_var LISPBM_INC)
+
+SRC="$SCRIPT_DIR/bench.c $LISPBM_SRC $LISPBM/platform/linux/src/platform_mutex.c $LISPBM/platform/linux/src/platform_timestamp.c $LISPBM/platform/linux/src/platform_thread.c"
+INC="$LISPBM_INC -I$LISPBM/platform/linux/include"
+FLAGS="-O2 -DLBM64 -DFULL_RTS_LIB"
+PROGRAMS="$SCRIPT_DIR/*.lisp"
+
+gcc $FLAGS $SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench_default"
+gcc $FLAGS -DLBM_MAILBOX_INDEX $SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench_index"
+
+echo "Default mailboxes"
+"$SCRIPT_DIR/bench_default" $REPS $PROGRAMS
+echo
+echo "Mailboxes with tag index"
+"$SCRIPT_DIR/bench_index" $REPS $PROGRAMS
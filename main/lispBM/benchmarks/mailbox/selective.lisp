@@ -0,0 +1,24 @@
+; A command is picked out from behind a mailbox full of telemetry,
+; which is then left for later. Returns the number of messages.
+
+(set-mailbox-size 200)
+
+(define telemetry (lambda (n)
+  (if (= n 0) nil
+    (progn (send (self) (list 'telemetry n)) (telemetry (- n 1))))))
+
+(define command (lambda (n)
+  (if (= n 0) nil
+    (progn (send (self) (list 'cmd n))
+           (recv ((cmd (? k)) k))
+           (command (- n 1))))))
+
+(define drain (lambda (n)
+  (if (= n 0) nil
+    (progn (recv ((telemetry (? x)) x)) (drain (- n 1))))))
+
+(telemetry 199)
+(command 2000)
+(drain 199)
+
+2199
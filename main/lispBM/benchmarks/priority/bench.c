@@ -0,0 +1,206 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of the response time of a context under load.
+ *
+ * Spawns a number of contexts that compute in an endless loop on
+ * priority level 1 and a control context that sleeps 10 ms in a loop
+ * on the given priority level, with a quota of 1000 evaluation steps.
+ * Reports how often the control context runs and the time from it
+ * becoming ready until it runs, taken from its scheduling statistics.
+ *
+ * Usage: bench <busy contexts> <control prio> <seconds>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "lispbm.h"
+#include "extensions/runtime_extensions.h"
+#include "platform_timestamp.h"
+
+#define HEAP_SIZE        16384
+#define GC_STACK_SIZE    256
+#define PRINT_STACK_SIZE 256
+#define EXTENSIONS       100
+#define IMAGE_WORDS      (32 * 1024)
+#define MEMORY_BLOCKS    65536
+
+static lbm_cons_t heap[HEAP_SIZE] __attribute__ ((aligned (8)));
+static lbm_uint memory[LBM_MEMORY_SIZE_BLOCKS_TO_WORDS(MEMORY_BLOCKS)];
+static lbm_uint bitmap[LBM_MEMORY_BITMAP_SIZE(MEMORY_BLOCKS)];
+static lbm_extension_t extensions[EXTENSIONS];
+static uint32_t image[IMAGE_WORDS];
+
+static lbm_char_channel_t channel;
+static lbm_string_channel_state_t channel_state;
+static volatile bool done = false;
+static volatile lbm_cid program_cid = -1;
+static lbm_value result;
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static double cpu_time(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+static uint32_t timestamp_us(void) {
+  return (uint32_t)(now() * 1e6);
+}
+
+static void sleep_us(uint32_t us) {
+  struct timespec s = {us / 1000000, (long)(us % 1000000) * 1000};
+  nanosleep(&s, NULL);
+}
+
+static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
+  (void)const_heap;
+  image[ix] = w;
+  return true;
+}
+
+static void ctx_done(eval_context_t *ctx) {
+  if (ctx->id == program_cid) {
+    result = ctx->r;
+    done = true;
+  }
+}
+
+static void *timestamp_thread(void *arg) {
+  lbm_timestamp_cacher(arg);
+  return NULL;
+}
+
+static void *eval_thread(void *arg) {
+  (void)arg;
+  lbm_run_eval();
+  return NULL;
+}
+
+static void wait_paused(void) {
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+    sleep_us(100);
+  }
+}
+
+static bool run(char *code) {
+  lbm_pause_eval();
+  wait_paused();
+  lbm_create_string_char_channel(&channel_state, &channel, code);
+  done = false;
+  program_cid = lbm_load_and_eval_program(&channel, NULL);
+  if (program_cid < 0) return false;
+  lbm_continue_eval();
+  while (!done) {
+    sleep_us(10);
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    printf("Usage: %s <busy contexts> <control prio> <seconds>\n", argv[0]);
+    return 1;
+  }
+  int busy = atoi(argv[1]);
+  int prio = atoi(argv[2]);
+  double seconds = atof(argv[3]);
+
+  memset(image, 0xff, sizeof(image));
+  if (!lbm_init(heap, HEAP_SIZE,
+                memory, LBM_MEMORY_SIZE_BLOCKS_TO_WORDS(MEMORY_BLOCKS),
+                bitmap, LBM_MEMORY_BITMAP_SIZE(MEMORY_BLOCKS),
+                GC_STACK_SIZE,
+                PRINT_STACK_SIZE,
+                extensions,
+                EXTENSIONS)) {
+    printf("Init failed\n");
+    return 1;
+  }
+  lbm_image_init(image, IMAGE_WORDS, image_write);
+  lbm_image_create("bench");
+  if (!lbm_image_boot()) {
+    printf("Image boot failed\n");
+    return 1;
+  }
+  lbm_add_eval_symbols();
+  lbm_runtime_extensions_init();
+
+  lbm_set_usleep_callback(sleep_us);
+  lbm_set_timestamp_us_callback(timestamp_us);
+  lbm_set_ctx_done_callback(ctx_done);
+  lbm_set_printf_callback(printf);
+
+  // The evaluator times sleeps with lbm_timestamp.
+  pthread_t ts_thd;
+  if (pthread_create(&ts_thd, NULL, timestamp_thread, NULL)) {
+    printf("Could not start the timestamp thread\n");
+    return 1;
+  }
+
+  pthread_t thd;
+  if (pthread_create(&thd, NULL, eval_thread, NULL)) {
+    printf("Could not start the evaluator\n");
+    return 1;
+  }
+
+  char code[512];
+  snprintf(code, sizeof(code),
+           "(set-eval-quota 1000)"
+           "(define busy (lambda (n) (busy (+ n 1))))"
+           "(define control (lambda () (progn (sleep 0.01) (control))))"
+           "(define spawn-n (lambda (n) (if (= n 0) t (progn (spawn 64 1 busy 0) (spawn-n (- n 1))))))"
+           "(spawn-n %d)"
+           "(spawn 64 %d control)",
+           busy, prio);
+  if (!run(code) || !lbm_is_number(result)) {
+    printf("Could not spawn %d contexts\n", busy + 1);
+    return 1;
+  }
+  lbm_cid control = lbm_dec_i(result);
+
+  sleep_us(100000);
+
+  lbm_ctx_sched_stats_t s0, s1;
+  lbm_sched_stats_t w;
+  if (!lbm_get_ctx_sched_stats(control, &s0)) {
+    printf("The control context is gone\n");
+    return 1;
+  }
+  sleep_us((uint32_t)(seconds * 1e6));
+  lbm_get_ctx_sched_stats(control, &s1);
+  lbm_get_sched_stats(&w);
+
+  lbm_uint runs = s1.runs - s0.runs;
+  printf("%4d busy  control prio %d  runs/s %7.0f  avg latency us %6lu  max latency us %6lu  max wake latency us %6lu\n",
+         busy,
+         prio,
+         (double)runs / seconds,
+         (unsigned long)(runs ? (s1.total_latency - s0.total_latency) / runs : 0),
+         (unsigned long)s1.max_latency,
+         (unsigned long)w.max_wake_latency);
+  return 0;
+}
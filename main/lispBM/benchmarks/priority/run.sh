@@ -0,0 +1,37 @@
+#!/bin/bash
+# Builds and runs the response time benchmark (bench.c) with an
+# increasing number of busy contexts, with the control context on the
+# same priority level as the busy ones and on a higher level.
+#
+# Usage:
+#   ./run.sh [seconds]
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+LISPBM="$SCRIPT_DIR/../.."
+SECONDS_PER_RUN=${1:-2}
+
+lispbm_var() {
+  make -s -C "$SCRIPT_DIR" -f - <<MK
+LISPBM := $LISPBM
+include \$(LISPBM)/lispbm.mk
+all:
+	@echo \$($1)
+MK
+}
+
+LISPBM_SRC=$(lispbm_var LISPBM_SRC)
+LISPBM_INC=$(lispbm_var LISPBM_INC)
+
+SRC="$SCRIPT_DIR/bench.c $LISPBM_SRC $LISPBM/platform/linux/src/platform_mutex.c $LISPBM/platform/linux/src/platform_timestamp.c $LISPBM/platform/linux/src/platform_thread.c"
+INC="$LISPBM_INC -I$LISPBM/platform/linux/include"
+FLAGS="-O2 -DLBM64 -DFULL_RTS_LIB"
+
+gcc $FLAGS $SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench"
+
+for n in 0 4 16 64; do
+  for prio in 1 3; do
+    "$SCRIPT_DIR/bench" $n $prio $SECONDS_PER_RUN
+  done
+done
@@ -0,0 +1,119 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Host benchmark of symbol lookup while reading a program.
+ *
+ * Registers a firmware sized set of extensions and runtime symbols,
+ * then resolves every symbol token of a generated program with
+ * lbm_str_to_symbol, the same way the tokenizer does. Build with
+ * -DLBM_NO_SYMBOL_INDEX to get the linear search.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lispbm.h"
+
+#define MEMORY_WORDS    LBM_MEMORY_SIZE_BLOCKS_TO_WORDS(1024)
+#define BITMAP_WORDS    LBM_MEMORY_BITMAP_SIZE(1024)
+#define NUM_EXTENSIONS  600
+#define NUM_VARIABLES   300
+#define LINES           3000
+#define TOKENS_PER_LINE 8
+
+static lbm_uint memory[MEMORY_WORDS];
+static lbm_uint bitmap[BITMAP_WORDS];
+static lbm_extension_t extensions[NUM_EXTENSIONS];
+static char ext_names[NUM_EXTENSIONS][24];
+static char var_names[NUM_VARIABLES][24];
+static const char *tokens[LINES * TOKENS_PER_LINE];
+
+static const char *specials[] = {
+  "define", "let", "if", "progn", "lambda", "setq", "loopwhile",
+  "car", "cdr", "cons", "list", "+", "-", "<", "=", "nil", "t"
+};
+
+static lbm_value ext_dummy(lbm_value *args, lbm_uint argn) {
+  (void)args;
+  (void)argn;
+  return ENC_SYM_TRUE;
+}
+
+static double now(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv) {
+  int reads = 10;
+  if (argc > 1) {
+    reads = atoi(argv[1]);
+  }
+
+  if (!lbm_memory_init(memory, MEMORY_WORDS, bitmap, BITMAP_WORDS) ||
+      !lbm_symrepr_init() ||
+      !lbm_extensions_init(extensions, NUM_EXTENSIONS)) {
+    printf("Init failed\n");
+    return 1;
+  }
+
+  for (int i = 0; i < NUM_EXTENSIONS; i ++) {
+    snprintf(ext_names[i], sizeof(ext_names[i]), "ext-func-%d", i);
+    lbm_add_extension(ext_names[i], ext_dummy);
+  }
+
+  for (int i = 0; i < NUM_VARIABLES; i ++) {
+    lbm_uint id;
+    snprintf(var_names[i], sizeof(var_names[i]), "var-%d", i);
+    lbm_add_symbol(var_names[i], &id);
+  }
+
+  // Roughly what a script looks like: a special form, a couple of
+  // extension calls and the rest references to user variables.
+  srand(1234);
+  for (int i = 0; i < LINES * TOKENS_PER_LINE; i ++) {
+    int r = rand() % TOKENS_PER_LINE;
+    if (r == 0) {
+      tokens[i] = specials[rand() % (int)(sizeof(specials) / sizeof(specials[0]))];
+    } else if (r < 3) {
+      tokens[i] = ext_names[rand() % NUM_EXTENSIONS];
+    } else {
+      tokens[i] = var_names[rand() % NUM_VARIABLES];
+    }
+  }
+
+  volatile lbm_uint sink = 0;
+  double t_start = now();
+  for (int r = 0; r < reads; r ++) {
+    for (int i = 0; i < LINES * TOKENS_PER_LINE; i ++) {
+      lbm_uint id;
+      lbm_str_to_symbol(tokens[i], &id);
+      sink += id;
+    }
+  }
+  double t = now() - t_start;
+  (void)sink;
+
+  unsigned long lookups = (unsigned long)reads * LINES * TOKENS_PER_LINE;
+  printf("%d extensions, %d variables, %d lines\n", NUM_EXTENSIONS, NUM_VARIABLES, LINES);
+  printf("%.2f ms per program, %.0f lookups/s\n",
+         t * 1000.0 / reads, (double)lookups / t);
+  return 0;
+}
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Builds and runs the symbol lookup benchmark (bench.c) with the
+# symbol index and with the linear search it replaces.
+#
+# Usage:
+#   ./run.sh [reads]
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+LISPBM="$SCRIPT_DIR/../.."
+
+lispbm_var() {
+  make -s -C "$SCRIPT_DIR" -f - <<MK
+LISPBM := $LISPBM
+include \$(LISPBM)/lispbm.mk
+all:
+	@echo \$($1)
+MK
+}
+
+LISPBM_SRC=$(lispbm_var LISPBM_SRC)
+LISPBM_INC=$(lispbm_var LISPBM_INC)
+
+SRC="$SCRIPT_DIR/bench.c $LISPBM_SRC $LISPBM/platform/linux/src/platform_mutex.c $LISPBM/platform/linux/src/platform_timestamp.c $LISPBM/platform/linux/src/platform_thread.c"
+INC="$LISPBM_INC -I$LISPBM/platform/linux/include"
+FLAGS="-O2 -DLBM64 -DFULL_RTS_LIB"
+
+gcc $FLAGS $SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench_index"
+gcc $FLAGS -DLBM_NO_SYMBOL_INDEX $SRC $INC -lpthread -lm -o "$SCRIPT_DIR/bench_linear"
+
+echo "Linear search"
+"$SCRIPT_DIR/bench_linear" "$@"
+echo
+echo "Symbol index"
+"$SCRIPT_DIR/bench_index" "$@"
@@ -1248,6 +1248,25 @@
                          ))
               end)))
 
+(define built-in-compile
+  (ref-entry "compile"
+             (list
+              (para (list "`compile` turns a closure into an equivalent closure whose body runs as bytecode."
+                          "The form of a compile expression is `(compile closure)`. Parameters and"
+                          "`let` bound variables are given fixed stack slots, built-in functions are"
+                          "called directly and calls between compiled closures stay in the bytecode"
+                          "interpreter. A compiled closure is called in the same way as any other closure"
+                          "and takes turns with other processes in the same way."
+                          ))
+              (para (list "The body may use `quote`, `if`, `cond`, `progn`, `let`, `and`, `or`"
+                          "and function application. Compiling a closure that uses other special forms,"
+                          "macros, `rest-args` or `local-env-get` results in an `eval_error`. Free variables are looked"
+                          "up when they are used, so a redefined global function is picked up."
+                          "A common use is to replace a definition with its compiled version,"
+                          "`(define fib (compile fib))`."
+                          ))
+              end)))
+
 (define built-in-read
   (ref-entry "read"
              (list
@@ -1437,6 +1456,7 @@
                  built-in-eval
                  built-in-eval-program
                  built-in-apply
+                 built-in-compile
                  built-in-read
                  built-in-read-program
                  built-in-read-eval-program
@@ -2513,8 +2533,10 @@
              (list
               (para (list "Use `spawn` to launch a concurrent process. Spawn takes a closure and"
                           "arguments to pass to that closure as its arguments. The form of a"
-                          "spawn expression is `(spawn opt-name opt-stack-size closure arg1"
-                          "... argN)`."
+                          "spawn expression is `(spawn opt-name opt-stack-size opt-prio closure arg1"
+                          "... argN)`. A priority level can only be given together with a stack size."
+                          "The process runs before processes of lower priority, see `set-prio`"
+                          "in the runtime extensions reference manual."
                           ))
               (para (list "Each process has a runtime-stack which is used for the evaluation of"
                           "expressions within that process. The stack size needed by a process"
@@ -2536,7 +2558,7 @@
              (list
               (para (list "Use `spawn-trap` to spawn a child process and enable trapping of exit"
                           "conditions for that child. The form of a `spawn-trap` expression is"
-                          "`(spawn-trap opt-name opt-stack-size closure arg1 .. argN)`.  If the"
+                          "`(spawn-trap opt-name opt-stack-size opt-prio closure arg1 .. argN)`.  If the"
                           "child process is terminated because of an error, a message is sent to"
                           "the parent process of the form `(exit-error tid err-val)`. If the"
                           "child process terminates successfully a message of the form `(exit-ok"
@@ -2894,6 +2916,15 @@
                         "programming abstractions in cases where it is ok to pay a little for"
                         "the overhead for benefits in expressivity."
                         ))
+            (para (list "A macro whose expansion depends only on its arguments can end with the"
+                        "symbol `memo`: `(macro args body memo)`. Its expansion is then remembered"
+                        "for each call site, so when it is used in a loop or in a function body it is"
+                        "only expanded the first time that code runs. Without `memo` a macro is"
+                        "expanded every time, as the expander may have side effects or read"
+                        "variables that change. The built-in macros such as `defun` and `loopfor`"
+                        "use `memo`. The number of remembered call sites is set by"
+                        "`LBM_MACRO_CACHE_SIZE` when building LispBM, 0 turns the cache off."
+                        ))
             m-macro
             )
            ))
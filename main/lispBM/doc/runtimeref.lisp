@@ -5,16 +5,84 @@
              (list
               (para (list "`set-eval-quota` sets the number of evaluation steps that is"
                           "given to each context when given turn to execute by the round-robin"
-                          "scheduler."
+                          "scheduler. An optional second argument sets the quota of the contexts"
+                          "on one priority level only."
                           ))
               (code '((set-eval-quota 30)
+                      (set-eval-quota 100 3)
                       ))
               end)))
 
+(define set-prio
+  (ref-entry "set-prio"
+             (list
+              (para (list "`set-prio` changes the priority level of a context. The form of a `set-prio`"
+                          "expression is `(set-prio opt-pid prio)` and without a pid it changes the priority"
+                          "of the calling context. The scheduler always runs a ready context of the highest"
+                          "priority level and a context that becomes ready ends the quota of a running context"
+                          "with a lower priority. Contexts on the same level share the time round-robin."
+                          "There are 4 levels by default, 0 is the lowest and contexts start on level 1"
+                          "unless a priority is given to `spawn`."
+                          ))
+              (code '((set-prio 2)
+                      (set-prio 1)
+                      ))
+              end)))
+
+(define sched-ctx-state
+  (ref-entry "sched-ctx-state"
+             (list
+              (para (list "`sched-ctx-state` can be used to query scheduling statistics of a context."
+                          "The form of a `sched-ctx-state` expression is `(sched-ctx-state pid sym)`."
+                          "`get-prio` is the priority level of the context and `get-runs` the number of"
+                          "times it has been scheduled. `get-max-latency` and `get-avg-latency` are the"
+                          "longest and average time in microseconds from the context becoming ready until it"
+                          "runs. The result is nil if there is no context with the given pid."
+                          ))
+              (code '((sched-ctx-state (self) 'get-prio)
+                      (sched-ctx-state (self) 'get-runs)
+                      (sched-ctx-state (self) 'get-max-latency)
+                      (sched-ctx-state (self) 'get-avg-latency)
+                      ))
+              end)))
+
+
+(define sched-state
+  (ref-entry "sched-state"
+             (list
+              (para (list "`sched-state` can be used to query statistics from the scheduler."
+                          "`get-ctx-switches` counts the times the scheduler switched to another context"
+                          "and `get-wake-ups` the contexts woken up at the end of a sleep or timeout."
+                          "`get-timers` is the number of contexts that are currently sleeping or waiting with a timeout"
+                          "and `get-max-wake-latency` is the longest time in microseconds from the end of a sleep"
+                          "or timeout until the context was woken up."
+                          ))
+              (code '((sched-state 'get-ctx-switches)
+                      (sched-state 'get-wake-ups)
+                      (sched-state 'get-timers)
+                      (sched-state 'get-max-wake-latency)
+                      ))
+              end)))
+
+(define sched-wake-histogram
+  (ref-entry "sched-wake-histogram"
+             (list
+              (para (list "`sched-wake-histogram` returns a list with the number of wake-ups by how late they came"
+                          "after the end of the sleep or timeout. The first element counts wake-ups less than"
+                          "16 microseconds late and the limit doubles for each following element."
+                          "The last element counts all wake-ups that are later."
+                          ))
+              (code '((sched-wake-histogram)
+                      ))
+              end)))
 
 (define chapter-scheduling
   (section 2 "Scheduling"
-           (list evaluation-quota)))
+           (list evaluation-quota
+                 set-prio
+                 sched-ctx-state
+                 sched-state
+                 sched-wake-histogram)))
 
 (define threads-mailbox-get
   (ref-entry "mailbox-get"
@@ -70,6 +138,9 @@
   (ref-entry "lbm-heap-state"
              (list
               (para (list "`lbm-heap-state` can be used to query information about heap usage."
+                          "`get-gc-mark-time` and `get-gc-sweep-time` are the durations of the mark and sweep phase"
+                          "of the most recent GC and `get-gc-max-pause` is the longest time the evaluator has been"
+                          "stopped by GC. Times are in microseconds as measured by the timestamp callback."
                           ))
               (code '((lbm-heap-state 'get-heap-size)
                       (lbm-heap-state 'get-heap-bytes)
@@ -81,16 +152,54 @@
                       (lbm-heap-state 'get-gc-num-recovered-arrays)
                       (lbm-heap-state 'get-gc-num-least-free)
                       (lbm-heap-state 'get-gc-num-last-free)
+                      (lbm-heap-state 'get-gc-mark-time)
+                      (lbm-heap-state 'get-gc-sweep-time)
+                      (lbm-heap-state 'get-gc-max-pause)
                       ))
               end)))
 
+(define gc-pause-histogram
+  (ref-entry "gc-pause-histogram"
+             (list
+              (para (list "`gc-pause-histogram` returns a list with the number of GC pauses of different lengths."
+                          "The first element counts pauses shorter than 16 microseconds and the limit doubles"
+                          "for each following element. The last element counts all pauses that are longer."
+                          "When LispBM is built with `LBM_GC_INCREMENTAL_SWEEP` the sweep is done in chunks"
+                          "between evaluation steps and each chunk is counted as a pause."
+                          ))
+              (code '((gc-pause-histogram)
+                      ))
+              end)))
+
+(define gc-telemetry
+  (ref-entry "gc-telemetry"
+             (list
+              (para (list "`gc-telemetry` returns a byte array with GC and memory statistics in a compact"
+                          "binary form, meant to be sent off the device and decoded elsewhere."
+                          "The first four bytes are the format version, the number of pause histogram bins,"
+                          "the number of collection records and a zero byte. Everything after that is big endian"
+                          "32 bit words: the number of collections and of full collections, the longest pause,"
+                          "the total GC time, the heap size, the number of free cells, the least number of"
+                          "free cells after a GC, the LBM memory size, number of free words, longest free"
+                          "sequence and maximum used words, followed by the pause histogram."
+                          "Last come the records of the most recent collections, oldest first. Each"
+                          "record holds the collection number, flags (1 for a full collection), the mark time,"
+                          "the sweep time, the number of free cells gained, the number of arrays freed, the number"
+                          "of free cells, and the free words and longest free sequence of the LBM memory"
+                          "after the collection. The number of records kept is set by `LBM_GC_TELEMETRY_SIZE`."
+                          ))
+              (code '((bufget-u8 (gc-telemetry) 0)
+                      ))
+              end)))
 
 (define chapter-memory
   (section 2 "Memory"
            (list num-free
                  longest-free
                  memory-size
-                 heap-state)))
+                 heap-state
+                 gc-pause-histogram
+                 gc-telemetry)))
 
 (define gc-stack
   (ref-entry "set-gc-stack-size"
@@ -210,6 +319,55 @@
                       ))
               end)))
 
+(define global-environment-state
+  (ref-entry "global-env-state"
+             (list
+              (para (list "`global-env-state` can be used to query how the bindings are spread over the"
+                          "global environment hashtable. The hashtable grows as bindings are added so that"
+                          "the chain of bindings walked on each global lookup stays short."
+                          "`get-env-avg-chain` is the average number of bindings per root that is in use."
+                          "Recently used global bindings are also kept in a small cache,"
+                          "`get-env-cache-hits` and `get-env-cache-misses` count the global lookups"
+                          "that were and were not found in it."
+                          ))
+              (code '((global-env-state 'get-env-roots)
+                      (global-env-state 'get-env-used-roots)
+                      (global-env-state 'get-env-bindings)
+                      (global-env-state 'get-env-max-chain)
+                      (global-env-state 'get-env-avg-chain)
+                      (global-env-state 'get-env-cache-hits)
+                      (global-env-state 'get-env-cache-misses)
+                      ))
+              end)))
+
+
+(define ext-stats
+  (ref-entry "ext-stats"
+             (list
+              (para (list "`ext-stats` returns call statistics for the extensions that have been called,"
+                          "ordered by the total time spent in them, most expensive first."
+                          "The form of an `ext-stats` expression is `(ext-stats)` or `(ext-stats n)`,"
+                          "where `n` limits the result to the top `n` extensions."
+                          "Each element of the result is a list `(name calls total-us max-us hist)` where"
+                          "`hist` is a list counting calls by duration. The first element of `hist` counts calls"
+                          "shorter than 16 microseconds and the limit doubles for each following element."
+                          "The last element counts all calls that are longer."
+                          "`ext-stats` is only available if LBM is built with `-DLBM_EXTENSION_STATS`."
+                          ))
+              end)))
+
+(define ext-stats-reset
+  (ref-entry "ext-stats-reset"
+             (list
+              (para (list "`ext-stats-reset` clears the call statistics of all extensions."
+                          "`ext-stats-reset` is only available if LBM is built with `-DLBM_EXTENSION_STATS`."
+                          ))
+              end)))
+
+(define chapter-ext-stats
+  (section 2 "Extension statistics"
+           (list ext-stats
+                 ext-stats-reset)))
 
 (define chapter-environments
   (section 2 "Environments"
@@ -218,6 +376,7 @@
                  environment-drop
                  local-environment-get
                  global-environment-size
+                 global-environment-state
                  )))
 
 
@@ -349,12 +508,13 @@
             (list
              (para (list "The runtime extensions, if present, can be either compiled"
                          "in a minimal or a full mode."
-                         "In the minimal mode only `set-eval-quota` is present."
+                         "In the minimal mode only `set-eval-quota` and `set-prio` are present."
                          "Minimal mode is the default when compiling LBM. To get the"
                          "full mode the `-DFULL_RTS_LIB` flag must be used when compiling."
                          ))
              chapter-errors
              chapter-environments
+             chapter-ext-stats
              chapter-gc
              chapter-memory
              chapter-scheduling
@@ -24,6 +24,7 @@ set(LISPBM_SOURCES
   "${LISPBM_DIR}/src/lbm_defrag_mem.c"
   "${LISPBM_DIR}/src/lbm_flat_value.c"
   "${LISPBM_DIR}/src/lbm_image.c"
+  "${LISPBM_DIR}/src/lbm_bytecode.c"
   "${LISPBM_DIR}/src/print.c"
   "${LISPBM_DIR}/src/stack.c"
   "${LISPBM_DIR}/src/symrepr.c"
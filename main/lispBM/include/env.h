@@ -25,10 +25,49 @@
 extern "C" {
 #endif
 
-/** Global environment hashtable size */
-#define GLOBAL_ENV_ROOTS 32
+/** Initial number of roots in the global environment hashtable.
+ *  Must be a power of two.
+ */
+#ifndef GLOBAL_ENV_INIT_ROOTS
+#define GLOBAL_ENV_INIT_ROOTS 32
+#endif
+/** The global environment hashtable does not grow beyond this number of roots.
+ *  Must be a power of two.
+ */
+#ifndef GLOBAL_ENV_MAX_ROOTS
+#define GLOBAL_ENV_MAX_ROOTS 1024
+#endif
+/** The global environment hashtable is doubled in size when the
+ *  average number of bindings per root exceeds this value.
+ */
+#ifndef GLOBAL_ENV_MAX_LOAD
+#define GLOBAL_ENV_MAX_LOAD 2
+#endif
+
+/** Number of entries in the cache of recently looked up global
+ *  bindings. Must be a power of two, 0 disables the cache.
+ */
+#ifndef GLOBAL_ENV_CACHE_SIZE
+#define GLOBAL_ENV_CACHE_SIZE 64
+#endif
+
+/** Current number of roots in the global environment hashtable.
+ *  This changes when the table grows, so it should not be kept
+ *  across calls that can add bindings.
+ */
+#define GLOBAL_ENV_ROOTS ((int)lbm_get_global_env_roots())
 /** Symbol to hashtable entry hashfunction */
-#define GLOBAL_ENV_MASK  0x1F
+#define GLOBAL_ENV_MASK  (lbm_get_global_env_roots() - 1)
+
+/** Global environment hashtable statistics */
+typedef struct {
+  lbm_uint roots;        /// Number of roots in the hashtable.
+  lbm_uint used_roots;   /// Number of roots with at least one binding.
+  lbm_uint bindings;     /// Total number of bindings.
+  lbm_uint max_chain;    /// Number of bindings in the longest chain.
+  lbm_uint cache_hits;   /// Global lookups answered by the binding cache.
+  lbm_uint cache_misses; /// Global lookups that had to search the hashtable.
+} lbm_global_env_stats_t;
 
 //environment interface
 /** Initialize the global environment. This sets the global environment to NIL
@@ -45,6 +84,16 @@ lbm_value *lbm_get_global_env(void);
  * \return the size of the global env in number of heap cells.
  */
 lbm_uint lbm_get_global_env_size(void);
+/**
+ * \return Number of roots in the global environment hashtable.
+ */
+lbm_uint lbm_get_global_env_roots(void);
+/** Get statistics about how bindings are spread over the global
+ *  environment hashtable.
+ *
+ * \param stats Result is stored here.
+ */
+void lbm_get_global_env_stats(lbm_global_env_stats_t *stats);
 /** Copy the spine of an environment. The list structure is
  * recreated but the values themselves are not copied but rather
  * just referenced.
@@ -71,6 +120,37 @@ bool lbm_env_lookup_b(lbm_value *res, lbm_value sym, lbm_value env);
  * \return True on success or false otherwise.
  */
 bool lbm_global_env_lookup(lbm_value *res, lbm_value sym);
+/** Create a new binding in the global environment or replace an old one.
+ *  Adding a binding can grow the hashtable, which invalidates pointers
+ *  obtained from lbm_get_global_env.
+ *
+ * \evalpaused
+ *
+ * \param key A symbol to associate with a value.
+ * \param val The value.
+ * \return ENC_SYM_TRUE on success or ENC_SYM_MERROR if GC needs to be run.
+ */
+lbm_value lbm_global_env_set(lbm_value key, lbm_value val);
+/** Remove a binding from the global environment.
+ *
+ * \evalpaused
+ *
+ * \param key Symbol to remove the binding of.
+ * \return ENC_SYM_TRUE on success or ENC_SYM_NOT_FOUND if key is not bound.
+ */
+lbm_value lbm_global_env_drop(lbm_value key);
+/** Clear the cache of global bindings. Must be called after bindings are
+ *  removed from the global environment by other means than lbm_global_env_drop,
+ *  for example when modifying the lists returned by lbm_get_global_env.
+ */
+void lbm_global_env_flush_cache(void);
+/** Get the number of times a macro has been bound with lbm_global_env_set
+ *  or lbm_env_modify_binding. Code that depends on a name not being
+ *  a macro only has to look it up again when this has changed.
+ *
+ * \return Number of macro bindings so far.
+ */
+lbm_uint lbm_env_macro_bindings(void);
 /** Create a new binding on the environment or replace an old binding.
  *
  * \evalpaused
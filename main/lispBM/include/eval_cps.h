@@ -43,6 +43,13 @@ extern "C" {
 
 #define EVAL_CPS_DEFAULT_MAILBOX_SIZE 10
 
+/* With LBM_MAILBOX_INDEX each mailbox also stores the tag of every
+ * message, the message itself if it is a symbol or its head if that is
+ * a symbol. recv then skips messages whose tag no pattern asks for
+ * without looking at the message. The index doubles the size of the
+ * mailboxes in lbm_memory.
+ */
+
 // Make sure the flags fit in an u28. (do not go beyond 27 flags)
 /** @name Evaluator Context Flags
  * @{
@@ -77,15 +84,38 @@ extern "C" {
 #define LBM_IS_STATE_RECV(X) (X & (LBM_THREAD_STATE_RECV_BL | LBM_THREAD_STATE_RECV_TO))
 /** @} */
 
+/** Number of context priority levels. Level 0 is the lowest priority.
+ */
+#ifndef LBM_PRIO_LEVELS
+#define LBM_PRIO_LEVELS 4
+#endif
+
+/** Priority level of contexts that are not given one when created.
+ */
+#ifndef LBM_PRIO_DEFAULT
+#define LBM_PRIO_DEFAULT 1
+#endif
+
+/** Number of entries in the macro expansion cache. Expansions of macros
+ *  that end in the symbol memo are remembered per call site, so such a
+ *  macro used in a loop is only expanded the first time around. Must be a
+ *  power of two, 0 disables the cache.
+ */
+#ifndef LBM_MACRO_CACHE_SIZE
+#define LBM_MACRO_CACHE_SIZE 32
+#endif
+
 /** Represents an evaluation context (a thread)
  */
 typedef struct eval_context_s{
   lbm_value program;
   lbm_value curr_exp;
   lbm_value curr_env;
-  lbm_value *mailbox;    // Message passing mailbox */
+  lbm_value *mailbox;    // Message passing mailbox, a circular buffer */
   uint32_t  mailbox_size;
   uint32_t  num_mail;    // Number of messages in mailbox
+  uint32_t  mail_head;   // Slot of the oldest message
+  uint32_t  mail_used;   // Slots in use from mail_head, including removed messages
   uint32_t  flags;
   lbm_value r;
   const char *error_reason;
@@ -104,8 +134,51 @@ typedef struct eval_context_s{
   // List structure
   struct eval_context_s *prev;
   struct eval_context_s *next;
+  // Timer heap, for contexts waiting for a timeout
+  uint32_t wake_time;
+  struct eval_context_s *timer_prev;  // Parent or previous sibling
+  struct eval_context_s *timer_child;
+  struct eval_context_s *timer_next;
+  // Scheduling
+  uint32_t priority;     // Ready queue level, 0 to LBM_PRIO_LEVELS - 1
+  uint32_t ready_time;   // Time when the context last became ready
+  lbm_uint sched_runs;   // Times the context has been scheduled
+  lbm_uint sched_max_latency;   // Longest time in us from ready to running
+  lbm_uint sched_total_latency; // Sum of the times in us from ready to running
 } eval_context_t;
 
+/** Macro expansion cache statistics
+ */
+typedef struct {
+  lbm_uint hits;    /// Macro applications that reused a cached expansion.
+  lbm_uint misses;  /// Macro applications that ran the expander.
+  lbm_uint entries; /// Call sites currently in the cache.
+} lbm_macro_cache_stats_t;
+
+/** Number of bins in the wake-up latency histogram.
+ */
+#ifndef LBM_SCHED_WAKE_HIST_BINS
+#define LBM_SCHED_WAKE_HIST_BINS 12
+#endif
+
+/** Scheduler statistics
+ */
+typedef struct {
+  lbm_uint ctx_switches;     /// Times the scheduler switched to another context.
+  lbm_uint wake_ups;         /// Contexts woken up by the end of a sleep or timeout.
+  lbm_uint timers;           /// Contexts currently sleeping or waiting with a timeout.
+  lbm_uint max_wake_latency; /// Longest time in us from the end of a sleep or timeout to the wake-up.
+} lbm_sched_stats_t;
+
+/** Scheduling statistics of one context
+ */
+typedef struct {
+  lbm_uint priority;      /// Ready queue level of the context.
+  lbm_uint runs;          /// Times the context has been scheduled.
+  lbm_uint max_latency;   /// Longest time in us from becoming ready to running.
+  lbm_uint total_latency; /// Sum of the times in us from becoming ready to running.
+} lbm_ctx_sched_stats_t;
+
 /** Event types */
 typedef enum {
   LBM_EVENT_FOR_HANDLER = 0,
@@ -160,12 +233,22 @@ bool lbm_eval_init(void);
  *   \param quota The new quota.
  */
 void lbm_set_eval_time_quota(uint32_t quota);
+/**  Set the time quota of contexts on one priority level.
+ *   \param prio The priority level.
+ *   \param quota The new quota.
+ */
+void lbm_set_eval_time_quota_prio(uint32_t prio, uint32_t quota);
 #else
 /**  Set a new value to use as step quota.
  *   This changes the scheduling interval.
  *   \param quota The new quota.
  */
 void lbm_set_eval_step_quota(uint32_t quota);
+/**  Set the step quota of contexts on one priority level.
+ *   \param prio The priority level.
+ *   \param quota The new quota.
+ */
+void lbm_set_eval_step_quota_prio(uint32_t prio, uint32_t quota);
 #endif
 /** Initialize events
  * \param num_events The maximum number of unprocessed events.
@@ -387,6 +470,12 @@ void lbm_set_printf_callback(int (*prnt)(const char*, ...));
  * an undefined symbol
  */
 void lbm_set_dynamic_load_callback(bool (*fptr)(const char *, const char **));
+/** Check if the dynamic load callback has code for a symbol.
+ *
+ * \param name Name of the symbol.
+ * \return true if the symbol would be loaded when it is first used.
+ */
+bool lbm_dynamic_load_exists(const char *name);
 /** Get the CID of the currently executing context.
  *  Should be called from an extension where there is
  *  a guarantee that a context is running
@@ -408,6 +497,67 @@ void lbm_surrender_quota(void);
  * \return true on success and false otherwise.
  */
 bool lbm_mailbox_change_size(eval_context_t *ctx, lbm_uint new_size);
+/** Get the scheduler statistics.
+ * \param stats Result is stored here.
+ */
+void lbm_get_sched_stats(lbm_sched_stats_t *stats);
+/** Get the wake-up latency histogram. Bin i counts wake-ups that came
+ *  less than 2^(i + 4) microseconds after the end of the sleep or
+ *  timeout and did not fit in a lower bin. The last bin counts all
+ *  later wake-ups.
+ *
+ * \return Array of LBM_SCHED_WAKE_HIST_BINS counters.
+ */
+const lbm_uint *lbm_sched_wake_hist(void);
+/** Forget all cached macro expansions. Call this after changing
+ *  a macro in place, for example with setcar on its body.
+ */
+void lbm_macro_cache_clear(void);
+/** Get the macro expansion cache statistics.
+ * \param stats Result is stored here.
+ */
+void lbm_get_macro_cache_stats(lbm_macro_cache_stats_t *stats);
+/** Turn recording of closure calls on the context stacks on or off.
+ *  This is used by the profiler to sample call stacks. While on, a
+ *  closure call that is not a tail call uses two more words of stack.
+ * \param on True to start recording.
+ */
+void lbm_set_call_stack_tracking(bool on);
+/** Get the closures that a context is evaluating, as recorded while
+ *  call stack tracking is on. Each closure is identified by its body.
+ *  Should be called with the context not running, or from the thread
+ *  that samples the running context.
+ * \param ctx The context.
+ * \param funs Bodies of the closures are stored here, outermost first.
+ * \param max Size of funs. If the stack is deeper the innermost max are kept.
+ * \param truncated Set to true if the stack was deeper than max.
+ * \return Number of closures stored in funs.
+ */
+lbm_uint lbm_get_call_stack(eval_context_t *ctx, lbm_value *funs, lbm_uint max, bool *truncated);
+/** Get the extension that the evaluator is executing, while call stack
+ *  tracking is on.
+ * \return The symbol of the extension, or nil.
+ */
+lbm_value lbm_get_running_extension(void);
+/** Change the priority level of a context. A ready context moves to
+ *  the queue of its new level.
+ * \param cid Id of the context.
+ * \param prio The new priority level, clamped to LBM_PRIO_LEVELS - 1.
+ * \return true on success and false if there is no such context.
+ */
+bool lbm_set_ctx_priority(lbm_cid cid, uint32_t prio);
+/** Get the scheduling statistics of a context.
+ * \param cid Id of the context.
+ * \param stats Result is stored here.
+ * \return true on success and false if there is no such context.
+ */
+bool lbm_get_ctx_sched_stats(lbm_cid cid, lbm_ctx_sched_stats_t *stats);
+/** Get a message from the mailbox of a context.
+ * \param ctx The context to get the message from.
+ * \param n Index of the message, 0 is the oldest. Must be less than ctx->num_mail.
+ * \return The message.
+ */
+lbm_value lbm_mailbox_get(eval_context_t *ctx, lbm_uint n);
 
 lbm_flash_status request_flash_storage_cell(lbm_value val, lbm_value *res);
   //bool lift_array_flash(lbm_value flash_cell, char *data, lbm_uint num_elt);
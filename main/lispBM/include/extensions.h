@@ -35,11 +35,36 @@ extern "C" {
  */
 typedef lbm_value (*extension_fptr)(lbm_value*,lbm_uint);
 
+#ifdef LBM_EXTENSION_STATS
+/** Number of bins in the per-extension execution time histogram.
+ */
+#ifndef LBM_EXTENSION_STATS_HIST_BINS
+#define LBM_EXTENSION_STATS_HIST_BINS 8
+#endif
+
+/** Call statistics for one extension. Only present when built with
+ *  LBM_EXTENSION_STATS. Times are in microseconds as given by the
+ *  timestamp callback of the evaluator.
+ */
+typedef struct {
+  uint32_t calls;    /// Number of times the extension has been called.
+  uint32_t max_us;   /// Longest single call.
+  uint64_t total_us; /// Sum of the time spent in all calls.
+  /** Bin i counts calls that took less than 2^(i + 4) microseconds
+   *  and did not fit in a lower bin. The last bin counts all longer calls.
+   */
+  uint32_t hist[LBM_EXTENSION_STATS_HIST_BINS];
+} lbm_extension_stats_t;
+#endif
+
 /** Type representing an entry in the extension table
  */
 typedef struct {
   extension_fptr fptr;
   const char *name;
+#ifdef LBM_EXTENSION_STATS
+  lbm_extension_stats_t stats;
+#endif
 } lbm_extension_t;
 
 
@@ -93,6 +118,23 @@ bool lbm_clr_extension(lbm_uint sym_id);
  */
 bool lbm_add_extension(const char *sym_str, extension_fptr ext);
 
+#ifdef LBM_EXTENSION_STATS
+/** Account one call of an extension. Called by the evaluator.
+ * \param ext_id Index of the extension in the extension table.
+ * \param us Time spent in the call in microseconds.
+ */
+void lbm_extension_stats_record(lbm_uint ext_id, uint32_t us);
+/** Get the call statistics of an extension.
+ * \param ext_id Index of the extension in the extension table.
+ * \param stats Result is stored here.
+ * \return true on success, false if ext_id is out of range.
+ */
+bool lbm_get_extension_stats(lbm_uint ext_id, lbm_extension_stats_t *stats);
+/** Clear the call statistics of all extensions.
+ */
+void lbm_extension_stats_reset(void);
+#endif
+
 /** Check if an lbm_value is a symbol that is bound to an extension.
  * \param exp Key to look up.
  * \return true if the lbm_value respresents an extension otherwise false.
@@ -198,6 +198,55 @@ typedef enum {
   LBM_FLASH_WRITE_ERROR
 } lbm_flash_status;
 
+/** Number of heap cells swept each time the evaluator runs a step of
+ *  an incremental sweep. Only used with LBM_GC_INCREMENTAL_SWEEP.
+ */
+#ifndef LBM_GC_SWEEP_CHUNK
+#define LBM_GC_SWEEP_CHUNK 256
+#endif
+/** Number of bins in the GC pause histogram.
+ */
+#ifndef LBM_GC_PAUSE_HIST_BINS
+#define LBM_GC_PAUSE_HIST_BINS 12
+#endif
+/** Number of recent collections kept in the GC telemetry record buffer.
+ *  0 disables the record buffer.
+ */
+#ifndef LBM_GC_TELEMETRY_SIZE
+#define LBM_GC_TELEMETRY_SIZE 8
+#endif
+/** Version of the binary layout produced by lbm_heap_gc_telemetry.
+ */
+#define LBM_GC_TELEMETRY_VERSION 1
+/** Number of old heap cells that can be recorded by the write barrier
+ *  between two collections. If more are written to, the next collection
+ *  is a full one. Only used with LBM_GC_GENERATIONAL.
+ */
+#ifndef LBM_GC_REMEMBERED_SIZE
+#define LBM_GC_REMEMBERED_SIZE 64
+#endif
+/** A minor collection that would leave less than this percentage of the
+ *  free cells left by the last full collection is redone as a full
+ *  collection. Only used with LBM_GC_GENERATIONAL.
+ */
+#ifndef LBM_GC_MINOR_MIN_FREE
+#define LBM_GC_MINOR_MIN_FREE 50
+#endif
+/** Number of GC mark bitmaps. LBM_GC_INCREMENTAL_SWEEP uses one and
+ *  LBM_GC_GENERATIONAL two.
+ */
+#if defined(LBM_GC_GENERATIONAL)
+#define LBM_GC_BITMAP_NUM 2
+#elif defined(LBM_GC_INCREMENTAL_SWEEP)
+#define LBM_GC_BITMAP_NUM 1
+#else
+#define LBM_GC_BITMAP_NUM 0
+#endif
+/** Size in words of the GC mark bitmaps for a heap of X cells, see
+ *  lbm_heap_set_gc_bitmap_storage.
+ */
+#define LBM_GC_BITMAP_SIZE(X) (LBM_GC_BITMAP_NUM * (((X) + sizeof(lbm_uint) * 8 - 1) / (sizeof(lbm_uint) * 8)))
+
 /** Struct representing a heap cons-cell.
  *
  */
@@ -227,10 +276,35 @@ typedef struct {
   lbm_uint gc_least_free;      // The smallest length of the freelist.
   lbm_uint gc_last_free;       // Number of elements on the freelist
                                // after most recent GC.
+  lbm_uint gc_mark_time;       // Duration of the most recent mark phase.
+  lbm_uint gc_sweep_time;      // Total duration of the most recent sweep.
+  lbm_uint gc_max_pause;       // Longest time spent in GC at once.
+  lbm_uint gc_total_time;      // Total time spent in GC, wraps around.
+  lbm_uint gc_full_num;        // Number of collections that traced the whole heap.
 } lbm_heap_state_t;
 
 extern lbm_heap_state_t lbm_heap_state;
 
+/** Bit in lbm_gc_record_t.flags set for collections that traced the whole heap.
+ */
+#define LBM_GC_RECORD_FULL 1
+
+/**
+ *  Telemetry of one garbage collection. Values describing the heap
+ *  and lbm_memory are taken when the sweep of the collection is done.
+ */
+typedef struct {
+  uint32_t gc_num;           // Number of the collection, as in lbm_heap_state.gc_num.
+  uint32_t flags;            // LBM_GC_RECORD_ flags.
+  uint32_t mark_time;        // Duration of the mark phase.
+  uint32_t sweep_time;       // Total duration of the sweep.
+  uint32_t recovered;        // Number of free cells gained by the collection.
+  uint32_t recovered_arrays; // Number of arrays freed.
+  uint32_t num_free;         // Number of free cells after the sweep.
+  uint32_t mem_free;         // Free words in lbm_memory after the sweep.
+  uint32_t mem_longest_free; // Longest free sequence in lbm_memory after the sweep.
+} lbm_gc_record_t;
+
 typedef bool (*const_heap_write_fun)(lbm_uint w, lbm_uint ix);
 
 typedef struct {
@@ -264,6 +338,18 @@ void lbm_gc_lock(void);
  */
 void lbm_gc_unlock(void);
 
+/** Give the GC mark bitmaps storage outside of lbm_memory. Must be
+ *  called before lbm_heap_init (or lbm_init) and the storage must stay
+ *  valid for as long as the heap is used. Without it, or if size is too
+ *  small for the heap, lbm_heap_init allocates the bitmaps from
+ *  lbm_memory. With LBM_GC_GENERATIONAL that is two words for every 64
+ *  heap cells (32 on 32-bit), which is taken from what programs can use.
+ *
+ * \param data Storage for the bitmaps, or NULL to use lbm_memory.
+ * \param size Size of data in words. LBM_GC_BITMAP_SIZE gives the size
+ *        needed for a heap.
+ */
+void lbm_heap_set_gc_bitmap_storage(lbm_uint *data, lbm_uint size);
 /** Initialize heap storage.
  * \param addr Pointer to an array of lbm_cons_t elements. This array must at least be aligned 4.
  * \param num_cells Number of lbm_cons_t elements in the array.
@@ -273,13 +359,63 @@ void lbm_gc_unlock(void);
 bool lbm_heap_init(lbm_cons_t *addr, lbm_uint num_cells,
                    lbm_uint gc_stack_size);
 
-/** Add GC time statistics to heap_stats
+/** Add GC time statistics to heap_stats. Each call is one pause of
+ *  the evaluator and is counted in the pause histogram.
  *
  * \internalonly
  *
  * \param dur Duration as reported by the timestamp callback.
  */
 void lbm_heap_new_gc_time(lbm_uint dur);
+/** Set the duration of the most recent mark phase.
+ *
+ * \internalonly
+ *
+ * \param dur Duration as reported by the timestamp callback.
+ */
+void lbm_heap_new_mark_time(lbm_uint dur);
+/** Add to the duration of the current sweep.
+ *
+ * \internalonly
+ *
+ * \param dur Duration as reported by the timestamp callback.
+ */
+void lbm_heap_new_sweep_time(lbm_uint dur);
+/** Get the GC pause histogram. Bin i counts pauses shorter than
+ *  2^(i + 4) microseconds that did not fit in a lower bin. The last bin
+ *  counts all longer pauses.
+ *
+ * \return Array of LBM_GC_PAUSE_HIST_BINS counters.
+ */
+const lbm_uint *lbm_heap_gc_pause_hist(void);
+/** Get the records of the most recent collections, oldest first.
+ *
+ * \param records Array to store the records in.
+ * \param max Size of the records array.
+ * \return Number of records stored, at most LBM_GC_TELEMETRY_SIZE.
+ */
+lbm_uint lbm_heap_gc_records(lbm_gc_record_t *records, lbm_uint max);
+/** Size in bytes of the blob produced by lbm_heap_gc_telemetry.
+ *
+ * \return Size in bytes.
+ */
+lbm_uint lbm_heap_gc_telemetry_size(void);
+/** Serialize the GC telemetry into a compact binary blob. All fields
+ *  after the first four bytes are big endian uint32.
+ *
+ *  - uint8 LBM_GC_TELEMETRY_VERSION, uint8 number of histogram bins,
+ *    uint8 number of records, uint8 0.
+ *  - gc_num, gc_full_num, gc_max_pause, gc_total_time, heap_size,
+ *    num_free, gc_least_free, lbm_memory size, free and longest free
+ *    words, and maximum used words.
+ *  - The pause histogram.
+ *  - The records, oldest first, each as the fields of lbm_gc_record_t in order.
+ *
+ * \param buf Buffer to write the blob to.
+ * \param size Size of buf in bytes.
+ * \return Number of bytes written, 0 if buf is too small.
+ */
+lbm_uint lbm_heap_gc_telemetry(uint8_t *buf, lbm_uint size);
 /** Add a new free_list length to the heap_stats.
  *  Calculates a new freelist length and updates
  *  the GC statistics.
@@ -296,6 +432,29 @@ static inline lbm_uint lbm_heap_num_free(void) {
   return lbm_heap_state.num_free;
 }
 
+/** Sweep until there are at least n cells on the free-list or the
+ *  sweep is done.
+ *
+ * \param n Number of cells needed.
+ * \return true if there are at least n cells on the free-list.
+ */
+bool lbm_gc_sweep_ahead(lbm_uint n);
+
+/** Check that there are at least n cells on the free-list. With
+ *  LBM_GC_INCREMENTAL_SWEEP, cells are swept as needed to get there.
+ *
+ * \param n Number of cells needed.
+ * \return true if n cells can be taken from the free-list.
+ */
+static inline bool lbm_heap_has_free(lbm_uint n) {
+#ifdef LBM_GC_INCREMENTAL_SWEEP
+  if (lbm_heap_state.num_free < n) {
+    return lbm_gc_sweep_ahead(n);
+  }
+#endif
+  return lbm_heap_state.num_free >= n;
+}
+
 /** Check how many lbm_cons_t cells are allocated.
  *
  * \return  Number of lbm_cons_t cells that are currently allocated.
@@ -607,13 +766,57 @@ void lbm_gc_mark_continuation_stack(lbm_uint *data, lbm_uint n);
  * \param num_roots size of array of roots.
  */
 void lbm_gc_mark_roots(lbm_uint *roots, lbm_uint num_roots);
+/** Mark the heap cells that old cells were made to point to since the
+ *  last collection. Does nothing unless LBM_GC_GENERATIONAL is defined.
+ *
+ * \internalonly
+ */
+void lbm_gc_mark_remembered(void);
+/** Check if the minor collection that is being marked would leave too
+ *  few free cells, see LBM_GC_MINOR_MIN_FREE. If so, the marks
+ *  of the old cells are dropped and the collection becomes a full one.
+ *  Always false unless LBM_GC_GENERATIONAL is defined.
+ *
+ * \internalonly
+ *
+ * \return true if the roots have to be marked again.
+ */
+bool lbm_gc_retry_full(void);
 /** Sweep up all non marked heap cells and place them on the free list.
+ *  With LBM_GC_INCREMENTAL_SWEEP only the first chunk is swept, the rest
+ *  is swept by lbm_gc_sweep_step and when allocating.
  *
  * \internalonly
  *
  * \return 1
  */
 int lbm_gc_sweep_phase(void);
+/** Sweep the next chunk of the heap if a sweep is in progress.
+ *
+ * \internalonly
+ *
+ * \return true if the sweep is still in progress.
+ */
+bool lbm_gc_sweep_step(void);
+/** Sweep the rest of the heap if a sweep is in progress. Called before
+ *  marking as the mark bits of the unswept cells are still in use.
+ */
+void lbm_gc_sweep_finish(void);
+/** Check if a sweep is in progress.
+ *
+ * \return true if there are heap cells left to sweep.
+ */
+bool lbm_gc_sweep_pending(void);
+/** Make the next GC sweep the whole heap at once. Called when lbm_memory
+ *  runs out, as arrays are freed when their heap cell is swept. With
+ *  LBM_GC_GENERATIONAL the next GC is a full collection.
+ */
+void lbm_gc_request_full_sweep(void);
+/** Set the number of heap cells swept by each call to lbm_gc_sweep_step.
+ *
+ * \param n Number of cells.
+ */
+void lbm_gc_set_sweep_chunk(lbm_uint n);
 
 // Array functionality
 /** Allocate an bytearray in symbols and arrays memory (lispbm_memory.h)
@@ -1046,6 +1249,24 @@ static inline lbm_cons_t* lbm_ref_cell(lbm_value addr) {
   //return &lbm_heap_state.heap[lbm_dec_ptr(addr)];
 }
 
+/** Record a write of v into the heap cell c. With LBM_GC_GENERATIONAL, a
+ *  cell that has survived a collection and is made to point to another
+ *  heap cell is remembered so that the next minor collection traces it.
+ *  Must be called by code that writes into cells or lisp arrays it did
+ *  not just allocate. Does nothing in other configurations.
+ *
+ * \param c Value referring to the heap cell or lisp array written to.
+ * \param v Value that was written.
+ */
+#ifdef LBM_GC_GENERATIONAL
+void lbm_gc_write_barrier(lbm_value c, lbm_value v);
+#else
+static inline void lbm_gc_write_barrier(lbm_value c, lbm_value v) {
+  (void)c;
+  (void)v;
+}
+#endif
+
 /** Update the value stored in the car field of a heap cell.
  *
  * \param c Value referring to a heap cell.
@@ -1058,6 +1279,7 @@ static inline int lbm_set_car(lbm_value c, lbm_value v) {
   if (lbm_is_cons_rw(c)) {
     lbm_cons_t *cell = lbm_ref_cell(c);
     cell->car = v;
+    lbm_gc_write_barrier(c, v);
     r = 1;
   }
   return r;
@@ -1074,6 +1296,7 @@ static inline int lbm_set_cdr(lbm_value c, lbm_value v) {
   if (lbm_is_cons_rw(c)){
     lbm_cons_t *cell = lbm_ref_cell(c);
     cell->cdr = v;
+    lbm_gc_write_barrier(c, v);
     r = 1;
   }
   return r;
@@ -1092,6 +1315,8 @@ static inline int lbm_set_car_and_cdr(lbm_value c, lbm_value car_val, lbm_value
     lbm_cons_t *cell = lbm_ref_cell(c);
     cell->car = car_val;
     cell->cdr = cdr_val;
+    lbm_gc_write_barrier(c, car_val);
+    lbm_gc_write_barrier(c, cdr_val);
     r = 1;
   }
   return r;
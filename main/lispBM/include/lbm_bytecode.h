@@ -0,0 +1,170 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** \file lbm_bytecode.h
+ *  Compiler from closure bodies to the bytecode run by the evaluator.
+ *
+ *  (compile f) turns the closure f into
+ *
+ *    (closure params (bytecode CODE p1 ... pn) env)
+ *
+ *  where CODE is a code object, a lisp array:
+ *
+ *    [bytes, env, source, checked, const0, const1, ...]
+ *
+ *  bytes is a byte array that starts with a header of the number of
+ *  parameters (u8) and the number of stack slots used by a call (u16)
+ *  followed by the instructions. Operands of 16 bits are stored
+ *  high byte first. source is (params . body) of the closure that was
+ *  compiled.
+ *
+ *  A call of a compiled closure from the evaluator goes through the
+ *  bytecode apply-fun with the parameters as arguments. Calls between
+ *  compiled closures stay in the VM. The VM keeps one frame per call
+ *  on the context stack:
+ *
+ *    [code | arg0 ... argN-1 | return pc, return fp | locals and operands]
+ *
+ *  Slots are numbered from arg0, the frame pointer.
+ *
+ *  Functions that are called by name are looked up when they are
+ *  called, and a name that was not a macro when the code was compiled
+ *  may be bound to one later. checked holds the value of
+ *  lbm_env_macro_bindings when the names were last found not to be
+ *  macros, or nil if one of them is. Code that calls a macro, or whose
+ *  frame does not fit on the stack, is not run. The source is
+ *  evaluated instead.
+ *
+ *  Building with LBM_LEXICAL_ADDRESSING compiles every closure that is
+ *  created in the global environment, such as the functions made by
+ *  defun, when it is created. Closures that cannot be compiled are
+ *  kept as they are.
+ */
+#ifndef LBM_BYTECODE_H_
+#define LBM_BYTECODE_H_
+
+#include "lbm_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** Number of instructions the VM runs before it gives the scheduler a
+ *  chance to run another context.
+ */
+#ifndef LBM_BYTECODE_SLICE
+#define LBM_BYTECODE_SLICE 100
+#endif
+
+/** Max number of stack slots, parameters included, of one compiled
+ *  function. This bounds the stack use of the compiler.
+ */
+#ifndef LBM_BYTECODE_MAX_SLOTS
+#define LBM_BYTECODE_MAX_SLOTS 64
+#endif
+
+/** Max nesting depth of the expressions of a compiled function.
+ */
+#ifndef LBM_BYTECODE_MAX_NESTING
+#define LBM_BYTECODE_MAX_NESTING 32
+#endif
+
+/** @name Code object layout
+ * @{
+ */
+#define LBM_BC_CODE_BYTES   0
+#define LBM_BC_CODE_ENV     1
+#define LBM_BC_CODE_SOURCE  2
+#define LBM_BC_CODE_CHECKED 3
+#define LBM_BC_CODE_CONSTS  4
+
+#define LBM_BC_HDR_NARGS    0
+#define LBM_BC_HDR_SLOTS    1
+#define LBM_BC_ENTRY        3
+/** @} */
+
+/** Words between the last argument and the first local of a frame.
+ */
+#define LBM_BC_FRAME_HEADER 2
+
+/** @name Instructions
+ *  k16 is a constant index, s8 a slot, t16 a jump target and n8 an
+ *  argument count.
+ * @{
+ */
+#define LBM_BC_CONST      0  // k16   push constant
+#define LBM_BC_INT        1  // i16   push small integer
+#define LBM_BC_LOAD       2  // s8    push slot
+#define LBM_BC_FREE       3  // k16   push value of free variable
+#define LBM_BC_POP        4  //       drop top
+#define LBM_BC_SLIDE      5  // n8    drop n values under the top
+#define LBM_BC_JMP        6  // t16
+#define LBM_BC_JMP_NIL    7  // t16   pop, jump if nil
+#define LBM_BC_AND        8  // t16   jump if top is nil, else pop
+#define LBM_BC_OR         9  // t16   jump if top is not nil, else pop
+#define LBM_BC_FUN       10  // f8 n8 call fundamental
+#define LBM_BC_CALL      11  // n8    call the function under the arguments
+#define LBM_BC_TCALL     12  // n8    tail call
+#define LBM_BC_RET       13  //       return top
+#define LBM_BC_ADD       14  //       two argument fundamentals with
+#define LBM_BC_SUB       15  //       a fast path for fixnums
+#define LBM_BC_MUL       16
+#define LBM_BC_NUMEQ     17
+#define LBM_BC_LT        18
+#define LBM_BC_GT        19
+#define LBM_BC_LEQ       20
+#define LBM_BC_GEQ       21
+#define LBM_BC_HEAD      22  // k16   push value of free variable that is called
+/** @} */
+
+/** @name Compiler results
+ * @{
+ */
+#define LBM_BC_OK            0
+#define LBM_BC_MERROR       -1
+#define LBM_BC_UNSUPPORTED  -2
+#define LBM_BC_TOO_LARGE    -3
+/** @} */
+
+/** Compile the body of a closure into a code object. Supported forms
+ *  are quote, if, cond, progn, let, and, or and application of anything
+ *  but macros, rest-args and local-env-get. Variables that are not
+ *  parameters or let bound are looked up in env and the global
+ *  environment when they are used.
+ *
+ * \param params Parameter list of the closure.
+ * \param body Body of the closure.
+ * \param env Environment of the closure.
+ * \param res The code object is stored here. If the body cannot be
+ *            compiled the offending form is stored here instead.
+ * \return LBM_BC_OK on success, LBM_BC_MERROR if there was not enough
+ *         memory for the code object or one of the error codes above.
+ */
+int lbm_bc_compile(lbm_value params, lbm_value body, lbm_value env, lbm_value *res);
+
+/** Check if any of the functions that a code object calls by name is
+ *  bound to a macro in the environment of the code or the global
+ *  environment.
+ *
+ * \param data Data of the code object.
+ * \return True if a called name is bound to a macro.
+ */
+bool lbm_bc_calls_macro(lbm_value *data);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
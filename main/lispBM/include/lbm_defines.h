@@ -382,6 +382,8 @@
 #define SYM_REST_ARGS             0x30015
 #define SYM_ROTATE                0x30016
 #define SYM_APPLY                 0x30017
+#define SYM_COMPILE               0x30018
+#define SYM_BYTECODE              0x30019
 
 #define SYMBOL_KIND(X)          ((X) >> 16)
 #define SYMBOL_KIND_SPECIAL     0
@@ -531,6 +533,8 @@
 #define ENC_SYM_CALL_CC_UNSAFE        ENC_SYM(SYM_CALL_CC_UNSAFE)
 #define ENC_SYM_CONT_SP               ENC_SYM(SYM_CONT_SP)
 #define ENC_SYM_APPLY                 ENC_SYM(SYM_APPLY)
+#define ENC_SYM_COMPILE               ENC_SYM(SYM_COMPILE)
+#define ENC_SYM_BYTECODE              ENC_SYM(SYM_BYTECODE)
 
 #define ENC_SYM_ADD           ENC_SYM(SYM_ADD)
 #define ENC_SYM_SUB           ENC_SYM(SYM_SUB)
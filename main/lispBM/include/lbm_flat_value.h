@@ -51,9 +51,17 @@ typedef struct {
 #define S_REF             0x21
 
 
-// Maximum number of recursive calls
+// Maximum nesting depth of a flattened value
 #define FLATTEN_VALUE_MAXIMUM_DEPTH 2000
 
+/** Size in bytes of the buffer that flatten_value starts out with.
+ *  Values that fit are flattened in a single pass. Larger values are
+ *  sized when the buffer runs full and moved to a buffer of exact size.
+ */
+#ifndef FLATTEN_VALUE_INITIAL_BUFFER_SIZE
+#define FLATTEN_VALUE_INITIAL_BUFFER_SIZE 64
+#endif
+
 #define FLATTEN_VALUE_OK  0
 #define FLATTEN_VALUE_ERROR_CANNOT_BE_FLATTENED -1
 #define FLATTEN_VALUE_ERROR_BUFFER_TOO_SMALL    -2
@@ -120,6 +120,11 @@ extern "C" {
   // Bumping it up like this makes it a half a word too large in that case instead.
 #define LBM_MEMORY_BITMAP_SIZE(X) ((X+1)/2)
 #endif
+
+/** Free-extent index size in words for a memory of X words, see
+ *  lbm_memory_init_index. Gives chunks of at most 32 words.
+ */
+#define LBM_MEMORY_INDEX_SIZE(X) (4 * (((X) + 31) / 32))
 /** @} */
 
 /** @name Legacy Size Macros (deprecated)
@@ -168,6 +173,21 @@ extern "C" {
 bool lbm_memory_init(lbm_uint *data, lbm_uint data_size,
                      lbm_uint *bitmap, lbm_uint bitmap_size);
 
+/** Enable the free-extent index. With the index, allocation takes the
+ *  first free block that fits, found in logarithmic time, and
+ *  lbm_memory_longest_free does not have to scan the bitmap.
+ *  The index is built from the current bitmap, so it can be enabled
+ *  after lbm_init. It is disabled by lbm_memory_init.
+ *
+ * \param data Storage for the index.
+ * \param size Size of data in words. Memory is split into chunks of a
+ *        power of two words such that 2 words per chunk (rounded up to a
+ *        power of two chunks) fit in size. LBM_MEMORY_INDEX_SIZE gives a
+ *        size with chunks of at most 32 words.
+ * \return true on success and false if memory is not initialized or size is too small.
+ */
+bool lbm_memory_init_index(lbm_uint *data, lbm_uint size);
+
 /** Set the size of the memory reserve in words.
  * \param num_words Number of words to treat as reserve.
  */
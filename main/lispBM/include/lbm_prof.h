@@ -23,6 +23,12 @@
 
 #define LBM_PROF_MAX_NAME_SIZE 20
 
+/** Number of innermost closure calls kept in a sampled call stack.
+ */
+#ifndef LBM_PROF_MAX_STACK_DEPTH
+#define LBM_PROF_MAX_STACK_DEPTH 16
+#endif
+
 typedef struct {
   lbm_cid cid;
   bool has_name;
@@ -31,8 +37,48 @@ typedef struct {
   lbm_uint gc_count;
 } lbm_prof_t;
 
+/** A sampled call stack and the number of samples that hit it.
+ */
+typedef struct {
+  lbm_cid  cid;         // -1 for an unused entry
+  uint32_t hash;
+  uint16_t depth;
+  bool     gc;
+  bool     truncated;
+  lbm_uint count;
+  lbm_value frames[LBM_PROF_MAX_STACK_DEPTH]; // Closure bodies outermost first, then the running extension if any
+} lbm_prof_stack_t;
+
 bool lbm_prof_init(lbm_prof_t *prof_data_buf,
                    lbm_uint    prof_data_buf_num);
+/** Start sampling call stacks in addition to the per context samples.
+ *  Samples are aggregated in a hash table of distinct stacks. This
+ *  turns on call stack tracking in the evaluator.
+ *
+ * \param stack_buf Storage for the hash table.
+ * \param stack_buf_num Number of entries in stack_buf.
+ * \return true on success.
+ */
+bool lbm_prof_stacks_init(lbm_prof_stack_t *stack_buf,
+                          lbm_uint          stack_buf_num);
+/** Stop sampling call stacks and turn off call stack tracking in the
+ *  evaluator. The collected stacks are kept.
+ */
+void lbm_prof_stacks_stop(void);
+/** Number of stack samples that did not fit in the hash table.
+ */
+lbm_uint lbm_prof_get_num_dropped_stack_samples(void);
+/** Print one sampled call stack in the collapsed format read by
+ *  flamegraph tools, "context;f;g;ext count". Closures are named by the
+ *  global bindings they are stored in, so this should be called with the
+ *  evaluator paused.
+ *
+ * \param ix Index of the entry in the stack table.
+ * \param buf Buffer to print to.
+ * \param buf_size Size of buf.
+ * \return Number of characters printed, 0 if the entry is unused.
+ */
+int lbm_prof_stack_collapsed(lbm_uint ix, char *buf, lbm_uint buf_size);
 lbm_uint lbm_prof_get_num_samples(void);
 lbm_uint lbm_prof_get_num_system_samples(void);
 lbm_uint lbm_prof_get_num_sleep_samples(void);
@@ -55,6 +55,16 @@ lbm_uint lbm_symrepr_get_next_id(void);
  */
 void lbm_symrepr_set_next_id(lbm_uint id);
 
+/** Mark the symbol index as out of date. It is rebuilt on the next lookup.
+ *  Called when the symlist or the extension table is replaced.
+ */
+void lbm_symrepr_invalidate_index(void);
+
+/** Add a newly registered extension to the symbol index.
+ * \param ext_ix Index of the extension in the extension table.
+ */
+void lbm_symrepr_index_add_extension(lbm_uint ext_ix);
+
 /* /\** Store a symbol name on the constant heap (flash). */
 /*  * \param name Symbol name. */
 /*  * \param res Pointer where result address in flash is returned. */
@@ -274,9 +274,11 @@ static uint32_t *image_storage = NULL;
 #define EXTENSION_STORAGE_SIZE 4096
 #define STR_SIZE 1024
 #define PROF_DATA_NUM 100
+#define PROF_STACK_NUM 256
 
 lbm_extension_t extensions[EXTENSION_STORAGE_SIZE];
 lbm_prof_t prof_data[100];
+static lbm_prof_stack_t prof_stacks[PROF_STACK_NUM];
 
 static char *env_input_file = NULL;
 static char *env_output_file = NULL;
@@ -951,15 +953,8 @@ bool load_flat_library(unsigned char *lib, unsigned int size) {
 
     pos += val_size;
 
-    lbm_uint ix_key  = sym_id & GLOBAL_ENV_MASK;
-    lbm_value *global_env = lbm_get_global_env();
-    lbm_uint orig_env = global_env[ix_key];
-    lbm_value new_env;
-
     // All of this should just succeed with no GC needed.
-    new_env = lbm_env_set(orig_env,sym,val);
-
-    global_env[ix_key] = new_env;
+    lbm_global_env_set(sym, val);
   }
   return true;
 }
@@ -1574,6 +1569,7 @@ static bool restart_core(void (*done_cb)(eval_context_t *),
   if (prof_running) {
     prof_running = false;
     lbm_thread_destroy(&prof_thread);
+    lbm_prof_stacks_stop();
   }
 
   if (lispbm_thd_running) {
@@ -1942,6 +1938,10 @@ void repl_process_cmd(unsigned char *data, unsigned int len,
         commands_printf_lisp(
                              ":prof report\n"
                              "  Print profiler report");
+        commands_printf_lisp(
+                             ":prof flame [file]\n"
+                             "  Print the sampled call stacks in the collapsed format of\n"
+                             "  flamegraph tools, or write them to file");
         commands_printf_lisp(
                              ":env\n"
                              "  Print current environment and variables");
@@ -2005,6 +2005,7 @@ void repl_process_cmd(unsigned char *data, unsigned int len,
           lbm_thread_destroy(&prof_thread);
         }
         lbm_prof_init(prof_data, PROF_DATA_NUM);
+        lbm_prof_stacks_init(prof_stacks, PROF_STACK_NUM);
         prof_running = true;
         if (!lbm_thread_create(&prof_thread, "prof", prof_thd, NULL, LBM_THREAD_PRIO_LOW, 0)) {
           prof_running = false;
@@ -2018,7 +2019,42 @@ void repl_process_cmd(unsigned char *data, unsigned int len,
           prof_running = false;
           lbm_thread_destroy(&prof_thread);
         }
+        lbm_prof_stacks_stop();
         commands_printf_lisp("Profiler stopped. Issue command ':prof report' for statistics\n");
+      } else if (strncmp(str, ":prof flame", 11) == 0) {
+        char file_name[256] = {0};
+        sscanf(str + 11, " %255s", file_name);
+        FILE *fp = NULL;
+        if (file_name[0]) {
+          fp = fopen(file_name, "w");
+        }
+        if (file_name[0] && !fp) {
+          commands_printf_lisp("Could not open %s\n", file_name);
+        } else {
+          lbm_pause_eval();
+          while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+            lbm_pause_eval();
+            sleep_callback(1);
+          }
+          char line[512];
+          for (lbm_uint i = 0; i < PROF_STACK_NUM; i ++) {
+            if (lbm_prof_stack_collapsed(i, line, sizeof(line)) == 0) continue;
+            if (fp) {
+              fprintf(fp, "%s\n", line);
+            } else {
+              commands_printf_lisp("%s", line);
+            }
+          }
+          lbm_continue_eval();
+          if (fp) {
+            fclose(fp);
+            commands_printf_lisp("Wrote %s\n", file_name);
+          }
+          if (lbm_prof_get_num_dropped_stack_samples() > 0) {
+            commands_printf_lisp("%u samples did not fit in the stack table\n",
+                                 (unsigned int)lbm_prof_get_num_dropped_stack_samples());
+          }
+        }
       } else if (strncmp(str, ":prof report", 12) == 0) {
         lbm_uint num_sleep = lbm_prof_get_num_sleep_samples();
         lbm_uint num_system = lbm_prof_get_num_system_samples();
@@ -2685,6 +2721,7 @@ static void repl_loop(void *arg) {
       } else if (strncmp(str, ":prof start", 11) == 0) {
         lbm_prof_init(prof_data,
                       PROF_DATA_NUM);
+        lbm_prof_stacks_init(prof_stacks, PROF_STACK_NUM);
         lbm_thread_t thd; // just forget this id.
         prof_running = true;
         if (!lbm_thread_create(&thd, "prof", prof_thd, NULL, LBM_THREAD_PRIO_LOW, 0)) {
@@ -2694,7 +2731,37 @@ static void repl_loop(void *arg) {
         printf("Profiler started\n");
       } else if (strncmp(str, ":prof stop", 10) == 0) {
         prof_running = false;
+        lbm_prof_stacks_stop();
         printf("Profiler stopped. Issue command ':prof report' for statistics\n.");
+      } else if (strncmp(str, ":prof flame", 11) == 0) {
+        char file_name[256] = {0};
+        sscanf(&str[11], " %255s", file_name);
+        FILE *fp = stdout;
+        if (file_name[0]) {
+          fp = fopen(file_name, "w");
+          if (!fp) {
+            printf("Could not open %s\n", file_name);
+            goto repl_next_iteration;
+          }
+        }
+        lbm_pause_eval();
+        while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+          sleep_callback(10);
+        }
+        char line[512];
+        for (lbm_uint i = 0; i < PROF_STACK_NUM; i ++) {
+          if (lbm_prof_stack_collapsed(i, line, sizeof(line)) == 0) continue;
+          fprintf(fp, "%s\n", line);
+        }
+        lbm_continue_eval();
+        if (fp != stdout) {
+          fclose(fp);
+          printf("Wrote %s\n", file_name);
+        }
+        if (lbm_prof_get_num_dropped_stack_samples() > 0) {
+          printf("%"PRI_UINT" samples did not fit in the stack table\n",
+                 lbm_prof_get_num_dropped_stack_samples());
+        }
       } else if (strncmp(str, ":prof report", 12) == 0) {
         lbm_uint num_sleep = lbm_prof_get_num_sleep_samples();
         lbm_uint num_system = lbm_prof_get_num_system_samples();
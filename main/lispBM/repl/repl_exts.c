@@ -1747,12 +1747,7 @@ static bool do_define(const char *symbol, lbm_value value) {
       !lbm_add_symbol_const_base(symbol, &sym_id, false)) {
     return false;
   }
-  lbm_uint ix_key = sym_id & GLOBAL_ENV_MASK;
-  lbm_value *glob_env = lbm_get_global_env();
-  lbm_value new_env = lbm_env_set(glob_env[ix_key], lbm_enc_sym(sym_id), value);
-  if (lbm_is_symbol(new_env)) return false;
-  glob_env[ix_key] = new_env;
-  return true;
+  return lbm_global_env_set(lbm_enc_sym(sym_id), value) == ENC_SYM_TRUE;
 }
 
 // (import filename sym)
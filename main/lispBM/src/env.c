@@ -24,18 +24,54 @@
 #include "env.h"
 #include "lbm_memory.h"
 
-static lbm_value env_global[GLOBAL_ENV_ROOTS];
+// The global environment starts out in env_global_init and is moved
+// to lbm_memory when it grows.
+static lbm_value env_global_init[GLOBAL_ENV_INIT_ROOTS];
+static lbm_value *env_global = env_global_init;
+static lbm_uint env_global_mask = GLOBAL_ENV_INIT_ROOTS - 1;
+// Bindings added through lbm_global_env_set since the last count.
+// Used to decide when to check if the table should grow.
+static lbm_uint env_global_count = 0;
+
+#if GLOBAL_ENV_CACHE_SIZE > 0
+// Binding cells, (key . value), of recently looked up globals indexed
+// by symbol. Define and setq update the binding cell in place, so only
+// removing a binding has to clear its entry. Cells on the heap are
+// never moved by GC.
+static lbm_value env_cache[GLOBAL_ENV_CACHE_SIZE];
+#endif
+static lbm_uint env_cache_hits = 0;
+static lbm_uint env_cache_misses = 0;
+// Number of times a macro has been bound by lbm_global_env_set or
+// lbm_env_modify_binding. Never reset, so a change always means that
+// a macro may have been bound since it was last read.
+static lbm_uint env_macro_bindings = 0;
+
+void lbm_global_env_flush_cache(void) {
+#if GLOBAL_ENV_CACHE_SIZE > 0
+  for (int i = 0; i < GLOBAL_ENV_CACHE_SIZE; i ++) {
+    env_cache[i] = ENC_SYM_NIL;
+  }
+#endif
+}
 
 bool lbm_init_env(void) {
-  for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+  // lbm_memory has been reinitialized, so a grown table is gone.
+  env_global = env_global_init;
+  env_global_mask = GLOBAL_ENV_INIT_ROOTS - 1;
+  env_global_count = 0;
+  for (int i = 0; i < GLOBAL_ENV_INIT_ROOTS; i ++) {
     env_global[i] = ENC_SYM_NIL;
   }
+  lbm_global_env_flush_cache();
+  env_cache_hits = 0;
+  env_cache_misses = 0;
   return true;
 }
 
 lbm_uint lbm_get_global_env_size(void) {
   lbm_uint n = 0;
-  for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+  for (lbm_uint i = 0; i <= env_global_mask; i ++) {
     lbm_value curr = env_global[i];
     while (lbm_is_cons(curr)) {
       n++;
@@ -45,10 +81,83 @@ lbm_uint lbm_get_global_env_size(void) {
   return n;
 }
 
+lbm_uint lbm_get_global_env_roots(void) {
+  return env_global_mask + 1;
+}
+
+void lbm_get_global_env_stats(lbm_global_env_stats_t *stats) {
+  stats->roots = env_global_mask + 1;
+  stats->used_roots = 0;
+  stats->bindings = 0;
+  stats->max_chain = 0;
+  for (lbm_uint i = 0; i <= env_global_mask; i ++) {
+    lbm_uint n = 0;
+    lbm_value curr = env_global[i];
+    while (lbm_is_cons(curr)) {
+      n++;
+      curr = lbm_ref_cell(curr)->cdr;
+    }
+    if (n > 0) stats->used_roots ++;
+    if (n > stats->max_chain) stats->max_chain = n;
+    stats->bindings += n;
+  }
+  stats->cache_hits = env_cache_hits;
+  stats->cache_misses = env_cache_misses;
+}
+
 lbm_value *lbm_get_global_env(void) {
   return env_global;
 }
 
+lbm_uint lbm_env_macro_bindings(void) {
+  return env_macro_bindings;
+}
+
+// Double the number of roots until the load is below GLOBAL_ENV_MAX_LOAD.
+// The cells of the chains are relinked into the new table, so no heap
+// cells are allocated. If lbm_memory is full the table stays as it is.
+static void global_env_grow(lbm_uint bindings) {
+  lbm_uint roots = env_global_mask + 1;
+  while (bindings > roots * GLOBAL_ENV_MAX_LOAD && roots < GLOBAL_ENV_MAX_ROOTS) {
+    roots *= 2;
+  }
+  if (roots == env_global_mask + 1) return;
+
+  // Relinking writes to the chains, they have to be in RAM.
+  for (lbm_uint i = 0; i <= env_global_mask; i ++) {
+    lbm_value curr = env_global[i];
+    while (lbm_is_cons(curr)) {
+      if (!lbm_is_cons_rw(curr) || !lbm_is_cons(lbm_ref_cell(curr)->car)) return;
+      curr = lbm_ref_cell(curr)->cdr;
+    }
+  }
+
+  lbm_value *new_env = (lbm_value*)lbm_malloc(roots * sizeof(lbm_value));
+  if (!new_env) return;
+  for (lbm_uint i = 0; i < roots; i ++) {
+    new_env[i] = ENC_SYM_NIL;
+  }
+
+  lbm_uint new_mask = roots - 1;
+  for (lbm_uint i = 0; i <= env_global_mask; i ++) {
+    lbm_value curr = env_global[i];
+    while (lbm_is_cons(curr)) {
+      lbm_cons_t *cell = &lbm_heaps[LBM_RAM_HEAP][lbm_dec_ptr(curr)];
+      lbm_value next = cell->cdr;
+      lbm_uint ix = lbm_dec_sym(lbm_ref_cell(cell->car)->car) & new_mask;
+      cell->cdr = new_env[ix];
+      lbm_gc_write_barrier(curr, new_env[ix]);
+      new_env[ix] = curr;
+      curr = next;
+    }
+  }
+
+  if (env_global != env_global_init) {
+    lbm_free(env_global);
+  }
+  env_global = new_env;
+  env_global_mask = new_mask;
+}
 // Copy the list structure of an environment.
 lbm_value lbm_env_copy_spine(lbm_value env) {
 
@@ -99,7 +208,20 @@ bool lbm_env_lookup_b(lbm_value *res, lbm_value sym, lbm_value env) {
 // Assumes that global environment structures are never constant.
 bool lbm_global_env_lookup(lbm_value *res, lbm_value sym) {
   lbm_uint dec_sym = lbm_dec_sym(sym);
-  lbm_uint ix = dec_sym & GLOBAL_ENV_MASK;
+#if GLOBAL_ENV_CACHE_SIZE > 0
+  lbm_uint cache_ix = dec_sym & (GLOBAL_ENV_CACHE_SIZE - 1);
+  lbm_value b = env_cache[cache_ix];
+  if (b) {
+    lbm_cons_t *b_cell = &lbm_heaps[LBM_RAM_HEAP][lbm_dec_ptr(b)];
+    if (b_cell->car == sym) {
+      env_cache_hits ++;
+      *res = b_cell->cdr;
+      return true;
+    }
+  }
+  env_cache_misses ++;
+#endif
+  lbm_uint ix = dec_sym & env_global_mask;
   lbm_value curr = env_global[ix];
 
   while (curr) { // Uses the fact that nil is 0 and the assumption
@@ -110,6 +232,9 @@ bool lbm_global_env_lookup(lbm_value *res, lbm_value sym) {
     lbm_uint c_ix = lbm_dec_ptr(c); // Assumes environment is correctly shaped.
     lbm_cons_t *c_cell = &lbm_heaps[LBM_RAM_HEAP][c_ix];
     if (c_cell->car == sym) {
+#if GLOBAL_ENV_CACHE_SIZE > 0
+      env_cache[cache_ix] = c;
+#endif
       *res = c_cell->cdr;
       return true;
     }
@@ -134,6 +259,7 @@ lbm_value lbm_env_set(lbm_value env, lbm_value key, lbm_value val) {
       lbm_cons_t *car_cell = &lbm_heaps[LBM_RAM_HEAP][lbm_dec_ptr(car_val)];
       if (car_cell->car == key) {
         car_cell->cdr = val;
+        lbm_gc_write_barrier(car_val, val);
         return env;
       }
     } // Possibly add a else here to handle corrupt environment.
@@ -149,10 +275,63 @@ lbm_value lbm_env_set(lbm_value env, lbm_value key, lbm_value val) {
   return new_env;
 }
 
+lbm_value lbm_global_env_set(lbm_value key, lbm_value val) {
+  lbm_uint ix = lbm_dec_sym(key) & env_global_mask;
+  lbm_value curr = env_global[ix];
+
+  if (lbm_is_macro(val)) env_macro_bindings ++;
+
+  while (lbm_is_cons_rw(curr)) {
+    lbm_cons_t *cell = &lbm_heaps[LBM_RAM_HEAP][lbm_dec_ptr(curr)];
+    if (lbm_is_cons_rw(cell->car)) {
+      lbm_cons_t *car_cell = &lbm_heaps[LBM_RAM_HEAP][lbm_dec_ptr(cell->car)];
+      if (car_cell->car == key) {
+        car_cell->cdr = val;
+        lbm_gc_write_barrier(cell->car, val);
+        return ENC_SYM_TRUE;
+      }
+    }
+    curr = cell->cdr;
+  }
+
+  lbm_value keyval = lbm_cons(key, val);
+  if (lbm_is_symbol(keyval)) return keyval;
+  lbm_value new_env = lbm_cons(keyval, env_global[ix]);
+  if (lbm_is_symbol(new_env)) return new_env;
+  env_global[ix] = new_env;
+
+  // The count misses bindings added by other means and does not
+  // go down when bindings are dropped, so count them all before growing.
+  env_global_count ++;
+  lbm_uint roots = env_global_mask + 1;
+  if (env_global_count > roots * GLOBAL_ENV_MAX_LOAD && roots < GLOBAL_ENV_MAX_ROOTS) {
+    env_global_count = lbm_get_global_env_size();
+    global_env_grow(env_global_count);
+    if (roots == env_global_mask + 1) {
+      // Did not grow, do not count again until as many more are added.
+      env_global_count = 0;
+    }
+  }
+  return ENC_SYM_TRUE;
+}
+
+lbm_value lbm_global_env_drop(lbm_value key) {
+  lbm_uint ix = lbm_dec_sym(key) & env_global_mask;
+  lbm_value res = lbm_env_drop_binding(env_global[ix], key);
+  if (res == ENC_SYM_NOT_FOUND) return res;
+  env_global[ix] = res;
+#if GLOBAL_ENV_CACHE_SIZE > 0
+  env_cache[lbm_dec_sym(key) & (GLOBAL_ENV_CACHE_SIZE - 1)] = ENC_SYM_NIL;
+#endif
+  return ENC_SYM_TRUE;
+}
+
 lbm_value lbm_env_modify_binding(lbm_value env, lbm_value key, lbm_value val) {
 
   lbm_value curr = env;
 
+  if (lbm_is_macro(val)) env_macro_bindings ++;
+
   while (lbm_is_cons_rw(curr)) {
     lbm_cons_t *curr_cell = &lbm_heaps[LBM_RAM_HEAP][lbm_dec_ptr(curr)];
     lbm_value car_val = curr_cell->car;
@@ -160,6 +339,7 @@ lbm_value lbm_env_modify_binding(lbm_value env, lbm_value key, lbm_value val) {
       lbm_cons_t *car_cell = &lbm_heaps[LBM_RAM_HEAP][lbm_dec_ptr(car_val)];
       if (car_cell->car == key) {
         car_cell->cdr = val;
+        lbm_gc_write_barrier(car_val, val);
         return env;
       }
     } // Else environment is invalid.
@@ -186,6 +366,7 @@ lbm_value lbm_env_drop_binding(lbm_value env, lbm_value key) {
     }
 
     lbm_cons_t *prev = cell;
+    lbm_value prev_val = env;
     lbm_value curr = cell->cdr;
 
     while (lbm_is_cons_rw(curr)) {
@@ -194,10 +375,12 @@ lbm_value lbm_env_drop_binding(lbm_value env, lbm_value key) {
         lbm_cons_t *car_cell = &lbm_heaps[LBM_RAM_HEAP][lbm_dec_ptr(cell->car)];
         if (car_cell->car == key) {
           prev->cdr = cell->cdr; // removes "cell" from list
+          lbm_gc_write_barrier(prev_val, cell->cdr);
           return env;
         }
       } // the unhandled else here would be an invalid environment.
       prev = cell;
+      prev_val = curr;
       curr = cell->cdr;
     }
   }
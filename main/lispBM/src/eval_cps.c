@@ -81,6 +81,7 @@
 #include "platform_mutex.h"
 #include "platform_timestamp.h"
 #include "lbm_flat_value.h"
+#include "lbm_bytecode.h"
 
 #include <setjmp.h>
 #include <stdarg.h>
@@ -164,12 +165,49 @@ static jmp_buf critical_error_jmp_buf;
 #define READ_APPEND_ARRAY          CONTINUATION(50)
 #define LOOP_ENV_PREP              CONTINUATION(51)
 #define READ_NEXT_TOKEN_GRAB_ROW   CONTINUATION(52)
-#define NUM_CONTINUATIONS          53
+#define BC_RUN                     CONTINUATION(53)
+#define BC_RETURN                  CONTINUATION(54)
+#define MACRO_MEMO                 CONTINUATION(55)
+#define PROF_FRAME                 CONTINUATION(56)
+#define NUM_CONTINUATIONS          57
 
 #define FM_NEED_GC       -1
 #define FM_NO_MATCH      -2
 #define FM_PATTERN_ERROR -3
 
+// Mailboxes are circular buffers. The mail_used slots from mail_head
+// hold the messages, oldest first. A message removed from the middle
+// leaves MAIL_NONE behind. These slots are dropped when they reach
+// either end of the buffer or when the buffer is compacted to make
+// room for new mail.
+//
+// MAIL_NONE is a continuation, which is never a lisp value, so no
+// message looks like it. It also stands for "no tag" in the index.
+#define MAIL_NONE LBM_CONTINUATION_INTERNAL
+
+#ifdef LBM_MAILBOX_INDEX
+// Max number of recv patterns that are looked up in the index.
+#define MAIL_INDEX_MAX_PATTERNS 8
+#define MAILBOX_WORDS(n) (2 * (n))
+#define MAIL_TAGS(ctx) ((ctx)->mailbox + (ctx)->mailbox_size)
+#else
+#define MAILBOX_WORDS(n) (n)
+#endif
+
+static inline uint32_t mail_slot(eval_context_t *ctx, uint32_t n) {
+  uint32_t s = ctx->mail_head + n;
+  return s >= ctx->mailbox_size ? s - ctx->mailbox_size : s;
+}
+
+#ifdef LBM_MAILBOX_INDEX
+static lbm_value mail_tag(lbm_value m) {
+  if (lbm_is_cons(m)) {
+    m = lbm_ref_cell(m)->car;
+  }
+  return lbm_is_symbol(m) ? m : MAIL_NONE;
+}
+#endif
+
 typedef enum {
   BL_OK = 0,
   BL_NO_MEMORY,
@@ -197,6 +235,24 @@ lbm_value symbol_y = ENC_SYM_NIL;
 static lbm_value clean_cl_env_symbol = ENC_SYM_NIL;
 #endif
 
+// ////////////////////////////////////////////////////////////
+// Macro expansion cache
+//
+// Direct mapped on the argument list cell of the call site. The
+// entries are GC roots, so a cached call site cannot be freed and
+// its cell reused for a different form while the entry is live.
+#if LBM_MACRO_CACHE_SIZE > 0
+typedef struct {
+  lbm_value site;       // Argument list of the macro call.
+  lbm_value macro;      // The macro that was applied.
+  lbm_value expansion;
+} macro_cache_entry_t;
+
+static macro_cache_entry_t macro_cache[LBM_MACRO_CACHE_SIZE];
+static lbm_value symbol_memo = ENC_SYM_NIL;
+#endif
+static lbm_macro_cache_stats_t macro_cache_stats;
+
 // ////////////////////////////////////////////////////////////
 // Error strings
 const char* lbm_error_str_parse_eof = "End of parse stream.";
@@ -225,6 +281,11 @@ static bool lbm_error_has_suspect = false;
 // Prototypes for locally used functions (static)
 static uint32_t lbm_mailbox_free_space_for_cid(lbm_cid cid);
 static void apply_apply(lbm_value *args, lbm_uint nargs, eval_context_t *ctx);
+static void apply_compile(lbm_value *args, lbm_uint nargs, eval_context_t *ctx);
+static void apply_bytecode(lbm_value *args, lbm_uint nargs, eval_context_t *ctx);
+#ifdef LBM_LEXICAL_ADDRESSING
+static void lexical_address(eval_context_t *ctx);
+#endif
 static int gc(void);
 #ifdef LBM_USE_ERROR_LINENO
 static noreturn void error_ctx(lbm_value, int line_no);
@@ -319,7 +380,14 @@ typedef struct {
 } eval_context_queue_t;
 
 static eval_context_queue_t blocked  = {NULL, NULL};
-static eval_context_queue_t queue    = {NULL, NULL};
+// Ready contexts, one queue per priority level.
+static eval_context_queue_t queue[LBM_PRIO_LEVELS];
+// Root of the timer heap, the blocked context that is due first.
+static eval_context_t *timers = NULL;
+
+static lbm_sched_stats_t sched_stats;
+static lbm_uint sched_wake_hist[LBM_SCHED_WAKE_HIST_BINS];
+static eval_context_t *sched_last_ctx = NULL;
 
 lbm_mutex_t qmutex;
 bool    qmutex_initialized = false;
@@ -330,6 +398,10 @@ static void enqueue_ctx(eval_context_queue_t *q, eval_context_t *ctx);
 eval_context_t *ctx_running = NULL;
 volatile bool  lbm_system_sleeping = false;
 
+// Call stack tracking for the profiler.
+static volatile bool call_stack_tracking = false;
+static volatile lbm_value running_extension = ENC_SYM_NIL;
+
 static volatile bool gc_requested = false;
 void lbm_request_gc(void) {
   gc_requested = true;
@@ -356,17 +428,37 @@ void lbm_request_gc(void) {
 #define EVAL_STEPS_QUOTA   10
 
 #ifdef LBM_USE_TIME_QUOTA
-static volatile uint32_t eval_time_refill = EVAL_TIME_QUOTA;
+// Quota per priority level, zero means the default quota.
+static volatile uint32_t eval_time_refill[LBM_PRIO_LEVELS];
 static uint32_t eval_time_quota = EVAL_TIME_QUOTA;
 static uint32_t eval_current_quota = 0;
 void lbm_set_eval_time_quota(uint32_t quota) {
-  eval_time_refill = quota;
+  for (int i = 0; i < LBM_PRIO_LEVELS; i ++) {
+    eval_time_refill[i] = quota;
+  }
+}
+void lbm_set_eval_time_quota_prio(uint32_t prio, uint32_t quota) {
+  if (prio < LBM_PRIO_LEVELS) eval_time_refill[prio] = quota;
+}
+static uint32_t time_refill(void) {
+  uint32_t q = eval_time_refill[ctx_running ? ctx_running->priority : 0];
+  return q ? q : EVAL_TIME_QUOTA;
 }
 #else
-static volatile uint32_t eval_steps_refill = EVAL_STEPS_QUOTA;
+// Quota per priority level, zero means the default quota.
+static volatile uint32_t eval_steps_refill[LBM_PRIO_LEVELS];
 static uint32_t eval_steps_quota = EVAL_STEPS_QUOTA;
 void lbm_set_eval_step_quota(uint32_t quota) {
-  eval_steps_refill = quota;
+  for (int i = 0; i < LBM_PRIO_LEVELS; i ++) {
+    eval_steps_refill[i] = quota;
+  }
+}
+void lbm_set_eval_step_quota_prio(uint32_t prio, uint32_t quota) {
+  if (prio < LBM_PRIO_LEVELS) eval_steps_refill[prio] = quota;
+}
+static uint32_t steps_refill(void) {
+  uint32_t q = eval_steps_refill[ctx_running ? ctx_running->priority : 0];
+  return q ? q : EVAL_STEPS_QUOTA;
 }
 #endif
 
@@ -394,6 +486,10 @@ sizeopt static void ctx_done_nonsense(eval_context_t *ctx) {
   (void) ctx;
 }
 
+static uint32_t timestamp_default(void) {
+  return lbm_timestamp();
+}
+
 sizeopt static void critical_nonsense(void) {
   return;
 }
@@ -403,6 +499,7 @@ static void (*usleep_callback)(uint32_t) = usleep_nonsense;
 static void (*ctx_done_callback)(eval_context_t *) = ctx_done_nonsense;
 int (*lbm_printf_callback)(const char *, ...) = printf_nonsense;
 static bool (*dynamic_load_callback)(const char *, const char **) = dynamic_load_nonsense;
+static uint32_t (*timestamp_us_callback)(void) = timestamp_default;
 
 sizeopt void lbm_set_critical_error_callback(void (*fptr)(void)) {
   if (fptr == NULL) critical_error_callback = critical_nonsense;
@@ -414,6 +511,11 @@ sizeopt void lbm_set_usleep_callback(void (*fptr)(uint32_t)) {
   else usleep_callback = fptr;
 }
 
+sizeopt void lbm_set_timestamp_us_callback(uint32_t (*fptr)(void)) {
+  if (fptr == NULL) timestamp_us_callback = timestamp_default;
+  else timestamp_us_callback = fptr;
+}
+
 sizeopt void lbm_set_ctx_done_callback(void (*fptr)(eval_context_t *)) {
   if (fptr == NULL) ctx_done_callback = ctx_done_nonsense;
   else ctx_done_callback = fptr;
@@ -429,6 +531,11 @@ sizeopt void lbm_set_dynamic_load_callback(bool (*fptr)(const char *, const char
   else  dynamic_load_callback = fptr;
 }
 
+bool lbm_dynamic_load_exists(const char *name) {
+  const char *code_str = NULL;
+  return dynamic_load_callback(name, &code_str);
+}
+
 static volatile lbm_event_t *lbm_events = NULL;
 static unsigned int lbm_events_head = 0;
 static unsigned int lbm_events_tail = 0;
@@ -573,10 +680,17 @@ eval_context_t *lbm_get_current_context(void) {
 void lbm_surrender_quota(void) {
   // dummy;
 }
+// End the quota of the running context at the next step.
+static void preempt_running(void) {
+  eval_current_quota = lbm_timestamp();
+}
 #else
 void lbm_surrender_quota(void) {
   eval_steps_quota = 0;
 }
+static void preempt_running(void) {
+  eval_steps_quota = 0;
+}
 #endif
 
 /****************************************************/
@@ -593,11 +707,11 @@ static lbm_value cons_with_gc(lbm_value head, lbm_value tail, lbm_value remember
   lbm_gc_mark_roots(always_gc_roots,3);
   gc();
 #endif
-  if (!lbm_heap_num_free()) {
+  if (!lbm_heap_has_free(1)) {
     lbm_value roots[3] = {head, tail, remember};
     lbm_gc_mark_roots(roots,3);
     gc();
-    if (!lbm_heap_num_free()) {
+    if (!lbm_heap_has_free(1)) {
       ERROR_CTX(ENC_SYM_MERROR);
     }
   }
@@ -759,16 +873,16 @@ static lbm_value allocate_binding(lbm_value key, lbm_value val, lbm_value the_cd
   lbm_gc_mark_phase(val);
   lbm_gc_mark_phase(the_cdr);
   gc();
-  if (lbm_heap_num_free() < 2) {
+  if (!lbm_heap_has_free(2)) {
     ERROR_CTX(ENC_SYM_MERROR);
   }
 #else
-  if (lbm_heap_num_free() < 2) {
+  if (!lbm_heap_has_free(2)) {
     lbm_gc_mark_phase(key);
     lbm_gc_mark_phase(val);
     lbm_gc_mark_phase(the_cdr);
     gc();
-    if (lbm_heap_num_free() < 2) {
+    if (!lbm_heap_has_free(2)) {
       ERROR_CTX(ENC_SYM_MERROR);
     }
   }
@@ -959,8 +1073,10 @@ sizeopt static void print_error_message(lbm_value error,
     print_environments(buf, ERROR_MESSAGE_BUFFER_SIZE_BYTES);
 
     lbm_printf_callback("\n   Mailbox:\n");
-    for (unsigned int i = 0; i < ctx_running->num_mail; i ++) {
-      lbm_print_value(buf, ERROR_MESSAGE_BUFFER_SIZE_BYTES, ctx_running->mailbox[i]);
+    for (uint32_t i = 0; i < ctx_running->mail_used; i ++) {
+      lbm_value m = ctx_running->mailbox[mail_slot(ctx_running, i)];
+      if (m == MAIL_NONE) continue;
+      lbm_print_value(buf, ERROR_MESSAGE_BUFFER_SIZE_BYTES, m);
       lbm_printf_callback("     %s\n", buf);
     }
     lbm_printf_callback("\n   Stack:\n");
@@ -1004,6 +1120,177 @@ static bool create_string_channel(char *str, lbm_value *res, lbm_value dep) {
   return true;
 }
 
+/****************************************************/
+/* Timers                                           */
+
+// Blocked contexts that wait for the end of a sleep or timeout are also
+// kept in a pairing heap ordered on wake_time, so that the scheduler
+// only looks at the contexts that are due.
+//
+// Wake-up times are compared to each other with wrap around, which works
+// as long as they are less than 2^31 us apart. Longer timeouts are
+// waited for in steps of at most TIMER_MAX_STEP us.
+#define TIMER_MAX_STEP (1u << 30)
+
+static inline bool timer_before(eval_context_t *a, eval_context_t *b) {
+  return (int32_t)(a->wake_time - b->wake_time) < 0;
+}
+
+static inline bool timer_in_heap(eval_context_t *ctx) {
+  return ctx == timers || ctx->timer_prev != NULL;
+}
+
+// Meld two heaps. a and b must not have siblings.
+static eval_context_t *timer_meld(eval_context_t *a, eval_context_t *b) {
+  if (a == NULL) return b;
+  if (b == NULL) return a;
+  if (timer_before(b, a)) {
+    eval_context_t *t = a;
+    a = b;
+    b = t;
+  }
+  b->timer_prev = a;
+  b->timer_next = a->timer_child;
+  if (a->timer_child) a->timer_child->timer_prev = b;
+  a->timer_child = b;
+  return a;
+}
+
+// Meld a list of siblings into one heap. First left to right in pairs
+// and then the pairs right to left.
+static eval_context_t *timer_merge_pairs(eval_context_t *first) {
+  eval_context_t *pairs = NULL;
+  while (first) {
+    eval_context_t *a = first;
+    eval_context_t *b = a->timer_next;
+    first = b ? b->timer_next : NULL;
+    a->timer_next = NULL;
+    if (b) b->timer_next = NULL;
+    a = timer_meld(a, b);
+    a->timer_next = pairs;
+    pairs = a;
+  }
+  eval_context_t *root = NULL;
+  while (pairs) {
+    eval_context_t *next = pairs->timer_next;
+    pairs->timer_next = NULL;
+    root = timer_meld(root, pairs);
+    pairs = next;
+  }
+  if (root) root->timer_prev = NULL;
+  return root;
+}
+
+static void timer_insert_nm(eval_context_t *ctx, uint32_t t_now) {
+  uint32_t elapsed = t_now - (uint32_t)ctx->timestamp;
+  lbm_uint left = ctx->sleep_us > elapsed ? ctx->sleep_us - elapsed : 0;
+  ctx->wake_time = t_now + (uint32_t)(left < TIMER_MAX_STEP ? left : TIMER_MAX_STEP);
+  ctx->timer_prev = NULL;
+  ctx->timer_child = NULL;
+  ctx->timer_next = NULL;
+  timers = timer_meld(timers, ctx);
+  sched_stats.timers ++;
+}
+
+static void timer_remove_nm(eval_context_t *ctx) {
+  eval_context_t *sub = timer_merge_pairs(ctx->timer_child);
+  if (ctx == timers) {
+    timers = sub;
+  } else {
+    eval_context_t *p = ctx->timer_prev;
+    if (p->timer_child == ctx) {
+      p->timer_child = ctx->timer_next;
+    } else {
+      p->timer_next = ctx->timer_next;
+    }
+    if (ctx->timer_next) ctx->timer_next->timer_prev = p;
+    timers = timer_meld(timers, sub);
+  }
+  ctx->timer_prev = NULL;
+  ctx->timer_child = NULL;
+  ctx->timer_next = NULL;
+  sched_stats.timers --;
+}
+
+static void sched_new_wake_latency(lbm_uint late) {
+  sched_stats.wake_ups ++;
+  if (late > sched_stats.max_wake_latency) {
+    sched_stats.max_wake_latency = late;
+  }
+  // Bin 0 is up to 15us, each following bin doubles the limit.
+  lbm_uint bin = 0;
+  late >>= 4;
+  while (late && bin < LBM_SCHED_WAKE_HIST_BINS - 1) {
+    late >>= 1;
+    bin ++;
+  }
+  sched_wake_hist[bin] ++;
+}
+
+void lbm_get_sched_stats(lbm_sched_stats_t *stats) {
+  lbm_mutex_lock(&qmutex);
+  *stats = sched_stats;
+  lbm_mutex_unlock(&qmutex);
+}
+
+const lbm_uint *lbm_sched_wake_hist(void) {
+  return sched_wake_hist;
+}
+
+void lbm_macro_cache_clear(void) {
+#if LBM_MACRO_CACHE_SIZE > 0
+  for (int i = 0; i < LBM_MACRO_CACHE_SIZE; i ++) {
+    macro_cache[i].site = ENC_SYM_NIL;
+    macro_cache[i].macro = ENC_SYM_NIL;
+    macro_cache[i].expansion = ENC_SYM_NIL;
+  }
+#endif
+}
+
+void lbm_set_call_stack_tracking(bool on) {
+  call_stack_tracking = on;
+  if (!on) running_extension = ENC_SYM_NIL;
+}
+
+lbm_uint lbm_get_call_stack(eval_context_t *ctx, lbm_value *funs, lbm_uint max, bool *truncated) {
+  lbm_uint n = 0;
+  *truncated = false;
+  for (lbm_uint i = ctx->K.sp; i >= 2; i --) {
+    // The sampler may read a frame that is being written,
+    // bodies are always lists.
+    if (ctx->K.data[i - 1] == PROF_FRAME &&
+        lbm_is_cons(ctx->K.data[i - 2])) {
+      if (n == max) {
+        *truncated = true;
+        break;
+      }
+      funs[n++] = ctx->K.data[i - 2];
+      i --;
+    }
+  }
+  // Innermost first to outermost first.
+  for (lbm_uint i = 0; i < n / 2; i ++) {
+    lbm_value t = funs[i];
+    funs[i] = funs[n - 1 - i];
+    funs[n - 1 - i] = t;
+  }
+  return n;
+}
+
+lbm_value lbm_get_running_extension(void) {
+  return running_extension;
+}
+
+void lbm_get_macro_cache_stats(lbm_macro_cache_stats_t *stats) {
+  *stats = macro_cache_stats;
+  stats->entries = 0;
+#if LBM_MACRO_CACHE_SIZE > 0
+  for (int i = 0; i < LBM_MACRO_CACHE_SIZE; i ++) {
+    if (macro_cache[i].site != ENC_SYM_NIL) stats->entries ++;
+  }
+#endif
+}
+
 /****************************************************/
 /* Queue functions                                  */
 
@@ -1017,17 +1304,24 @@ static void queue_iterator_nm(eval_context_queue_t *q, ctx_fun f, void *arg1, vo
   }
 }
 
+// Highest priority first.
+static void ready_iterator_nm(ctx_fun f, void *arg1, void *arg2) {
+  for (int i = LBM_PRIO_LEVELS - 1; i >= 0; i --) {
+    queue_iterator_nm(&queue[i], f, arg1, arg2);
+  }
+}
+
 void lbm_all_ctxs_iterator(ctx_fun f, void *arg1, void *arg2) {
   lbm_mutex_lock(&qmutex);
   queue_iterator_nm(&blocked, f, arg1, arg2);
-  queue_iterator_nm(&queue, f, arg1, arg2);
+  ready_iterator_nm(f, arg1, arg2);
   if (ctx_running) f(ctx_running, arg1, arg2);
   lbm_mutex_unlock(&qmutex);
 }
 
 void lbm_running_iterator(ctx_fun f, void *arg1, void *arg2){
   lbm_mutex_lock(&qmutex);
-  queue_iterator_nm(&queue, f, arg1, arg2);
+  ready_iterator_nm(f, arg1, arg2);
   lbm_mutex_unlock(&qmutex);
 }
 
@@ -1038,6 +1332,9 @@ void lbm_blocked_iterator(ctx_fun f, void *arg1, void *arg2){
 }
 
 static void enqueue_ctx_nm(eval_context_queue_t *q, eval_context_t *ctx) {
+  if (q == &blocked && LBM_IS_STATE_WAKE_UP_WAKABLE(ctx->state)) {
+    timer_insert_nm(ctx, lbm_timestamp());
+  }
   if (q->last == NULL) {
     ctx->prev = NULL;
     ctx->next = NULL;
@@ -1074,6 +1371,10 @@ static eval_context_t *lookup_ctx_nm(eval_context_queue_t *q, lbm_cid cid) {
 // lock of a mutex.
 static void unlink_ctx_nm(eval_context_queue_t *q, eval_context_t *ctx) {
 
+  if (timer_in_heap(ctx)) {
+    timer_remove_nm(ctx);
+  }
+
   if (ctx->prev == NULL) { // ctx is first in queue
     q->first = ctx->next;
   } else {
@@ -1134,6 +1435,7 @@ sizeopt static noreturn void error_ctx_base(lbm_value err_val, bool has_at, lbm_
 #else
 sizeopt static noreturn void error_ctx_base(lbm_value err_val, bool has_at, lbm_value at, unsigned int row, unsigned int column) {
 #endif
+  running_extension = ENC_SYM_NIL; // In case the error came from an extension.
   bool print_trapped = !lbm_hide_trapped_error && (ctx_running->flags & EVAL_CPS_CONTEXT_FLAG_TRAP_UNROLL_RETURN);
 
   if (!(lbm_hide_trapped_error &&
@@ -1156,11 +1458,11 @@ sizeopt static noreturn void error_ctx_base(lbm_value err_val, bool has_at, lbm_
   }
 #endif
   if (ctx_running->flags & EVAL_CPS_CONTEXT_FLAG_TRAP) {
-    if (lbm_heap_num_free() < 3) {
+    if (!lbm_heap_has_free(3)) {
       gc();
     }
 
-    if (lbm_heap_num_free() >= 3) {
+    if (lbm_heap_has_free(3)) {
       lbm_value msg = lbm_cons(err_val, ENC_SYM_NIL);
       msg = lbm_cons(lbm_enc_i(ctx_running->id), msg);
       msg = lbm_cons(ENC_SYM_EXIT_ERROR, msg);
@@ -1251,57 +1553,79 @@ static eval_context_t *dequeue_ctx_nm(eval_context_queue_t *q) {
   return res;
 }
 
-static void wake_up_ctxs_nm(void) {
-  lbm_uint t_now;
-  t_now = lbm_timestamp();
-  eval_context_queue_t *q = &blocked;
-  eval_context_t *curr = q->first;
+// Put a context in the ready queue of its priority level. The running
+// context is preempted if the new context has a higher priority.
+static void enqueue_ready_nm(eval_context_t *ctx) {
+  ctx->ready_time = lbm_timestamp();
+  enqueue_ctx_nm(&queue[ctx->priority], ctx);
+  if (ctx_running && ctx->priority > ctx_running->priority) {
+    preempt_running();
+  }
+}
 
-  while (curr != NULL) {
-    lbm_uint t_diff;
-    eval_context_t *next = curr->next;
-    if (LBM_IS_STATE_WAKE_UP_WAKABLE(curr->state)) {
-      if ( curr->timestamp > t_now) {
-        /* There was an overflow on the counter */
-#ifndef LBM64
-        t_diff = (0xFFFFFFFF - curr->timestamp) + t_now;
-#else
-        t_diff = (0xFFFFFFFFFFFFFFFF - curr->timestamp) + t_now;
-#endif
-      } else {
-        t_diff = t_now - curr->timestamp;
-      }
+static void enqueue_ready(eval_context_t *ctx) {
+  lbm_mutex_lock(&qmutex);
+  enqueue_ready_nm(ctx);
+  lbm_mutex_unlock(&qmutex);
+}
 
-      if (t_diff >= curr->sleep_us) {
-        eval_context_t *wake_ctx = curr;
-        if (curr == q->last) {
-          if (curr->prev) {
-            q->last = curr->prev;
-            q->last->next = NULL;
-          } else {
-            q->first = NULL;
-            q->last = NULL;
-          }
-        } else if (curr->prev == NULL) {
-          q->first = curr->next;
-          q->first->prev = NULL;
-        } else {
-          curr->prev->next = curr->next;
-          if (curr->next) {
-            curr->next->prev = curr->prev;
-          }
-        }
-        wake_ctx->next = NULL;
-        wake_ctx->prev = NULL;
-        if (LBM_IS_STATE_TIMEOUT(curr->state)) {
-          mailbox_add_mail(wake_ctx, ENC_SYM_TIMEOUT);
-          wake_ctx->r = ENC_SYM_TIMEOUT;
-        }
-        wake_ctx->state = LBM_THREAD_STATE_READY;
-        enqueue_ctx_nm(&queue, wake_ctx);
+static eval_context_t *lookup_ready_nm(lbm_cid cid) {
+  for (int i = 0; i < LBM_PRIO_LEVELS; i ++) {
+    eval_context_t *found = lookup_ctx_nm(&queue[i], cid);
+    if (found) return found;
+  }
+  return NULL;
+}
+
+// Take the first context of the highest non-empty level. The number
+// of levels is a small constant so this does not depend on the number
+// of ready contexts.
+static eval_context_t *dequeue_ready_nm(void) {
+  for (int i = LBM_PRIO_LEVELS - 1; i >= 0; i --) {
+    if (queue[i].first) {
+      eval_context_t *ctx = dequeue_ctx_nm(&queue[i]);
+      uint32_t latency = lbm_timestamp() - ctx->ready_time;
+      ctx->sched_runs ++;
+      ctx->sched_total_latency += latency;
+      if (latency > ctx->sched_max_latency) {
+        ctx->sched_max_latency = latency;
       }
+      return ctx;
     }
-    curr = next;
+  }
+  return NULL;
+}
+
+static void wake_up_ctxs_nm(void) {
+  uint32_t t_now = lbm_timestamp();
+
+  while (timers && (int32_t)(t_now - timers->wake_time) >= 0) {
+    eval_context_t *wake_ctx = timers;
+    uint32_t elapsed = t_now - (uint32_t)wake_ctx->timestamp;
+    if (elapsed < wake_ctx->sleep_us) {
+      // One step of a long timeout.
+      timer_remove_nm(wake_ctx);
+      timer_insert_nm(wake_ctx, t_now);
+      continue;
+    }
+    unlink_ctx_nm(&blocked, wake_ctx);
+    sched_new_wake_latency(elapsed - wake_ctx->sleep_us);
+    if (LBM_IS_STATE_TIMEOUT(wake_ctx->state)) {
+      mailbox_add_mail(wake_ctx, ENC_SYM_TIMEOUT);
+      wake_ctx->r = ENC_SYM_TIMEOUT;
+    }
+    wake_ctx->state = LBM_THREAD_STATE_READY;
+    enqueue_ready_nm(wake_ctx);
+  }
+}
+
+// Pick the next context to run. Called with qmutex locked.
+static void schedule_nm(void) {
+  wake_up_ctxs_nm();
+  ctx_running = dequeue_ready_nm();
+  if (ctx_running && ctx_running != sched_last_ctx) {
+    sched_stats.ctx_switches ++;
+    sched_last_ctx = ctx_running;
   }
 }
 
@@ -1316,7 +1640,7 @@ static void yield_ctx(lbm_uint sleep_us) {
   ctx_running = NULL;
 }
 
-static lbm_cid lbm_create_ctx_parent(lbm_value program, lbm_value env, lbm_uint stack_size, lbm_cid parent, uint32_t context_flags, char *name) {
+static lbm_cid lbm_create_ctx_parent(lbm_value program, lbm_value env, lbm_uint stack_size, lbm_cid parent, uint32_t context_flags, uint32_t priority, char *name) {
 
   if (!lbm_is_cons(program)) return -1;
 
@@ -1361,12 +1685,12 @@ static lbm_cid lbm_create_ctx_parent(lbm_value program, lbm_value env, lbm_uint
     gc();
   }
 #endif
-  mailbox = (lbm_value*)lbm_memory_allocate(EVAL_CPS_DEFAULT_MAILBOX_SIZE);
+  mailbox = (lbm_value*)lbm_memory_allocate(MAILBOX_WORDS(EVAL_CPS_DEFAULT_MAILBOX_SIZE));
   if (mailbox == NULL) {
     lbm_value roots[2] = {program, env};
     lbm_gc_mark_roots(roots,2);
     gc();
-    mailbox = (lbm_value *)lbm_memory_allocate(EVAL_CPS_DEFAULT_MAILBOX_SIZE);
+    mailbox = (lbm_value *)lbm_memory_allocate(MAILBOX_WORDS(EVAL_CPS_DEFAULT_MAILBOX_SIZE));
   }
   if (mailbox == NULL) {
     lbm_stack_free(&ctx->K);
@@ -1413,12 +1737,22 @@ static lbm_cid lbm_create_ctx_parent(lbm_value program, lbm_value env, lbm_uint
   ctx->mailbox_size = EVAL_CPS_DEFAULT_MAILBOX_SIZE;
   ctx->flags = context_flags;
   ctx->num_mail = 0;
+  ctx->mail_head = 0;
+  ctx->mail_used = 0;
   ctx->app_cont = false;
   ctx->timestamp = 0;
   ctx->sleep_us = 0;
   ctx->state = LBM_THREAD_STATE_READY;
   ctx->prev = NULL;
   ctx->next = NULL;
+  ctx->timer_prev = NULL;
+  ctx->timer_child = NULL;
+  ctx->timer_next = NULL;
+  ctx->priority = priority < LBM_PRIO_LEVELS ? priority : LBM_PRIO_LEVELS - 1;
+  ctx->ready_time = 0;
+  ctx->sched_runs = 0;
+  ctx->sched_max_latency = 0;
+  ctx->sched_total_latency = 0;
 
   ctx->row0 = -1;
   ctx->row1 = -1;
@@ -1434,7 +1768,7 @@ static lbm_cid lbm_create_ctx_parent(lbm_value program, lbm_value env, lbm_uint
     return -1;
   }
 
-  enqueue_ctx(&queue,ctx);
+  enqueue_ready(ctx);
 
   return ctx->id;
 }
@@ -1446,51 +1780,115 @@ lbm_cid lbm_create_ctx(lbm_value program, lbm_value env, lbm_uint stack_size, ch
                                stack_size,
                                -1,
                                EVAL_CPS_CONTEXT_FLAG_NOTHING,
+                               LBM_PRIO_DEFAULT,
                                name);
 }
 
+static void mailbox_compact(eval_context_t *ctx) {
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < ctx->mail_used; i ++) {
+    uint32_t from = mail_slot(ctx, i);
+    if (ctx->mailbox[from] != MAIL_NONE) {
+      uint32_t to = mail_slot(ctx, n);
+      ctx->mailbox[to] = ctx->mailbox[from];
+#ifdef LBM_MAILBOX_INDEX
+      MAIL_TAGS(ctx)[to] = MAIL_TAGS(ctx)[from];
+#endif
+      n ++;
+    }
+  }
+  ctx->mail_used = n;
+}
+
 bool lbm_mailbox_change_size(eval_context_t *ctx, lbm_uint new_size) {
 
   lbm_value *mailbox = NULL;
+  if (new_size == 0) {
+    return false;
+  }
 #ifdef LBM_ALWAYS_GC
   gc();
 #endif
-  mailbox = (lbm_value*)lbm_memory_allocate(new_size);
+  mailbox = (lbm_value*)lbm_memory_allocate(MAILBOX_WORDS(new_size));
   if (mailbox == NULL) {
     gc();
-    mailbox = (lbm_value *)lbm_memory_allocate(new_size);
+    mailbox = (lbm_value *)lbm_memory_allocate(MAILBOX_WORDS(new_size));
   }
   if (mailbox == NULL) {
     return false;
   }
 
-  for (lbm_uint i = 0; i < ctx->num_mail; i ++ ) {
-    mailbox[i] = ctx->mailbox[i];
+  // Keep the newest messages that fit.
+  uint32_t drop = ctx->num_mail > new_size ? ctx->num_mail - (uint32_t)new_size : 0;
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < ctx->mail_used; i ++) {
+    uint32_t s = mail_slot(ctx, i);
+    if (ctx->mailbox[s] == MAIL_NONE) continue;
+    if (drop > 0) {
+      drop --;
+    } else {
+      mailbox[n++] = ctx->mailbox[s];
+    }
   }
   lbm_memory_free(ctx->mailbox);
   ctx->mailbox = mailbox;
   ctx->mailbox_size = (uint32_t)new_size;
+  ctx->mail_head = 0;
+  ctx->mail_used = n;
+  ctx->num_mail = n;
+#ifdef LBM_MAILBOX_INDEX
+  for (uint32_t i = 0; i < n; i ++) {
+    MAIL_TAGS(ctx)[i] = mail_tag(mailbox[i]);
+  }
+#endif
   return true;
 }
 
-static void mailbox_remove_mail(eval_context_t *ctx, lbm_uint ix) {
+// n is the position from mail_head.
+static void mailbox_remove_mail(eval_context_t *ctx, lbm_uint n) {
 
-  for (lbm_uint i = ix; i < ctx->num_mail-1; i ++) {
-    ctx->mailbox[i] = ctx->mailbox[i+1];
-  }
+  ctx->mailbox[mail_slot(ctx, (uint32_t)n)] = MAIL_NONE;
   ctx->num_mail --;
+
+  while (ctx->mail_used > 0 && ctx->mailbox[ctx->mail_head] == MAIL_NONE) {
+    ctx->mail_head = mail_slot(ctx, 1);
+    ctx->mail_used --;
+  }
+  while (ctx->mail_used > 0 &&
+         ctx->mailbox[mail_slot(ctx, ctx->mail_used - 1)] == MAIL_NONE) {
+    ctx->mail_used --;
+  }
 }
 
 static void mailbox_add_mail(eval_context_t *ctx, lbm_value mail) {
 
-  if (ctx->num_mail >= ctx->mailbox_size) {
-    mailbox_remove_mail(ctx, 0);
+  if (ctx->mail_used >= ctx->mailbox_size) {
+    if (ctx->num_mail < ctx->mail_used) {
+      mailbox_compact(ctx);
+    } else {
+      mailbox_remove_mail(ctx, 0);
+    }
   }
 
-  ctx->mailbox[ctx->num_mail] = mail;
+  uint32_t s = mail_slot(ctx, ctx->mail_used);
+  ctx->mailbox[s] = mail;
+#ifdef LBM_MAILBOX_INDEX
+  MAIL_TAGS(ctx)[s] = mail_tag(mail);
+#endif
+  ctx->mail_used ++;
   ctx->num_mail ++;
 }
 
+lbm_value lbm_mailbox_get(eval_context_t *ctx, lbm_uint n) {
+  lbm_mutex_lock(&qmutex);
+  if (ctx->num_mail < ctx->mail_used) {
+    mailbox_compact(ctx);
+  }
+  lbm_value m = ctx->mailbox[mail_slot(ctx, (uint32_t)n)];
+  lbm_mutex_unlock(&qmutex);
+  return m;
+}
+
 /**************************************************************
  * Advance execution to the next expression in the program.
  * Assumes programs are not malformed. Apply_eval_program
@@ -1524,7 +1922,7 @@ bool lbm_unblock_ctx_r(lbm_cid cid) {
   if (found && (LBM_IS_STATE_UNBLOCKABLE(found->state))) {
     unlink_ctx_nm(&blocked,found);
     found->state = LBM_THREAD_STATE_READY;
-    enqueue_ctx_nm(&queue,found);
+    enqueue_ready_nm(found);
     r = true;
   }
   lbm_mutex_unlock(&qmutex);
@@ -1548,7 +1946,7 @@ bool lbm_unblock_ctx_unboxed(lbm_cid cid, lbm_value unboxed) {
       found->app_cont = true;
     }
     found->state = LBM_THREAD_STATE_READY;
-    enqueue_ctx_nm(&queue,found);
+    enqueue_ready_nm(found);
     r = true;
   }
   lbm_mutex_unlock(&qmutex);
@@ -1599,7 +1997,7 @@ static uint32_t lbm_mailbox_free_space_for_cid(lbm_cid cid) {
 
   found = lookup_ctx_nm(&blocked, cid);
   if (!found) {
-    found = lookup_ctx_nm(&queue, cid);
+    found = lookup_ready_nm(cid);
   }
   if (!found && ctx_running && ctx_running->id == cid) {
     found = ctx_running;
@@ -1614,6 +2012,62 @@ static uint32_t lbm_mailbox_free_space_for_cid(lbm_cid cid) {
   return res;
 }
 
+bool lbm_set_ctx_priority(lbm_cid cid, uint32_t prio) {
+  if (prio >= LBM_PRIO_LEVELS) prio = LBM_PRIO_LEVELS - 1;
+  bool r = true;
+
+  lbm_mutex_lock(&qmutex);
+
+  eval_context_t *found = lookup_ready_nm(cid);
+  if (found) {
+    uint32_t ready_time = found->ready_time;
+    unlink_ctx_nm(&queue[found->priority], found);
+    found->priority = prio;
+    enqueue_ready_nm(found);
+    found->ready_time = ready_time;
+  } else if ((found = lookup_ctx_nm(&blocked, cid))) {
+    found->priority = prio;
+  } else if (ctx_running && ctx_running->id == cid) {
+    ctx_running->priority = prio;
+    // Give way if a higher priority context is waiting.
+    for (uint32_t i = prio + 1; i < LBM_PRIO_LEVELS; i ++) {
+      if (queue[i].first) {
+        preempt_running();
+        break;
+      }
+    }
+  } else {
+    r = false;
+  }
+
+  lbm_mutex_unlock(&qmutex);
+  return r;
+}
+
+bool lbm_get_ctx_sched_stats(lbm_cid cid, lbm_ctx_sched_stats_t *stats) {
+  eval_context_t *found = NULL;
+
+  lbm_mutex_lock(&qmutex);
+
+  found = lookup_ctx_nm(&blocked, cid);
+  if (!found) {
+    found = lookup_ready_nm(cid);
+  }
+  if (!found && ctx_running && ctx_running->id == cid) {
+    found = ctx_running;
+  }
+
+  if (found) {
+    stats->priority = found->priority;
+    stats->runs = found->sched_runs;
+    stats->max_latency = found->sched_max_latency;
+    stats->total_latency = found->sched_total_latency;
+  }
+
+  lbm_mutex_unlock(&qmutex);
+  return found != NULL;
+}
+
 /** find_receiver_and_send is used for message passing where
  * the semantics is that the oldest message is dropped if the
  * receiver mailbox is full.
@@ -1628,13 +2082,13 @@ bool lbm_find_receiver_and_send(lbm_cid cid, lbm_value msg) {
     if (LBM_IS_STATE_RECV(found->state)) { // only if unblock receivers here.
       unlink_ctx_nm(&blocked,found);
       found->state = LBM_THREAD_STATE_READY;
-      enqueue_ctx_nm(&queue,found);
+      enqueue_ready_nm(found);
     }
     mailbox_add_mail(found, msg);
     goto find_receiver_end;
   }
 
-  found = lookup_ctx_nm(&queue, cid);
+  found = lookup_ready_nm(cid);
   if (found) {
     mailbox_add_mail(found, msg);
     goto find_receiver_end;
@@ -1712,13 +2166,42 @@ static bool match(lbm_value p, lbm_value e, lbm_value *env) {
 // Find match is not very picky about syntax.
 // A completely malformed recv form is most likely to
 // just return no_match.
-static int find_match(lbm_value plist, lbm_value *earr, lbm_uint num, lbm_value *e, lbm_value *env) {
+static int find_match(lbm_value plist, eval_context_t *ctx, lbm_value *e, lbm_value *env) {
   // A pattern list is a list of pattern, expression lists.
   // ( (p1 e1) (p2 e2) ... (pn en))
+#ifdef LBM_MAILBOX_INDEX
+  // Mail can be skipped on its tag alone if every pattern has a tag.
+  lbm_value tags[MAIL_INDEX_MAX_PATTERNS];
+  int num_tags = 0;
+  for (lbm_value c = plist; lbm_is_cons(c); c = lbm_ref_cell(c)->cdr) {
+    lbm_value pe = lbm_ref_cell(c)->car;
+    lbm_value t = MAIL_NONE;
+    if (lbm_is_cons(pe) && num_tags < MAIL_INDEX_MAX_PATTERNS) {
+      lbm_value p = lbm_ref_cell(pe)->car;
+      if (!get_match_binder_variable(p)) {
+        t = mail_tag(p);
+      }
+    }
+    if (t == MAIL_NONE || t == ENC_SYM_DONTCARE) {
+      num_tags = -1;
+      break;
+    }
+    tags[num_tags++] = t;
+  }
+#endif
   lbm_value curr_p = plist;
-  int n = 0;
-  for (int i = 0; i < (int)num; i ++ ) {
-    lbm_value curr_e = earr[i];
+  for (uint32_t n = 0; n < ctx->mail_used; n ++) {
+    uint32_t slot = mail_slot(ctx, n);
+    lbm_value curr_e = ctx->mailbox[slot];
+    if (curr_e == MAIL_NONE) continue;
+#ifdef LBM_MAILBOX_INDEX
+    if (num_tags >= 0) {
+      lbm_value t = MAIL_TAGS(ctx)[slot];
+      int i = 0;
+      while (i < num_tags && tags[i] != t) i ++;
+      if (i == num_tags) continue;
+    }
+#endif
     while (lbm_is_cons(curr_p)) {
 
       lbm_value curr = lbm_ref_cell(curr_p)->car;
@@ -1732,12 +2215,11 @@ static int find_match(lbm_value plist, lbm_value *earr, lbm_uint num, lbm_value
       }
       if (match(p0, curr_e, env)) {
         *e = p1;
-        return n;
+        return (int)n;
       }
       curr_p = lbm_ref_cell(curr_p)->cdr;
     }
     curr_p = plist;       /* search all patterns against next exp */
-    n ++;
   }
   return FM_NO_MATCH;
 }
@@ -1751,20 +2233,16 @@ static void mark_context(eval_context_t *ctx, void *arg1, void *arg2) {
   lbm_value roots[4] = {ctx->curr_exp, ctx->program, ctx->r, ctx->reader_stream};
   lbm_gc_mark_env(ctx->curr_env);
   lbm_gc_mark_roots(roots, 4);
-  lbm_gc_mark_roots(ctx->mailbox, ctx->num_mail);
+  for (uint32_t i = 0; i < ctx->mail_used; i ++) {
+    lbm_value m = ctx->mailbox[mail_slot(ctx, i)];
+    if (lbm_is_ptr(m) && m != MAIL_NONE) {
+      lbm_gc_mark_phase(m);
+    }
+  }
   lbm_gc_mark_continuation_stack(ctx->K.data, ctx->K.sp);
 }
 
-static int gc(void) {
-  if (ctx_running) {
-    ctx_running->state = ctx_running->state | LBM_THREAD_STATE_GC_BIT;
-  }
-
-  gc_requested = false;
-  lbm_gc_state_inc();
-
-  // The freelist should generally be NIL when GC runs.
-  lbm_nil_freelist();
+static void gc_mark_all_roots(void) {
   lbm_value *env = lbm_get_global_env();
   for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
     lbm_gc_mark_env(env[i]);
@@ -1773,7 +2251,7 @@ static int gc(void) {
   lbm_mutex_lock(&qmutex); // Lock the queues.
                        // Any concurrent messing with the queues
                        // while doing GC cannot possibly be good.
-  queue_iterator_nm(&queue, mark_context, NULL, NULL);
+  ready_iterator_nm(mark_context, NULL, NULL);
   queue_iterator_nm(&blocked, mark_context, NULL, NULL);
 
   if (ctx_running) {
@@ -1781,17 +2259,64 @@ static int gc(void) {
   }
   lbm_mutex_unlock(&qmutex);
 
+#if LBM_MACRO_CACHE_SIZE > 0
+  lbm_gc_mark_roots((lbm_uint*)macro_cache, LBM_MACRO_CACHE_SIZE * 3);
+#endif
+}
+
+static int gc(void) {
+  uint32_t t_start = timestamp_us_callback();
+  if (ctx_running) {
+    ctx_running->state = ctx_running->state | LBM_THREAD_STATE_GC_BIT;
+  }
+
+  // The mark bits of the previous GC are still in use
+  // until it has been swept to the end.
+  lbm_gc_sweep_finish();
+  uint32_t t_mark = timestamp_us_callback();
+  lbm_heap_new_sweep_time(t_mark - t_start);
+
+  gc_requested = false;
+  lbm_gc_state_inc();
+
+  // The freelist should generally be NIL when GC runs.
+  lbm_nil_freelist();
+  lbm_gc_mark_remembered();
+  gc_mark_all_roots();
+  if (lbm_gc_retry_full()) {
+    gc_mark_all_roots();
+  }
+
+  uint32_t t_sweep = timestamp_us_callback();
   int r = lbm_gc_sweep_phase();
-  lbm_heap_new_freelist_length();
   lbm_memory_update_min_free();
 
   if (ctx_running) {
     ctx_running->state = ctx_running->state & ~LBM_THREAD_STATE_GC_BIT;
   }
+  uint32_t t_end = timestamp_us_callback();
+  lbm_heap_new_mark_time(t_sweep - t_mark);
+  lbm_heap_new_sweep_time(t_end - t_sweep);
+  lbm_heap_new_gc_time(t_end - t_start);
+  return r;
+}
+
+#ifdef LBM_GC_INCREMENTAL_SWEEP
+// Sweep a chunk of the heap between evaluation steps.
+static bool gc_sweep_step(void) {
+  if (!lbm_gc_sweep_pending()) return false;
+  uint32_t t_start = timestamp_us_callback();
+  bool r = lbm_gc_sweep_step();
+  uint32_t dur = timestamp_us_callback() - t_start;
+  lbm_heap_new_sweep_time(dur);
+  lbm_heap_new_gc_time(dur);
   return r;
 }
+#endif
 
 int lbm_perform_gc(void) {
+  // An explicit GC should leave all unreachable memory freed.
+  lbm_gc_request_full_sweep();
   return gc();
 }
 
@@ -2019,7 +2544,7 @@ static void eval_lambda(eval_context_t *ctx) {
   gc();
 #endif
   for (int retry = 0; retry < 2; retry ++) {
-    if (lbm_heap_num_free() >= 4) {
+    if (lbm_heap_has_free(4)) {
       lbm_value clo = lbm_heap_state.freelist;
       lbm_value lam = get_cdr(ctx->curr_exp);
       lbm_uint ix = lbm_dec_ptr(clo);
@@ -2035,6 +2560,9 @@ static void eval_lambda(eval_context_t *ctx) {
       heap[ix].cdr = ENC_SYM_NIL;
       lbm_heap_state.num_free-=4;
       ctx->r = clo;
+#ifdef LBM_LEXICAL_ADDRESSING
+      lexical_address(ctx);
+#endif
 #ifdef CLEAN_UP_CLOSURES
       lbm_uint sym_id  = 0;
       if (clean_cl_env_symbol) {
@@ -2396,12 +2924,9 @@ static void eval_receive(eval_context_t *ctx) {
     if (ctx->num_mail == 0) {
       block_current_ctx(LBM_THREAD_STATE_RECV_BL,0,false);
     } else {
-      lbm_value *msgs = ctx->mailbox;
-      lbm_uint  num   = ctx->num_mail;
-
       lbm_value e;
       lbm_value new_env = ctx->curr_env;
-      int n = find_match(pats, msgs, num, &e, &new_env);
+      int n = find_match(pats, ctx, &e, &new_env);
       if (n >= 0 ) { /* Match */
         mailbox_remove_mail(ctx, (lbm_uint)n);
         ctx->curr_env = new_env;
@@ -2430,15 +2955,10 @@ static void cont_set_global_env(eval_context_t *ctx){
   lbm_value val = ctx->r;
 
   lbm_value key = ctx->K.data[--ctx->K.sp];
-  lbm_uint dec_key = lbm_dec_sym(key);
-  lbm_uint ix_key  = dec_key & GLOBAL_ENV_MASK;
-  lbm_value *global_env = lbm_get_global_env();
-  lbm_uint orig_env = global_env[ix_key];
-  lbm_value new_env;
+  lbm_value res;
   // A key is a symbol and should not need to be remembered.
-  WITH_GC(new_env, lbm_env_set(orig_env,key,val));
-
-  global_env[ix_key] = new_env;
+  WITH_GC(res, lbm_global_env_set(key, val));
+  (void)res;
   ctx->r = val;
 
   ctx->app_cont = true;
@@ -2667,6 +3187,82 @@ static inline __attribute__ ((always_inline)) void setup_macro(eval_context_t *c
   ctx->curr_env = expand_env;
 }
 
+#if LBM_MACRO_CACHE_SIZE > 0
+static inline lbm_uint macro_cache_ix(lbm_value site) {
+  return lbm_dec_ptr(site) & (LBM_MACRO_CACHE_SIZE - 1);
+}
+
+// The expander runs in the environment of the call, so an expansion can
+// depend on more than the arguments. A macro opts in to expansion caching
+// by ending in the symbol memo, (macro params body memo).
+static bool macro_memoizable(lbm_value m) {
+  lbm_value opts = m;
+  for (int i = 0; i < 3 && lbm_is_cons(opts); i ++) {
+    opts = lbm_ref_cell(opts)->cdr;
+  }
+  return lbm_is_cons(opts) && lbm_ref_cell(opts)->car == symbol_memo;
+}
+#endif
+
+/**
+ * @brief Setup application of macro at a call site
+ *
+ * Reuses the cached expansion if this macro has been expanded at the
+ * call site before. Otherwise the macro is expanded as by setup_macro,
+ * and if the macro ends in memo the result is remembered on the way to
+ * EVAL_R.
+ *
+ * @param args Argument list of the call, identifies the call site.
+ * @param curr_env The environment to evaluate the expansion in.
+ */
+static void setup_macro_site(eval_context_t *ctx, lbm_value args, lbm_value curr_env) {
+#if LBM_MACRO_CACHE_SIZE > 0
+  if (lbm_is_cons(args)) {
+    macro_cache_entry_t *e = &macro_cache[macro_cache_ix(args)];
+    if (e->site == args && e->macro == ctx->r) {
+      macro_cache_stats.hits ++;
+      ctx->curr_exp = e->expansion;
+      ctx->curr_env = curr_env;
+      return;
+    }
+    macro_cache_stats.misses ++;
+    lbm_value macro = ctx->r;
+    setup_macro(ctx, args, curr_env);
+    if (macro_memoizable(macro)) {
+      lbm_value *sptr = stack_reserve(ctx, 3);
+      sptr[0] = args;
+      sptr[1] = macro;
+      sptr[2] = MACRO_MEMO;
+    }
+    return;
+  }
+  macro_cache_stats.misses ++;
+#endif
+  setup_macro(ctx, args, curr_env);
+}
+
+/**
+ * @brief Record entry into a closure body
+ *
+ * While call stack tracking is on, the body is pushed in a PROF_FRAME
+ * for the profiler to find. A call in tail position finds the frame of
+ * its caller on top of the stack and replaces it, so tail recursion
+ * still runs in constant stack space.
+ *
+ * @param body Body of the closure, identifies the function.
+ */
+static inline __attribute__ ((always_inline)) void enter_closure(eval_context_t *ctx, lbm_value body) {
+  if (call_stack_tracking) {
+    if (ctx->K.sp >= 2 && ctx->K.data[ctx->K.sp - 1] == PROF_FRAME) {
+      ctx->K.data[ctx->K.sp - 2] = body;
+    } else {
+      lbm_value *sptr = stack_reserve(ctx, 2);
+      sptr[0] = body;
+      sptr[1] = PROF_FRAME;
+    }
+  }
+}
+
 static lbm_value perform_setvar(lbm_value key, lbm_value val, lbm_value env) {
 
   lbm_uint s = lbm_dec_sym(key);
@@ -2821,32 +3417,26 @@ static void apply_read(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
 static void apply_spawn_base(lbm_value *args, lbm_uint nargs, eval_context_t *ctx, uint32_t context_flags) {
 
   lbm_uint stack_size = EVAL_CPS_DEFAULT_STACK_SIZE;
+  uint32_t priority = LBM_PRIO_DEFAULT;
   lbm_uint closure_pos = 0;
   char *name = NULL;
   // allowed arguments:
-  // (spawn opt-name opt-stack-size closure arg1 ... argN)
-
-  if (nargs >= 1 &&
-      lbm_is_closure(args[0])) {
-    closure_pos = 0;
-  } else if (nargs >= 2 &&
-      lbm_is_number(args[0]) &&
-      lbm_is_closure(args[1])) {
-    stack_size = lbm_dec_as_u32(args[0]);
-    closure_pos = 1;
-  } else if (nargs >= 2 &&
-             lbm_is_array_r(args[0]) &&
-             lbm_is_closure(args[1])) {
-    name = lbm_dec_str(args[0]);
-    closure_pos = 1;
-  } else if (nargs >= 3 &&
-             lbm_is_array_r(args[0]) &&
-             lbm_is_number(args[1]) &&
-             lbm_is_closure(args[2])) {
-    stack_size = lbm_dec_as_u32(args[1]);
-    closure_pos = 2;
-    name = lbm_dec_str(args[0]);
-  } else {
+  // (spawn opt-name opt-stack-size opt-priority closure arg1 ... argN)
+  // The priority can only be given together with a stack size.
+
+  if (closure_pos < nargs && lbm_is_array_r(args[closure_pos])) {
+    name = lbm_dec_str(args[closure_pos]);
+    closure_pos ++;
+  }
+  if (closure_pos < nargs && lbm_is_number(args[closure_pos])) {
+    stack_size = lbm_dec_as_u32(args[closure_pos]);
+    closure_pos ++;
+    if (closure_pos < nargs && lbm_is_number(args[closure_pos])) {
+      priority = lbm_dec_as_u32(args[closure_pos]);
+      closure_pos ++;
+    }
+  }
+  if (closure_pos >= nargs || !lbm_is_closure(args[closure_pos])) {
     if (context_flags & EVAL_CPS_CONTEXT_FLAG_TRAP)
       ERROR_AT_CTX(ENC_SYM_TERROR,ENC_SYM_SPAWN_TRAP);
     else
@@ -2878,6 +3468,7 @@ static void apply_spawn_base(lbm_value *args, lbm_uint nargs, eval_context_t *ct
                                       stack_size,
                                       lbm_get_current_cid(),
                                       context_flags,
+                                      priority,
                                       name);
   // setting these values is a good idea
   // even if creating a context failed.
@@ -3072,6 +3663,8 @@ static void apply_map(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
     lbm_cons_t *cell = lbm_ref_cell(appli_0);
     cell->car = h;
     cell->cdr = ENC_SYM_NIL;
+    // appli_1 survived a GC if allocating appli needed one.
+    lbm_gc_write_barrier(appli_0, h);
 
     cell = lbm_ref_cell(appli_1);
     cell->car = ENC_SYM_QUOTE;
@@ -3181,8 +3774,8 @@ static void apply_kill(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
     eval_context_t *found = NULL;
     if ((found = lookup_ctx_nm(&blocked, cid))) {
       unlink_ctx_nm(&blocked, found);
-    } else if ((found = lookup_ctx_nm(&queue, cid))) {
-      unlink_ctx_nm(&queue, found);
+    } else if ((found = lookup_ready_nm(cid))) {
+      unlink_ctx_nm(&queue[found->priority], found);
     }
 
     if (found) {
@@ -3190,7 +3783,7 @@ static void apply_kill(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
       found->r = args[1];
       found->app_cont = true;
       found->state = LBM_THREAD_STATE_READY;
-      enqueue_ctx_nm(&queue,found);
+      enqueue_ready_nm(found);
       ctx->r = ENC_SYM_TRUE;
     } else {
       ctx->r = ENC_SYM_NIL;
@@ -3465,6 +4058,8 @@ static const apply_fun fun_table[] =
    apply_rest_args,
    apply_rotate,
    apply_apply,
+   apply_compile,
+   apply_bytecode,
   };
 
 
@@ -3490,6 +4085,22 @@ static void call_fptr(lbm_value (*fptr)(lbm_value *, lbm_uint), lbm_value *args,
   ctx->r = res;
 }
 
+#ifdef LBM_EXTENSION_STATS
+/* Extensions are called through this wrapper so that both the
+ * first call and a retry after GC are timed, and calls that
+ * end in an error are counted as well.
+ */
+static lbm_uint timed_extension_ix;
+
+static lbm_value call_extension_timed(lbm_value *args, lbm_uint argn) {
+  extension_fptr fptr = extension_table[timed_extension_ix].fptr;
+  uint32_t t_start = timestamp_us_callback();
+  lbm_value res = fptr(args, argn);
+  lbm_extension_stats_record(timed_extension_ix, timestamp_us_callback() - t_start);
+  return res;
+}
+#endif
+
 /***************************************************/
 /* Application of function that takes arguments    */
 /* passed over the stack.                          */
@@ -3504,8 +4115,20 @@ static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_c
   lbm_uint fun_kind = SYMBOL_KIND(fun_val);
 
   switch (fun_kind) {
-  case SYMBOL_KIND_EXTENSION:
-    call_fptr(extension_table[SYMBOL_IX(fun_val)].fptr, fun_args, arg_count, ctx);
+  case SYMBOL_KIND_EXTENSION: {
+#ifdef LBM_EXTENSION_STATS
+    timed_extension_ix = SYMBOL_IX(fun_val);
+    extension_fptr ext_fptr = call_extension_timed;
+#else
+    extension_fptr ext_fptr = extension_table[SYMBOL_IX(fun_val)].fptr;
+#endif
+    if (call_stack_tracking) {
+      running_extension = fun;
+      call_fptr(ext_fptr, fun_args, arg_count, ctx);
+      running_extension = ENC_SYM_NIL;
+    } else {
+      call_fptr(ext_fptr, fun_args, arg_count, ctx);
+    }
     if (blocking_extension) {
       blocking_extension = false;
       if (is_atomic) {
@@ -3522,7 +4145,7 @@ static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_c
       }
       lbm_mutex_unlock(&blocking_extension_mutex);
     }
-    break;
+  } break;
   case SYMBOL_KIND_FUNDAMENTAL:
     call_fptr(fundamental_table[SYMBOL_IX(fun_val)], fun_args, arg_count, ctx);
     break;
@@ -3538,6 +4161,519 @@ static void application(eval_context_t *ctx, lbm_value *fun_args, lbm_uint arg_c
   }
 }
 
+/***************************************************/
+/* Bytecode virtual machine                        */
+/*                                                 */
+/* Runs the code objects made by lbm_bc_compile.   */
+/* The frames live on the context stack (see       */
+/* lbm_bytecode.h) so that GC, errors and          */
+/* continuations see them as any other stack       */
+/* content. Whenever control goes back to the      */
+/* evaluator the pc and frame pointer are pushed   */
+/* as u together with BC_RUN or BC_RETURN.         */
+
+#define BC_U16(p) (((lbm_uint)code[(p)] << 8) | code[(p) + 1])
+
+static inline lbm_value *bc_code_data(lbm_value code_obj) {
+  return (lbm_value*)((lbm_array_header_t*)lbm_ref_cell(code_obj)->car)->data;
+}
+
+static inline uint8_t *bc_code_bytes(lbm_value *data) {
+  return (uint8_t*)((lbm_array_header_t*)lbm_ref_cell(data[LBM_BC_CODE_BYTES])->car)->data;
+}
+
+// Code object of a compiled closure or nil.
+static lbm_value bc_closure_code(lbm_value fun) {
+  if (lbm_is_cons(fun)) {
+    lbm_cons_t *cell = lbm_ref_cell(fun);
+    if (cell->car == ENC_SYM_CLOSURE) {
+      lbm_value body = lbm_car(lbm_cdr(cell->cdr));
+      if (lbm_is_cons(body)) {
+        lbm_cons_t *body_cell = lbm_ref_cell(body);
+        if (body_cell->car == ENC_SYM_BYTECODE) return lbm_car(body_cell->cdr);
+      }
+    }
+  }
+  return ENC_SYM_NIL;
+}
+
+// Check that a frame starting at fp fits on the stack, with room
+// for the 3 words pushed when control goes back to the evaluator.
+static inline bool bc_frame_fits(eval_context_t *ctx, lbm_uint fp, uint8_t *code) {
+  return fp + BC_U16(LBM_BC_HDR_SLOTS) + 3 < ctx->K.size;
+}
+
+// Check that none of the names the code calls has been bound to a
+// macro since the code was compiled. The names are only looked up
+// again after a macro has been bound somewhere.
+static inline bool bc_code_valid(lbm_value *data) {
+  lbm_value now = lbm_enc_u(lbm_env_macro_bindings());
+  lbm_value checked = data[LBM_BC_CODE_CHECKED];
+  if (checked == now) return true;
+  if (checked == ENC_SYM_NIL || lbm_bc_calls_macro(data)) {
+    data[LBM_BC_CODE_CHECKED] = ENC_SYM_NIL;
+    return false;
+  }
+  data[LBM_BC_CODE_CHECKED] = now;
+  return true;
+}
+
+// Evaluate the source of the code instead of running it. The n
+// arguments at fp are bound to the parameters and the frame, from the
+// bytecode symbol up, is dropped.
+static void bc_interpret(eval_context_t *ctx, lbm_value *data, lbm_uint fp, lbm_uint n) {
+  lbm_value source = data[LBM_BC_CODE_SOURCE];
+  lbm_value params = lbm_car(source);
+  lbm_value env = data[LBM_BC_CODE_ENV];
+  for (lbm_uint i = 0; i < n; i ++) {
+    lbm_cons_t *p_cell = lbm_ref_cell(params);
+    env = allocate_binding(p_cell->car, ctx->K.data[fp + i], env);
+    params = p_cell->cdr;
+  }
+  ctx->K.sp = fp - 2;
+  ctx->curr_env = env;
+  ctx->curr_exp = lbm_cdr(source);
+}
+
+static lbm_value bc_fundamental(lbm_uint ix, lbm_value *args, lbm_uint n) {
+  fundamental_fun f = fundamental_table[ix];
+#ifdef LBM_ALWAYS_GC
+  gc();
+#endif
+  lbm_value res = f(args, n);
+  if (lbm_is_error(res)) {
+    if (lbm_is_symbol_merror(res)) {
+      gc();
+      res = f(args, n);
+    }
+    if (lbm_is_error(res)) {
+      ERROR_AT_CTX(res, lbm_enc_sym(FUNDAMENTAL_SYMBOLS_START | ix));
+    }
+  }
+  return res;
+}
+
+// Call a function that is not compiled. The callee and its n
+// arguments are on top of the stack. The VM state is put under them
+// and BC_RETURN picks up the result.
+static void bc_call_other(eval_context_t *ctx, lbm_uint n, lbm_uint pc, lbm_uint fp) {
+  lbm_uint base = ctx->K.sp - n - 1;
+  stack_reserve(ctx, 3);
+  lbm_value *K = ctx->K.data;
+  lbm_value *fun_args = &K[base + 3];
+  memmove(fun_args, &K[base], (n + 1) * sizeof(lbm_value));
+  K[base] = lbm_enc_u(pc);
+  K[base + 1] = lbm_enc_u(fp);
+  K[base + 2] = BC_RETURN;
+  lbm_value fun = fun_args[0];
+
+  if (lbm_is_symbol(fun)) {
+    application(ctx, fun_args, n);
+    return;
+  }
+  if (lbm_is_closure(fun)) {
+    lbm_value cl = lbm_ref_cell(fun)->cdr;
+    lbm_value cl0, cl1, cl2;
+    EXTRACT(cl, cl0); // CLO_PARAMS
+    EXTRACT(cl, cl1); // CLO_BODY
+    EXTRACT_NO_ADVANCE(cl, cl2); // CLO_ENV
+    if (lbm_list_length(cl0) == n) {
+      // Compiled code that cannot be run is evaluated from source.
+      lbm_value code_obj = bc_closure_code(fun);
+      if (code_obj != ENC_SYM_NIL) {
+        cl1 = lbm_cdr(bc_code_data(code_obj)[LBM_BC_CODE_SOURCE]);
+      }
+      lbm_value env = cl2;
+      for (lbm_uint i = 1; i <= n; i ++) {
+        lbm_cons_t *p_cell = lbm_ref_cell(cl0);
+        env = allocate_binding(p_cell->car, fun_args[i], env);
+        cl0 = p_cell->cdr;
+      }
+      ctx->K.sp = base + 3;
+      enter_closure(ctx, cl1);
+      ctx->curr_env = env;
+      ctx->curr_exp = cl1;
+      return;
+    }
+  }
+  // Rest arguments, continuations, macros and errors are left to apply.
+  lbm_value args = ENC_SYM_NIL;
+  for (lbm_uint i = n; i > 0; i --) {
+    args = cons_with_gc(fun_args[i], args, ENC_SYM_NIL);
+  }
+  ctx->K.sp = base + 3;
+  // apply drops its arguments from the stack and expects the argument
+  // list in ctx->r, where GC finds it.
+  ctx->r = args;
+  lbm_value *sptr = stack_reserve(ctx, 3);
+  sptr[0] = ENC_SYM_APPLY;
+  sptr[1] = fun;
+  sptr[2] = args;
+  apply_apply(&sptr[1], 2, ctx);
+}
+
+static void bc_run(eval_context_t *ctx, lbm_uint fp, lbm_uint pc) {
+  lbm_value *K = ctx->K.data;
+  lbm_uint sp = ctx->K.sp;
+  lbm_value *data = bc_code_data(K[fp - 1]);
+  uint8_t *code = bc_code_bytes(data);
+  lbm_uint budget = LBM_BYTECODE_SLICE;
+  lbm_value a;
+  lbm_value b;
+  lbm_uint n;
+
+  while (budget > 0) {
+    budget --;
+    switch (code[pc]) {
+    case LBM_BC_CONST:
+      K[sp++] = data[LBM_BC_CODE_CONSTS + BC_U16(pc + 1)];
+      pc += 3;
+      break;
+    case LBM_BC_INT:
+      K[sp++] = lbm_enc_i((int16_t)BC_U16(pc + 1));
+      pc += 3;
+      break;
+    case LBM_BC_LOAD:
+      K[sp++] = K[fp + code[pc + 1]];
+      pc += 2;
+      break;
+    case LBM_BC_HEAD:
+    case LBM_BC_FREE:
+      a = data[LBM_BC_CODE_CONSTS + BC_U16(pc + 1)];
+      if (lbm_env_lookup_b(&b, a, data[LBM_BC_CODE_ENV]) ||
+          lbm_global_env_lookup(&b, a)) {
+        if (code[pc] == LBM_BC_HEAD && lbm_is_macro(b)) {
+          // Bound to a macro after this call started. Later calls
+          // evaluate the source.
+          ctx->K.sp = sp;
+          data[LBM_BC_CODE_CHECKED] = ENC_SYM_NIL;
+          lbm_set_error_reason("compile: called name was bound to a macro during the call");
+          ERROR_AT_CTX(ENC_SYM_EERROR, a);
+        }
+        pc += 3;
+        K[sp++] = b;
+        break;
+      } else {
+        pc += 3;
+        // Let the evaluator report the error or load the definition.
+        ctx->K.sp = sp;
+        lbm_value *sptr = stack_reserve(ctx, 3);
+        sptr[0] = lbm_enc_u(pc);
+        sptr[1] = lbm_enc_u(fp);
+        sptr[2] = BC_RETURN;
+        ctx->curr_exp = a;
+        ctx->curr_env = data[LBM_BC_CODE_ENV];
+        return;
+      }
+    case LBM_BC_POP:
+      sp --;
+      pc ++;
+      break;
+    case LBM_BC_SLIDE:
+      a = K[sp - 1];
+      sp -= code[pc + 1];
+      K[sp - 1] = a;
+      pc += 2;
+      break;
+    case LBM_BC_JMP:
+      pc = BC_U16(pc + 1);
+      break;
+    case LBM_BC_JMP_NIL:
+      sp --;
+      pc = (K[sp] == ENC_SYM_NIL) ? BC_U16(pc + 1) : pc + 3;
+      break;
+    case LBM_BC_AND:
+      if (K[sp - 1] == ENC_SYM_NIL) {
+        pc = BC_U16(pc + 1);
+      } else {
+        sp --;
+        pc += 3;
+      }
+      break;
+    case LBM_BC_OR:
+      if (K[sp - 1] != ENC_SYM_NIL) {
+        pc = BC_U16(pc + 1);
+      } else {
+        sp --;
+        pc += 3;
+      }
+      break;
+    case LBM_BC_FUN:
+      n = code[pc + 2];
+      ctx->K.sp = sp;
+      a = bc_fundamental(code[pc + 1], &K[sp - n], n);
+      sp -= n;
+      K[sp++] = a;
+      pc += 3;
+      break;
+#define BC_FIXNUM_OP(OP, SYM, RES)                                      \
+      case OP:                                                          \
+        a = K[sp - 2];                                                  \
+        b = K[sp - 1];                                                  \
+        if (lbm_type_of(a) == LBM_TYPE_I && lbm_type_of(b) == LBM_TYPE_I) { \
+          K[sp - 2] = (RES);                                            \
+        } else {                                                        \
+          ctx->K.sp = sp;                                               \
+          K[sp - 2] = bc_fundamental(SYMBOL_IX(SYM), &K[sp - 2], 2); \
+        }                                                               \
+        sp --;                                                          \
+        pc ++;                                                          \
+        break;
+      BC_FIXNUM_OP(LBM_BC_ADD, SYM_ADD, lbm_enc_i(lbm_dec_i(a) + lbm_dec_i(b)))
+      BC_FIXNUM_OP(LBM_BC_SUB, SYM_SUB, lbm_enc_i(lbm_dec_i(a) - lbm_dec_i(b)))
+      BC_FIXNUM_OP(LBM_BC_MUL, SYM_MUL, lbm_enc_i(lbm_dec_i(a) * lbm_dec_i(b)))
+      BC_FIXNUM_OP(LBM_BC_NUMEQ, SYM_NUMEQ, (a == b) ? ENC_SYM_TRUE : ENC_SYM_NIL)
+      BC_FIXNUM_OP(LBM_BC_LT, SYM_LT, (lbm_dec_i(a) < lbm_dec_i(b)) ? ENC_SYM_TRUE : ENC_SYM_NIL)
+      BC_FIXNUM_OP(LBM_BC_GT, SYM_GT, (lbm_dec_i(a) > lbm_dec_i(b)) ? ENC_SYM_TRUE : ENC_SYM_NIL)
+      BC_FIXNUM_OP(LBM_BC_LEQ, SYM_LEQ, (lbm_dec_i(a) <= lbm_dec_i(b)) ? ENC_SYM_TRUE : ENC_SYM_NIL)
+      BC_FIXNUM_OP(LBM_BC_GEQ, SYM_GEQ, (lbm_dec_i(a) >= lbm_dec_i(b)) ? ENC_SYM_TRUE : ENC_SYM_NIL)
+#undef BC_FIXNUM_OP
+    case LBM_BC_TCALL:
+      n = code[pc + 1];
+      a = K[sp - n - 1];
+      b = bc_closure_code(a);
+      if (b != ENC_SYM_NIL) {
+        lbm_value *callee_data = bc_code_data(b);
+        uint8_t *callee_code = bc_code_bytes(callee_data);
+        if (callee_code[LBM_BC_HDR_NARGS] == n &&
+            bc_code_valid(callee_data) &&
+            bc_frame_fits(ctx, fp, callee_code)) {
+          // Replace the current frame.
+          lbm_uint header = fp + code[LBM_BC_HDR_NARGS];
+          a = K[header];
+          lbm_value ret_fp = K[header + 1];
+          K[sp - n - 1] = b;
+          memmove(&K[fp - 1], &K[sp - n - 1], (n + 1) * sizeof(lbm_value));
+          sp = fp + n;
+          K[sp++] = a;
+          K[sp++] = ret_fp;
+          data = callee_data;
+          code = callee_code;
+          ctx->K.sp = sp;
+          pc = LBM_BC_ENTRY;
+          break;
+        }
+      }
+      // Not compiled or not run, a regular call followed by RET.
+      /* fall through */
+    case LBM_BC_CALL:
+      n = code[pc + 1];
+      a = K[sp - n - 1];
+      b = bc_closure_code(a);
+      if (b != ENC_SYM_NIL) {
+        lbm_value *callee_data = bc_code_data(b);
+        uint8_t *callee_code = bc_code_bytes(callee_data);
+        if (callee_code[LBM_BC_HDR_NARGS] == n &&
+            bc_code_valid(callee_data) &&
+            bc_frame_fits(ctx, sp - n, callee_code)) {
+          ctx->K.sp = sp;
+          K[sp - n - 1] = b;
+          K[sp++] = lbm_enc_u(pc + 2);
+          K[sp++] = lbm_enc_u(fp);
+          fp = sp - n - LBM_BC_FRAME_HEADER;
+          data = callee_data;
+          code = callee_code;
+          pc = LBM_BC_ENTRY;
+          break;
+        }
+      } else if (lbm_is_symbol(a) &&
+                 SYMBOL_KIND(lbm_dec_sym(a)) == SYMBOL_KIND_FUNDAMENTAL) {
+        ctx->K.sp = sp;
+        a = bc_fundamental(SYMBOL_IX(lbm_dec_sym(a)), &K[sp - n], n);
+        sp -= n + 1;
+        K[sp++] = a;
+        pc += 2;
+        break;
+      }
+      ctx->K.sp = sp;
+      bc_call_other(ctx, n, pc + 2, fp);
+      return;
+    case LBM_BC_RET: {
+      a = K[sp - 1];
+      lbm_uint header = fp + code[LBM_BC_HDR_NARGS];
+      b = K[header];
+      if (b == ENC_SYM_NIL) {
+        // Entered from the evaluator, drop the bytecode symbol too.
+        ctx->K.sp = fp - 2;
+        ctx->r = a;
+        ctx->app_cont = true;
+        return;
+      }
+      sp = fp - 1;
+      K[sp++] = a;
+      fp = lbm_dec_u(K[header + 1]);
+      pc = lbm_dec_u(b);
+      data = bc_code_data(K[fp - 1]);
+      code = bc_code_bytes(data);
+    } break;
+    default:
+      ctx->K.sp = sp;
+      ERROR_AT_CTX(ENC_SYM_FATAL_ERROR, ENC_SYM_BYTECODE);
+    }
+  }
+  // End of the slice, let the scheduler run other contexts.
+  ctx->K.sp = sp;
+  lbm_value *sptr = stack_reserve(ctx, 3);
+  sptr[0] = lbm_enc_u(pc);
+  sptr[1] = lbm_enc_u(fp);
+  sptr[2] = BC_RUN;
+  ctx->app_cont = true;
+}
+
+#undef BC_U16
+
+// cont_bc_run
+//
+// s[sp-2] = pc
+// s[sp-1] = frame pointer
+static void cont_bc_run(eval_context_t *ctx) {
+  lbm_value *sptr = pop_stack_ptr(ctx, 2);
+  bc_run(ctx, lbm_dec_u(sptr[1]), lbm_dec_u(sptr[0]));
+}
+
+// cont_bc_return
+//
+// s[sp-2] = pc
+// s[sp-1] = frame pointer
+//
+// ctx->r  = result of the call
+static void cont_bc_return(eval_context_t *ctx) {
+  lbm_value *sptr = get_stack_ptr(ctx, 2);
+  lbm_uint pc = lbm_dec_u(sptr[0]);
+  lbm_uint fp = lbm_dec_u(sptr[1]);
+  sptr[0] = ctx->r;
+  stack_drop(ctx, 1);
+  bc_run(ctx, fp, pc);
+}
+
+// cont_macro_memo
+//
+// s[sp-2] = call site
+// s[sp-1] = macro
+//
+// ctx->r  = expansion
+static void cont_macro_memo(eval_context_t *ctx) {
+  lbm_value *sptr = pop_stack_ptr(ctx, 2);
+#if LBM_MACRO_CACHE_SIZE > 0
+  macro_cache_entry_t *e = &macro_cache[macro_cache_ix(sptr[0])];
+  e->site = sptr[0];
+  e->macro = sptr[1];
+  e->expansion = ctx->r;
+#else
+  (void)sptr;
+#endif
+  ctx->app_cont = true;
+}
+
+// cont_prof_frame
+//
+// s[sp-2] = body of the closure that returned
+// s[sp-1] = PROF_FRAME
+//
+// ctx->r  = result of the closure
+static void cont_prof_frame(eval_context_t *ctx) {
+  stack_drop(ctx, 1);
+  ctx->app_cont = true;
+}
+
+// (closure params (bytecode code . params) env)
+static lbm_value bc_make_closure(lbm_value params, lbm_value code_obj, lbm_value env) {
+  lbm_value body = cons_with_gc(code_obj, params, ENC_SYM_NIL);
+  body = cons_with_gc(ENC_SYM_BYTECODE, body, ENC_SYM_NIL);
+  lbm_value res = cons_with_gc(env, ENC_SYM_NIL, body);
+  res = cons_with_gc(body, res, ENC_SYM_NIL);
+  res = cons_with_gc(params, res, ENC_SYM_NIL);
+  return cons_with_gc(ENC_SYM_CLOSURE, res, ENC_SYM_NIL);
+}
+
+#ifdef LBM_LEXICAL_ADDRESSING
+// Replace the closure in ctx->r by a compiled one if its body can be
+// compiled. Only closures created in the global environment are
+// compiled, as those are created once, while inner lambdas may be
+// created over and over.
+static void lexical_address(eval_context_t *ctx) {
+  if (!lbm_is_symbol_nil(ctx->curr_env)) return;
+  lbm_value cl = lbm_ref_cell(ctx->r)->cdr;
+  lbm_value cl0, cl1, cl2;
+  EXTRACT(cl, cl0); // CLO_PARAMS
+  EXTRACT(cl, cl1); // CLO_BODY
+  EXTRACT_NO_ADVANCE(cl, cl2); // CLO_ENV
+  lbm_value code_obj;
+  if (lbm_bc_compile(cl0, cl1, cl2, &code_obj) == LBM_BC_OK) {
+    ctx->r = bc_make_closure(cl0, code_obj, cl2);
+  }
+}
+#endif
+
+// (bytecode code arg0 ... argN-1)
+// Entry into the VM from the evaluator. The code object and the
+// arguments already form a frame on the stack.
+static void apply_bytecode(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
+  if (nargs >= 1 && lbm_is_lisp_array_r(args[0])) {
+    lbm_array_header_t *arr = (lbm_array_header_t*)lbm_car(args[0]);
+    lbm_value *data = (lbm_value*)arr->data;
+    if (arr->size >= LBM_BC_CODE_CONSTS * sizeof(lbm_value) &&
+        lbm_is_array_r(data[LBM_BC_CODE_BYTES])) {
+      uint8_t *code = bc_code_bytes(data);
+      if (code[LBM_BC_HDR_NARGS] != nargs - 1) {
+        lbm_set_error_reason(lbm_error_str_num_args);
+        ERROR_AT_CTX(ENC_SYM_EERROR, ENC_SYM_BYTECODE);
+      }
+      lbm_uint fp = ctx->K.sp - (nargs - 1);
+      if (!bc_code_valid(data) || !bc_frame_fits(ctx, fp, code)) {
+        bc_interpret(ctx, data, fp, nargs - 1);
+        return;
+      }
+      lbm_value *sptr = stack_reserve(ctx, LBM_BC_FRAME_HEADER);
+      sptr[0] = ENC_SYM_NIL; // No bytecode caller
+      sptr[1] = lbm_enc_u(0);
+      bc_run(ctx, fp, LBM_BC_ENTRY);
+      return;
+    }
+  }
+  ERROR_AT_CTX(ENC_SYM_TERROR, ENC_SYM_BYTECODE);
+}
+
+// (compile closure)
+static void apply_compile(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
+  if (nargs != 1 || !lbm_is_closure(args[0])) {
+    ERROR_AT_CTX(ENC_SYM_TERROR, ENC_SYM_COMPILE);
+  }
+  lbm_value fun = args[0];
+  if (bc_closure_code(fun) != ENC_SYM_NIL) {
+    stack_drop(ctx, 2);
+    ctx->r = fun;
+    ctx->app_cont = true;
+    return;
+  }
+  lbm_value cl = lbm_ref_cell(fun)->cdr;
+  lbm_value cl0, cl1, cl2;
+  EXTRACT(cl, cl0); // CLO_PARAMS
+  EXTRACT(cl, cl1); // CLO_BODY
+  EXTRACT_NO_ADVANCE(cl, cl2); // CLO_ENV
+
+  lbm_value code_obj;
+  int r = lbm_bc_compile(cl0, cl1, cl2, &code_obj);
+  if (r == LBM_BC_MERROR) {
+    gc();
+    r = lbm_bc_compile(cl0, cl1, cl2, &code_obj);
+  }
+  switch (r) {
+  case LBM_BC_OK: break;
+  case LBM_BC_MERROR: ERROR_CTX(ENC_SYM_MERROR);
+  case LBM_BC_TOO_LARGE:
+    lbm_set_error_reason("compile: function is too large");
+    ERROR_AT_CTX(ENC_SYM_EERROR, code_obj);
+  default:
+    lbm_set_error_reason("compile: unsupported form");
+    ERROR_AT_CTX(ENC_SYM_EERROR, code_obj);
+  }
+  lbm_value res = bc_make_closure(cl0, code_obj, cl2);
+  stack_drop(ctx, 2);
+  ctx->r = res;
+  ctx->app_cont = true;
+}
+
 // cont_cloure_application_args
 //
 // s[sp-5]  = environment to evaluate the args in.
@@ -3590,6 +4726,7 @@ static void cont_closure_application_args(eval_context_t *ctx) {
       stack_drop(ctx, 5);
       ctx->curr_env = binder;
       ctx->curr_exp = sptr[1]; //exp;
+      enter_closure(ctx, ctx->curr_exp); // Overwrites sptr.
     } else { // Not enough arguments
       lbm_set_error_reason((char*)lbm_error_str_num_args);
       ERROR_CTX(ENC_SYM_EERROR);
@@ -3615,12 +4752,11 @@ static void cont_closure_args_rest(eval_context_t *ctx) {
 #ifdef LBM_ALWAYS_GC
   gc();
 #endif
-  lbm_value binding = lbm_heap_state.freelist;
-  if (binding == ENC_SYM_NIL) {
+  if (!lbm_heap_has_free(1)) {
     gc();
-    binding = lbm_heap_state.freelist;
-    if (binding == ENC_SYM_NIL) ERROR_CTX(ENC_SYM_MERROR);
+    if (!lbm_heap_has_free(1)) ERROR_CTX(ENC_SYM_MERROR);
   }
+  lbm_value binding = lbm_heap_state.freelist;
   lbm_uint binding_ix = lbm_dec_ptr(binding);
   lbm_heap_state.freelist = heap[binding_ix].cdr;
   lbm_heap_state.num_free -= 1;
@@ -3632,6 +4768,7 @@ static void cont_closure_args_rest(eval_context_t *ctx) {
 
   if (args == ENC_SYM_NIL) {
     stack_drop(ctx, 5);
+    enter_closure(ctx, exp);
     ctx->curr_env = clo_env;
     ctx->curr_exp = exp;
   } else {
@@ -3888,6 +5025,7 @@ static void cont_map(eval_context_t *ctx) {
   lbm_value env = sptr[1];
   lbm_value t   = sptr[3]; // known cons!
   lbm_ref_cell(t)->car = ctx->r;
+  lbm_gc_write_barrier(t, ctx->r);
   //lbm_set_car(t, ctx->r); // update car field tailmost position.
   if (lbm_is_cons(ls)) {
     lbm_cons_t *cell = lbm_ref_cell(ls); // already checked that cons.
@@ -3896,10 +5034,12 @@ static void cont_map(eval_context_t *ctx) {
     sptr[0] = rest;
     stack_reserve(ctx,1)[0] = MAP;
     lbm_ref_cell(sptr[5])->car = next; // update known cons
+    lbm_gc_write_barrier(sptr[5], next);
     //lbm_set_car(sptr[5], next); // new arguments
 
     lbm_value elt = cons_with_gc(ENC_SYM_NIL, ENC_SYM_NIL, ENC_SYM_NIL);
     lbm_ref_cell(t)->cdr = elt;
+    lbm_gc_write_barrier(t, elt);
     //lbm_set_cdr(t, elt);
     sptr[3] = elt;  // (r1 ... rN . (nil . nil))
     ctx->curr_exp = sptr[4];
@@ -4729,6 +5869,7 @@ static void cont_read_append_array(eval_context_t *ctx) {
     ctx->app_cont = true;
   } else {
     ((lbm_uint*)arr->data)[ix] = ctx->r;
+    lbm_gc_write_barrier(array, ctx->r);
 
     sptr[2] = lbm_enc_u(ix + 1);
     lbm_value *rptr = stack_reserve(ctx, 2);
@@ -4798,6 +5939,7 @@ static void cont_read_append_continue(eval_context_t *ctx) {
     first_cell = last_cell = new_cell;
   } else {
     lbm_ref_cell(last_cell)->cdr = new_cell;
+    lbm_gc_write_barrier(last_cell, new_cell);
     last_cell = new_cell;
   }
 
@@ -4880,6 +6022,7 @@ static void cont_read_dot_terminate(eval_context_t *ctx) {
     READ_ERROR_CTX(lbm_channel_row(str), lbm_channel_column(str));
   } else if (lbm_is_cons(last_cell)) {
     lbm_ref_cell(last_cell)->cdr = ctx->r;
+    lbm_gc_write_barrier(last_cell, ctx->r);
     //lbm_set_cdr(last_cell, ctx->r);
     ctx->r = sptr[0]; // first cell
     lbm_value *rptr = stack_reserve(ctx, 1);
@@ -4971,6 +6114,7 @@ static void cont_application_start(eval_context_t *ctx) {
       } else { // No args
         if (lbm_is_symbol_nil(cl0)) { // No parameters
           stack_drop(ctx, 2);
+          enter_closure(ctx, cl1);
           ctx->curr_exp = cl1;
           ctx->curr_env = cl2;
         } else { // Not enough arguments
@@ -4989,7 +6133,7 @@ static void cont_application_start(eval_context_t *ctx) {
     case ENC_SYM_MACRO:{
       lbm_value env = (lbm_value)sptr[0];
       pop_stack_ptr(ctx, 2);
-      setup_macro(ctx, args, env);
+      setup_macro_site(ctx, args, env);
     } break;
     default:
       ERROR_CTX(ENC_SYM_EERROR);
@@ -5045,6 +6189,9 @@ static void cont_move_to_flash(eval_context_t *ctx) {
 
   if (lbm_is_symbol_nil(args)) {
     // Done looping over arguments. return true.
+    // Cached expansions may refer to the RAM copies of what was
+    // moved, drop them so that those can be freed.
+    lbm_macro_cache_clear();
     ctx->r = ENC_SYM_TRUE;
     ctx->app_cont = true;
     return;
@@ -5501,7 +6648,7 @@ static void cont_recv_to(eval_context_t *ctx) {
     if (ctx->num_mail > 0) {
       lbm_value e;
       lbm_value new_env = ctx->curr_env;
-      int n = find_match(sptr[0], ctx->mailbox, ctx->num_mail, &e, &new_env);
+      int n = find_match(sptr[0], ctx, &e, &new_env);
       if (n >= 0) { // match
         mailbox_remove_mail(ctx, (lbm_uint)n);
         ctx->curr_env = new_env;
@@ -5532,7 +6679,7 @@ static void cont_recv_to_retry(eval_context_t *ctx) {
   if (ctx->num_mail > 0) {
     lbm_value e;
     lbm_value new_env = ctx->curr_env;
-    int n = find_match(sptr[0], ctx->mailbox, ctx->num_mail, &e, &new_env);
+    int n = find_match(sptr[0], ctx, &e, &new_env);
     if (n >= 0) { // match
       mailbox_remove_mail(ctx, (lbm_uint)n);
       ctx->curr_env = new_env;
@@ -5614,6 +6761,10 @@ static const cont_fun continuations[NUM_CONTINUATIONS] =
     cont_read_append_array,
     cont_loop_env_prep,
     cont_read_next_token_grab_row,
+    cont_bc_run,
+    cont_bc_return,
+    cont_macro_memo,
+    cont_prof_frame,
   };
 
 /*********************************************************/
@@ -5766,6 +6917,7 @@ static void apply_apply(lbm_value *args, lbm_uint nargs, eval_context_t *ctx) {
           ERROR_AT_CTX(ENC_SYM_EERROR, fun);
         }
 
+        enter_closure(ctx, cl1);
         ctx->curr_env = env;
         ctx->curr_exp = cl1;
         return;
@@ -5847,21 +6999,16 @@ static void handle_event_unblock_ctx(lbm_cid cid, lbm_value v) {
     }
     found->r = v;
     found->state = LBM_THREAD_STATE_READY;
-    enqueue_ctx_nm(&queue,found);
+    enqueue_ready_nm(found);
   }
   lbm_mutex_unlock(&qmutex);
 }
 
 static void handle_event_define(lbm_value key, lbm_value val) {
-  lbm_uint dec_key = lbm_dec_sym(key);
-  lbm_uint ix_key  = dec_key & GLOBAL_ENV_MASK;
-  lbm_value *global_env = lbm_get_global_env();
-  lbm_uint orig_env = global_env[ix_key];
-  lbm_value new_env;
+  lbm_value res;
   // A key is a symbol and should not need to be remembered.
-  WITH_GC(new_env, lbm_env_set(orig_env,key,val));
-
-  global_env[ix_key] = new_env;
+  WITH_GC(res, lbm_global_env_set(key, val));
+  (void)res;
 }
 
 static lbm_value get_event_value(lbm_event_t *e) {
@@ -5919,6 +7066,11 @@ void lbm_add_eval_symbols(void) {
   lbm_add_symbol("y", &y);
   symbol_x = lbm_enc_sym(x);
   symbol_y = lbm_enc_sym(y);
+#if LBM_MACRO_CACHE_SIZE > 0
+  lbm_uint memo = 0;
+  lbm_add_symbol("memo", &memo);
+  symbol_memo = lbm_enc_sym(memo);
+#endif
 }
 
 
@@ -5942,15 +7094,14 @@ bool lbm_eval_step(int n) {
       n--;
     }
     if (ctx_running) {
-      enqueue_ctx_nm(&queue, ctx_running);
+      enqueue_ready_nm(ctx_running);
       ctx_running = NULL;
     }  
   } else {
     if (gc_requested) gc();
     process_events();
     lbm_mutex_lock(&qmutex);
-    wake_up_ctxs_nm();
-    ctx_running = dequeue_ctx_nm(&queue);
+    schedule_nm();
     lbm_mutex_unlock(&qmutex);
   }
   return busy;  
@@ -5959,8 +7110,13 @@ bool lbm_eval_step(int n) {
 bool lbm_eval_init(void) {
   blocked.first = NULL;
   blocked.last = NULL;
-  queue.first = NULL;
-  queue.last = NULL;
+  timers = NULL;
+  memset(&sched_stats, 0, sizeof(sched_stats));
+  memset(sched_wake_hist, 0, sizeof(sched_wake_hist));
+  sched_last_ctx = NULL;
+  lbm_macro_cache_clear();
+  memset(&macro_cache_stats, 0, sizeof(macro_cache_stats));
+  memset(queue, 0, sizeof(queue));
   ctx_running = NULL;
 
   if (!lbm_init_env()) return false;
@@ -5993,13 +7149,13 @@ void lbm_run_eval(void){
           is_atomic = false;
           blocked.first = NULL;
           blocked.last = NULL;
-          queue.first = NULL;
-          queue.last = NULL;
+          timers = NULL;
+          memset(queue, 0, sizeof(queue));
           ctx_running = NULL;
 #ifdef LBM_USE_TIME_QUOTA
           eval_time_quota = 0; // maybe timestamp here ?
 #else
-          eval_steps_quota = eval_steps_refill;
+          eval_steps_quota = steps_refill();
 #endif
           eval_cps_run_state = EVAL_CPS_STATE_RESET;
           if (blocking_extension) {
@@ -6011,7 +7167,7 @@ void lbm_run_eval(void){
         continue;
       case EVAL_CPS_STATE_PAUSED:
         if (eval_cps_run_state != EVAL_CPS_STATE_PAUSED) {
-          if (lbm_heap_num_free() < eval_cps_next_state_arg) {
+          if (!lbm_heap_has_free(eval_cps_next_state_arg)) {
             gc();
           }
           eval_cps_next_state_arg = 0;
@@ -6042,19 +7198,25 @@ void lbm_run_eval(void){
       } else {
         if (eval_cps_state_changed) break;
         if (!is_atomic) {
+          bool sweeping = false;
           if (gc_requested) {
             gc();
           }
+#ifdef LBM_GC_INCREMENTAL_SWEEP
+          else {
+            sweeping = gc_sweep_step();
+          }
+#endif
           process_events();
           lbm_mutex_lock(&qmutex);
           if (ctx_running) {
-            enqueue_ctx_nm(&queue, ctx_running);
+            enqueue_ready_nm(ctx_running);
             ctx_running = NULL;
           }
-          wake_up_ctxs_nm();
-          ctx_running = dequeue_ctx_nm(&queue);
+          schedule_nm();
           lbm_mutex_unlock(&qmutex);
-          if (!ctx_running) {
+          // Keep sweeping instead of sleeping when there is nothing to run.
+          if (!ctx_running && !sweeping) {
             lbm_system_sleeping = true;
             //Fixed sleep interval to poll events regularly.
             usleep_callback(EVAL_CPS_MIN_SLEEP);
@@ -6070,7 +7232,7 @@ void lbm_run_eval(void){
         // up to be just shy of an overflow, going through all the rest of
         // logic could potentially overflow the timestamp and create a situation
         // where the scheduled task has a humongous quota!
-        eval_current_quota = lbm_timestamp() + eval_time_refill;
+        eval_current_quota = lbm_timestamp() + time_refill();
       }
 #else
       if (eval_steps_quota && ctx_running) {
@@ -6078,27 +7240,35 @@ void lbm_run_eval(void){
         evaluation_step();
       } else {
         if (eval_cps_state_changed) break;
-        eval_steps_quota = eval_steps_refill;
         if (!is_atomic) {
+          bool sweeping = false;
           if (gc_requested) {
             gc();
           }
+#ifdef LBM_GC_INCREMENTAL_SWEEP
+          else {
+            sweeping = gc_sweep_step();
+          }
+#endif
           process_events();
           lbm_mutex_lock(&qmutex);
           if (ctx_running) {
-            enqueue_ctx_nm(&queue, ctx_running);
+            enqueue_ready_nm(ctx_running);
             ctx_running = NULL;
           }
-          wake_up_ctxs_nm();
-          ctx_running = dequeue_ctx_nm(&queue);
+          schedule_nm();
           lbm_mutex_unlock(&qmutex);
-          if (!ctx_running) {
+          // Keep sweeping instead of sleeping when there is nothing to run.
+          if (!ctx_running && !sweeping) {
             lbm_system_sleeping = true;
             //Fixed sleep interval to poll events regularly.
             usleep_callback(EVAL_CPS_MIN_SLEEP);
             lbm_system_sleeping = false;
           }
         }
+        // The quota depends on the priority of the context that was
+        // scheduled, so it is assigned last.
+        eval_steps_quota = steps_refill();
       }
 #endif
     }
@@ -6124,8 +7294,13 @@ bool lbm_eval_init(void) {
 
   blocked.first = NULL;
   blocked.last = NULL;
-  queue.first = NULL;
-  queue.last = NULL;
+  timers = NULL;
+  memset(&sched_stats, 0, sizeof(sched_stats));
+  memset(sched_wake_hist, 0, sizeof(sched_wake_hist));
+  sched_last_ctx = NULL;
+  lbm_macro_cache_clear();
+  memset(&macro_cache_stats, 0, sizeof(macro_cache_stats));
+  memset(queue, 0, sizeof(queue));
   ctx_running = NULL;
 
   eval_cps_run_state = EVAL_CPS_STATE_RUNNING;
@@ -25,6 +25,7 @@
 #include <lbm_c_interop.h>
 
 #include "extensions.h"
+#include "symrepr.h"
 #include "lbm_utils.h"
 
 static lbm_uint ext_max    = 0;
@@ -34,6 +35,7 @@ lbm_extension_t *extension_table = NULL;
 
 void lbm_extensions_set_next(lbm_uint i) {
   next_extension_ix = i;
+  lbm_symrepr_invalidate_index();
 }
 
 lbm_value lbm_extensions_default(lbm_value *args, lbm_uint argn) {
@@ -54,6 +56,7 @@ bool lbm_extensions_init(lbm_extension_t *extension_storage, lbm_uint extension_
 
   next_extension_ix = 0;
   ext_max = (lbm_uint)extension_storage_size;
+  lbm_symrepr_invalidate_index();
 
   return true;
 }
@@ -82,6 +85,10 @@ bool lbm_clr_extension(lbm_uint sym_id) {
   }
   extension_table[ext_id].name = NULL;
   extension_table[ext_id].fptr = lbm_extensions_default;
+#ifdef LBM_EXTENSION_STATS
+  memset(&extension_table[ext_id].stats, 0, sizeof(lbm_extension_stats_t));
+#endif
+  lbm_symrepr_invalidate_index();
   return true;
 }
 
@@ -97,6 +104,38 @@ bool lbm_lookup_extension_id(char *sym_str, lbm_uint *ix) {
   return false;
 }
 
+#ifdef LBM_EXTENSION_STATS
+void lbm_extension_stats_record(lbm_uint ext_id, uint32_t us) {
+  if (ext_id >= ext_max) return;
+  lbm_extension_stats_t *st = &extension_table[ext_id].stats;
+  st->calls ++;
+  st->total_us += us;
+  if (us > st->max_us) {
+    st->max_us = us;
+  }
+  // Bin 0 is up to 15us, each following bin doubles the limit.
+  lbm_uint bin = 0;
+  us >>= 4;
+  while (us && bin < LBM_EXTENSION_STATS_HIST_BINS - 1) {
+    us >>= 1;
+    bin ++;
+  }
+  st->hist[bin] ++;
+}
+
+bool lbm_get_extension_stats(lbm_uint ext_id, lbm_extension_stats_t *stats) {
+  if (ext_id >= ext_max) return false;
+  *stats = extension_table[ext_id].stats;
+  return true;
+}
+
+void lbm_extension_stats_reset(void) {
+  for (lbm_uint i = 0; i < ext_max; i ++) {
+    memset(&extension_table[i].stats, 0, sizeof(lbm_extension_stats_t));
+  }
+}
+#endif
+
 // Dynamically loaded (lbm) libraries use position independent code:
 // So a "ext-..." string could end up
 bool lbm_add_extension(const char *sym_str, extension_fptr ext) {
@@ -121,6 +160,7 @@ bool lbm_add_extension(const char *sym_str, extension_fptr ext) {
     lbm_uint sym_ix = next_extension_ix ++;
     extension_table[sym_ix].name = sym_str;
     extension_table[sym_ix].fptr = ext;
+    lbm_symrepr_index_add_extension(sym_ix);
     return true;
   }
   return false;
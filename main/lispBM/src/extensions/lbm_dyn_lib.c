@@ -100,15 +100,15 @@ static const char* lbm_dyn_fun[] = {
 
 #ifdef LBM_USE_DYN_MACROS
 static const char* lbm_dyn_macros[] = {
-  "(define defun (macro (name args body) (me-defun name args body)))",
-  "(define defunret (macro (name args body) (me-defunret name args body)))",
-  "(define defmacro (macro (name args body) `(define ,name (macro ,args ,body))))",
+  "(define defun (macro (name args body) (me-defun name args body) memo))",
+  "(define defunret (macro (name args body) (me-defunret name args body) memo))",
+  "(define defmacro (macro (name args body) `(define ,name (macro ,args ,body)) memo))",
 #ifdef LBM_USE_DYN_LOOPS
-  "(define loopfor (macro (it start cnd update body) (me-loopfor it start cnd update body)))",
-  "(define loopwhile (macro (cnd body) (me-loopwhile cnd body)))",
-  "(define looprange (macro (it start end body) (me-looprange it start end body)))",
-  "(define loopforeach (macro (it lst body) (me-loopforeach it lst body)))",
-  "(define loopwhile-thd (macro (stk cnd body) `(spawn ,@(if (list? stk) stk (list stk)) (fn () (loopwhile ,cnd ,body)))))",
+  "(define loopfor (macro (it start cnd update body) (me-loopfor it start cnd update body) memo))",
+  "(define loopwhile (macro (cnd body) (me-loopwhile cnd body) memo))",
+  "(define looprange (macro (it start end body) (me-looprange it start end body) memo))",
+  "(define loopforeach (macro (it lst body) (me-loopforeach it lst body) memo))",
+  "(define loopwhile-thd (macro (stk cnd body) `(spawn ,@(if (list? stk) stk (list stk)) (fn () (loopwhile ,cnd ,body))) memo))",
 #endif
 #ifdef LBM_USE_DYN_DEFSTRUCT
   "(define defstruct (macro (name list-of-fields)"
@@ -42,20 +42,63 @@ static lbm_uint sym_num_gc_recovered_cells;
 static lbm_uint sym_num_gc_recovered_arrays;
 static lbm_uint sym_num_least_free;
 static lbm_uint sym_num_last_free;
+static lbm_uint sym_gc_mark_time;
+static lbm_uint sym_gc_sweep_time;
+static lbm_uint sym_gc_max_pause;
+static lbm_uint sym_env_roots;
+static lbm_uint sym_env_used_roots;
+static lbm_uint sym_env_bindings;
+static lbm_uint sym_env_max_chain;
+static lbm_uint sym_env_avg_chain;
+static lbm_uint sym_env_cache_hits;
+static lbm_uint sym_env_cache_misses;
+static lbm_uint sym_sched_ctx_switches;
+static lbm_uint sym_sched_wake_ups;
+static lbm_uint sym_sched_timers;
+static lbm_uint sym_sched_max_wake_latency;
+static lbm_uint sym_sched_prio;
+static lbm_uint sym_sched_runs;
+static lbm_uint sym_sched_max_latency;
+static lbm_uint sym_sched_avg_latency;
 
 static lbm_uint little_endian = 0;
 static lbm_uint big_endian = 0;
 #endif
 
 lbm_value ext_eval_set_quota(lbm_value *args, lbm_uint argn) {
-  LBM_CHECK_ARGN_NUMBER(1);
-  uint32_t q = lbm_dec_as_u32(args[0]);
+  if (argn == 1 && lbm_is_number(args[0])) {
+    uint32_t q = lbm_dec_as_u32(args[0]);
 #ifdef LBM_USE_TIME_QUOTA
-  lbm_set_eval_time_quota(q);
+    lbm_set_eval_time_quota(q);
 #else
-  lbm_set_eval_step_quota(q);
+    lbm_set_eval_step_quota(q);
 #endif
-  return ENC_SYM_TRUE;
+    return ENC_SYM_TRUE;
+  }
+  if (argn == 2 && lbm_is_number(args[0]) && lbm_is_number(args[1])) {
+    uint32_t q = lbm_dec_as_u32(args[0]);
+    uint32_t prio = lbm_dec_as_u32(args[1]);
+    if (prio >= LBM_PRIO_LEVELS) return ENC_SYM_EERROR;
+#ifdef LBM_USE_TIME_QUOTA
+    lbm_set_eval_time_quota_prio(prio, q);
+#else
+    lbm_set_eval_step_quota_prio(prio, q);
+#endif
+    return ENC_SYM_TRUE;
+  }
+  return ENC_SYM_TERROR;
+}
+
+lbm_value ext_set_prio(lbm_value *args, lbm_uint argn) {
+  if (argn == 1 && lbm_is_number(args[0])) {
+    lbm_set_ctx_priority(lbm_get_current_cid(), lbm_dec_as_u32(args[0]));
+    return ENC_SYM_TRUE;
+  }
+  if (argn == 2 && lbm_is_number(args[0]) && lbm_is_number(args[1])) {
+    return lbm_set_ctx_priority(lbm_dec_as_i32(args[0]), lbm_dec_as_u32(args[1])) ?
+      ENC_SYM_TRUE : ENC_SYM_NIL;
+  }
+  return ENC_SYM_TERROR;
 }
 
 lbm_value ext_hide_trapped_error(lbm_value *args, lbm_uint argn) {
@@ -150,6 +193,92 @@ lbm_value ext_lbm_heap_state(lbm_value *args, lbm_uint argn) {
       res = lbm_enc_u(hs.gc_least_free);
     } else if (s == sym_num_last_free) {
       res = lbm_enc_u(hs.gc_last_free);
+    } else if (s == sym_gc_mark_time) {
+      res = lbm_enc_u(hs.gc_mark_time);
+    } else if (s == sym_gc_sweep_time) {
+      res = lbm_enc_u(hs.gc_sweep_time);
+    } else if (s == sym_gc_max_pause) {
+      res = lbm_enc_u(hs.gc_max_pause);
+    } else {
+      res = ENC_SYM_NIL;
+    }
+  }
+  return res;
+}
+
+lbm_value ext_gc_pause_histogram(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  lbm_value res = lbm_heap_allocate_list(LBM_GC_PAUSE_HIST_BINS);
+  if (lbm_is_cons(res)) {
+    const lbm_uint *hist = lbm_heap_gc_pause_hist();
+    lbm_value curr = res;
+    for (lbm_uint i = 0; i < LBM_GC_PAUSE_HIST_BINS; i ++) {
+      lbm_set_car(curr, lbm_enc_u(hist[i]));
+      curr = lbm_cdr(curr);
+    }
+  }
+  return res;
+}
+
+lbm_value ext_gc_telemetry(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  lbm_value res;
+  lbm_uint size = lbm_heap_gc_telemetry_size();
+  if (!lbm_heap_allocate_array(&res, size)) {
+    return ENC_SYM_MERROR;
+  }
+  lbm_array_header_t *arr = lbm_dec_array_r(res);
+  lbm_heap_gc_telemetry((uint8_t*)arr->data, arr->size);
+  return res;
+}
+
+lbm_value ext_sched_state(lbm_value *args, lbm_uint argn) {
+
+  lbm_value res = ENC_SYM_TERROR;
+
+  lbm_sched_stats_t st;
+  lbm_get_sched_stats(&st);
+
+  if (argn == 1 &&
+      lbm_is_symbol(args[0])) {
+    lbm_uint s = lbm_dec_sym(args[0]);
+    if (s == sym_sched_ctx_switches) {
+      res = lbm_enc_u(st.ctx_switches);
+    } else if (s == sym_sched_wake_ups) {
+      res = lbm_enc_u(st.wake_ups);
+    } else if (s == sym_sched_timers) {
+      res = lbm_enc_u(st.timers);
+    } else if (s == sym_sched_max_wake_latency) {
+      res = lbm_enc_u(st.max_wake_latency);
+    } else {
+      res = ENC_SYM_NIL;
+    }
+  }
+  return res;
+}
+
+lbm_value ext_sched_ctx_state(lbm_value *args, lbm_uint argn) {
+
+  lbm_value res = ENC_SYM_TERROR;
+
+  if (argn == 2 &&
+      lbm_is_number(args[0]) &&
+      lbm_is_symbol(args[1])) {
+    lbm_ctx_sched_stats_t st;
+    if (!lbm_get_ctx_sched_stats(lbm_dec_as_i32(args[0]), &st)) {
+      return ENC_SYM_NIL;
+    }
+    lbm_uint s = lbm_dec_sym(args[1]);
+    if (s == sym_sched_prio) {
+      res = lbm_enc_u(st.priority);
+    } else if (s == sym_sched_runs) {
+      res = lbm_enc_u(st.runs);
+    } else if (s == sym_sched_max_latency) {
+      res = lbm_enc_u(st.max_latency);
+    } else if (s == sym_sched_avg_latency) {
+      res = lbm_enc_u(st.runs ? st.total_latency / st.runs : 0);
     } else {
       res = ENC_SYM_NIL;
     }
@@ -157,6 +286,98 @@ lbm_value ext_lbm_heap_state(lbm_value *args, lbm_uint argn) {
   return res;
 }
 
+lbm_value ext_sched_wake_histogram(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  lbm_value res = lbm_heap_allocate_list(LBM_SCHED_WAKE_HIST_BINS);
+  if (lbm_is_cons(res)) {
+    const lbm_uint *hist = lbm_sched_wake_hist();
+    lbm_value curr = res;
+    for (lbm_uint i = 0; i < LBM_SCHED_WAKE_HIST_BINS; i ++) {
+      lbm_set_car(curr, lbm_enc_u(hist[i]));
+      curr = lbm_cdr(curr);
+    }
+  }
+  return res;
+}
+
+#ifdef LBM_EXTENSION_STATS
+// Order extensions by total time, descending, with ties broken by index.
+static bool ext_stats_before(lbm_extension_stats_t *a, lbm_uint a_ix,
+                             lbm_extension_stats_t *b, lbm_uint b_ix) {
+  return (a->total_us > b->total_us ||
+          (a->total_us == b->total_us && a_ix < b_ix));
+}
+
+lbm_value ext_ext_stats(lbm_value *args, lbm_uint argn) {
+  lbm_uint n = lbm_get_num_extensions();
+  if (argn == 1 && lbm_is_number(args[0])) {
+    n = lbm_dec_as_u32(args[0]);
+  } else if (argn != 0) {
+    return ENC_SYM_TERROR;
+  }
+
+  lbm_uint num_called = 0;
+  lbm_uint num_ext = lbm_get_num_extensions();
+  for (lbm_uint i = 0; i < num_ext; i ++) {
+    if (extension_table[i].stats.calls) num_called ++;
+  }
+  if (n > num_called) n = num_called;
+
+  lbm_value res = lbm_heap_allocate_list(n);
+  if (!lbm_is_list(res)) return res;
+
+  // Selection by repeated scans keeps this free of temporary storage.
+  lbm_extension_stats_t *prev = NULL;
+  lbm_uint prev_ix = 0;
+  lbm_value curr = res;
+  while (lbm_is_cons(curr)) {
+    lbm_extension_stats_t *best = NULL;
+    lbm_uint best_ix = 0;
+    for (lbm_uint i = 0; i < num_ext; i ++) {
+      lbm_extension_stats_t *st = &extension_table[i].stats;
+      if (st->calls == 0) continue;
+      if (prev && !ext_stats_before(prev, prev_ix, st, i)) continue;
+      if (!best || ext_stats_before(st, i, best, best_ix)) {
+        best = st;
+        best_ix = i;
+      }
+    }
+    // (name calls total-us max-us (hist ...))
+    lbm_value entry = lbm_heap_allocate_list(5 + LBM_EXTENSION_STATS_HIST_BINS);
+    if (!lbm_is_cons(entry)) return entry;
+    lbm_value total = lbm_enc_u64(best->total_us);
+    if (lbm_is_symbol_merror(total)) return total;
+    lbm_value e = entry;
+    lbm_set_car(e, lbm_enc_sym(EXTENSION_SYMBOLS_START + best_ix)); e = lbm_cdr(e);
+    lbm_set_car(e, lbm_enc_u(best->calls)); e = lbm_cdr(e);
+    lbm_set_car(e, total); e = lbm_cdr(e);
+    lbm_set_car(e, lbm_enc_u(best->max_us)); e = lbm_cdr(e);
+    // The remaining cells become the histogram list.
+    lbm_value hist = lbm_cdr(e);
+    lbm_set_cdr(e, ENC_SYM_NIL);
+    lbm_set_car(e, hist);
+    lbm_value h = hist;
+    for (lbm_uint i = 0; i < LBM_EXTENSION_STATS_HIST_BINS; i ++) {
+      lbm_set_car(h, lbm_enc_u(best->hist[i]));
+      h = lbm_cdr(h);
+    }
+    lbm_set_car(curr, entry);
+    curr = lbm_cdr(curr);
+    prev = best;
+    prev_ix = best_ix;
+  }
+  return res;
+}
+
+lbm_value ext_ext_stats_reset(lbm_value *args, lbm_uint argn) {
+  (void) args;
+  (void) argn;
+  lbm_extension_stats_reset();
+  return ENC_SYM_TRUE;
+}
+#endif
+
 lbm_value ext_env_get(lbm_value *args, lbm_uint argn) {
   if (argn == 1 && lbm_is_number(args[0])) {
     lbm_uint ix = lbm_dec_as_u32(args[0]) & GLOBAL_ENV_MASK;
@@ -177,6 +398,7 @@ lbm_value ext_env_set(lbm_value *args, lbm_uint argn) {
     lbm_uint ix = lbm_dec_as_u32(args[0]) & GLOBAL_ENV_MASK;
     lbm_value *glob_env = lbm_get_global_env();
     glob_env[ix] = args[1];
+    lbm_global_env_flush_cache();
     return ENC_SYM_TRUE;
   }
   return ENC_SYM_NIL;
@@ -186,6 +408,8 @@ lbm_value ext_env_drop(lbm_value *args, lbm_uint argn) {
   lbm_value r = ENC_SYM_TERROR;
   if (argn == 2 && lbm_is_symbol(args[0])) {
     r = lbm_env_drop_binding(args[1], args[0]);
+    // The environment can be a part of the global environment.
+    lbm_global_env_flush_cache();
   }
   return r;
 }
@@ -196,6 +420,40 @@ lbm_value ext_global_env_size(lbm_value *args, lbm_uint argn) {
   return lbm_enc_u(lbm_get_global_env_size());
 }
 
+lbm_value ext_global_env_state(lbm_value *args, lbm_uint argn) {
+
+  lbm_value res = ENC_SYM_TERROR;
+
+  lbm_global_env_stats_t st;
+  lbm_get_global_env_stats(&st);
+
+  if (argn == 1 &&
+      lbm_is_symbol(args[0])) {
+    lbm_uint s = lbm_dec_sym(args[0]);
+    if (s == sym_env_roots) {
+      res = lbm_enc_u(st.roots);
+    } else if (s == sym_env_used_roots) {
+      res = lbm_enc_u(st.used_roots);
+    } else if (s == sym_env_bindings) {
+      res = lbm_enc_u(st.bindings);
+    } else if (s == sym_env_max_chain) {
+      res = lbm_enc_u(st.max_chain);
+    } else if (s == sym_env_avg_chain) {
+      // Average over roots that are in use, which is the expected
+      // length of the chain walked when looking up a bound symbol.
+      float avg = st.used_roots ? (float)st.bindings / (float)st.used_roots : 0.0f;
+      res = lbm_enc_float(avg);
+    } else if (s == sym_env_cache_hits) {
+      res = lbm_enc_u(st.cache_hits);
+    } else if (s == sym_env_cache_misses) {
+      res = lbm_enc_u(st.cache_misses);
+    } else {
+      res = ENC_SYM_NIL;
+    }
+  }
+  return res;
+}
+
 lbm_value ext_set_gc_stack_size(lbm_value *args, lbm_uint argn) {
   if (argn == 1) {
     if (lbm_is_number(args[0])) {
@@ -284,9 +542,9 @@ lbm_value ext_mailbox_get(lbm_uint *args, lbm_uint argn) {
       res = ls;
       if (lbm_is_ptr(ls)) {
         lbm_value curr = ls;
-        int i = 0;
+        lbm_uint i = 0;
         while (lbm_is_ptr(curr)) {
-          lbm_set_car(curr, ctx->mailbox[i++]);
+          lbm_set_car(curr, lbm_mailbox_get(ctx, i++));
           curr = lbm_cdr(curr);
         }
       }
@@ -310,6 +568,24 @@ void lbm_runtime_extensions_init(void) {
     lbm_add_symbol_const("get-gc-num-recovered-arrays", &sym_num_gc_recovered_arrays);
     lbm_add_symbol_const("get-gc-num-least-free", &sym_num_least_free);
     lbm_add_symbol_const("get-gc-num-last-free", &sym_num_last_free);
+    lbm_add_symbol_const("get-gc-mark-time", &sym_gc_mark_time);
+    lbm_add_symbol_const("get-gc-sweep-time", &sym_gc_sweep_time);
+    lbm_add_symbol_const("get-gc-max-pause", &sym_gc_max_pause);
+    lbm_add_symbol_const("get-env-roots", &sym_env_roots);
+    lbm_add_symbol_const("get-env-used-roots", &sym_env_used_roots);
+    lbm_add_symbol_const("get-env-bindings", &sym_env_bindings);
+    lbm_add_symbol_const("get-env-max-chain", &sym_env_max_chain);
+    lbm_add_symbol_const("get-env-avg-chain", &sym_env_avg_chain);
+    lbm_add_symbol_const("get-env-cache-hits", &sym_env_cache_hits);
+    lbm_add_symbol_const("get-env-cache-misses", &sym_env_cache_misses);
+    lbm_add_symbol_const("get-ctx-switches", &sym_sched_ctx_switches);
+    lbm_add_symbol_const("get-wake-ups", &sym_sched_wake_ups);
+    lbm_add_symbol_const("get-timers", &sym_sched_timers);
+    lbm_add_symbol_const("get-max-wake-latency", &sym_sched_max_wake_latency);
+    lbm_add_symbol_const("get-prio", &sym_sched_prio);
+    lbm_add_symbol_const("get-runs", &sym_sched_runs);
+    lbm_add_symbol_const("get-max-latency", &sym_sched_max_latency);
+    lbm_add_symbol_const("get-avg-latency", &sym_sched_avg_latency);
 
     lbm_add_symbol_const("little-endian", &little_endian);
     lbm_add_symbol_const("big-endian", &big_endian);
@@ -318,13 +594,19 @@ void lbm_runtime_extensions_init(void) {
 #if defined(LBM_USE_EXT_MAILBOX_GET) || defined(FULL_RTS_LIB)
     lbm_add_extension("mailbox-get", ext_mailbox_get);
 #endif
+#ifdef LBM_EXTENSION_STATS
+    lbm_add_extension("ext-stats", ext_ext_stats);
+    lbm_add_extension("ext-stats-reset", ext_ext_stats_reset);
+#endif
 #ifndef FULL_RTS_LIB
     lbm_add_extension("set-eval-quota", ext_eval_set_quota);
+    lbm_add_extension("set-prio", ext_set_prio);
     lbm_add_extension("hide-trapped-error", ext_hide_trapped_error);
     lbm_add_extension("show-trapped-error", ext_show_trapped_error);
 #else
     lbm_add_extension("is-always-gc",ext_is_always_gc);
     lbm_add_extension("set-eval-quota", ext_eval_set_quota);
+    lbm_add_extension("set-prio", ext_set_prio);
     lbm_add_extension("hide-trapped-error", ext_hide_trapped_error);
     lbm_add_extension("show-trapped-error", ext_show_trapped_error);
     lbm_add_extension("mem-num-free", ext_memory_num_free);
@@ -334,11 +616,17 @@ void lbm_runtime_extensions_init(void) {
     lbm_add_extension("lbm-version", ext_lbm_version);
     lbm_add_extension("lbm-endian", ext_lbm_endianness);
     lbm_add_extension("lbm-heap-state", ext_lbm_heap_state);
+    lbm_add_extension("gc-pause-histogram", ext_gc_pause_histogram);
+    lbm_add_extension("gc-telemetry", ext_gc_telemetry);
+    lbm_add_extension("sched-state", ext_sched_state);
+    lbm_add_extension("sched-wake-histogram", ext_sched_wake_histogram);
+    lbm_add_extension("sched-ctx-state", ext_sched_ctx_state);
     lbm_add_extension("env-get", ext_env_get);
     lbm_add_extension("env-set", ext_env_set);
     lbm_add_extension("env-drop", ext_env_drop);
     lbm_add_extension("local-env-get", ext_local_env_get);
     lbm_add_extension("global-env-size", ext_global_env_size);
+    lbm_add_extension("global-env-state", ext_global_env_state);
     lbm_add_extension("set-gc-stack-size", ext_set_gc_stack_size);
     lbm_add_extension("is-64bit", ext_is_64bit);
     lbm_add_extension("symtab-size", ext_symbol_table_size);
@@ -731,27 +731,15 @@ static lbm_value fundamental_append(lbm_value *args, lbm_uint nargs) {
 }
 
 static lbm_value fundamental_undefine(lbm_value *args, lbm_uint nargs) {
-  lbm_value *global_env = lbm_get_global_env();
   if (nargs == 1 && lbm_is_symbol(args[0])) {
-    lbm_value key = args[0];
-    lbm_uint ix_key = lbm_dec_sym(key) & GLOBAL_ENV_MASK;
-    lbm_value env = global_env[ix_key];
-    lbm_value res = lbm_env_drop_binding(env, key);
-    if (res == ENC_SYM_NOT_FOUND) {
+    if (lbm_global_env_drop(args[0]) == ENC_SYM_NOT_FOUND) {
       return ENC_SYM_NIL;
     }
-    global_env[ix_key] = res;
     return ENC_SYM_TRUE;
   } else if (nargs == 1 && lbm_is_cons(args[0])) {
     lbm_value curr = args[0];
     while (lbm_type_of(curr) == LBM_TYPE_CONS) {
-      lbm_value key = lbm_car(curr);
-      lbm_uint ix_key = lbm_dec_sym(key) & GLOBAL_ENV_MASK;
-      lbm_value env = global_env[ix_key];
-      lbm_value res = lbm_env_drop_binding(env, key);
-      if (res != ENC_SYM_NOT_FOUND) {
-        global_env[ix_key] = res;
-      }
+      lbm_global_env_drop(lbm_car(curr));
       curr = lbm_cdr(curr);
     }
     return ENC_SYM_TRUE;
@@ -866,6 +854,7 @@ static lbm_value fundamental_set_ix(lbm_value *args, lbm_uint nargs) {
         lbm_value next = curr_cell->cdr;
         if (i == ix) {
           curr_cell->car = args[2];
+          lbm_gc_write_barrier(curr, args[2]);
           result = args[0]; // Acts as true and as itself.
           break;
         } else if (lbm_is_symbol_nil(next)) {
@@ -883,6 +872,7 @@ static lbm_value fundamental_set_ix(lbm_value *args, lbm_uint nargs) {
       if (index < 0) index = (int32_t)size + index;
       if ((uint32_t)index < size) {
         arrdata[index] = args[2]; // value
+        lbm_gc_write_barrier(args[0], args[2]);
         result = args[0];
       }  // index out of range will be eval error.
     }
@@ -937,6 +927,7 @@ static lbm_value set_assoc(lbm_value assoc_list, lbm_value keyval) {
     if (struct_eq(key, lbm_car(curr_cell->car))) {
       if (!lbm_ptr_is_constant(curr)) {
         curr_cell->car = keyval;
+        lbm_gc_write_barrier(curr, keyval);
       }
       return assoc_list;
     }
@@ -1292,7 +1283,7 @@ static lbm_value fundamental_range(lbm_value *args, lbm_uint nargs) {
 
   int num = end - start;
 
-  if ((unsigned int)num > lbm_heap_num_free()) {
+  if (!lbm_heap_has_free((lbm_uint)num)) {
     return ENC_SYM_MERROR;
   }
 
@@ -47,6 +47,114 @@ static inline bool lbm_get_gc_mark(lbm_value x) {
   return x & LBM_GC_MASK;
 }
 
+#ifdef LBM_GC_INCREMENTAL_SWEEP
+#ifdef LBM_USE_GC_PTR_REV
+#error "LBM_GC_INCREMENTAL_SWEEP cannot be used with LBM_USE_GC_PTR_REV"
+#endif
+#ifdef LBM_GC_GENERATIONAL
+#error "LBM_GC_INCREMENTAL_SWEEP cannot be used with LBM_GC_GENERATIONAL"
+#endif
+// With incremental sweep the evaluator runs while part of the heap is
+// unswept. The mutator reads and writes cdr fields without masking out
+// the GC bit, so the mark phase keeps its marks in a bitmap instead.
+// The cdr bit is still used by lbm_ptr_rev_trav.
+#define GC_MARK_BITMAP
+#endif
+
+#ifdef LBM_GC_GENERATIONAL
+#ifdef LBM_USE_GC_PTR_REV
+#error "LBM_GC_GENERATIONAL cannot be used with LBM_USE_GC_PTR_REV"
+#endif
+// In generational mode the marks in the bitmap are kept by the sweep.
+// A marked cell is old and a minor collection stops marking when it
+// reaches one, so only the cells allocated since the last collection
+// are marked and freed. Old cells that are made to point to other cells
+// are recorded by lbm_gc_write_barrier and traced again by the next
+// minor collection. A full collection clears the bitmap first.
+//
+// Cells marked outside of a collection, by the evaluator protecting
+// values before calling GC and by lbm_ptr_rev_trav, get the cdr bit.
+// That marking does not stop at old cells, so the cdr marks are still
+// complete if the bitmap is cleared before the collection is done.
+#define GC_MARK_BITMAP
+static lbm_uint *gc_remembered_bitmap = NULL;
+static lbm_value gc_remembered[LBM_GC_REMEMBERED_SIZE];
+static lbm_uint gc_remembered_num = 0;
+static lbm_uint gc_old_num = 0;         // Old cells after the last sweep.
+static lbm_uint gc_premarked = 0;       // Cells marked outside of a collection.
+static lbm_uint gc_full_free = 0;       // Free cells after the last full collection.
+static bool gc_collecting = false;      // From lbm_gc_state_inc to the sweep.
+static bool gc_full_pending = false;
+#endif
+
+#ifdef GC_MARK_BITMAP
+#define GC_BITMAP_BITS (sizeof(lbm_uint) * 8)
+static lbm_uint *gc_bitmap = NULL;
+static lbm_uint *gc_bitmap_storage = NULL;
+static lbm_uint gc_bitmap_storage_size = 0;
+
+static inline bool gc_bitmap_get(lbm_uint *bm, lbm_uint ix) {
+  return (bm[ix / GC_BITMAP_BITS] >> (ix % GC_BITMAP_BITS)) & 1;
+}
+
+static inline void gc_bitmap_set(lbm_uint *bm, lbm_uint ix) {
+  bm[ix / GC_BITMAP_BITS] |= (lbm_uint)1 << (ix % GC_BITMAP_BITS);
+}
+
+static inline void gc_bitmap_clr(lbm_uint *bm, lbm_uint ix) {
+  bm[ix / GC_BITMAP_BITS] &= ~((lbm_uint)1 << (ix % GC_BITMAP_BITS));
+}
+
+static inline lbm_uint gc_bitmap_words(void) {
+  return (lbm_heap_state.heap_size + GC_BITMAP_BITS - 1) / GC_BITMAP_BITS;
+}
+#endif
+
+static lbm_uint sweep_pos = 0;    // Next cell to sweep, heap_size when done.
+static lbm_uint sweep_chunk = LBM_GC_SWEEP_CHUNK;
+static bool sweep_full = false;   // Sweep everything at once after a traversal.
+static bool gc_full = true;       // The current collection marks the whole heap.
+static lbm_uint gc_pause_hist[LBM_GC_PAUSE_HIST_BINS];
+#if LBM_GC_TELEMETRY_SIZE > 0
+// The record of the current collection is filled in as the collection
+// progresses and is added to the buffer when the time of the final
+// part of the sweep has been accounted.
+static lbm_gc_record_t gc_records[LBM_GC_TELEMETRY_SIZE];
+static lbm_uint gc_records_num = 0; // Total number of records added.
+static lbm_gc_record_t gc_record;
+static lbm_uint gc_record_arrays = 0; // gc_recovered_arrays at start.
+static lbm_uint gc_record_free = 0;   // num_free at start.
+static bool gc_record_open = false;
+#endif
+
+static inline bool gc_cell_marked(lbm_cons_t *cell) {
+#ifdef LBM_GC_GENERATIONAL
+  if (!gc_collecting) return lbm_get_gc_mark(cell->cdr);
+#endif
+#ifdef GC_MARK_BITMAP
+  return gc_bitmap_get(gc_bitmap, (lbm_uint)(cell - lbm_heap_state.heap)) ||
+    lbm_get_gc_mark(cell->cdr);
+#else
+  return lbm_get_gc_mark(cell->cdr);
+#endif
+}
+
+static inline void gc_cell_set_mark(lbm_cons_t *cell) {
+#ifdef LBM_GC_GENERATIONAL
+  if (!gc_collecting) {
+    cell->cdr = lbm_set_gc_mark(cell->cdr);
+    gc_premarked ++;
+    sweep_full = true;
+    return;
+  }
+#endif
+#ifdef GC_MARK_BITMAP
+  gc_bitmap_set(gc_bitmap, (lbm_uint)(cell - lbm_heap_state.heap));
+#else
+  cell->cdr = lbm_set_gc_mark(cell->cdr);
+#endif
+}
+
 static inline void gc_mark(lbm_value c) {
   //c must be a cons cell.
   lbm_cons_t *cell = lbm_ref_cell(c);
@@ -54,8 +162,7 @@ static inline void gc_mark(lbm_value c) {
 }
 
 static inline bool gc_marked(lbm_value c) {
-  lbm_cons_t *cell = lbm_ref_cell(c);
-  return lbm_get_gc_mark(cell->cdr);
+  return gc_cell_marked(lbm_ref_cell(c));
 }
 
 __attribute__((unused)) static inline void gc_clear_mark(lbm_value c) {
@@ -569,14 +676,182 @@ static void heap_init_state(lbm_cons_t *addr, lbm_uint num_cells,
   lbm_heap_state.gc_recovered_arrays = 0;
   lbm_heap_state.gc_least_free       = num_cells;
   lbm_heap_state.gc_last_free        = num_cells;
+  lbm_heap_state.gc_mark_time        = 0;
+  lbm_heap_state.gc_sweep_time       = 0;
+  lbm_heap_state.gc_max_pause        = 0;
+  lbm_heap_state.gc_total_time       = 0;
+  lbm_heap_state.gc_full_num         = 0;
+
+  sweep_pos = num_cells;
+  sweep_full = false;
+  gc_full = true;
+#ifdef LBM_GC_GENERATIONAL
+  gc_remembered_num = 0;
+  gc_old_num = 0;
+  gc_premarked = 0;
+  gc_full_free = num_cells;
+  gc_collecting = false;
+  gc_full_pending = false;
+#endif
+  memset(gc_pause_hist, 0, sizeof(gc_pause_hist));
+#if LBM_GC_TELEMETRY_SIZE > 0
+  gc_records_num = 0;
+  gc_record_open = false;
+#endif
+}
+
+#if LBM_GC_TELEMETRY_SIZE > 0
+static void gc_record_start(void) {
+  memset(&gc_record, 0, sizeof(gc_record));
+  gc_record.gc_num = (uint32_t)lbm_heap_state.gc_num;
+  gc_record_arrays = lbm_heap_state.gc_recovered_arrays;
+  gc_record_free = lbm_heap_state.num_free;
+  gc_record_open = true;
+}
+
+static void gc_record_sweep_done(void) {
+  if (!gc_record_open) return;
+  // The sweep rebuilds the whole freelist, so gc_recovered also counts
+  // cells that were free before the collection.
+  if (lbm_heap_state.num_free > gc_record_free) {
+    gc_record.recovered = (uint32_t)(lbm_heap_state.num_free - gc_record_free);
+  }
+  gc_record.recovered_arrays = (uint32_t)(lbm_heap_state.gc_recovered_arrays - gc_record_arrays);
+  gc_record.num_free = (uint32_t)lbm_heap_state.num_free;
+  gc_record.mem_free = (uint32_t)lbm_memory_num_free();
+  gc_record.mem_longest_free = (uint32_t)lbm_memory_longest_free();
 }
 
+static void gc_record_end(void) {
+  if (!gc_record_open) return;
+  gc_record.mark_time = (uint32_t)lbm_heap_state.gc_mark_time;
+  gc_record.sweep_time = (uint32_t)lbm_heap_state.gc_sweep_time;
+  gc_records[gc_records_num % LBM_GC_TELEMETRY_SIZE] = gc_record;
+  gc_records_num ++;
+  gc_record_open = false;
+}
+#endif
+
 void lbm_heap_new_freelist_length(void) {
   lbm_heap_state.gc_last_free = lbm_heap_state.num_free;
   if (lbm_heap_state.num_free < lbm_heap_state.gc_least_free)
       lbm_heap_state.gc_least_free = lbm_heap_state.num_free;
 }
 
+void lbm_heap_new_gc_time(lbm_uint dur) {
+  lbm_heap_state.gc_total_time += dur;
+  if (dur > lbm_heap_state.gc_max_pause) {
+    lbm_heap_state.gc_max_pause = dur;
+  }
+  // Bin 0 is pauses up to 15us, each following bin doubles the limit.
+  lbm_uint bin = 0;
+  dur >>= 4;
+  while (dur && bin < LBM_GC_PAUSE_HIST_BINS - 1) {
+    dur >>= 1;
+    bin ++;
+  }
+  gc_pause_hist[bin] ++;
+}
+
+void lbm_heap_new_mark_time(lbm_uint dur) {
+  lbm_heap_state.gc_mark_time = dur;
+}
+
+void lbm_heap_new_sweep_time(lbm_uint dur) {
+  lbm_heap_state.gc_sweep_time += dur;
+#if LBM_GC_TELEMETRY_SIZE > 0
+  if (!lbm_gc_sweep_pending()) gc_record_end();
+#endif
+}
+
+const lbm_uint *lbm_heap_gc_pause_hist(void) {
+  return gc_pause_hist;
+}
+
+static lbm_uint gc_records_count(void) {
+#if LBM_GC_TELEMETRY_SIZE > 0
+  return gc_records_num < LBM_GC_TELEMETRY_SIZE ? gc_records_num : LBM_GC_TELEMETRY_SIZE;
+#else
+  return 0;
+#endif
+}
+
+lbm_uint lbm_heap_gc_records(lbm_gc_record_t *records, lbm_uint max) {
+#if LBM_GC_TELEMETRY_SIZE > 0
+  lbm_uint n = gc_records_count();
+  if (n > max) n = max;
+  lbm_uint first = gc_records_num - n;
+  for (lbm_uint i = 0; i < n; i ++) {
+    records[i] = gc_records[(first + i) % LBM_GC_TELEMETRY_SIZE];
+  }
+  return n;
+#else
+  (void)records;
+  (void)max;
+  return 0;
+#endif
+}
+
+#define GC_TELEMETRY_HEADER_WORDS 11
+#define GC_RECORD_WORDS (sizeof(lbm_gc_record_t) / sizeof(uint32_t))
+
+static void gc_telemetry_put(uint8_t *buf, lbm_uint *ix, lbm_uint v) {
+  uint32_t w = (uint32_t)v;
+  buf[(*ix)++] = (uint8_t)(w >> 24);
+  buf[(*ix)++] = (uint8_t)(w >> 16);
+  buf[(*ix)++] = (uint8_t)(w >> 8);
+  buf[(*ix)++] = (uint8_t)w;
+}
+
+lbm_uint lbm_heap_gc_telemetry_size(void) {
+  return 4 + 4 * (GC_TELEMETRY_HEADER_WORDS +
+                  LBM_GC_PAUSE_HIST_BINS +
+                  gc_records_count() * GC_RECORD_WORDS);
+}
+
+lbm_uint lbm_heap_gc_telemetry(uint8_t *buf, lbm_uint size) {
+  if (size < lbm_heap_gc_telemetry_size()) return 0;
+  lbm_gc_record_t records[LBM_GC_TELEMETRY_SIZE > 0 ? LBM_GC_TELEMETRY_SIZE : 1];
+  lbm_uint n = lbm_heap_gc_records(records, LBM_GC_TELEMETRY_SIZE);
+
+  lbm_uint ix = 0;
+  buf[ix++] = LBM_GC_TELEMETRY_VERSION;
+  buf[ix++] = (uint8_t)LBM_GC_PAUSE_HIST_BINS;
+  buf[ix++] = (uint8_t)n;
+  buf[ix++] = 0;
+  gc_telemetry_put(buf, &ix, lbm_heap_state.gc_num);
+  gc_telemetry_put(buf, &ix, lbm_heap_state.gc_full_num);
+  gc_telemetry_put(buf, &ix, lbm_heap_state.gc_max_pause);
+  gc_telemetry_put(buf, &ix, lbm_heap_state.gc_total_time);
+  gc_telemetry_put(buf, &ix, lbm_heap_state.heap_size);
+  gc_telemetry_put(buf, &ix, lbm_heap_state.num_free);
+  gc_telemetry_put(buf, &ix, lbm_heap_state.gc_least_free);
+  gc_telemetry_put(buf, &ix, lbm_memory_num_words());
+  gc_telemetry_put(buf, &ix, lbm_memory_num_free());
+  gc_telemetry_put(buf, &ix, lbm_memory_longest_free());
+  gc_telemetry_put(buf, &ix, lbm_memory_maximum_used());
+  for (lbm_uint i = 0; i < LBM_GC_PAUSE_HIST_BINS; i ++) {
+    gc_telemetry_put(buf, &ix, gc_pause_hist[i]);
+  }
+  for (lbm_uint i = 0; i < n; i ++) {
+    uint32_t *w = (uint32_t*)&records[i];
+    for (lbm_uint j = 0; j < GC_RECORD_WORDS; j ++) {
+      gc_telemetry_put(buf, &ix, w[j]);
+    }
+  }
+  return ix;
+}
+
+void lbm_heap_set_gc_bitmap_storage(lbm_uint *data, lbm_uint size) {
+#ifdef GC_MARK_BITMAP
+  gc_bitmap_storage = data;
+  gc_bitmap_storage_size = data ? size : 0;
+#else
+  (void)data;
+  (void)size;
+#endif
+}
+
 bool lbm_heap_init(lbm_cons_t *addr, lbm_uint num_cells,
                   lbm_uint gc_stack_size) {
 
@@ -587,6 +862,27 @@ bool lbm_heap_init(lbm_cons_t *addr, lbm_uint num_cells,
   lbm_uint *gc_stack_storage = (lbm_uint*)lbm_malloc(gc_stack_size * sizeof(lbm_uint));
   if (gc_stack_storage == NULL) return 0;
 
+#ifdef GC_MARK_BITMAP
+  lbm_uint bitmap_size = (num_cells + GC_BITMAP_BITS - 1) / GC_BITMAP_BITS;
+  if (gc_bitmap_storage &&
+      gc_bitmap_storage_size >= LBM_GC_BITMAP_SIZE(num_cells)) {
+    gc_bitmap = gc_bitmap_storage;
+  } else {
+    gc_bitmap = (lbm_uint*)lbm_malloc(bitmap_size * sizeof(lbm_uint));
+    if (gc_bitmap == NULL) return 0;
+  }
+  memset(gc_bitmap, 0, bitmap_size * sizeof(lbm_uint));
+#endif
+#ifdef LBM_GC_GENERATIONAL
+  if (gc_bitmap == gc_bitmap_storage) {
+    gc_remembered_bitmap = gc_bitmap_storage + bitmap_size;
+  } else {
+    gc_remembered_bitmap = (lbm_uint*)lbm_malloc(bitmap_size * sizeof(lbm_uint));
+    if (gc_remembered_bitmap == NULL) return 0;
+  }
+  memset(gc_remembered_bitmap, 0, bitmap_size * sizeof(lbm_uint));
+#endif
+
   heap_init_state(addr, num_cells,
                   gc_stack_storage, gc_stack_size);
 
@@ -599,6 +895,11 @@ bool lbm_heap_init(lbm_cons_t *addr, lbm_uint num_cells,
 lbm_value lbm_heap_allocate_cell(lbm_type ptr_type, lbm_value car, lbm_value cdr) {
   lbm_value r;
   lbm_value cell = lbm_heap_state.freelist;
+#ifdef LBM_GC_INCREMENTAL_SWEEP
+  if (!cell && lbm_gc_sweep_ahead(1)) {
+    cell = lbm_heap_state.freelist;
+  }
+#endif
   if (cell) {
     lbm_uint heap_ix = lbm_dec_ptr(cell);
     lbm_heap_state.freelist = lbm_heap_state.heap[heap_ix].cdr;
@@ -614,7 +915,7 @@ lbm_value lbm_heap_allocate_cell(lbm_type ptr_type, lbm_value car, lbm_value cdr
 
 lbm_value lbm_heap_allocate_list(lbm_uint n) {
   if (n == 0) return ENC_SYM_NIL;
-  if (lbm_heap_num_free() < n) return ENC_SYM_MERROR;
+  if (!lbm_heap_has_free(n)) return ENC_SYM_MERROR;
   // Here the freelist is guaranteed to be a cons_cell.
 
   lbm_value curr = lbm_heap_state.freelist;
@@ -636,7 +937,7 @@ lbm_value lbm_heap_allocate_list(lbm_uint n) {
 
 lbm_value lbm_heap_allocate_list_init_va(unsigned int n, va_list valist) {
   if (n == 0) return ENC_SYM_NIL;
-  if (lbm_heap_num_free() < n) return ENC_SYM_MERROR;
+  if (!lbm_heap_has_free(n)) return ENC_SYM_MERROR;
 
   lbm_value curr = lbm_heap_state.freelist;
   lbm_value res  = curr;
@@ -759,6 +1060,9 @@ bool active_ptr(lbm_value p) {
 void lbm_gc_mark_phase(lbm_value root) {
   lbm_value t_ptr;
   lbm_stack_t *s = &lbm_heap_state.gc_stack;
+#ifdef LBM_GC_INCREMENTAL_SWEEP
+  if (sweep_pos < lbm_heap_state.heap_size) lbm_gc_sweep_finish();
+#endif
   s->data[s->sp++] = root;
 
   while (!lbm_stack_is_empty(s)) {
@@ -774,7 +1078,7 @@ void lbm_gc_mark_phase(lbm_value root) {
 
     lbm_cons_t *cell = &lbm_heap_state.heap[lbm_dec_ptr(curr)];
 
-    if (lbm_get_gc_mark(cell->cdr)) {
+    if (gc_cell_marked(cell)) {
       continue;
     }
 
@@ -804,7 +1108,7 @@ void lbm_gc_mark_phase(lbm_value root) {
             !((arrdata[arr->index] & LBM_CONTINUATION_INTERNAL) == LBM_CONTINUATION_INTERNAL)) {
 
           lbm_cons_t *elt = &lbm_heap_state.heap[lbm_dec_ptr(arrdata[arr->index])];
-          if (!lbm_get_gc_mark(elt->cdr)) {
+          if (!gc_cell_marked(elt)) {
             curr = arrdata[arr->index];
             arr->index++;
             goto mark_shortcut;
@@ -824,11 +1128,11 @@ void lbm_gc_mark_phase(lbm_value root) {
                            // elem_dropped == cell
       // Cell is the array reference. so this marks the array reference itself
       // after having marked all the elements.
-      cell->cdr = lbm_set_gc_mark(cell->cdr);
+      gc_cell_set_mark(cell);
       lbm_heap_state.gc_marked ++;
       continue;
     } else if (t_ptr == LBM_TYPE_CHANNEL) {
-      cell->cdr = lbm_set_gc_mark(cell->cdr);
+      gc_cell_set_mark(cell);
       lbm_heap_state.gc_marked ++;
       // TODO: Can channels be explicitly freed ?
       if (cell->car != ENC_SYM_NIL) {
@@ -839,7 +1143,7 @@ void lbm_gc_mark_phase(lbm_value root) {
       continue;
     }
 
-    cell->cdr = lbm_set_gc_mark(cell->cdr);
+    gc_cell_set_mark(cell);
     lbm_heap_state.gc_marked ++;
 
     if (t_ptr == LBM_TYPE_CONS) {
@@ -860,12 +1164,15 @@ void lbm_gc_mark_phase(lbm_value root) {
 void lbm_gc_mark_env(lbm_value env) {
   lbm_value curr = env;
   lbm_cons_t *c;
+#ifdef LBM_GC_INCREMENTAL_SWEEP
+  if (sweep_pos < lbm_heap_state.heap_size) lbm_gc_sweep_finish();
+#endif
 
   while (lbm_is_ptr(curr)) {
     c = lbm_ref_cell(curr);
-    c->cdr = lbm_set_gc_mark(c->cdr); // mark the environent list structure.
+    gc_cell_set_mark(c); // mark the environent list structure.
     lbm_cons_t *b = lbm_ref_cell(c->car);
-    b->cdr = lbm_set_gc_mark(b->cdr); // mark the binding list head cell.
+    gc_cell_set_mark(b); // mark the binding list head cell.
     lbm_heap_state.gc_marked +=2;
     if (lbm_is_ptr(b->cdr)) {
       lbm_gc_mark_phase(b->cdr); // mark the bound object.
@@ -901,14 +1208,36 @@ void lbm_gc_mark_roots(lbm_uint *roots, lbm_uint num_roots) {
 }
 
 // Sweep moves non-marked heap objects to the free list.
-int lbm_gc_sweep_phase(void) {
-  unsigned int i = 0;
+static void sweep_range(lbm_uint start, lbm_uint end) {
   lbm_cons_t *heap = (lbm_cons_t *)lbm_heap_state.heap;
 
-  for (i = 0; i < lbm_heap_state.heap_size; i ++) {
+  for (lbm_uint i = start; i < end; i ++) {
+#if defined(LBM_GC_GENERATIONAL)
+    lbm_uint *w = &gc_bitmap[i / GC_BITMAP_BITS];
+    // Skip whole words of old cells unless there are cdr marks to clear.
+    if (!sweep_full && (i % GC_BITMAP_BITS) == 0 && *w == ~(lbm_uint)0) {
+      gc_old_num += GC_BITMAP_BITS;
+      i += GC_BITMAP_BITS - 1;
+      continue;
+    }
+    lbm_uint bit = (lbm_uint)1 << (i % GC_BITMAP_BITS);
+    if ((*w & bit) || lbm_get_gc_mark(heap[i].cdr)) {
+      *w |= bit;
+      heap[i].cdr = lbm_clr_gc_mark(heap[i].cdr);
+      gc_old_num ++;
+    } else {
+#elif defined(LBM_GC_INCREMENTAL_SWEEP)
+    lbm_uint *w = &gc_bitmap[i / GC_BITMAP_BITS];
+    lbm_uint bit = (lbm_uint)1 << (i % GC_BITMAP_BITS);
+    if ((*w & bit) || lbm_get_gc_mark(heap[i].cdr)) {
+      *w &= ~bit;
+      heap[i].cdr = lbm_clr_gc_mark(heap[i].cdr);
+    } else {
+#else
     if ( lbm_get_gc_mark(heap[i].cdr)) {
       heap[i].cdr = lbm_clr_gc_mark(heap[i].cdr);
     } else {
+#endif
       // Check if this cell is a pointer to an array
       // and free it.
       if (lbm_type_of(heap[i].cdr) == LBM_TYPE_SYMBOL) {
@@ -959,13 +1288,163 @@ int lbm_gc_sweep_phase(void) {
       lbm_heap_state.gc_recovered ++;
     }
   }
+}
+
+static void sweep_to(lbm_uint end) {
+  sweep_range(sweep_pos, end);
+  sweep_pos = end;
+  if (sweep_pos == lbm_heap_state.heap_size) {
+    lbm_heap_new_freelist_length();
+#if LBM_GC_TELEMETRY_SIZE > 0
+    gc_record_sweep_done();
+#endif
+  }
+}
+
+int lbm_gc_sweep_phase(void) {
+  sweep_pos = 0;
+  if (gc_full) {
+    lbm_heap_state.gc_full_num ++;
+#if LBM_GC_TELEMETRY_SIZE > 0
+    gc_record.flags |= LBM_GC_RECORD_FULL;
+#endif
+  }
+#ifdef LBM_GC_INCREMENTAL_SWEEP
+  if (!sweep_full) {
+    lbm_gc_sweep_step();
+    return 1;
+  }
+#endif
+#ifdef LBM_GC_GENERATIONAL
+  gc_old_num = 0;
+  sweep_to(lbm_heap_state.heap_size);
+  if (gc_full) gc_full_free = lbm_heap_state.num_free;
+  gc_collecting = false;
+  gc_full = false;
+  gc_premarked = 0;
+#else
+  sweep_to(lbm_heap_state.heap_size);
+#endif
+  sweep_full = false;
   return 1;
 }
 
+bool lbm_gc_sweep_step(void) {
+  lbm_uint n = lbm_heap_state.heap_size - sweep_pos;
+  if (n == 0) return false;
+  if (n > sweep_chunk) n = sweep_chunk;
+  sweep_to(sweep_pos + n);
+  return sweep_pos < lbm_heap_state.heap_size;
+}
+
+void lbm_gc_sweep_finish(void) {
+  if (sweep_pos < lbm_heap_state.heap_size) {
+    sweep_to(lbm_heap_state.heap_size);
+  }
+}
+
+bool lbm_gc_sweep_ahead(lbm_uint n) {
+  while (lbm_heap_state.num_free < n &&
+         lbm_gc_sweep_step());
+  return lbm_heap_state.num_free >= n;
+}
+
+void lbm_gc_request_full_sweep(void) {
+  sweep_full = true;
+#ifdef LBM_GC_GENERATIONAL
+  gc_full_pending = true;
+#endif
+}
+
+bool lbm_gc_sweep_pending(void) {
+  return sweep_pos < lbm_heap_state.heap_size;
+}
+
+void lbm_gc_set_sweep_chunk(lbm_uint n) {
+  sweep_chunk = n ? n : 1;
+}
+
+#ifdef LBM_GC_GENERATIONAL
+// Make all cells young again. Cells marked outside of the collection
+// keep their cdr marks.
+static void gc_clear_old(void) {
+  memset(gc_bitmap, 0, gc_bitmap_words() * sizeof(lbm_uint));
+  for (lbm_uint i = 0; i < gc_remembered_num; i ++) {
+    gc_bitmap_clr(gc_remembered_bitmap, lbm_dec_ptr(gc_remembered[i]));
+  }
+  gc_remembered_num = 0;
+  gc_old_num = 0;
+  gc_full = true;
+  gc_full_pending = false;
+}
+
+void lbm_gc_write_barrier(lbm_value c, lbm_value v) {
+  if (!lbm_is_ptr(v) || (v & LBM_PTR_TO_CONSTANT_BIT) ||
+      !lbm_is_ptr(c) || (c & LBM_PTR_TO_CONSTANT_BIT)) {
+    return;
+  }
+  lbm_uint ix = lbm_dec_ptr(c);
+  if (ix >= lbm_heap_state.heap_size ||
+      !gc_bitmap_get(gc_bitmap, ix) ||
+      gc_bitmap_get(gc_remembered_bitmap, ix)) {
+    return;
+  }
+  if (gc_remembered_num < LBM_GC_REMEMBERED_SIZE) {
+    gc_bitmap_set(gc_remembered_bitmap, ix);
+    gc_remembered[gc_remembered_num++] = c;
+  } else {
+    gc_full_pending = true;
+  }
+}
+#endif
+
+void lbm_gc_mark_remembered(void) {
+#ifdef LBM_GC_GENERATIONAL
+  // A remembered cell is made young and marked again to
+  // mark the cells it points to now.
+  for (lbm_uint i = 0; i < gc_remembered_num; i ++) {
+    lbm_uint ix = lbm_dec_ptr(gc_remembered[i]);
+    gc_bitmap_clr(gc_remembered_bitmap, ix);
+    gc_bitmap_clr(gc_bitmap, ix);
+    lbm_gc_mark_phase(gc_remembered[i]);
+  }
+  gc_remembered_num = 0;
+#endif
+}
+
+bool lbm_gc_retry_full(void) {
+#ifdef LBM_GC_GENERATIONAL
+  if (gc_full) return false;
+  lbm_uint size = lbm_heap_state.heap_size;
+  lbm_uint live = gc_old_num + gc_premarked + lbm_heap_state.gc_marked;
+  if (live < size && (size - live) * 100 >= gc_full_free * LBM_GC_MINOR_MIN_FREE) {
+    return false;
+  }
+  gc_clear_old();
+  lbm_heap_state.gc_marked = 0;
+  return true;
+#else
+  return false;
+#endif
+}
+
 void lbm_gc_state_inc(void) {
+#if LBM_GC_TELEMETRY_SIZE > 0
+  // The previous collection is complete even if its sweep time was
+  // never reported.
+  gc_record_end();
+#endif
   lbm_heap_state.gc_num ++;
   lbm_heap_state.gc_recovered = 0;
   lbm_heap_state.gc_marked = 0;
+  lbm_heap_state.gc_sweep_time = 0;
+#ifdef LBM_GC_GENERATIONAL
+  gc_collecting = true;
+  if (gc_full_pending) gc_clear_old();
+#endif
+#if LBM_GC_TELEMETRY_SIZE > 0
+  gc_record_start();
+#endif
 }
 
 // construct, alter and break apart
@@ -1046,6 +1525,7 @@ lbm_value lbm_list_destructive_reverse(lbm_value list) {
     lbm_cons_t *cell = lbm_ref_cell(curr);
     lbm_value next = cell->cdr;
     cell->cdr = last_cell;
+    lbm_gc_write_barrier(curr, last_cell);
     last_cell = curr;
     curr = next;
   }
@@ -1420,6 +1900,11 @@ lbm_uint lbm_flash_memory_usage(void) {
 
 void lbm_ptr_rev_trav(trav_fun f, lbm_value v, void* arg) {
 
+  // The GC bits set by the traversal are cleared by the GC that follows,
+  // so that sweep must not leave any cells for later.
+  lbm_gc_sweep_finish();
+  sweep_full = true;
+
   lbm_value curr = v;
   lbm_value prev = lbm_enc_cons_ptr(LBM_PTR_NULL);
   while (true) {
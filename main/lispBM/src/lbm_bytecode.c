@@ -0,0 +1,489 @@
+/*
+    Copyright 2026 Joel Svensson  svenssonjoel@yahoo.se
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "lbm_bytecode.h"
+#include "heap.h"
+#include "env.h"
+#include "symrepr.h"
+#include "eval_cps.h"
+
+// The compiler runs twice over the body. The first pass has no
+// code buffer and only measures the code, the number of constants
+// and the stack use. The code object is then allocated and the
+// second pass fills it in. No heap allocation happens during a pass.
+
+typedef struct {
+  uint8_t   *code;        // NULL while measuring
+  lbm_value *consts;      // NULL while measuring
+  lbm_uint  pc;
+  lbm_uint  num_consts;
+  lbm_uint  depth;        // Slots in use, relative to the frame pointer
+  lbm_uint  max_depth;
+  lbm_uint  nesting;
+  lbm_value env;
+  lbm_value slots[LBM_BYTECODE_MAX_SLOTS]; // Variable in each slot or NIL
+  lbm_value error;        // Form that could not be compiled
+  int       status;
+} bc_comp_t;
+
+static bool comp_exp(bc_comp_t *c, lbm_value e, bool tail);
+
+static bool comp_fail(bc_comp_t *c, int status, lbm_value form) {
+  if (c->status == LBM_BC_OK) {
+    c->status = status;
+    c->error = form;
+  }
+  return false;
+}
+
+static void emit(bc_comp_t *c, uint8_t b) {
+  if (c->code) c->code[c->pc] = b;
+  c->pc ++;
+}
+
+static void emit16(bc_comp_t *c, uint16_t v) {
+  emit(c, (uint8_t)(v >> 8));
+  emit(c, (uint8_t)v);
+}
+
+static void patch16(bc_comp_t *c, lbm_uint at, lbm_uint v) {
+  if (c->code) {
+    c->code[at] = (uint8_t)(v >> 8);
+    c->code[at + 1] = (uint8_t)v;
+  }
+}
+
+// Emit a jump and return the position of its target.
+static lbm_uint emit_jump(bc_comp_t *c, uint8_t op) {
+  emit(c, op);
+  lbm_uint at = c->pc;
+  emit16(c, 0);
+  return at;
+}
+
+static bool push(bc_comp_t *c, lbm_value var, lbm_value form) {
+  if (c->depth >= LBM_BYTECODE_MAX_SLOTS) {
+    return comp_fail(c, LBM_BC_TOO_LARGE, form);
+  }
+  c->slots[c->depth] = var;
+  c->depth ++;
+  if (c->depth > c->max_depth) c->max_depth = c->depth;
+  return true;
+}
+
+static bool emit_const(bc_comp_t *c, lbm_value v) {
+  if (lbm_type_of(v) == LBM_TYPE_I &&
+      lbm_dec_i(v) >= INT16_MIN && lbm_dec_i(v) <= INT16_MAX) {
+    emit(c, LBM_BC_INT);
+    emit16(c, (uint16_t)(int16_t)lbm_dec_i(v));
+  } else {
+    if (c->num_consts > UINT16_MAX) return comp_fail(c, LBM_BC_TOO_LARGE, v);
+    if (c->consts) c->consts[c->num_consts] = v;
+    emit(c, LBM_BC_CONST);
+    emit16(c, (uint16_t)c->num_consts);
+    c->num_consts ++;
+  }
+  return push(c, ENC_SYM_NIL, v);
+}
+
+// Innermost slot bound to sym or -1.
+static int find_slot(bc_comp_t *c, lbm_value sym) {
+  for (int i = (int)c->depth - 1; i >= 0; i --) {
+    if (c->slots[i] == sym) return i;
+  }
+  return -1;
+}
+
+static bool comp_ret(bc_comp_t *c, bool tail) {
+  if (tail) {
+    emit(c, LBM_BC_RET);
+    c->depth --;
+  }
+  return true;
+}
+
+// Look up a variable that is not in a slot, op is LBM_BC_FREE or
+// LBM_BC_HEAD.
+static bool emit_free(bc_comp_t *c, uint8_t op, lbm_value sym) {
+  if (c->num_consts > UINT16_MAX) return comp_fail(c, LBM_BC_TOO_LARGE, sym);
+  if (c->consts) c->consts[c->num_consts] = sym;
+  emit(c, op);
+  emit16(c, (uint16_t)c->num_consts);
+  c->num_consts ++;
+  return push(c, ENC_SYM_NIL, sym);
+}
+
+static bool comp_symbol(bc_comp_t *c, lbm_value sym, bool tail) {
+  // Unused slots hold nil, only runtime symbols are looked up.
+  bool constant = lbm_dec_sym(sym) < RUNTIME_SYMBOLS_START;
+  int slot = constant ? -1 : find_slot(c, sym);
+  if (slot >= 0) {
+    emit(c, LBM_BC_LOAD);
+    emit(c, (uint8_t)slot);
+    if (!push(c, ENC_SYM_NIL, sym)) return false;
+  } else if (constant) {
+    if (!emit_const(c, sym)) return false;
+  } else {
+    if (!emit_free(c, LBM_BC_FREE, sym)) return false;
+  }
+  return comp_ret(c, tail);
+}
+
+// (if c then else)
+static bool comp_if(bc_comp_t *c, lbm_value args, bool tail) {
+  if (!comp_exp(c, lbm_car(args), false)) return false;
+  lbm_uint to_else = emit_jump(c, LBM_BC_JMP_NIL);
+  c->depth --;
+  lbm_uint depth = c->depth;
+  if (!comp_exp(c, lbm_car(lbm_cdr(args)), tail)) return false;
+  lbm_uint to_end = 0;
+  if (!tail) {
+    to_end = emit_jump(c, LBM_BC_JMP);
+  }
+  patch16(c, to_else, c->pc);
+  c->depth = depth;
+  if (!comp_exp(c, lbm_car(lbm_cdr(lbm_cdr(args))), tail)) return false;
+  if (!tail) patch16(c, to_end, c->pc);
+  return true;
+}
+
+// (cond (c1 e1) (c2 e2) ...)
+static bool comp_cond(bc_comp_t *c, lbm_value clauses, bool tail) {
+  if (!lbm_is_cons(clauses)) {
+    return emit_const(c, ENC_SYM_NIL) && comp_ret(c, tail);
+  }
+  lbm_value clause = lbm_car(clauses);
+  if (lbm_list_length(clause) != 2) {
+    return comp_fail(c, LBM_BC_UNSUPPORTED, clause);
+  }
+  if (!comp_exp(c, lbm_car(clause), false)) return false;
+  lbm_uint to_next = emit_jump(c, LBM_BC_JMP_NIL);
+  c->depth --;
+  lbm_uint depth = c->depth;
+  if (!comp_exp(c, lbm_car(lbm_cdr(clause)), tail)) return false;
+  lbm_uint to_end = 0;
+  if (!tail) {
+    to_end = emit_jump(c, LBM_BC_JMP);
+  }
+  patch16(c, to_next, c->pc);
+  c->depth = depth;
+  if (!comp_cond(c, lbm_cdr(clauses), tail)) return false;
+  if (!tail) patch16(c, to_end, c->pc);
+  return true;
+}
+
+// (progn e1 ... en)
+static bool comp_progn(bc_comp_t *c, lbm_value exps, bool tail) {
+  if (!lbm_is_cons(exps)) {
+    return emit_const(c, ENC_SYM_NIL) && comp_ret(c, tail);
+  }
+  while (lbm_is_cons(lbm_cdr(exps))) {
+    if (!comp_exp(c, lbm_car(exps), false)) return false;
+    emit(c, LBM_BC_POP);
+    c->depth --;
+    exps = lbm_cdr(exps);
+  }
+  return comp_exp(c, lbm_car(exps), tail);
+}
+
+// (and e1 ... en) and (or e1 ... en)
+static bool comp_and_or(bc_comp_t *c, lbm_value exps, uint8_t op, lbm_value empty, bool tail) {
+  if (!lbm_is_cons(exps)) {
+    return emit_const(c, empty) && comp_ret(c, tail);
+  }
+  // Each jump is patched to the end when the next is emitted.
+  lbm_uint prev = 0;
+  bool has_prev = false;
+  while (true) {
+    if (!comp_exp(c, lbm_car(exps), false)) return false;
+    exps = lbm_cdr(exps);
+    if (!lbm_is_cons(exps)) break;
+    lbm_uint at = emit_jump(c, op);
+    if (has_prev) patch16(c, at, prev);
+    prev = at;
+    has_prev = true;
+    c->depth --;
+  }
+  // Resolve the chain of jumps.
+  while (has_prev) {
+    lbm_uint next = 0;
+    if (c->code) {
+      next = ((lbm_uint)c->code[prev] << 8) | c->code[prev + 1];
+    }
+    has_prev = (next != 0);
+    patch16(c, prev, c->pc);
+    prev = next;
+  }
+  return comp_ret(c, tail);
+}
+
+// (let ((v1 e1) ... (vn en)) body)
+static bool comp_let(bc_comp_t *c, lbm_value args, bool tail) {
+  lbm_value binds = lbm_car(args);
+  lbm_uint n = 0;
+  while (lbm_is_cons(binds)) {
+    lbm_value b = lbm_car(binds);
+    lbm_value var = lbm_car(b);
+    if (!lbm_is_symbol(var) || lbm_dec_sym(var) < RUNTIME_SYMBOLS_START) {
+      return comp_fail(c, LBM_BC_UNSUPPORTED, b);
+    }
+    if (!comp_exp(c, lbm_car(lbm_cdr(b)), false)) return false;
+    c->slots[c->depth - 1] = var;
+    n ++;
+    binds = lbm_cdr(binds);
+  }
+  if (!comp_exp(c, lbm_car(lbm_cdr(args)), tail)) return false;
+  if (!tail) {
+    if (n > 0) {
+      emit(c, LBM_BC_SLIDE);
+      emit(c, (uint8_t)n);
+      c->depth -= n;
+      c->slots[c->depth - 1] = ENC_SYM_NIL;
+    }
+  } else {
+    c->depth -= n;
+  }
+  return true;
+}
+
+static uint8_t fast_op(lbm_value fun) {
+  switch (fun) {
+  case ENC_SYM_ADD: return LBM_BC_ADD;
+  case ENC_SYM_SUB: return LBM_BC_SUB;
+  case ENC_SYM_MUL: return LBM_BC_MUL;
+  case ENC_SYM_NUMEQ: return LBM_BC_NUMEQ;
+  case ENC_SYM_LT: return LBM_BC_LT;
+  case ENC_SYM_GT: return LBM_BC_GT;
+  case ENC_SYM_LEQ: return LBM_BC_LEQ;
+  case ENC_SYM_GEQ: return LBM_BC_GEQ;
+  default: return 0;
+  }
+}
+
+static bool comp_args(bc_comp_t *c, lbm_value args, lbm_uint *n) {
+  *n = 0;
+  while (lbm_is_cons(args)) {
+    if (!comp_exp(c, lbm_car(args), false)) return false;
+    (*n) ++;
+    args = lbm_cdr(args);
+  }
+  return true;
+}
+
+static bool comp_application(bc_comp_t *c, lbm_value e, bool tail) {
+  lbm_value fun = lbm_car(e);
+  lbm_value args = lbm_cdr(e);
+  lbm_uint n;
+
+  if (lbm_is_symbol(fun) && find_slot(c, fun) < 0) {
+    lbm_uint s = lbm_dec_sym(fun);
+    if (SYMBOL_KIND(s) == SYMBOL_KIND_FUNDAMENTAL) {
+      if (!comp_args(c, args, &n)) return false;
+      if (n > UINT8_MAX) return comp_fail(c, LBM_BC_TOO_LARGE, e);
+      uint8_t op = fast_op(fun);
+      if (op && n == 2) {
+        emit(c, op);
+      } else {
+        emit(c, LBM_BC_FUN);
+        emit(c, (uint8_t)SYMBOL_IX(s));
+        emit(c, (uint8_t)n);
+      }
+      c->depth -= n;
+      if (!push(c, ENC_SYM_NIL, e)) return false;
+      return comp_ret(c, tail);
+    }
+    // The special forms that get here are not supported and the rest
+    // arguments only exist in the environment of an interpreted call.
+    if (SYMBOL_KIND(s) == SYMBOL_KIND_SPECIAL || fun == ENC_SYM_REST_ARGS) {
+      return comp_fail(c, LBM_BC_UNSUPPORTED, e);
+    }
+    // Compiled code keeps its variables on the stack and not in
+    // the local environment.
+    if (SYMBOL_KIND(s) == SYMBOL_KIND_EXTENSION) {
+      const char *name = lbm_get_name_by_symbol(s);
+      if (name && strcmp(name, "local-env-get") == 0) {
+        return comp_fail(c, LBM_BC_UNSUPPORTED, e);
+      }
+    }
+    // Macros expect their arguments unevaluated. A symbol that is
+    // not defined yet may be a macro that is loaded when first used.
+    if (s >= RUNTIME_SYMBOLS_START) {
+      lbm_value v;
+      if (lbm_env_lookup_b(&v, fun, c->env) || lbm_global_env_lookup(&v, fun)) {
+        if (lbm_is_macro(v)) return comp_fail(c, LBM_BC_UNSUPPORTED, e);
+      } else if (lbm_dynamic_load_exists(lbm_get_name_by_symbol(s))) {
+        return comp_fail(c, LBM_BC_UNSUPPORTED, e);
+      }
+    }
+  }
+
+  // The VM checks that names that are called are not bound to macros.
+  if (lbm_is_symbol(fun) && lbm_dec_sym(fun) >= RUNTIME_SYMBOLS_START &&
+      find_slot(c, fun) < 0) {
+    if (!emit_free(c, LBM_BC_HEAD, fun)) return false;
+  } else if (!comp_exp(c, fun, false)) {
+    return false;
+  }
+  if (!comp_args(c, args, &n)) return false;
+  if (n > UINT8_MAX) return comp_fail(c, LBM_BC_TOO_LARGE, e);
+  emit(c, tail ? LBM_BC_TCALL : LBM_BC_CALL);
+  emit(c, (uint8_t)n);
+  c->depth -= n + 1;
+  if (!push(c, ENC_SYM_NIL, e)) return false;
+  return comp_ret(c, tail);
+}
+
+static bool comp_exp(bc_comp_t *c, lbm_value e, bool tail) {
+  if (c->nesting >= LBM_BYTECODE_MAX_NESTING) {
+    return comp_fail(c, LBM_BC_TOO_LARGE, e);
+  }
+  if (c->pc > UINT16_MAX) {
+    return comp_fail(c, LBM_BC_TOO_LARGE, e);
+  }
+  bool r;
+  c->nesting ++;
+  if (lbm_is_symbol(e)) {
+    r = comp_symbol(c, e, tail);
+  } else if (!lbm_is_cons(e)) {
+    r = emit_const(c, e) && comp_ret(c, tail);
+  } else {
+    lbm_value head = lbm_car(e);
+    lbm_value args = lbm_cdr(e);
+    switch (head) {
+    case ENC_SYM_QUOTE: r = emit_const(c, lbm_car(args)) && comp_ret(c, tail); break;
+    case ENC_SYM_IF:    r = comp_if(c, args, tail); break;
+    case ENC_SYM_COND:  r = comp_cond(c, args, tail); break;
+    case ENC_SYM_PROGN: r = comp_progn(c, args, tail); break;
+    case ENC_SYM_LET:   r = comp_let(c, args, tail); break;
+    case ENC_SYM_AND:   r = comp_and_or(c, args, LBM_BC_AND, ENC_SYM_TRUE, tail); break;
+    case ENC_SYM_OR:    r = comp_and_or(c, args, LBM_BC_OR, ENC_SYM_NIL, tail); break;
+    default:
+      if (lbm_is_symbol(head) &&
+          ((head & ENC_SPECIAL_FORMS_MASK) == ENC_SPECIAL_FORMS_BIT)) {
+        r = comp_fail(c, LBM_BC_UNSUPPORTED, e);
+      } else {
+        r = comp_application(c, e, tail);
+      }
+      break;
+    }
+  }
+  c->nesting --;
+  return r;
+}
+
+static int comp_pass(bc_comp_t *c, lbm_value params, lbm_value body) {
+  c->pc = LBM_BC_ENTRY;
+  c->num_consts = 0;
+  c->depth = 0;
+  c->max_depth = 0;
+  c->nesting = 0;
+  c->status = LBM_BC_OK;
+  c->error = ENC_SYM_NIL;
+
+  lbm_uint nargs = 0;
+  while (lbm_is_cons(params)) {
+    lbm_value p = lbm_car(params);
+    if (!lbm_is_symbol(p) || lbm_dec_sym(p) < RUNTIME_SYMBOLS_START ||
+        nargs > UINT8_MAX) {
+      comp_fail(c, LBM_BC_UNSUPPORTED, p);
+      return c->status;
+    }
+    if (!push(c, p, p)) return c->status;
+    nargs ++;
+    params = lbm_cdr(params);
+  }
+  // Return pc and fp of the caller.
+  if (!push(c, ENC_SYM_NIL, body) ||
+      !push(c, ENC_SYM_NIL, body)) {
+    return c->status;
+  }
+  if (!comp_exp(c, body, true)) return c->status;
+  if (c->pc > UINT16_MAX) {
+    comp_fail(c, LBM_BC_TOO_LARGE, body);
+    return c->status;
+  }
+  if (c->code) {
+    c->code[LBM_BC_HDR_NARGS] = (uint8_t)nargs;
+    c->code[LBM_BC_HDR_SLOTS] = (uint8_t)(c->max_depth >> 8);
+    c->code[LBM_BC_HDR_SLOTS + 1] = (uint8_t)c->max_depth;
+  }
+  return LBM_BC_OK;
+}
+
+int lbm_bc_compile(lbm_value params, lbm_value body, lbm_value env, lbm_value *res) {
+  bc_comp_t c;
+  c.code = NULL;
+  c.consts = NULL;
+  c.env = env;
+
+  int r = comp_pass(&c, params, body);
+  if (r != LBM_BC_OK) {
+    *res = c.error;
+    return r;
+  }
+
+  lbm_value bytes;
+  lbm_value code;
+  lbm_value source = lbm_cons(params, body);
+  if (lbm_is_symbol_merror(source) ||
+      !lbm_heap_allocate_array(&bytes, c.pc) ||
+      !lbm_heap_allocate_lisp_array(&code, LBM_BC_CODE_CONSTS + c.num_consts)) {
+    *res = ENC_SYM_MERROR;
+    return LBM_BC_MERROR;
+  }
+  lbm_value *data = (lbm_value*)((lbm_array_header_t*)lbm_car(code))->data;
+  data[LBM_BC_CODE_BYTES] = bytes;
+  data[LBM_BC_CODE_ENV] = env;
+  data[LBM_BC_CODE_SOURCE] = source;
+  // Names that are macros now were not compiled as calls.
+  data[LBM_BC_CODE_CHECKED] = lbm_enc_u(lbm_env_macro_bindings());
+  c.code = (uint8_t*)((lbm_array_header_t*)lbm_car(bytes))->data;
+  c.consts = &data[LBM_BC_CODE_CONSTS];
+
+  comp_pass(&c, params, body);
+  *res = code;
+  return LBM_BC_OK;
+}
+
+// Size in bytes of each instruction.
+static const uint8_t op_size[] = {
+  3, 3, 2, 3, 1, 2, 3, 3, 3, 3, // CONST INT LOAD FREE POP SLIDE JMP JMP_NIL AND OR
+  3, 2, 2, 1,                   // FUN CALL TCALL RET
+  1, 1, 1, 1, 1, 1, 1, 1,       // ADD SUB MUL NUMEQ LT GT LEQ GEQ
+  3                             // HEAD
+};
+
+bool lbm_bc_calls_macro(lbm_value *data) {
+  lbm_array_header_t *arr = (lbm_array_header_t*)lbm_car(data[LBM_BC_CODE_BYTES]);
+  uint8_t *code = (uint8_t*)arr->data;
+  lbm_uint pc = LBM_BC_ENTRY;
+  while (pc < arr->size && code[pc] < sizeof(op_size)) {
+    if (code[pc] == LBM_BC_HEAD) {
+      lbm_value sym = data[LBM_BC_CODE_CONSTS + (((lbm_uint)code[pc + 1] << 8) | code[pc + 2])];
+      lbm_value v;
+      if ((lbm_env_lookup_b(&v, sym, data[LBM_BC_CODE_ENV]) ||
+           lbm_global_env_lookup(&v, sym)) &&
+          lbm_is_macro(v)) {
+        return true;
+      }
+    }
+    pc += op_size[code[pc]];
+  }
+  return false;
+}
@@ -187,13 +187,7 @@ int lbm_define(char *symbol, lbm_value value) {
 #endif
       if (lbm_get_symbol_by_name(symbol, &sym_id) ||
           lbm_add_symbol_const_base(symbol, &sym_id, false)) {
-        lbm_uint ix_key = sym_id & GLOBAL_ENV_MASK;
-        lbm_value *glob_env = lbm_get_global_env();
-        lbm_value new_env_entry = lbm_env_set(glob_env[ix_key], lbm_enc_sym(sym_id), value);
-        if (lbm_is_symbol(new_env_entry)) {
-          res = 0;
-        } else {
-          glob_env[ix_key] = new_env_entry;
+        if (lbm_global_env_set(lbm_enc_sym(sym_id), value) == ENC_SYM_TRUE) {
           res = 1;
         }
       }
@@ -208,13 +202,7 @@ int lbm_undefine(char *symbol) {
   lbm_uint sym_id;
   int res = 0;
   if (symbol && lbm_get_symbol_by_name(symbol, &sym_id)) {
-
-    lbm_value *glob_env = lbm_get_global_env();
-    lbm_uint ix_key = sym_id & GLOBAL_ENV_MASK;
-    lbm_value new_env = lbm_env_drop_binding(glob_env[ix_key], lbm_enc_sym(sym_id));
-
-    if (new_env != ENC_SYM_NOT_FOUND) {
-      glob_env[ix_key] = new_env;
+    if (lbm_global_env_drop(lbm_enc_sym(sym_id)) == ENC_SYM_TRUE) {
       res = 1;
     }
   }
@@ -267,6 +255,7 @@ void lbm_clear_env(void) {
   for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
     env[i] = ENC_SYM_NIL;
   }
+  lbm_global_env_flush_cache();
   lbm_perform_gc();
 }
 
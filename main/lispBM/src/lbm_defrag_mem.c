@@ -217,6 +217,7 @@ lbm_value lbm_defrag_mem_alloc_internal(lbm_uint *defrag_mem, lbm_uint bytes, lb
     res = cell;
   } else {
     DEFRAG_MEM_FLAGS(defrag_mem) = 1;
+    lbm_gc_request_full_sweep();
     lbm_set_car_and_cdr(cell, ENC_SYM_NIL, ENC_SYM_NIL);
   }
   return res;
@@ -20,8 +20,6 @@
 #include <eval_cps.h>
 #include <stack.h>
 
-#include <setjmp.h>
-
 #ifndef DEBUG
 #define DEBUG 0
 #endif
@@ -254,81 +252,246 @@ int lbm_get_max_flatten_depth(void) {
   return flatten_maximum_depth;
 }
 
-static void flatten_error(jmp_buf jb, int val) {
-  longjmp(jb, val);
+// ////////////////////////////////////////////////////////////
+// Traversal
+//
+// Flattening walks the value iteratively. A cons with a leaf in the car
+// continues with its cdr directly, otherwise it pushes its cdr and
+// continues with its car. A lisp array stays on the work stack as a
+// frame that hands out its elements in order. The work stack starts
+// out in a small local buffer and moves to lbm_memory only for deeply
+// nested values, so flattening uses a bounded amount of C stack.
+//
+// The same walk computes the flat size, writes into a fixed buffer or
+// writes into a buffer that is resized to fit when it runs full.
+
+#define FLATTEN_MODE_SIZE   0
+#define FLATTEN_MODE_FIXED  1
+#define FLATTEN_MODE_GROW   2
+
+#define FLATTEN_ITEM_VALUE  ((lbm_uint)-1)
+#define FLATTEN_LOCAL_STACK_SIZE 8
+
+typedef struct {
+  lbm_value v;
+  lbm_uint ix;  // Next element of a lisp array frame or FLATTEN_ITEM_VALUE.
+  int depth;
+} flatten_item_t;
+
+typedef struct {
+  flatten_item_t *items;
+  lbm_uint sp;
+  lbm_uint size;
+  flatten_item_t local[FLATTEN_LOCAL_STACK_SIZE];
+} flatten_stack_t;
+
+static bool flatten_push(flatten_stack_t *s, lbm_value v, lbm_uint ix, int depth) {
+  if (s->sp == s->size) {
+    lbm_uint new_size = s->size * 2;
+    flatten_item_t *items = (flatten_item_t*)lbm_malloc(new_size * sizeof(flatten_item_t));
+    if (!items) return false;
+    memcpy(items, s->items, s->sp * sizeof(flatten_item_t));
+    if (s->items != s->local) lbm_free(s->items);
+    s->items = items;
+    s->size = new_size;
+  }
+  s->items[s->sp].v = v;
+  s->items[s->sp].ix = ix;
+  s->items[s->sp].depth = depth;
+  s->sp ++;
+  return true;
 }
 
-/* Use of setjmp/longjmp in flatten_value_size
-
-  setjmp/longjmp behavior is undefined:
-  * If the function which  called  setjmp()  returns  before  longjmp()  is
-    called,  the  behavior  is  undefined.  Some kind of subtle or unsubtle
-    chaos is sure to result.
-
-  * If, in a multithreaded program, a longjmp() call employs an env  buffer
-    that  was  initialized by a call to setjmp() in a different thread, the
-    behavior is undefined.
-
-  The use of setjmp/longjmp in in flatten_value_size_internal/flatten_value_size
-  is avoiding undefined behviour by:
-  1. flatten_value_size_internal is static.
-  2. flatten_error is static.
-  3. flatten_error is ONLY allowed to be called from flatten_value_size_internal.
-  4. The jmpbuf is created in flatten_value_size, which is exposed API.
-  5. Only flatten_value_size calls flatten_value_size_internal.
+typedef struct {
+  lbm_flat_value_t *fv;
+  int mode;
+  lbm_value root;  // The value being flattened.
+  int total;       // Flat size so far in FLATTEN_MODE_SIZE.
+} flatten_state_t;
+
+// Make room for num_bytes more bytes. In FLATTEN_MODE_GROW a buffer that
+// runs full is replaced by one of the exact flat size of the whole
+// value, so the flat data is moved at most once.
+static int flatten_reserve(flatten_state_t *st, lbm_uint num_bytes) {
+  lbm_flat_value_t *fv = st->fv;
+  if (fv->buf_size >= fv->buf_pos + num_bytes) return FLATTEN_VALUE_OK;
+  if (st->mode != FLATTEN_MODE_GROW) return FLATTEN_VALUE_ERROR_BUFFER_TOO_SMALL;
+  int size = flatten_value_size(st->root, false);
+  if (size < 0) return size;
+  if ((lbm_uint)size < fv->buf_pos + num_bytes) return FLATTEN_VALUE_ERROR_FATAL;
+  uint8_t *buf = lbm_malloc_reserve((lbm_uint)size);
+  if (!buf) return FLATTEN_VALUE_ERROR_NOT_ENOUGH_MEMORY;
+  memcpy(buf, fv->buf, fv->buf_pos);
+  lbm_free(fv->buf);
+  fv->buf = buf;
+  fv->buf_size = (lbm_uint)size;
+  st->mode = FLATTEN_MODE_FIXED;
+  return FLATTEN_VALUE_OK;
+}
 
-  Changes to the flat value code MUST NOT change 1 - 5 properties mentioned
-  above.
-*/
+// One node of the flat representation: a tag, a big endian number of
+// num_bytes bytes and data_bytes of raw data. The elements of a cons or
+// lisp array follow as nodes of their own.
+typedef struct {
+  uint8_t tag;
+  uint8_t num_bytes;
+  uint64_t num;
+  const uint8_t *data;
+  lbm_uint data_bytes;
+} flatten_node_t;
+
+// Describe v as a node. Returns the flat size of the node or an error.
+static int flatten_node(flatten_node_t *n, lbm_value v, lbm_uint t) {
+  n->num_bytes = 0;
+  n->num = 0;
+  n->data_bytes = 0;
 
-static int flatten_value_size_internal(jmp_buf jb, lbm_value v, int depth, bool image) {
-  if (depth > flatten_maximum_depth) {
-    flatten_error(jb, FLATTEN_VALUE_ERROR_MAXIMUM_DEPTH);
+  switch (t) {
+  case LBM_TYPE_CONS:
+    n->tag = S_CONS;
+    return 1;
+  case LBM_TYPE_LISPARRAY: {
+    lbm_array_header_t *header = (lbm_array_header_t*)lbm_car(v);
+    if (!header) return FLATTEN_VALUE_ERROR_ARRAY;
+    // arrays are smaller than 2^32 elements long
+    n->tag = S_LBM_LISP_ARRAY;
+    n->num_bytes = 4;
+    n->num = (uint32_t)(header->size / sizeof(lbm_value));
+    return 1 + 4;
   }
-
-  lbm_uint t = lbm_type_of(v);
-  if (t >= LBM_POINTER_TYPE_FIRST && t < LBM_POINTER_TYPE_LAST) {
-    //  Clear constant bit, it is irrelevant to flattening
-    t = t & ~(LBM_PTR_TO_CONSTANT_BIT);
+  case LBM_TYPE_BYTE:
+    n->tag = S_BYTE_VALUE;
+    n->num_bytes = 1;
+    n->num = (uint8_t)lbm_dec_as_char(v);
+    return 1 + 1;
+  case LBM_TYPE_U:
+#ifndef LBM64
+    n->tag = S_U28_VALUE;
+    n->num_bytes = 4;
+#else
+    n->tag = S_U56_VALUE;
+    n->num_bytes = 8;
+#endif
+    n->num = (uint64_t)lbm_dec_u(v);
+    return 1 + n->num_bytes;
+  case LBM_TYPE_I:
+#ifndef LBM64
+    n->tag = S_I28_VALUE;
+    n->num_bytes = 4;
+    n->num = (uint32_t)lbm_dec_i(v);
+#else
+    n->tag = S_I56_VALUE;
+    n->num_bytes = 8;
+    n->num = (uint64_t)lbm_dec_i(v);
+#endif
+    return 1 + n->num_bytes;
+  case LBM_TYPE_U32:
+    n->tag = S_U32_VALUE;
+    n->num_bytes = 4;
+    n->num = lbm_dec_as_u32(v);
+    return 1 + 4;
+  case LBM_TYPE_I32:
+    n->tag = S_I32_VALUE;
+    n->num_bytes = 4;
+    n->num = (uint32_t)lbm_dec_as_i32(v);
+    return 1 + 4;
+  case LBM_TYPE_FLOAT: {
+    float f = lbm_dec_as_float(v);
+    uint32_t u;
+    memcpy(&u, &f, sizeof(uint32_t));
+    n->tag = S_FLOAT_VALUE;
+    n->num_bytes = 4;
+    n->num = u;
+    return 1 + 4;
   }
-
-  if (image && lbm_is_ptr(v) && (v & LBM_PTR_TO_CONSTANT_BIT)) {
-    // If flattening to image, constants can be stored by reference.
-    return (sizeof(lbm_uint) + 1); // one byte tag, one word ptr
+  case LBM_TYPE_U64:
+    n->tag = S_U64_VALUE;
+    n->num_bytes = 8;
+    n->num = lbm_dec_as_u64(v);
+    return 1 + 8;
+  case LBM_TYPE_I64:
+    n->tag = S_I64_VALUE;
+    n->num_bytes = 8;
+    n->num = (uint64_t)lbm_dec_as_i64(v);
+    return 1 + 8;
+  case LBM_TYPE_DOUBLE: {
+    double d = lbm_dec_as_double(v);
+    n->tag = S_DOUBLE_VALUE;
+    n->num_bytes = 8;
+    memcpy(&n->num, &d, sizeof(uint64_t));
+    return 1 + 8;
   }
+  case LBM_TYPE_SYMBOL: {
+    const char *sym_str = lbm_get_name_by_symbol(lbm_dec_sym(v));
+    if (!sym_str) return FLATTEN_VALUE_ERROR_FATAL;
+    n->tag = S_SYM_STRING;
+    n->data = (const uint8_t*)sym_str;
+    n->data_bytes = strlen(sym_str) + 1;
+    return 1 + (int)n->data_bytes;
+  }
+  case LBM_TYPE_ARRAY: {
+    // Platform dependent size.
+    // TODO: Something needs to be done to these inconsistencies.
+    lbm_int s = lbm_heap_array_get_size(v);
+    const uint8_t *d = lbm_heap_array_get_data_ro(v);
+    if (s <= 0 || d == NULL) return FLATTEN_VALUE_ERROR_ARRAY;
+    n->tag = S_LBM_ARRAY;
+    n->num_bytes = 4;
+    n->num = (uint32_t)s;
+    n->data = d;
+    n->data_bytes = (lbm_uint)s;
+    return 1 + 4 + (int)s;
+  }
+  default:
+    return FLATTEN_VALUE_ERROR_CANNOT_BE_FLATTENED;
+  }
+}
 
-  switch (t) {
-  case LBM_TYPE_CONS: {
-    int res = flatten_value_size_internal(jb,lbm_car(v), depth + 1, image);
-    if (res > 0) {
-      int s2 = flatten_value_size_internal(jb,lbm_cdr(v), depth + 1, image);
-      if (s2 > 0) {
-        res = (1 + res + s2);
-      } else {
-        res = s2;
-      }
-    }
-    return res;
+// Write the node with a single bounds check.
+static int flatten_emit(flatten_state_t *st, flatten_node_t *n, int size) {
+  int r = flatten_reserve(st, (lbm_uint)size);
+  if (r != FLATTEN_VALUE_OK) return r;
+  lbm_flat_value_t *fv = st->fv;
+  uint8_t *p = fv->buf + fv->buf_pos;
+  p[0] = n->tag;
+  switch (n->num_bytes) {
+  case 1:
+    p[1] = (uint8_t)n->num;
+    break;
+  case 4:
+    p[1] = (uint8_t)(n->num >> 24);
+    p[2] = (uint8_t)(n->num >> 16);
+    p[3] = (uint8_t)(n->num >> 8);
+    p[4] = (uint8_t)n->num;
+    break;
+  case 8:
+    p[1] = (uint8_t)(n->num >> 56);
+    p[2] = (uint8_t)(n->num >> 48);
+    p[3] = (uint8_t)(n->num >> 40);
+    p[4] = (uint8_t)(n->num >> 32);
+    p[5] = (uint8_t)(n->num >> 24);
+    p[6] = (uint8_t)(n->num >> 16);
+    p[7] = (uint8_t)(n->num >> 8);
+    p[8] = (uint8_t)n->num;
+    break;
+  default:
+    break;
   }
-  case LBM_TYPE_LISPARRAY: {
-    int sum = 4 + 1; // sizeof(uint32_t) + 1;
-    lbm_array_header_t *header = (lbm_array_header_t*)lbm_car(v);
-    if (header) {
-      lbm_value *arrdata = (lbm_value*)header->data;
-      lbm_uint size = header->size / sizeof(lbm_value);
-      for (lbm_uint i = 0; i < size; i ++ ) {
-        int r = flatten_value_size_internal(jb, arrdata[i], depth + 1, image);
-        if (r > 0) {
-          sum += r;
-        } else {
-          return r;
-        }
-      }
-    } else {
-      flatten_error(jb, FLATTEN_VALUE_ERROR_ARRAY);
-    }
-    return sum;
+  if (n->data_bytes) {
+    memcpy(p + 1 + n->num_bytes, n->data, n->data_bytes);
   }
+  fv->buf_pos += (lbm_uint)size;
+  return FLATTEN_VALUE_OK;
+}
+
+// Flat size of v without decoding it, for the size pass.
+static int flatten_node_size(lbm_value v, lbm_uint t) {
+  switch (t) {
+  case LBM_TYPE_CONS:
+    return 1;
+  case LBM_TYPE_LISPARRAY:
+    if ((lbm_array_header_t*)lbm_car(v) == NULL) return FLATTEN_VALUE_ERROR_ARRAY;
+    return 4 + 1; // sizeof(uint32_t) + 1;
   case LBM_TYPE_BYTE:
     return 1 + 1;
   case LBM_TYPE_U: /* fall through */
@@ -347,141 +510,173 @@ static int flatten_value_size_internal(jmp_buf jb, lbm_value v, int depth, bool
   case LBM_TYPE_DOUBLE:
     return 1 + 8;
   case LBM_TYPE_SYMBOL: {
-    if (!image) {
-      int s = f_sym_string_bytes(v);
-      if (s > 0) return 1 + s;
-      flatten_error(jb, (int)s);
-    } else {
-      return 1 + sizeof(lbm_uint);
-    }
-  } return 0; // already terminated with error
+    int s = f_sym_string_bytes(v);
+    if (s > 0) return 1 + s;
+    return s;
+  }
   case LBM_TYPE_ARRAY: {
-    // Platform dependent size.
-    // TODO: Something needs to be done to these inconsistencies.
     lbm_int s = lbm_heap_array_get_size(v);
-    if (s > 0)
+    if (s > 0 && lbm_heap_array_get_data_ro(v) != NULL)
       return 1 + 4 + (int)s;
-    flatten_error(jb, (int)s);
-  } return 0; // already terminated with error
+    return FLATTEN_VALUE_ERROR_ARRAY;
+  }
   default:
     return FLATTEN_VALUE_ERROR_CANNOT_BE_FLATTENED;
   }
 }
 
-int flatten_value_size(lbm_value v, bool image) {
-  jmp_buf jb;
-  int r = setjmp(jb);
-  if (r != 0) {
-    return r;
+static int flatten_one(flatten_state_t *st, lbm_value v, lbm_uint t) {
+  if (st->mode == FLATTEN_MODE_SIZE) {
+    int n = flatten_node_size(v, t);
+    if (n < 0) return n;
+    st->total += n;
+    return FLATTEN_VALUE_OK;
   }
-  return flatten_value_size_internal(jb, v, 0, image);
+  flatten_node_t node;
+  int n = flatten_node(&node, v, t);
+  if (n < 0) return n;
+  return flatten_emit(st, &node, n);
 }
 
-int flatten_value_c(lbm_flat_value_t *fv, lbm_value v) {
-
+static inline lbm_uint flatten_type_of(lbm_value v) {
   lbm_uint t = lbm_type_of(v);
   if (t >= LBM_POINTER_TYPE_FIRST && t < LBM_POINTER_TYPE_LAST) {
     //  Clear constant bit, it is irrelevant to flattening
     t = t & ~(LBM_PTR_TO_CONSTANT_BIT);
   }
+  return t;
+}
 
-  switch (t) {
-  case LBM_TYPE_CONS: {
-    bool res = true;
-    res = res && f_cons(fv);
-    if (res) {
-      int fv_r = flatten_value_c(fv, lbm_car(v));
-      if (fv_r == FLATTEN_VALUE_OK) {
-        fv_r = flatten_value_c(fv, lbm_cdr(v));
-      }
-      return fv_r;
-    }
-  }break;
-  case LBM_TYPE_LISPARRAY: {
-    lbm_array_header_t *header = (lbm_array_header_t*)lbm_car(v);
-    if (header) {
-      lbm_value *arrdata = (lbm_value*)header->data;
-      // always exact multiple of sizeof(lbm_value)
-      uint32_t size = (uint32_t)(header->size / sizeof(lbm_value));
-      if (!f_lisp_array(fv, size)) return FLATTEN_VALUE_ERROR_NOT_ENOUGH_MEMORY;
-      int fv_r = FLATTEN_VALUE_OK;
-      for (lbm_uint i = 0; i < size; i ++ ) {
-        fv_r =  flatten_value_c(fv, arrdata[i]);
-        if (fv_r != FLATTEN_VALUE_OK) {
+static inline int flatten_cons_tag(flatten_state_t *st) {
+  if (st->mode == FLATTEN_MODE_SIZE) {
+    st->total += 1;
+    return FLATTEN_VALUE_OK;
+  }
+  int r = flatten_reserve(st, 1);
+  if (r == FLATTEN_VALUE_OK) {
+    st->fv->buf[st->fv->buf_pos++] = S_CONS;
+  }
+  return r;
+}
+
+static inline bool flatten_is_leaf(lbm_uint t) {
+  return t != LBM_TYPE_CONS && t != LBM_TYPE_LISPARRAY;
+}
+
+// Returns the flat size in FLATTEN_MODE_SIZE and FLATTEN_VALUE_OK
+// otherwise, or a negative error code.
+static int flatten_walk(lbm_flat_value_t *fv, lbm_value v, int mode, bool image) {
+  flatten_stack_t s;
+  s.items = s.local;
+  s.sp = 0;
+  s.size = FLATTEN_LOCAL_STACK_SIZE;
+
+  flatten_state_t st;
+  st.fv = fv;
+  st.mode = mode;
+  st.root = v;
+  st.total = 0;
+
+  int res = FLATTEN_VALUE_OK;
+  int depth = 0;
+  bool next = true; // v holds the next value to flatten.
+
+  while (res == FLATTEN_VALUE_OK) {
+    if (!next) {
+      if (s.sp == 0) break;
+      flatten_item_t *top = &s.items[s.sp - 1];
+      if (top->ix == FLATTEN_ITEM_VALUE) {
+        v = top->v;
+        depth = top->depth;
+        s.sp --;
+      } else {
+        // Lisp array frame. Leaf elements are flattened right here,
+        // the frame stays on the stack for the first element that
+        // needs a walk of its own.
+        lbm_array_header_t *header = (lbm_array_header_t*)lbm_ref_cell(top->v)->car;
+        lbm_value *data = (lbm_value*)header->data;
+        lbm_uint num = header->size / sizeof(lbm_value);
+        depth = top->depth + 1;
+        if (top->ix < num && depth > flatten_maximum_depth) {
+          res = FLATTEN_VALUE_ERROR_MAXIMUM_DEPTH;
           break;
         }
+        while (top->ix < num) {
+          v = data[top->ix ++];
+          lbm_uint t = flatten_type_of(v);
+          if (image || !flatten_is_leaf(t)) {
+            next = true;
+            break;
+          }
+          res = flatten_one(&st, v, t);
+          if (res != FLATTEN_VALUE_OK) break;
+        }
+        if (!next) {
+          s.sp --;
+          continue;
+        }
       }
-      return fv_r;
-    } else {
-      return FLATTEN_VALUE_ERROR_ARRAY;
-    }
-  } break;
-  case LBM_TYPE_BYTE:
-    if (f_b(fv, (uint8_t)lbm_dec_as_char(v))) {
-      return FLATTEN_VALUE_OK;
     }
-    break;
-  case LBM_TYPE_U:
-    if (f_u(fv, lbm_dec_u(v))) {
-      return FLATTEN_VALUE_OK;
-    }
-    break;
-  case LBM_TYPE_I:
-    if (f_i(fv, lbm_dec_i(v))) {
-      return FLATTEN_VALUE_OK;
-    }
-    break;
-  case LBM_TYPE_U32:
-    if (f_u32(fv, lbm_dec_as_u32(v))) {
-      return FLATTEN_VALUE_OK;
-    }
-    break;
-  case LBM_TYPE_I32:
-    if (f_i32(fv, lbm_dec_as_i32(v))) {
-      return FLATTEN_VALUE_OK;
-    }
-    break;
-  case LBM_TYPE_U64:
-    if (f_u64(fv, lbm_dec_as_u64(v))) {
-      return FLATTEN_VALUE_OK;
-    }
-    break;
-  case LBM_TYPE_I64:
-    if (f_i64(fv, lbm_dec_as_i64(v))) {
-      return FLATTEN_VALUE_OK;
-    }
-    break;
-  case LBM_TYPE_FLOAT:
-    if (f_float(fv, lbm_dec_as_float(v))) {
-      return FLATTEN_VALUE_OK;
-    }
-    break;
-  case LBM_TYPE_DOUBLE:
-    if (f_double(fv, lbm_dec_as_double(v))) {
-      return FLATTEN_VALUE_OK;
+    next = false;
+
+    if (depth > flatten_maximum_depth) {
+      res = FLATTEN_VALUE_ERROR_MAXIMUM_DEPTH;
+      break;
     }
-    break;
-  case LBM_TYPE_SYMBOL: {
-    char *sym_str = (char*)lbm_get_name_by_symbol(lbm_dec_sym(v));
-    if (f_sym_string(fv, sym_str)) {
-      return FLATTEN_VALUE_OK;
+
+    if (image &&
+        ((lbm_is_ptr(v) && (v & LBM_PTR_TO_CONSTANT_BIT)) || lbm_is_symbol(v))) {
+      // If flattening to image, constants are stored by reference
+      // and symbols by id. One byte tag, one word.
+      st.total += (int)sizeof(lbm_uint) + 1;
+      continue;
     }
-  } break;
-  case LBM_TYPE_ARRAY: {
-    lbm_int s = lbm_heap_array_get_size(v);
-    const uint8_t *d = lbm_heap_array_get_data_ro(v);
-    if (s > 0 && d != NULL) {
-      if (f_lbm_array(fv, (uint32_t)s, (uint8_t*)d)) {
-        return FLATTEN_VALUE_OK;
+
+    lbm_uint t = flatten_type_of(v);
+    if (t == LBM_TYPE_CONS) {
+      res = flatten_cons_tag(&st);
+      if (res != FLATTEN_VALUE_OK) break;
+      lbm_cons_t *cell = lbm_ref_cell(v);
+      lbm_uint car_t = flatten_type_of(cell->car);
+      depth ++;
+      if (!image && flatten_is_leaf(car_t)) {
+        // Leaf in the car, as in most lists. Flatten it here and go
+        // on with the cdr without using the stack.
+        if (depth > flatten_maximum_depth) {
+          res = FLATTEN_VALUE_ERROR_MAXIMUM_DEPTH;
+          break;
+        }
+        res = flatten_one(&st, cell->car, car_t);
+        v = cell->cdr;
+      } else if (flatten_push(&s, cell->cdr, FLATTEN_ITEM_VALUE, depth)) {
+        v = cell->car;
+      } else {
+        res = FLATTEN_VALUE_ERROR_NOT_ENOUGH_MEMORY;
       }
+      next = true;
     } else {
-      return FLATTEN_VALUE_ERROR_ARRAY;
+      res = flatten_one(&st, v, t);
+      if (res == FLATTEN_VALUE_OK &&
+          t == LBM_TYPE_LISPARRAY &&
+          !flatten_push(&s, v, 0, depth)) {
+        res = FLATTEN_VALUE_ERROR_NOT_ENOUGH_MEMORY;
+      }
     }
-  }break;
-  default:
-    return FLATTEN_VALUE_ERROR_CANNOT_BE_FLATTENED;
   }
-  return FLATTEN_VALUE_ERROR_BUFFER_TOO_SMALL;
+
+  if (s.items != s.local) lbm_free(s.items);
+  if (res == FLATTEN_VALUE_OK && mode == FLATTEN_MODE_SIZE) {
+    return st.total;
+  }
+  return res;
+}
+
+int flatten_value_size(lbm_value v, bool image) {
+  return flatten_walk(NULL, v, FLATTEN_MODE_SIZE, image);
+}
+
+int flatten_value_c(lbm_flat_value_t *fv, lbm_value v) {
+  return flatten_walk(fv, v, FLATTEN_MODE_FIXED, false);
 }
 
 lbm_value handle_flatten_error(int err_val) {
@@ -501,6 +696,10 @@ lbm_value handle_flatten_error(int err_val) {
   return ENC_SYM_NIL;
 }
 
+// Values that fit in FLATTEN_VALUE_INITIAL_BUFFER_SIZE bytes are
+// flattened in a single pass. For larger values the exact size is
+// computed when the initial buffer runs full and flattening goes on in
+// a buffer of that size.
 lbm_value flatten_value(lbm_value v) {
 
   lbm_value array_cell = lbm_heap_allocate_cell(LBM_TYPE_CONS, ENC_SYM_NIL, ENC_SYM_ARRAY_TYPE);
@@ -509,42 +708,31 @@ lbm_value flatten_value(lbm_value v) {
     return array_cell;
   }
 
-  lbm_flat_value_t fv;
-
-  lbm_array_header_t *array = NULL;
-  int required_mem = flatten_value_size(v, false);
-  if (required_mem > 0) {
-    array = (lbm_array_header_t *)lbm_malloc(sizeof(lbm_array_header_t));
-    if (array == NULL) {
-      lbm_set_car_and_cdr(array_cell, ENC_SYM_NIL, ENC_SYM_NIL);
-      return ENC_SYM_MERROR;
-    }
-
-    bool r = lbm_start_flatten(&fv, (lbm_uint)required_mem);
-    if (!r) {
-      lbm_free(array);
-      lbm_set_car_and_cdr(array_cell, ENC_SYM_NIL, ENC_SYM_NIL);
-      return ENC_SYM_MERROR;
-    }
+  lbm_array_header_t *array = (lbm_array_header_t *)lbm_malloc(sizeof(lbm_array_header_t));
+  if (array == NULL) {
+    lbm_set_car_and_cdr(array_cell, ENC_SYM_NIL, ENC_SYM_NIL);
+    return ENC_SYM_MERROR;
+  }
 
-    if (flatten_value_c(&fv, v) == FLATTEN_VALUE_OK) {
-      // it would be wasteful to run finish_flatten here.
-      r = true;
-    } else {
-      r = false;
-    }
+  lbm_flat_value_t fv;
+  int r = FLATTEN_VALUE_ERROR_NOT_ENOUGH_MEMORY;
+  if (lbm_start_flatten(&fv, FLATTEN_VALUE_INITIAL_BUFFER_SIZE)) {
+    r = flatten_walk(&fv, v, FLATTEN_MODE_GROW, false);
+    if (r != FLATTEN_VALUE_OK) lbm_free(fv.buf);
+  }
 
-    if (r)  {
-      // lift flat_value
-      array->data = (lbm_uint*)fv.buf;
-      array->size = fv.buf_size;
-      lbm_set_car(array_cell, (lbm_uint)array);
-      array_cell = lbm_set_ptr_type(array_cell, LBM_TYPE_ARRAY);
-      return array_cell;
-    }
+  if (r == FLATTEN_VALUE_OK) {
+    // lift flat_value
+    lbm_finish_flatten(&fv);
+    array->data = (lbm_uint*)fv.buf;
+    array->size = fv.buf_pos;
+    lbm_set_car(array_cell, (lbm_uint)array);
+    array_cell = lbm_set_ptr_type(array_cell, LBM_TYPE_ARRAY);
+    return array_cell;
   }
+  lbm_free(array);
   lbm_set_car_and_cdr(array_cell, ENC_SYM_NIL, ENC_SYM_NIL);
-  return handle_flatten_error(required_mem);
+  return handle_flatten_error(r);
 }
 
 // ////////////////////////////////////////////////////////////
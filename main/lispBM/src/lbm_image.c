@@ -1217,15 +1217,9 @@ bool lbm_image_boot(void) {
       lbm_uint bind_val = read_u32(pos-1);
       pos -= 2;
 #endif
-      lbm_uint ix_key  = lbm_dec_sym(bind_key) & GLOBAL_ENV_MASK;
-      lbm_value *global_env = lbm_get_global_env();
-      lbm_uint orig_env = global_env[ix_key];
-      lbm_value new_env = lbm_env_set(orig_env,bind_key,bind_val);
-
-      if (lbm_is_symbol(new_env)) {
+      if (lbm_global_env_set(bind_key, bind_val) != ENC_SYM_TRUE) {
         return false;
       }
-      global_env[ix_key] = new_env;
     } break;
     case BINDING_FLAT: {
       // on 64 bit           | on 32 bit
@@ -1284,15 +1278,9 @@ bool lbm_image_boot(void) {
           lbm_unflatten_value(&fv, &unflattened);
         }
       }
-      lbm_uint ix_key  = lbm_dec_sym(bind_key) & GLOBAL_ENV_MASK;
-      lbm_value *global_env = lbm_get_global_env();
-      lbm_uint orig_env = global_env[ix_key];
-      lbm_value new_env = lbm_env_set(orig_env,bind_key,unflattened);
-
-      if (lbm_is_symbol(new_env)) {
+      if (lbm_global_env_set(bind_key, unflattened) != ENC_SYM_TRUE) {
         return false;
       }
-      global_env[ix_key] = new_env;
       pos --;
     } break;
     case SYMBOL_ENTRY: {
@@ -25,6 +25,8 @@
 
 // pull in from eval_cps
 void lbm_request_gc(void);
+// pull in from heap
+void lbm_gc_request_full_sweep(void);
 
 /* Status bit patterns */
 #define FREE_OR_USED  0  //00b
@@ -51,6 +53,23 @@ static lbm_mutex_t lbm_mem_mutex;
 static bool    lbm_mem_mutex_initialized;
 static lbm_uint alloc_offset = 0;
 
+/* Free-extent index
+ *
+ * Optional summary tree on top of the status bitmap. Memory is divided
+ * into chunks of 2^index_shift words and each leaf holds the length of
+ * the longest free extent that starts in that chunk (the extent may run
+ * past the end of the chunk). Inner nodes hold the max of their
+ * children, so the root is the longest free extent and the leftmost
+ * chunk with a large enough extent is found in log(chunks) steps.
+ *
+ * The bitmap is still the source of truth. Allocate, free and shrink
+ * recompute the leaves of the chunks where an extent starts or stops
+ * starting and propagate the change towards the root.
+ */
+static lbm_uint *index_tree = NULL;
+static lbm_uint index_leaves = 0; // Power of two, leaf i is at index_tree[index_leaves + i]
+static lbm_uint index_shift = 0;
+
 // TODO: Go over the size requirements here.
 // There may be some extra tight constraints set on bitmap size.
 //
@@ -67,6 +86,7 @@ bool lbm_memory_init(lbm_uint *data, lbm_uint data_size,
   alloc_offset = 0;
 
   lbm_mutex_lock(&lbm_mem_mutex);
+  index_tree = NULL;
   bool res = false;
   if (data && bits) {
 
@@ -161,6 +181,170 @@ static inline void set_status(lbm_uint i, lbm_uint status) {
   bitmap[word_ix] |= mask;
 }
 
+#define STATUS_PER_WORD ((WORD_MOD_MASK + 1) >> 1)
+#ifndef LBM64
+#define STATUS_LO_BITS 0x55555555u
+#else
+#define STATUS_LO_BITS 0x5555555555555555u
+#endif
+#define STATUS_HI_BITS (STATUS_LO_BITS << 1)
+
+// First index >= i where status has a bit in common with the pattern
+// (STATUS_LO_BITS finds END/START_END, STATUS_HI_BITS finds
+// START/START_END) or memory_size if there is none. Bitmap words without
+// a match are skipped whole.
+static lbm_uint find_next(lbm_uint i, lbm_uint pattern) {
+  while (i < memory_size) {
+    lbm_uint ix = i << 1;
+    lbm_uint word_ix = ix >> WORD_IX_SHIFT;
+    lbm_uint bit_ix  = ix & WORD_MOD_MASK;
+
+    if (((bitmap[word_ix] & pattern) >> bit_ix) == 0) {
+      i = (i | (STATUS_PER_WORD - 1)) + 1;
+      continue;
+    }
+    if ((status(i) << bit_ix) & pattern) {
+      return i;
+    }
+    i++;
+  }
+  return memory_size;
+}
+
+// Last index <= i with a status other than FREE_OR_USED.
+static bool find_prev_marked(lbm_uint i, lbm_uint *res) {
+  for (;;) {
+    lbm_uint ix = i << 1;
+    lbm_uint word_ix = ix >> WORD_IX_SHIFT;
+    lbm_uint bit_ix  = ix & WORD_MOD_MASK;
+
+    lbm_uint w = bitmap[word_ix];
+    if (bit_ix + 2 <= WORD_MOD_MASK) {
+      w &= (((lbm_uint)1) << (bit_ix + 2)) - 1;
+    }
+    if (w == 0) {
+      if (word_ix == 0) return false;
+      i = (word_ix * STATUS_PER_WORD) - 1;
+      continue;
+    }
+    while (status(i) == FREE_OR_USED) {
+      i--;
+    }
+    *res = i;
+    return true;
+  }
+}
+
+// Index of the first word of the free extent that i is inside of,
+// or memory_size if i is not free.
+static lbm_uint extent_start(lbm_uint i) {
+  if (status(i) != FREE_OR_USED) return memory_size;
+  lbm_uint j;
+  if (!find_prev_marked(i, &j)) return 0;
+  if (status(j) == START) return memory_size;
+  return j + 1;
+}
+
+// Scan the extents that start in chunk c. With num_words > 0 the index
+// of the first extent of at least num_words is returned in found,
+// otherwise the length of the longest extent is returned.
+static lbm_uint index_scan_chunk(lbm_uint c, lbm_uint num_words, lbm_uint *found) {
+  lbm_uint i = c << index_shift;
+  lbm_uint end = i + ((lbm_uint)1 << index_shift);
+  if (end > memory_size) end = memory_size;
+  lbm_uint max = 0;
+
+  if (i < memory_size && status(i) == FREE_OR_USED) {
+    lbm_uint s = extent_start(i);
+    if (s == memory_size) {
+      i = find_next(i, STATUS_LO_BITS) + 1; // Inside an allocation
+    } else if (s < i) {
+      i = find_next(i, STATUS_HI_BITS); // Extent started in an earlier chunk
+    }
+  }
+
+  while (i < end) {
+    switch (status(i)) {
+    case START:
+      i = find_next(i, STATUS_LO_BITS) + 1;
+      break;
+    case END: // Only at the start of the chunk
+    case START_END:
+      i++;
+      break;
+    default: {
+      lbm_uint e = find_next(i, STATUS_HI_BITS);
+      if (num_words > 0 && e - i >= num_words) {
+        *found = i;
+        return e - i;
+      }
+      if (e - i > max) max = e - i;
+      i = e;
+    } break;
+    }
+  }
+  return max;
+}
+
+static void index_update(lbm_uint i) {
+  if (!index_tree || i >= memory_size) return;
+  lbm_uint c = i >> index_shift;
+  lbm_uint n = index_leaves + c;
+  lbm_uint v = index_scan_chunk(c, 0, NULL);
+  if (index_tree[n] == v) return;
+  index_tree[n] = v;
+  while (n > 1) {
+    n >>= 1;
+    lbm_uint l = index_tree[2 * n];
+    lbm_uint r = index_tree[2 * n + 1];
+    v = l > r ? l : r;
+    if (index_tree[n] == v) break;
+    index_tree[n] = v;
+  }
+}
+
+static bool index_find(lbm_uint num_words, lbm_uint *start_ix) {
+  if (index_tree[1] < num_words) return false;
+  lbm_uint n = 1;
+  while (n < index_leaves) {
+    n = index_tree[2 * n] >= num_words ? 2 * n : 2 * n + 1;
+  }
+  return index_scan_chunk(n - index_leaves, num_words, start_ix) >= num_words;
+}
+
+bool lbm_memory_init_index(lbm_uint *data, lbm_uint size) {
+  if (memory == NULL || bitmap == NULL || data == NULL) {
+    return false;
+  }
+
+  lbm_uint shift = 0;
+  lbm_uint leaves = 1;
+  for (;;) {
+    lbm_uint chunks = (memory_size + ((lbm_uint)1 << shift) - 1) >> shift;
+    leaves = 1;
+    while (leaves < chunks) leaves <<= 1;
+    if (2 * leaves <= size) break;
+    if (leaves == 1) return false;
+    shift++;
+  }
+
+  lbm_mutex_lock(&lbm_mem_mutex);
+  index_tree = data;
+  index_leaves = leaves;
+  index_shift = shift;
+  for (lbm_uint c = 0; c < leaves; c ++) {
+    index_tree[leaves + c] = index_scan_chunk(c, 0, NULL);
+  }
+  for (lbm_uint n = leaves - 1; n > 0; n --) {
+    lbm_uint l = index_tree[2 * n];
+    lbm_uint r = index_tree[2 * n + 1];
+    index_tree[n] = l > r ? l : r;
+  }
+  index_tree[0] = 0;
+  lbm_mutex_unlock(&lbm_mem_mutex);
+  return true;
+}
+
 lbm_uint lbm_memory_num_words(void) {
   return memory_size;
 }
@@ -187,7 +371,12 @@ lbm_uint lbm_memory_longest_free(void) {
   lbm_uint max_length = 0;
 
   lbm_uint curr_length = 0;
-  for (unsigned int i = 0; i < memory_size; i ++) {
+  lbm_uint scan_size = memory_size;
+  if (index_tree) {
+    max_length = index_tree[1];
+    scan_size = 0;
+  }
+  for (unsigned int i = 0; i < scan_size; i ++) {
 
     // The status field is 2 bits and this 4 cases is exhaustive!
     switch(status(i)) {
@@ -244,12 +433,14 @@ static lbm_uint *lbm_memory_allocate_internal(lbm_uint num_words, bool use_reser
 
   if (num_words > memory_num_free) {
     lbm_request_gc();
+    lbm_gc_request_full_sweep();
     lbm_mutex_unlock(&lbm_mem_mutex);
     return NULL;
   }
 
   if (!use_reserve && memory_num_free - num_words < memory_reserve_level) {
     lbm_request_gc();
+    lbm_gc_request_full_sweep();
     lbm_mutex_unlock(&lbm_mem_mutex);
     return NULL;
   }
@@ -258,8 +449,18 @@ static lbm_uint *lbm_memory_allocate_internal(lbm_uint num_words, bool use_reser
   lbm_uint end_ix = 0;
   lbm_uint free_length = 0;
   unsigned int state = INIT;
+  lbm_uint scan_size = memory_size;
+
+  if (index_tree) {
+    // First fit through the index instead of the linear scan
+    scan_size = 0;
+    if (num_words > 0 && index_find(num_words, &start_ix)) {
+      end_ix = start_ix + num_words - 1;
+      state = ALLOC_DONE;
+    }
+  }
 
-  for (lbm_uint i = 0; i < memory_size; i ++) {
+  for (lbm_uint i = 0; i < scan_size; i ++) {
     switch(status(alloc_offset)) {
     case FREE_OR_USED:
       switch (state) {
@@ -314,10 +515,13 @@ static lbm_uint *lbm_memory_allocate_internal(lbm_uint num_words, bool use_reser
       set_status(start_ix, START);
       set_status(end_ix, END);
     }
+    index_update(start_ix);
+    index_update(end_ix + 1);
     memory_num_free -= num_words;
     lbm_mutex_unlock(&lbm_mem_mutex);
     return bitmap_ix_to_address(start_ix);
   }
+  lbm_gc_request_full_sweep();
   lbm_mutex_unlock(&lbm_mem_mutex);
   return NULL;
 }
@@ -354,8 +558,14 @@ int lbm_memory_free(lbm_uint *ptr) {
       break;
     }
     if (r) {
-      while (alloc_offset > 0 && status(alloc_offset - 1) == FREE_OR_USED) {
-        alloc_offset--;
+      if (index_tree) {
+        // The freed range merges with the extents on both sides
+        index_update(extent_start(ix));
+        index_update(ix + count_freed);
+      } else {
+        while (alloc_offset > 0 && status(alloc_offset - 1) == FREE_OR_USED) {
+          alloc_offset--;
+        }
       }
     }
     memory_num_free += count_freed;
@@ -438,6 +648,8 @@ int lbm_memory_shrink(lbm_uint *ptr, lbm_uint n) {
         break;
       }
     }
+    index_update(ix + n);
+    index_update(ix + n + count);
   }
 
   memory_num_free += count;
@@ -15,7 +15,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <stdio.h>
+
 #include "lbm_prof.h"
+#include "env.h"
 #include "platform_mutex.h"
 
 static lbm_uint num_samples = 0;
@@ -29,6 +32,10 @@ extern volatile bool lbm_system_sleeping;
 static lbm_prof_t *prof_data;
 static lbm_uint    prof_data_num;
 
+static lbm_prof_stack_t *stack_data = NULL;
+static lbm_uint          stack_data_num = 0;
+static lbm_uint          num_dropped_stack_samples = 0;
+
 #define TRUNC_SIZE(N) (((N) > LBM_PROF_MAX_NAME_SIZE -1) ? LBM_PROF_MAX_NAME_SIZE-1 : N)
 
 bool lbm_prof_init(lbm_prof_t *prof_data_buf,
@@ -50,6 +57,32 @@ bool lbm_prof_init(lbm_prof_t *prof_data_buf,
   return false;
 }
 
+bool lbm_prof_stacks_init(lbm_prof_stack_t *stack_buf,
+                          lbm_uint          stack_buf_num) {
+  if (qmutex_initialized && stack_buf && stack_buf_num > 0) {
+    lbm_mutex_lock(&qmutex);
+    num_dropped_stack_samples = 0;
+    for (lbm_uint i = 0; i < stack_buf_num; i ++) {
+      stack_buf[i].cid = -1;
+      stack_buf[i].count = 0;
+    }
+    stack_data = stack_buf;
+    stack_data_num = stack_buf_num;
+    lbm_mutex_unlock(&qmutex);
+    lbm_set_call_stack_tracking(true);
+    return true;
+  }
+  return false;
+}
+
+void lbm_prof_stacks_stop(void) {
+  lbm_set_call_stack_tracking(false);
+}
+
+lbm_uint lbm_prof_get_num_dropped_stack_samples(void) {
+  return num_dropped_stack_samples;
+}
+
 lbm_uint lbm_prof_get_num_samples(void) {
   return num_samples;
 }
@@ -62,6 +95,59 @@ lbm_uint lbm_prof_get_num_sleep_samples(void) {
   return num_sleep_samples;
 }
 
+// FNV-1a over the parts of the sample that identify it.
+static uint32_t stack_hash(lbm_cid cid, bool gc, lbm_value *frames, lbm_uint n) {
+  uint32_t h = 2166136261u;
+  h = (h ^ (uint32_t)cid) * 16777619u;
+  h = (h ^ (gc ? 1u : 0u)) * 16777619u;
+  for (lbm_uint i = 0; i < n; i ++) {
+    h = (h ^ (uint32_t)frames[i]) * 16777619u;
+  }
+  return h;
+}
+
+static void sample_stack(eval_context_t *ctx, bool doing_gc) {
+  lbm_value frames[LBM_PROF_MAX_STACK_DEPTH];
+  bool truncated;
+  lbm_uint n = lbm_get_call_stack(ctx, frames, LBM_PROF_MAX_STACK_DEPTH, &truncated);
+  lbm_value ext = lbm_get_running_extension();
+  if (ext != ENC_SYM_NIL) {
+    if (n == LBM_PROF_MAX_STACK_DEPTH) {
+      memmove(frames, frames + 1, (n - 1) * sizeof(lbm_value));
+      n --;
+      truncated = true;
+    }
+    frames[n++] = ext;
+  }
+
+  uint32_t h = stack_hash(ctx->id, doing_gc, frames, n);
+  lbm_uint ix = h % stack_data_num;
+  for (lbm_uint i = 0; i < stack_data_num; i ++) {
+    lbm_prof_stack_t *e = &stack_data[ix];
+    if (e->cid == -1) {
+      e->cid = ctx->id;
+      e->hash = h;
+      e->depth = (uint16_t)n;
+      e->gc = doing_gc;
+      e->truncated = truncated;
+      e->count = 1;
+      memcpy(e->frames, frames, n * sizeof(lbm_value));
+      return;
+    }
+    if (e->hash == h &&
+        e->cid == ctx->id &&
+        e->gc == doing_gc &&
+        e->truncated == truncated &&
+        e->depth == n &&
+        memcmp(e->frames, frames, n * sizeof(lbm_value)) == 0) {
+      e->count ++;
+      return;
+    }
+    ix = (ix + 1) % stack_data_num;
+  }
+  num_dropped_stack_samples ++;
+}
+
 void lbm_prof_sample(void) {
   num_samples ++;
 
@@ -108,6 +194,9 @@ void lbm_prof_sample(void) {
         break;
       }
     }
+    if (stack_data) {
+      sample_stack(curr, doing_gc);
+    }
   } else {
     if (lbm_system_sleeping) {
       num_sleep_samples ++;
@@ -117,3 +206,72 @@ void lbm_prof_sample(void) {
   }
   lbm_mutex_unlock(&qmutex);
 }
+
+// Name of the global binding of the closure with the given body.
+static const char *closure_name(lbm_value body) {
+  lbm_value *env = lbm_get_global_env();
+  for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
+    for (lbm_value curr = env[i]; lbm_is_cons(curr); curr = lbm_cdr(curr)) {
+      lbm_value binding = lbm_car(curr);
+      lbm_value val = lbm_cdr(binding);
+      if (lbm_is_closure(val) &&
+          lbm_car(lbm_cdr(lbm_cdr(val))) == body) {
+        const char *name = lbm_get_name_by_symbol(lbm_dec_sym(lbm_car(binding)));
+        if (name) return name;
+      }
+    }
+  }
+  return "lambda";
+}
+
+static const char *frame_name(lbm_value frame) {
+  if (lbm_is_symbol(frame)) {
+    const char *name = lbm_get_name_by_symbol(lbm_dec_sym(frame));
+    return name ? name : "extension";
+  }
+  return closure_name(frame);
+}
+
+static void append(char *buf, lbm_uint buf_size, lbm_uint *n, const char *fmt, const char *str) {
+  if (*n >= buf_size) return;
+  int r = snprintf(buf + *n, buf_size - *n, fmt, str);
+  if (r > 0) {
+    *n += (lbm_uint)r;
+    if (*n >= buf_size) *n = buf_size - 1;
+  }
+}
+
+int lbm_prof_stack_collapsed(lbm_uint ix, char *buf, lbm_uint buf_size) {
+  if (!stack_data || ix >= stack_data_num || buf_size == 0) return 0;
+  lbm_prof_stack_t *e = &stack_data[ix];
+  if (e->cid == -1) return 0;
+
+  lbm_uint n = 0;
+  const char *ctx_name = NULL;
+  for (lbm_uint i = 0; i < prof_data_num; i ++) {
+    if (prof_data[i].cid == e->cid && prof_data[i].has_name) {
+      ctx_name = prof_data[i].name;
+      break;
+    }
+  }
+  if (ctx_name) {
+    append(buf, buf_size, &n, "%s", ctx_name);
+  } else {
+    char cid_str[24];
+    snprintf(cid_str, sizeof(cid_str), "%d", (int)e->cid);
+    append(buf, buf_size, &n, "cid-%s", cid_str);
+  }
+  if (e->truncated) {
+    append(buf, buf_size, &n, ";%s", "...");
+  }
+  for (lbm_uint i = 0; i < e->depth; i ++) {
+    append(buf, buf_size, &n, ";%s", frame_name(e->frames[i]));
+  }
+  if (e->gc) {
+    append(buf, buf_size, &n, ";%s", "[gc]");
+  }
+  char count_str[24];
+  snprintf(count_str, sizeof(count_str), "%u", (unsigned int)e->count);
+  append(buf, buf_size, &n, " %s", count_str);
+  return (int)n;
+}
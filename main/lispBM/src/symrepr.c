@@ -85,6 +85,8 @@ special_sym const special_symbols[] =  {
   {"rotate"       , SYM_ROTATE},
   {"call-cc-unsafe", SYM_CALL_CC_UNSAFE},
   {"apply"        , SYM_APPLY},
+  {"compile"      , SYM_COMPILE},
+  {"bytecode"     , SYM_BYTECODE},
 
   // pattern matching
   {"?"          , SYM_MATCH_ANY},
@@ -265,9 +267,294 @@ static lbm_uint symbol_table_size_list_flash = 0;
 static lbm_uint symbol_table_size_strings = 0;
 static lbm_uint symbol_table_size_strings_flash = 0;
 
+// Symbol index
+//
+// Open addressed hash table from name to a 16 bit key, allocated in
+// lbm_memory. Key k refers to
+//   special_symbols[k]                               k < NUM_SPECIAL_SYMBOLS
+//   extension_table[k - NUM_SPECIAL_SYMBOLS]         k < NUM_SPECIAL_SYMBOLS + max extensions
+//   sym_by_id[k - NUM_SPECIAL_SYMBOLS - max ext]     otherwise
+// Slots hold key + 1 so that 0 is an empty slot. sym_by_id maps runtime
+// symbol ids (minus RUNTIME_SYMBOLS_START) to their symlist entries and
+// is used for id to name lookups as well.
+//
+// The index is rebuilt lazily from the special symbols, the extension
+// table and the symlist when invalidated, for example by an image boot.
+// If it does not fit in lbm_memory the linear searches are used instead.
+
+#ifndef LBM_NO_SYMBOL_INDEX
+
+#define SYM_INDEX_INVALID   0
+#define SYM_INDEX_VALID     1
+#define SYM_INDEX_OFF       2
+
+#define SYM_INDEX_MIN_SIZE  64
+#define SYM_INDEX_MAX_KEY   0xFFFE
+
+static uint16_t *sym_index = NULL;
+static lbm_uint sym_index_size = 0;
+static lbm_uint sym_index_num = 0;
+static lbm_uint **sym_by_id = NULL;
+static lbm_uint sym_by_id_size = 0;
+static lbm_uint sym_index_ext_max = 0;
+static int sym_index_state = SYM_INDEX_INVALID;
+// Held while the index is read or changed, as growing it frees the old
+// tables. Lookups can come from other threads than the evaluator.
+static lbm_mutex_t sym_index_mutex;
+static bool sym_index_mutex_initialized = false;
+
+// The extension table can be set up before lbm_symrepr_init.
+static void sym_index_lock(void) {
+  if (sym_index_mutex_initialized) lbm_mutex_lock(&sym_index_mutex);
+}
+
+static void sym_index_unlock(void) {
+  if (sym_index_mutex_initialized) lbm_mutex_unlock(&sym_index_mutex);
+}
+
+static uint32_t sym_hash(const char *name) {
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  while (*name) {
+    h ^= (uint8_t)*name++;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static const char *sym_key_name(lbm_uint k) {
+  if (k < NUM_SPECIAL_SYMBOLS) {
+    return special_symbols[k].name;
+  }
+  k -= NUM_SPECIAL_SYMBOLS;
+  if (k < sym_index_ext_max) {
+    return extension_table[k].name;
+  }
+  k -= sym_index_ext_max;
+  return (const char *)sym_by_id[k][NAME];
+}
+
+static lbm_uint sym_key_id(lbm_uint k) {
+  if (k < NUM_SPECIAL_SYMBOLS) {
+    return special_symbols[k].id;
+  }
+  k -= NUM_SPECIAL_SYMBOLS;
+  if (k < sym_index_ext_max) {
+    return EXTENSION_SYMBOLS_START + k;
+  }
+  k -= sym_index_ext_max;
+  return sym_by_id[k][ID];
+}
+
+static void sym_index_off(void) {
+  if (sym_index) lbm_free(sym_index);
+  if (sym_by_id) lbm_free(sym_by_id);
+  sym_index = NULL;
+  sym_by_id = NULL;
+  sym_index_size = 0;
+  sym_index_num = 0;
+  sym_by_id_size = 0;
+  sym_index_state = SYM_INDEX_OFF;
+}
+
+// Returns the slot holding name, or the empty slot where it belongs.
+static lbm_uint sym_index_slot(const char *name) {
+  lbm_uint mask = sym_index_size - 1;
+  lbm_uint i = sym_hash(name) & mask;
+  while (sym_index[i] && !str_eq(name, sym_key_name(sym_index[i] - 1u))) {
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+
+static void sym_index_put(lbm_uint k, bool replace) {
+  const char *name = sym_key_name(k);
+  if (!name) return;
+  lbm_uint i = sym_index_slot(name);
+  if (sym_index[i] == 0) {
+    sym_index_num ++;
+  } else if (!replace || sym_index[i] - 1u < NUM_SPECIAL_SYMBOLS + sym_index_ext_max) {
+    // Only runtime symbols are replaced, special symbols and
+    // extensions are found before them.
+    return;
+  }
+  sym_index[i] = (uint16_t)(k + 1);
+}
+
+// Make room for one more key, at most 3/4 of the slots are used.
+static bool sym_index_reserve(void) {
+  if ((sym_index_num + 1) * 4 <= sym_index_size * 3) return true;
+
+  uint16_t *old = sym_index;
+  lbm_uint old_size = sym_index_size;
+  lbm_uint size = old_size ? old_size * 2 : SYM_INDEX_MIN_SIZE;
+  while ((sym_index_num + 1) * 4 > size * 3) size *= 2;
+
+  uint16_t *tab = lbm_malloc(size * sizeof(uint16_t));
+  if (!tab) return false;
+  memset(tab, 0, size * sizeof(uint16_t));
+  sym_index = tab;
+  sym_index_size = size;
+  sym_index_num = 0;
+  for (lbm_uint i = 0; i < old_size; i ++) {
+    if (old[i]) sym_index_put(old[i] - 1u, false);
+  }
+  if (old) lbm_free(old);
+  return true;
+}
+
+static bool sym_by_id_reserve(lbm_uint n) {
+  if (n <= sym_by_id_size) return true;
+  lbm_uint size = sym_by_id_size ? sym_by_id_size : 16;
+  while (size < n) size *= 2;
+  lbm_uint **tab = lbm_malloc(size * sizeof(lbm_uint *));
+  if (!tab) return false;
+  memset(tab, 0, size * sizeof(lbm_uint *));
+  if (sym_by_id) {
+    memcpy(tab, sym_by_id, sym_by_id_size * sizeof(lbm_uint *));
+    lbm_free(sym_by_id);
+  }
+  sym_by_id = tab;
+  sym_by_id_size = size;
+  return true;
+}
+
+static bool sym_index_add_runtime(lbm_uint *entry) {
+  lbm_uint ix = entry[ID] - RUNTIME_SYMBOLS_START;
+  if (entry[ID] < RUNTIME_SYMBOLS_START ||
+      NUM_SPECIAL_SYMBOLS + sym_index_ext_max + ix > SYM_INDEX_MAX_KEY ||
+      !sym_by_id_reserve(ix + 1) ||
+      !sym_index_reserve()) {
+    return false;
+  }
+  sym_by_id[ix] = entry;
+  // Newer symbols take precedence, as in the symlist
+  sym_index_put(NUM_SPECIAL_SYMBOLS + sym_index_ext_max + ix, true);
+  return true;
+}
+
+static void sym_index_rebuild(void) {
+  sym_index_off();
+  sym_index_state = SYM_INDEX_VALID;
+  sym_index_ext_max = lbm_get_max_extensions();
+
+  if (NUM_SPECIAL_SYMBOLS + sym_index_ext_max > SYM_INDEX_MAX_KEY) {
+    sym_index_off();
+    return;
+  }
+
+  for (lbm_uint i = 0; i < NUM_SPECIAL_SYMBOLS; i ++) {
+    if (!sym_index_reserve()) goto rebuild_failed;
+    sym_index_put(i, false);
+  }
+
+  for (lbm_uint i = 0; i < lbm_get_num_extensions(); i ++) {
+    if (extension_table[i].name) {
+      if (!sym_index_reserve()) goto rebuild_failed;
+      sym_index_put(NUM_SPECIAL_SYMBOLS + i, false);
+    }
+  }
+
+  // Ids are handed out in increasing order, so adding the runtime
+  // symbols by id lets the newest one win for names that occur more
+  // than once, as when searching the symlist.
+  if (next_symbol_id > RUNTIME_SYMBOLS_START) {
+    lbm_uint n = next_symbol_id - RUNTIME_SYMBOLS_START;
+    if (NUM_SPECIAL_SYMBOLS + sym_index_ext_max + n > SYM_INDEX_MAX_KEY + 1 ||
+        !sym_by_id_reserve(n)) {
+      goto rebuild_failed;
+    }
+    for (lbm_uint *curr = symlist; curr; curr = (lbm_uint *)curr[NEXT]) {
+      if (curr[ID] >= RUNTIME_SYMBOLS_START && curr[ID] < next_symbol_id) {
+        sym_by_id[curr[ID] - RUNTIME_SYMBOLS_START] = curr;
+      }
+    }
+    for (lbm_uint i = 0; i < n; i ++) {
+      if (sym_by_id[i]) {
+        if (!sym_index_reserve()) goto rebuild_failed;
+        sym_index_put(NUM_SPECIAL_SYMBOLS + sym_index_ext_max + i, true);
+      }
+    }
+  }
+  return;
+
+ rebuild_failed:
+  sym_index_off();
+}
+
+// Must be called with sym_index_mutex held.
+static bool sym_index_ready(void) {
+  if (sym_index_state == SYM_INDEX_INVALID) {
+    sym_index_rebuild();
+  }
+  return sym_index_state == SYM_INDEX_VALID;
+}
+
+static void sym_index_added(lbm_uint *entry) {
+  sym_index_lock();
+  if (sym_index_state == SYM_INDEX_VALID && !sym_index_add_runtime(entry)) {
+    sym_index_off();
+  }
+  sym_index_unlock();
+}
+
+static void sym_index_set_state(int state) {
+  sym_index_lock();
+  sym_index_state = state;
+  sym_index_unlock();
+}
+
+void lbm_symrepr_index_add_extension(lbm_uint ext_ix) {
+  sym_index_lock();
+  if (sym_index_state == SYM_INDEX_VALID) {
+    if (ext_ix >= sym_index_ext_max || !sym_index_reserve()) {
+      sym_index_off();
+    } else {
+      sym_index_put(NUM_SPECIAL_SYMBOLS + ext_ix, false);
+    }
+  }
+  sym_index_unlock();
+}
+
+static void sym_index_init(void) {
+  if (!sym_index_mutex_initialized) {
+    lbm_mutex_init(&sym_index_mutex);
+    sym_index_mutex_initialized = true;
+  }
+  // The index was in the previous lbm_memory, do not free it.
+  sym_index = NULL;
+  sym_by_id = NULL;
+  sym_index_size = 0;
+  sym_index_num = 0;
+  sym_by_id_size = 0;
+  sym_index_state = SYM_INDEX_INVALID;
+}
+
+#else
+
+static void sym_index_added(lbm_uint *entry) {
+  (void)entry;
+}
+
+#define sym_index_set_state(state)
+
+void lbm_symrepr_index_add_extension(lbm_uint ext_ix) {
+  (void)ext_ix;
+}
+
+static void sym_index_init(void) {
+}
+
+#endif
+
+void lbm_symrepr_invalidate_index(void) {
+  sym_index_set_state(SYM_INDEX_INVALID);
+}
+
 // When rebooting an image...
 void lbm_symrepr_set_symlist(lbm_uint *ls) {
   symlist = ls;
+  sym_index_set_state(SYM_INDEX_INVALID);
 }
 
 
@@ -280,6 +567,7 @@ void lbm_symrepr_set_next_id(lbm_uint id) {
 }
 
 bool lbm_symrepr_init(void) {
+  sym_index_init();
   symlist = NULL;
   next_symbol_id = RUNTIME_SYMBOLS_START;
   symbol_table_size_list = 0;
@@ -333,8 +621,21 @@ const char *lbm_get_name_by_symbol(lbm_uint id) {
       res = extension_table[ext_id].name;
     }
   } break;
-  default:
+  default: {
+#ifndef LBM_NO_SYMBOL_INDEX
+    sym_index_lock();
+    if (sym_index_ready()) {
+      lbm_uint ix = id - RUNTIME_SYMBOLS_START;
+      if (ix < sym_by_id_size && sym_by_id[ix]) {
+        res = (const char *)sym_by_id[ix][NAME];
+      }
+      sym_index_unlock();
+      break;
+    }
+    sym_index_unlock();
+#endif
     res = lookup_symrepr_name_memory(id);
+  } break;
   }
   return res;
 }
@@ -356,6 +657,20 @@ int lbm_get_symbol_by_name(const char *name, lbm_uint* id) {
   int res = 0;
   lbm_uint *curr;
 
+#ifndef LBM_NO_SYMBOL_INDEX
+  sym_index_lock();
+  if (sym_index_ready()) {
+    lbm_uint i = sym_index_slot(name);
+    if (sym_index[i]) {
+      *id = sym_key_id(sym_index[i] - 1u);
+      res = 1;
+    }
+    sym_index_unlock();
+    return res;
+  }
+  sym_index_unlock();
+#endif
+
   // loop through special symbols
   for (unsigned int i = 0; i < NUM_SPECIAL_SYMBOLS; i ++) {
     if (str_eq(name, (char *)special_symbols[i].name)) {
@@ -437,6 +752,7 @@ int lbm_add_symbol_base(const char *name, lbm_uint *id) {
       symlist = new_symlist;
       *id = next_symbol_id ++;
       res = 1;
+      sym_index_added(symlist);
     }
   }
   return res;
@@ -467,6 +783,7 @@ int lbm_add_symbol_const_base(const char *name, lbm_uint* id, bool link) {
     symlist = new_symlist;
     *id = next_symbol_id ++;
     res = 1;
+    sym_index_added(symlist);
   }
   return res;
 }
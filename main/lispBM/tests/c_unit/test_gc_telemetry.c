@@ -0,0 +1,209 @@
+#define _GNU_SOURCE // MAP_ANON
+#define _POSIX_C_SOURCE 200809L // nanosleep?
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "lispbm.h"
+#include "heap.h"
+
+#include "init/start_lispbm.c"
+
+static void pause_for_test(void) {
+  lbm_pause_eval();
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+    sleep_callback(100);
+  }
+}
+
+static lbm_uint last_record_gc_num(void) {
+  lbm_gc_record_t records[LBM_GC_TELEMETRY_SIZE];
+  lbm_uint n = lbm_heap_gc_records(records, LBM_GC_TELEMETRY_SIZE);
+  return n ? records[n - 1].gc_num : 0;
+}
+
+// Run one collection on the evaluator thread and pause again
+// once its record is available.
+static int run_gc(void) {
+  lbm_uint gc_num = lbm_heap_state.gc_num;
+  lbm_request_gc();
+  lbm_continue_eval();
+  int timeout = 0;
+  while (last_record_gc_num() != gc_num + 1) {
+    sleep_callback(100);
+    if (timeout++ > 10000) return 0;
+  }
+  pause_for_test();
+  return 1;
+}
+
+static int last_record(lbm_gc_record_t *r) {
+  lbm_gc_record_t records[LBM_GC_TELEMETRY_SIZE];
+  lbm_uint n = lbm_heap_gc_records(records, LBM_GC_TELEMETRY_SIZE);
+  if (n == 0) return 0;
+  *r = records[n - 1];
+  return 1;
+}
+
+static uint32_t get_u32(uint8_t *buf, lbm_uint ix) {
+  return ((uint32_t)buf[ix] << 24) | ((uint32_t)buf[ix + 1] << 16) |
+         ((uint32_t)buf[ix + 2] << 8) | (uint32_t)buf[ix + 3];
+}
+
+int test_gc_telemetry_recovered(void) {
+  if (!start_lispbm_for_tests()) return 0;
+  pause_for_test();
+  if (!run_gc()) return 0;
+
+  // Garbage: a list of 500 cells and 10 arrays that use one cell each.
+  lbm_value l = ENC_SYM_NIL;
+  for (int i = 0; i < 500; i ++) {
+    l = lbm_cons(lbm_enc_i(i), l);
+    if (lbm_is_symbol_merror(l)) return 0;
+  }
+  for (int i = 0; i < 10; i ++) {
+    lbm_value arr;
+    if (!lbm_heap_allocate_array(&arr, 100)) return 0;
+  }
+  if (!run_gc()) return 0;
+
+  lbm_gc_record_t r;
+  if (!last_record(&r)) return 0;
+  printf("recovered: %u, arrays: %u, mark: %u, sweep: %u\n",
+         (unsigned int)r.recovered, (unsigned int)r.recovered_arrays,
+         (unsigned int)r.mark_time, (unsigned int)r.sweep_time);
+
+  int ok =
+    r.gc_num == lbm_heap_state.gc_num &&
+    r.recovered == 510 &&
+    r.recovered_arrays == 10 &&
+    r.num_free == lbm_heap_state.num_free &&
+    r.mem_free == lbm_memory_num_free() &&
+    r.mem_longest_free == lbm_memory_longest_free() &&
+    r.mark_time + r.sweep_time <= lbm_heap_state.gc_max_pause;
+  lbm_continue_eval();
+  return ok;
+}
+
+int test_gc_telemetry_fragmentation(void) {
+  if (!start_lispbm_for_tests()) return 0;
+  pause_for_test();
+
+  // Free every other block to leave holes in lbm_memory.
+  lbm_uint *blocks[20];
+  for (int i = 0; i < 20; i ++) {
+    blocks[i] = lbm_memory_allocate(50);
+    if (!blocks[i]) return 0;
+  }
+  for (int i = 0; i < 20; i += 2) {
+    lbm_memory_free(blocks[i]);
+  }
+  if (!run_gc()) return 0;
+
+  lbm_gc_record_t r;
+  if (!last_record(&r)) return 0;
+  printf("mem free: %u, longest free: %u\n",
+         (unsigned int)r.mem_free, (unsigned int)r.mem_longest_free);
+
+  int ok =
+    r.mem_free == lbm_memory_num_free() &&
+    r.mem_longest_free == lbm_memory_longest_free() &&
+    r.mem_longest_free + 10 * 50 <= r.mem_free;
+
+  for (int i = 1; i < 20; i += 2) {
+    lbm_memory_free(blocks[i]);
+  }
+  lbm_continue_eval();
+  return ok;
+}
+
+int test_gc_telemetry_wrap(void) {
+  if (!start_lispbm_for_tests()) return 0;
+  pause_for_test();
+  for (int i = 0; i < LBM_GC_TELEMETRY_SIZE + 3; i ++) {
+    if (!run_gc()) return 0;
+  }
+
+  lbm_gc_record_t records[LBM_GC_TELEMETRY_SIZE];
+  lbm_uint n = lbm_heap_gc_records(records, LBM_GC_TELEMETRY_SIZE);
+  int ok = n == LBM_GC_TELEMETRY_SIZE;
+  for (lbm_uint i = 0; ok && i < n; i ++) {
+    ok = records[i].gc_num == lbm_heap_state.gc_num - (n - 1 - i);
+  }
+  // Asking for fewer records gives the most recent ones.
+  lbm_gc_record_t last;
+  ok = ok && lbm_heap_gc_records(&last, 1) == 1 &&
+    last.gc_num == lbm_heap_state.gc_num;
+  lbm_continue_eval();
+  return ok;
+}
+
+int test_gc_telemetry_blob(void) {
+  if (!start_lispbm_for_tests()) return 0;
+  pause_for_test();
+  for (int i = 0; i < 3; i ++) {
+    if (!run_gc()) return 0;
+  }
+
+  uint8_t buf[1024];
+  lbm_uint size = lbm_heap_gc_telemetry_size();
+  lbm_uint n = lbm_heap_gc_telemetry(buf, sizeof(buf));
+  if (n != size) return 0;
+  if (lbm_heap_gc_telemetry(buf, size - 1) != 0) return 0;
+
+  lbm_gc_record_t records[LBM_GC_TELEMETRY_SIZE];
+  lbm_uint num_records = lbm_heap_gc_records(records, LBM_GC_TELEMETRY_SIZE);
+
+  int ok =
+    buf[0] == LBM_GC_TELEMETRY_VERSION &&
+    buf[1] == LBM_GC_PAUSE_HIST_BINS &&
+    buf[2] == num_records &&
+    get_u32(buf, 4) == lbm_heap_state.gc_num &&
+    get_u32(buf, 20) == lbm_heap_state.heap_size &&
+    get_u32(buf, 24) == lbm_heap_state.num_free &&
+    get_u32(buf, 32) == lbm_memory_num_words() &&
+    get_u32(buf, 36) == lbm_memory_num_free();
+
+  lbm_uint ix = 4 + 11 * 4;
+  lbm_uint hist_sum = 0;
+  for (int i = 0; i < LBM_GC_PAUSE_HIST_BINS; i ++) {
+    hist_sum += get_u32(buf, ix);
+    ix += 4;
+  }
+#ifndef LBM_GC_INCREMENTAL_SWEEP
+  // Every collection is a single pause.
+  ok = ok && hist_sum == lbm_heap_state.gc_num;
+#endif
+  for (lbm_uint i = 0; ok && i < num_records; i ++) {
+    ok = get_u32(buf, ix) == records[i].gc_num &&
+      get_u32(buf, ix + 16) == records[i].recovered &&
+      get_u32(buf, ix + 32) == records[i].mem_longest_free;
+    ix += sizeof(lbm_gc_record_t);
+  }
+  ok = ok && ix == size;
+  lbm_continue_eval();
+  return ok;
+}
+
+int main(void) {
+  int tests_passed = 0;
+  int total_tests = 0;
+
+  total_tests++; if (test_gc_telemetry_recovered()) tests_passed++;
+  total_tests++; if (test_gc_telemetry_fragmentation()) tests_passed++;
+  total_tests++; if (test_gc_telemetry_wrap()) tests_passed++;
+  total_tests++; if (test_gc_telemetry_blob()) tests_passed++;
+
+  if (tests_passed == total_tests) {
+    printf("SUCCESS\n");
+    return 0;
+  } else {
+    printf("FAILED: %d/%d tests passed\n", tests_passed, total_tests);
+    return 1;
+  }
+}
@@ -953,6 +953,52 @@ int test_flatten_depth_edge_cases(void) {
   return 1;
 }
 
+// Test that flatten_value, which resizes its buffer while flattening,
+// produces the same bytes as flattening into a buffer of exact size.
+int test_flatten_value_growing_buffer(void) {
+  if (!test_init()) return 0;
+
+  // A list much larger than the initial buffer, with a deep car chain
+  // that does not fit the local work stack.
+  lbm_value nested = lbm_enc_i(7);
+  for (int i = 0; i < 50; i++) {
+    nested = lbm_cons(nested, ENC_SYM_NIL);
+    if (lbm_is_symbol_merror(nested)) return 0;
+  }
+  lbm_value v = lbm_cons(nested, ENC_SYM_NIL);
+  for (int i = 0; i < 200 && !lbm_is_symbol_merror(v); i++) {
+    v = lbm_cons(lbm_enc_i(i), v);
+  }
+  if (lbm_is_symbol_merror(v)) return 0;
+
+  int size = flatten_value_size(v, false);
+  if (size <= FLATTEN_VALUE_INITIAL_BUFFER_SIZE) return 0;
+
+  lbm_value arr = flatten_value(v);
+  lbm_array_header_t *header = lbm_dec_array_r(arr);
+  if (!header || header->size != (lbm_uint)size) return 0;
+
+  uint8_t *buffer = malloc((size_t)size);
+  if (!buffer) return 0;
+  lbm_flat_value_t fv;
+  fv.buf = buffer;
+  fv.buf_size = (lbm_uint)size;
+  fv.buf_pos = 0;
+  int ok = flatten_value_c(&fv, v) == FLATTEN_VALUE_OK &&
+    fv.buf_pos == (lbm_uint)size &&
+    memcmp(buffer, header->data, (size_t)size) == 0;
+  free(buffer);
+  if (!ok) return 0;
+
+  // Round trip through unflatten gives the same flat value again.
+  fv.buf = (uint8_t*)header->data;
+  fv.buf_size = header->size;
+  fv.buf_pos = 0;
+  lbm_value res;
+  if (!lbm_unflatten_value(&fv, &res)) return 0;
+  return flatten_value_size(res, false) == size;
+}
+
 int main(void) {
   int tests_passed = 0;
   int total_tests = 0;
@@ -980,6 +1026,7 @@ int main(void) {
   total_tests++; if (test_flatten_depth_configuration()) tests_passed++;
   total_tests++; if (test_flatten_depth_limits()) tests_passed++;
   total_tests++; if (test_flatten_depth_edge_cases()) tests_passed++;
+  total_tests++; if (test_flatten_value_growing_buffer()) tests_passed++;
   
   kill_eval_after_tests();
   
@@ -945,6 +945,111 @@ int test_free_middle_of_allocation() {
   return 1;
 }
 
+// Free-extent index tests
+
+#define TEST_INDEX_SIZE LBM_MEMORY_INDEX_SIZE(TEST_MEMORY_SIZE)
+static lbm_uint test_index[TEST_INDEX_SIZE];
+
+static lbm_uint test_status(lbm_uint i) {
+  lbm_uint bits = sizeof(lbm_uint) * 8;
+  return (test_bitmap[(i * 2) / bits] >> ((i * 2) % bits)) & 3;
+}
+
+// Longest free run computed directly from the bitmap, without
+// reserve. The start of the first run of at least n words is stored
+// in first_fit, or TEST_MEMORY_SIZE if there is none.
+static lbm_uint scan_longest_free(lbm_uint n, lbm_uint *first_fit) {
+  lbm_uint longest = 0;
+  lbm_uint curr = 0;
+  bool in_block = false;
+  *first_fit = TEST_MEMORY_SIZE;
+  for (lbm_uint i = 0; i < TEST_MEMORY_SIZE; i ++) {
+    switch (test_status(i)) {
+    case 0:
+      if (!in_block) {
+        curr ++;
+        if (curr > longest) longest = curr;
+        if (curr == n && *first_fit == TEST_MEMORY_SIZE) *first_fit = i + 1 - n;
+      }
+      break;
+    case 1: in_block = false; curr = 0; break;
+    case 2: in_block = true; curr = 0; break;
+    default: curr = 0; break;
+    }
+  }
+  return longest;
+}
+
+int test_memory_index_init() {
+  if (!setup_memory()) return 0;
+  if (lbm_memory_init_index(NULL, TEST_INDEX_SIZE)) return 0;
+  if (lbm_memory_init_index(test_index, 1)) return 0;
+
+  // Enabling the index with allocations in place picks them up
+  lbm_uint *ptr1 = lbm_memory_allocate(100);
+  lbm_uint *ptr2 = lbm_memory_allocate(10);
+  if (!ptr1 || !ptr2) return 0;
+  if (!lbm_memory_free(ptr1)) return 0;
+  if (!lbm_memory_init_index(test_index, TEST_INDEX_SIZE)) return 0;
+
+  // First fit goes into the hole left by ptr1
+  lbm_uint *ptr3 = lbm_memory_allocate(50);
+  if (ptr3 != ptr1) return 0;
+
+  // A smaller index also works, with larger chunks
+  if (!lbm_memory_init_index(test_index, 4)) return 0;
+  lbm_uint *ptr4 = lbm_memory_allocate(50);
+  if (ptr4 != ptr1 + 50) return 0;
+  return 1;
+}
+
+int test_memory_index_random() {
+  if (!setup_memory()) return 0;
+  lbm_memory_set_reserve(0);
+  if (!lbm_memory_init_index(test_index, TEST_INDEX_SIZE)) return 0;
+
+  lbm_uint *ptrs[64] = {0};
+  lbm_uint sizes[64] = {0};
+  srand(1234);
+
+  for (int op = 0; op < 20000; op ++) {
+    int k = rand() % 64;
+    if (ptrs[k] == NULL) {
+      lbm_uint n = (lbm_uint)(1 + (rand() % 4 == 0 ? rand() % 100 : rand() % 8));
+      lbm_uint first_fit;
+      scan_longest_free(n, &first_fit);
+      ptrs[k] = lbm_memory_allocate(n);
+      if (first_fit == TEST_MEMORY_SIZE) {
+        if (ptrs[k] != NULL) return 0;
+      } else if (ptrs[k] != &test_memory[first_fit]) {
+        return 0;
+      }
+      if (ptrs[k]) {
+        sizes[k] = n;
+        for (lbm_uint i = 0; i < n; i ++) ptrs[k][i] = (lbm_uint)k;
+      }
+    } else if (rand() % 4 == 0 && sizes[k] > 1) {
+      sizes[k] = sizes[k] / 2;
+      if (!lbm_memory_shrink(ptrs[k], sizes[k])) return 0;
+    } else {
+      for (lbm_uint i = 0; i < sizes[k]; i ++) {
+        if (ptrs[k][i] != (lbm_uint)k) return 0;
+      }
+      if (!lbm_memory_free(ptrs[k])) return 0;
+      ptrs[k] = NULL;
+    }
+    lbm_uint unused;
+    if (lbm_memory_longest_free() != scan_longest_free(0, &unused)) return 0;
+  }
+
+  for (int k = 0; k < 64; k ++) {
+    if (ptrs[k]) lbm_memory_free(ptrs[k]);
+  }
+  if (lbm_memory_num_free() != TEST_MEMORY_SIZE) return 0;
+  if (lbm_memory_longest_free() != TEST_MEMORY_SIZE) return 0;
+  return 1;
+}
+
 int main(void) {
   int tests_passed = 0;
   int total_tests = 0;
@@ -1004,6 +1109,10 @@ int main(void) {
   total_tests++; if (test_free_unallocated_valid_address()) tests_passed++;
   total_tests++; if (test_free_middle_of_allocation()) tests_passed++;
 
+  // Free-extent index tests
+  total_tests++; if (test_memory_index_init()) tests_passed++;
+  total_tests++; if (test_memory_index_random()) tests_passed++;
+
   if (tests_passed == total_tests) {
     printf("SUCCESS\n");
     return 0;
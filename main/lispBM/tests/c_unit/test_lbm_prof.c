@@ -152,6 +152,57 @@ int test_lbm_prof_measure2(void) {
   return 0;
 }
 
+int test_lbm_prof_stacks(void) {
+  lbm_prof_t prof_data_buf[100];
+  lbm_prof_stack_t stack_buf[64];
+
+  if (!start_lispbm_for_tests()) return 0;
+
+  if (!lbm_prof_init(prof_data_buf, 100)) return 0;
+  if (!lbm_prof_stacks_init(stack_buf, 64)) return 0;
+
+  char *prog1 = "(define g (lambda (n) (if (= n 0) 0 (+ 1 (g (- n 1))))))"
+                "(define f (lambda () {(g 5) (f)}))"
+                "(spawn \"flame\" f)";
+  lbm_string_channel_state_t st1;
+  lbm_char_channel_t chan1;
+  lbm_create_string_char_channel(&st1, &chan1, prog1);
+  lbm_cid cid1 = lbm_load_and_eval_program(&chan1, "thread-1");
+
+  if (cid1 < 0) return 0;
+
+  for (int i = 0; i < 1000; i ++) {
+    lbm_prof_sample();
+    sleep_callback(100);
+  }
+  lbm_prof_stacks_stop();
+
+  lbm_pause_eval();
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED) {
+    sleep_callback(100);
+  }
+
+  // The tail call (f) replaces the frame of f, so no stack is deeper
+  // than f and six calls to g.
+  bool has_f_g = false;
+  bool too_deep = false;
+  lbm_uint count = 0;
+  char line[256];
+  for (lbm_uint i = 0; i < 64; i ++) {
+    int n = lbm_prof_stack_collapsed(i, line, sizeof(line));
+    if (n == 0) continue;
+    if (strncmp(line, "flame;f;g", 9) == 0) has_f_g = true;
+    if (strstr(line, "f;g;g;g;g;g;g;g")) too_deep = true;
+    count += (lbm_uint)atoi(strrchr(line, ' ') + 1);
+  }
+  printf("Stack samples: %u, dropped: %u\n",
+         (unsigned int)count,
+         (unsigned int)lbm_prof_get_num_dropped_stack_samples());
+
+  lbm_continue_eval();
+  return has_f_g && !too_deep && count > 0;
+}
+
 int main(void) {
   int tests_passed = 0;
   int total_tests = 0;
@@ -160,6 +211,7 @@ int main(void) {
   total_tests++; if (test_lbm_prof_sample_100()) tests_passed++;
   total_tests++; if (test_lbm_prof_measure()) tests_passed++;
   total_tests++; if (test_lbm_prof_measure2()) tests_passed++;
+  total_tests++; if (test_lbm_prof_stacks()) tests_passed++;
   
   if (tests_passed == total_tests) {
     printf("SUCCESS\n");
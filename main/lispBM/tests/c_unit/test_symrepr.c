@@ -8,6 +8,7 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 #include <unistd.h>
+#include <string.h>
 
 #include "lispbm.h"
 #include "symrepr.h"
@@ -399,8 +400,6 @@ int test_lbm_add_symbol_base(void) {
   // Test 3: Try to add empty symbol name (should fail)
   lbm_uint empty_id;
   int result3 = lbm_add_symbol_base("", &empty_id);
-
-  printf("
   
   if (!result1 || !result2 || result3) {
     return 0;
@@ -448,6 +447,54 @@ int test_lbm_add_symbol_const_base(void) {
   return 1;
 }
 
+int test_lbm_symbol_index(void) {
+  if (!start_lispbm_for_tests()) return 0;
+
+  lbm_pause_eval();
+  int timeout = 0;
+  while (lbm_get_eval_state() != EVAL_CPS_STATE_PAUSED && timeout < 5) {
+    sleep_callback(1000);
+    timeout++;
+  }
+  if (timeout >= 5) return 0;
+
+  // Test 1: Many symbols, forcing the index to grow a few times
+  char name[32];
+  lbm_uint ids[500];
+  for (int i = 0; i < 500; i ++) {
+    snprintf(name, sizeof(name), "index-test-%d", i);
+    if (!lbm_add_symbol(name, &ids[i])) return 0;
+  }
+
+  // Test 2: Name to id and id to name for all of them, before and
+  // after rebuilding the index
+  for (int pass = 0; pass < 2; pass ++) {
+    for (int i = 0; i < 500; i ++) {
+      lbm_uint id;
+      snprintf(name, sizeof(name), "index-test-%d", i);
+      if (!lbm_get_symbol_by_name(name, &id) || id != ids[i]) return 0;
+      const char *n = lbm_get_name_by_symbol(ids[i]);
+      if (!n || strcmp(n, name) != 0) return 0;
+    }
+    lbm_symrepr_invalidate_index();
+  }
+
+  // Test 3: Special symbols and aliases
+  lbm_uint id;
+  if (!lbm_get_symbol_by_name("first", &id) || id != SYM_CAR) return 0;
+  if (!lbm_get_symbol_by_name("car", &id) || id != SYM_CAR) return 0;
+  if (lbm_get_symbol_by_name("index-test-missing", &id)) return 0;
+
+  // Test 4: Extensions are found after being added and not after being cleared
+  if (!lbm_add_extension("index-test-ext", lbm_extensions_default)) return 0;
+  if (!lbm_get_symbol_by_name("index-test-ext", &id)) return 0;
+  if (SYMBOL_KIND(id) != SYMBOL_KIND_EXTENSION) return 0;
+  if (!lbm_clr_extension(id)) return 0;
+  if (lbm_get_symbol_by_name("index-test-ext", &id)) return 0;
+
+  return 1;
+}
+
 int main(void) {
   int tests_passed = 0;
   int total_tests = 0;
@@ -545,6 +592,13 @@ int main(void) {
     printf("test_lbm_add_symbol_const_base FAILED\n");
   }
   
+  total_tests++; if (test_lbm_symbol_index()) {
+    tests_passed++;
+    printf("test_lbm_symbol_index passed\n");
+  } else {
+    printf("test_lbm_symbol_index FAILED\n");
+  }
+  
   if (tests_passed == total_tests) {
     printf("SUCCESS\n");
     return 0;
@@ -67,7 +67,9 @@ test_config=("-t $timeout -h 32768"
               "-t $timeout -h 512"
               "-t $timeout -i -h 512"
               "-t $timeout -s -h 512"
-              "-t $timeout -i -s -h 512")
+              "-t $timeout -i -s -h 512"
+              "-t $timeout -m -h 8192"
+              "-t $timeout -m -i -s -h 2048")
 
 for conf in "${test_config[@]}" ; do
     expected_fails+=("test_lisp_code_cps $conf tests/test_is_64bit.lisp")
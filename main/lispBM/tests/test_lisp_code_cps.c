@@ -455,6 +455,7 @@ int main(int argc, char **argv) {
 
   bool stream_source = false;
   bool incremental = false;
+  bool mem_index = false;
 
   static pthread_t timestamp_thread = 0;
   pthread_t lispbm_thd;
@@ -465,7 +466,7 @@ int main(int argc, char **argv) {
   int c;
   opterr = 1;
 
-  while (( c = getopt(argc, argv, "igsch:t:")) != -1) {
+  while (( c = getopt(argc, argv, "igsmch:t:")) != -1) {
     switch (c) {
     case 't':
       timeout = (uint32_t)atoi((char *)optarg);
@@ -476,6 +477,9 @@ int main(int argc, char **argv) {
     case 'i':
       incremental = true;
       break;
+    case 'm':
+      mem_index = true;
+      break;
       //    case 'c':
       //compress_decompress = true;
       //break;
@@ -491,6 +495,7 @@ int main(int argc, char **argv) {
   printf("Heap size: %u\n", heap_size);
   printf("Streaming source: %s\n", stream_source ? "yes" : "no");
   printf("Incremental read: %s\n", incremental ? "yes" : "no");
+  printf("Memory index: %s\n", mem_index ? "yes" : "no");
   printf("------------------------------------------------------------\n");
 
   if (argc - optind < 1) {
@@ -554,6 +559,15 @@ int main(int argc, char **argv) {
     return FAIL;
   }
 
+  lbm_uint gc_bitmap_size = LBM_GC_BITMAP_SIZE(heap_size);
+  if (gc_bitmap_size > 0) {
+    lbm_uint *gc_bitmap_storage = (lbm_uint*)malloc(sizeof(lbm_uint) * gc_bitmap_size);
+    if (gc_bitmap_storage == NULL) {
+      return FAIL;
+    }
+    lbm_heap_set_gc_bitmap_storage(gc_bitmap_storage, gc_bitmap_size);
+  }
+
   if (lbm_init(heap_storage, heap_size,
                memory, LBM_MEMORY_SIZE_16K,
                bitmap, LBM_MEMORY_BITMAP_SIZE_16K,
@@ -568,6 +582,14 @@ int main(int argc, char **argv) {
     return FAIL;
   }
 
+  if (mem_index) {
+    static lbm_uint mem_index_storage[LBM_MEMORY_INDEX_SIZE(LBM_MEMORY_SIZE_16K)];
+    if (!lbm_memory_init_index(mem_index_storage, LBM_MEMORY_INDEX_SIZE(LBM_MEMORY_SIZE_16K))) {
+      printf ("FAILED to initialize memory index\n");
+      return FAIL;
+    }
+  }
+
   lbm_image_init(image_storage,
                  image_storage_size / sizeof(lbm_uint),
                  image_write);
@@ -0,0 +1,55 @@
+; Compiled closures compute the same results as the interpreted ones,
+; also when they call interpreted functions and fundamentals through
+; variables, use free variables and run out of fixnum fast paths.
+
+(define fib (lambda (n) (if (< n 2) n (+ (fib (- n 1)) (fib (- n 2))))))
+(define fib-i fib)
+(define fib (compile fib))
+
+(define t1 (= (fib 20) (fib-i 20) 6765))
+
+(define tak (compile (lambda (x y z)
+  (if (not (< y x))
+      z
+    (tak
+     (tak (- x 1) y z)
+     (tak (- y 1) z x)
+     (tak (- z 1) x y))))))
+
+(define q2 (compile (lambda (x y)
+  (if (or (< x 1) (< y 1)) 1
+    (+ (q2 (- x (q2 (- x 1) y)) y)
+       (q2 x (- y (q2 x (- y 1)))))))))
+
+(define t2 (and (= (tak 18 12 6) 7) (= (q2 6 7) 17)))
+
+(define scale 3)
+(defun sq (x) (* x x))
+
+(define f (compile (lambda (x l)
+  (let ((a (* scale x))
+        (b (sq a)))
+    (cond ((eq x 'none) 'none)
+          ((and (> a 10) (< a 100)) (list a b (map sq l)))
+          (t (progn (+ a 1.5) (apply + l))))))))
+
+(define t3 (and (eq (f 4 '(1 2)) '(12 144 (1 4)))
+                (= (f 1 '(1 2 3)) 6)
+                (= (f 1.0 '(1)) 1)))
+
+(define count (compile (lambda (n acc) (if (= n 0) acc (count (- n 1) (+ acc 1))))))
+
+(define t4 (= (count 100000 0) 100000))
+
+(define rev-onto (compile (lambda (a l)
+  (if (eq a nil) l (rev-onto (cdr a) (cons (car a) l))))))
+
+(define t5 (eq (rev-onto '(1 2 3) nil) '(3 2 1)))
+
+(define t6 (eq (trap (fib 'a)) '(exit-error type_error)))
+
+(define t7 (eq (trap (compile (lambda (x) (define y x)))) '(exit-error eval_error)))
+
+(define t8 (eq (trap (compile (lambda (x) (local-env-get)))) '(exit-error eval_error)))
+
+(check (and t1 t2 t3 t4 t5 t6 t7 t8))
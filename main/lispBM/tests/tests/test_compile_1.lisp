@@ -0,0 +1,29 @@
+; Compiled closures that call a name which is bound to a macro after
+; they were compiled evaluate their source instead, and so do compiled
+; closures whose frame does not fit on the stack of the context.
+
+(define me (self))
+
+(define f (compile (lambda () (q some-sym))))
+(defmacro q (a) `(quote ,a))
+
+(define g (compile (lambda (x) (my-if x 1 (car 'boom)))))
+(defmacro my-if (c a b) `(if ,c ,a ,b))
+
+; Calls from compiled code, as a call and as a tail call.
+(define h (compile (lambda (x) (list (g x) (f)))))
+(define h-tail (compile (lambda (x) (g x))))
+
+(define t1 (and (eq (f) 'some-sym)
+                (= (g t) 1)
+                (eq (trap (g nil)) '(exit-error type_error))))
+
+(define t2 (and (eq (h t) '(1 some-sym))
+                (= (h-tail t) 1)))
+
+(define l3 (compile (lambda (a b c) (list a b c))))
+(define g3 (compile (lambda (a b c) (send me (eq (l3 a b c) (list 1 2 3))))))
+
+(spawn 22 g3 1 2 3)
+
+(check (and t1 t2 (recv-to 2 (timeout nil) ((? x) x))))
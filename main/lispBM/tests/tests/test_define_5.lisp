@@ -0,0 +1,26 @@
+
+(define n 80)
+
+(define roots-before (global-env-state 'get-env-roots))
+
+(loopfor i 0 (< i n) (+ i 1)
+         (eval (list 'define (str2sym (str-merge "grow-" (to-str i))) i)))
+
+(define roots-after (global-env-state 'get-env-roots))
+
+(defun all-bound (i)
+  (if (= i n) t
+    (if (= (eval (str2sym (str-merge "grow-" (to-str i)))) i)
+        (all-bound (+ i 1))
+      nil)))
+
+(define r1 (> roots-after roots-before))
+(define r2 (all-bound 0))
+(define r3 (<= (global-env-state 'get-env-avg-chain) 2.0))
+(define r4 (>= (global-env-state 'get-env-bindings) n))
+
+(undefine 'grow-10)
+(define r5 (eq '(exit-error variable_not_bound) (trap grow-10)))
+(define r6 (= grow-11 11))
+
+(check (and r1 r2 r3 r4 r5 r6))
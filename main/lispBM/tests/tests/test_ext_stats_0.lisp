@@ -0,0 +1,32 @@
+;; ext-stats only exists when built with LBM_EXTENSION_STATS.
+(define has-stats (not (eq (car (trap (ext-stats-reset))) 'exit-error)))
+
+(defun calls-of (name)
+  (let ((e (assoc (ext-stats) name)))
+    (if e (car e) 0)))
+
+(defun ordered (xs)
+  (or (eq (cdr xs) nil)
+      (and (>= (ix (car xs) 2) (ix (car (cdr xs)) 2))
+           (ordered (cdr xs)))))
+
+(if has-stats
+    {
+    (ext-stats-reset)
+    (loopfor i 0 (< i 5) (+ i 1) (mem-num-free))
+    (word-size)
+    (define t1 (= (calls-of 'mem-num-free) 5))
+    (define t2 (= (calls-of 'word-size) 1))
+    (define t3 (= (length (ext-stats 1)) 1))
+    (define t4 (ordered (ext-stats)))
+    ;; Each histogram sums to the number of calls.
+    (define t5 (= (apply + (ix (assoc (ext-stats) 'mem-num-free) 3)) 5))
+    (ext-stats-reset)
+    (define t6 (= (calls-of 'mem-num-free) 0))
+    }
+    {
+    (define t1 t) (define t2 t) (define t3 t)
+    (define t4 t) (define t5 t) (define t6 t)
+    })
+
+(check (and t1 t2 t3 t4 t5 t6))
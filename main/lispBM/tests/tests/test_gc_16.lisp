@@ -0,0 +1,18 @@
+
+(define keep (range 100))
+
+(defun garbage (n)
+  (if (= n 0) 'done
+    (progn (range 20) (garbage (- n 1)))))
+
+(garbage 200)
+(gc)
+(garbage 200)
+
+(define hist (gc-pause-histogram))
+
+(check (and (eq keep (range 100))
+            (= (length hist) 12)
+            (> (apply + hist) 0)
+            (>= (lbm-heap-state 'get-gc-max-pause) (lbm-heap-state 'get-gc-mark-time))
+            (>= (lbm-heap-state 'get-gc-sweep-time) 0)))
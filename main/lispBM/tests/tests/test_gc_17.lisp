@@ -0,0 +1,29 @@
+(define ls (range 10))
+(define arr (array 0 0 0 0 0 0 0 0 0 0))
+(define al (list (cons 'a 0) (cons 'b 0)))
+(define acc (let ((xs nil)) (lambda (x) (setq xs (cons x xs)))))
+
+(gc)
+
+(defun garbage (n)
+  (if (= n 0) 'done
+    (progn (range 20) (garbage (- n 1)))))
+
+(defun fill (i)
+  (if (= i 10) 'done
+    (progn
+      (setix ls i (list i i))
+      (setix arr i (list i i i))
+      (setassoc al 'b (list i))
+      (acc (list i))
+      (garbage 20)
+      (fill (+ i 1)))))
+
+(fill 0)
+(garbage 200)
+
+(check (and (eq ls (map (lambda (i) (list i i)) (range 10)))
+            (eq (ix arr 9) '(9 9 9))
+            (eq (ix arr 0) '(0 0 0))
+            (eq (assoc al 'b) '(9))
+            (eq (acc '(10)) (map (lambda (i) (list i)) (reverse (range 11))))))
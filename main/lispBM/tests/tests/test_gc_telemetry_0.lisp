@@ -0,0 +1,14 @@
+(gc)
+(gc)
+(define b (gc-telemetry))
+(define bins (bufget-u8 b 1))
+(define n (bufget-u8 b 2))
+
+(define t1 (= (bufget-u8 b 0) 1))
+(define t2 (and (> n 0) (= (buflen b) (+ 4 (* 4 (+ 11 bins (* 9 n)))))))
+;; The last record is for the most recent collection.
+(define last-rec (+ 4 (* 4 (+ 11 bins (* 9 (- n 1))))))
+(define t3 (= (bufget-u32 b last-rec) (bufget-u32 b 4)))
+(define t4 (= (bufget-u32 b 20) (lbm-heap-state 'get-heap-size)))
+
+(check (and t1 t2 t3 t4))
@@ -0,0 +1,25 @@
+
+(define x 10)
+
+(defun read-x (n acc)
+  (if (= n 0) acc
+    (read-x (- n 1) (+ acc x))))
+
+(define hits-before (global-env-state 'get-env-cache-hits))
+
+(define r1 (= (read-x 100 0) 1000))
+(define r2 (> (global-env-state 'get-env-cache-hits) (+ hits-before 100)))
+
+(setq x 20)
+(define r3 (= x 20))
+
+(define x 30)
+(define r4 (= x 30))
+
+(undefine 'x)
+(define r5 (eq '(exit-error variable_not_bound) (trap x)))
+
+(define x 40)
+(define r6 (= x 40))
+
+(check (and r1 r2 r3 r4 r5 r6))
@@ -0,0 +1,22 @@
+
+(define apa 1)
+
+(define find-env (lambda (i)
+  (if (assoc (env-get i) 'apa)
+      i
+    (find-env (+ i 1)))))
+
+(define r1 (= apa 1))
+
+(define e-ix (find-env 0))
+(define e (env-get e-ix))
+
+;; Replacing the bindings under an index must not leave a cached
+;; binding behind.
+(env-set e-ix nil)
+(define r2 (eq '(exit-error variable_not_bound) (trap apa)))
+
+(env-set e-ix e)
+(define r3 (= apa 1))
+
+(check (and r1 r2 r3))
@@ -0,0 +1,42 @@
+(define n-exp 0)
+
+(define inc (macro (x) (progn (setq n-exp (+ n-exp 1)) `(+ ,x 1)) memo))
+(define inc-nm (macro (x) (progn (setq n-exp (+ n-exp 1)) `(+ ,x 1))))
+
+(defun sum-inc (n)
+  (let ((s 0))
+    (progn
+      (loopfor i 0 (< i n) (+ i 1)
+               (setq s (+ s (inc i))))
+      s)))
+
+(defun sum-inc-nm (n)
+  (let ((s 0))
+    (progn
+      (loopfor i 0 (< i n) (+ i 1)
+               (setq s (+ s (inc-nm i))))
+      s)))
+
+(define t1 (and (= (sum-inc 10) 55) (= n-exp 1)))
+
+(setq n-exp 0)
+(define t2 (and (= (sum-inc-nm 10) 55) (= n-exp 10)))
+
+;; A redefined macro is expanded again at the same call site.
+(setq n-exp 0)
+(define inc (macro (x) (progn (setq n-exp (+ n-exp 1)) `(+ ,x 2)) memo))
+(define t3 (and (= (sum-inc 10) 65) (= n-exp 1)))
+
+;; Expansions that survive a GC are still correct.
+(defun sum-inc-gc (n)
+  (let ((s 0))
+    (progn
+      (loopfor i 0 (< i n) (+ i 1)
+               (progn
+                 (gc)
+                 (setq s (+ s (inc i)))))
+      s)))
+
+(define t4 (= (sum-inc-gc 10) 65))
+
+(check (and t1 t2 t3 t4))
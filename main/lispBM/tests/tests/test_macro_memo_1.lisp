@@ -0,0 +1,21 @@
+;; An expander runs in the environment of the call, so the expansion of a
+;; macro without memo can change between calls at the same call site.
+
+(define dbg nil)
+(define pick (macro (x) (if dbg ''yes ''no)))
+(defun f () (pick 1))
+
+(define t1 (eq (f) 'no))
+(setq dbg t)
+(define t2 (eq (f) 'yes))
+
+;; The same holds for macros defined with defmacro.
+(define n 1)
+(defmacro add-n (x) `(+ ,x ,n))
+(defun g (x) (add-n x))
+
+(define t3 (= (g 1) 2))
+(setq n 10)
+(define t4 (= (g 1) 11))
+
+(check (and t1 t2 t3 t4))
@@ -0,0 +1,50 @@
+
+; Selective receive out of the middle of the mailbox. The remaining
+; messages keep their order when the mailbox wraps around, is
+; compacted, drops its oldest message or changes size.
+
+(send (self) '(a 1))
+(send (self) '(b 2))
+(send (self) 'c)
+(send (self) 3)
+(send (self) '(a 4))
+
+(define r1 (recv ((b (? x)) x)))
+(define r2 (recv (3 'three)))
+(define r3 (recv (c 'c)))
+(define r4 (recv ((a (? x)) x)))
+(define r5 (recv ((a (? x)) x)))
+
+(define t1 (and (= r1 2) (eq r2 'three) (eq r3 'c) (= r4 1) (= r5 4)))
+
+(defun recv-all (n)
+  (if (= n 0) nil
+    (let ((m (recv ((? x) x))))
+      (cons m (recv-all (- n 1))))))
+
+(loopfor i 0 (< i 10) (+ i 1) (send (self) (list 'n i)))
+
+(define r6 (recv ((n 5) 5)))
+(define r7 (recv ((n 2) 2)))
+(send (self) '(m 10))
+(send (self) '(m 11))
+(send (self) '(m 12))
+
+(define t2 (and (= r6 5) (= r7 2)
+                (eq (recv-all 10)
+                    '((n 1) (n 3) (n 4) (n 6) (n 7) (n 8) (n 9) (m 10) (m 11) (m 12)))))
+
+(define t3 (eq (recv-to 0.1 ((nope (? x)) x) (timeout 'timeout)) 'timeout))
+
+(loopfor i 0 (< i 5) (+ i 1) (send (self) i))
+(define r8 (recv (3 3) (_ 'any)))
+(set-mailbox-size 3)
+(define t4 (and (eq r8 'any) (eq (recv-all 3) '(2 3 4))))
+(set-mailbox-size 10)
+
+(send (self) '(x 1))
+(send (self) '(y 2))
+(define t5 (eq (recv ((y (? v)) v) ((? m) m)) '(x 1)))
+(define t6 (= (recv ((y (? v)) v)) 2))
+
+(check (and t1 t2 t3 t4 t5 t6))
@@ -0,0 +1,35 @@
+; A context with a higher priority runs before the ones with a lower
+; priority, also when it is spawned last, and a context that lowers its
+; own priority gives way to waiting contexts.
+
+(define me (self))
+
+(defun report (x) (send me x))
+
+(spawn 64 0 report 'low)
+(spawn "high" 64 3 report 'high)
+(spawn 64 1 report 'normal)
+
+(defun recv-n (n)
+  (if (= n 0) nil
+    (let ((i (recv ((? x) x))))
+      (cons i (recv-n (- n 1))))))
+
+(define t1 (eq (recv-n 3) '(high normal low)))
+
+(spawn 64 1 report 'normal)
+(set-prio 0)
+(send me 'me)
+(define t2 (eq (recv-n 2) '(normal me)))
+(set-prio 1)
+
+(define pid (spawn 64 2 report 'x))
+(define t3 (and (eq (recv-n 1) '(x))
+                (not (sched-ctx-state pid 'get-prio))))
+
+(define t4 (and (= (sched-ctx-state me 'get-prio) 1)
+                (> (sched-ctx-state me 'get-runs) 0)
+                (>= (sched-ctx-state me 'get-max-latency)
+                    (sched-ctx-state me 'get-avg-latency))))
+
+(check (and t1 t2 t3 t4))
@@ -0,0 +1,52 @@
+
+; Contexts wake up in the order of their deadlines, a timeout that is
+; cancelled by a message does not fire later and all timers are gone
+; when the contexts are done.
+;
+; The sleepers all start sleeping when they get 'go, which is sent to
+; them back to back, so their deadlines are 50 ms apart no matter how
+; long spawning takes. Each waiter reports both of its results in one
+; message, so the waiters can finish in any order. All waiting is done
+; in the last expression, so that the source is read before it starts.
+
+(define me (self))
+
+(defun recv-n (n)
+  (if (= n 0) nil
+    (let ((i (recv ((? x) x))))
+      (cons i (recv-n (- n 1))))))
+
+(defun sleeper (i)
+  (progn (recv (go nil))
+         (sleep (* 0.05 (- 20 i)))
+         (send me i)))
+
+(define sleepers (map (lambda (i) (spawn 64 sleeper i)) (range 20)))
+
+(defun test-sleepers ()
+  (progn
+    (loopforeach pid sleepers (send pid 'go))
+    (eq (recv-n 20) (reverse (range 20)))))
+
+(defun waiter (name)
+  (send me (list name
+                 (recv-to 0.2 (go 'first) (timeout 'early-timeout))
+                 (recv-to 0.4 (go 'second) (timeout 'timeout)))))
+
+(defun test-waiters ()
+  (progn
+    (spawn waiter 'a)
+    (send (spawn waiter 'b) 'go)
+    (and (eq (recv ((a (? x) (? y)) (list x y))) '(early-timeout timeout))
+         (eq (recv ((b (? x) (? y)) (list x y))) '(first timeout))
+         ; Nothing more is sent, so the cancelled timeout did not fire
+         (eq (recv-to 0.5 (timeout 'none) ((? x) x)) 'none))))
+
+(defun test-timers ()
+  (and (= (sched-state 'get-timers) 0)
+       (>= (sched-state 'get-wake-ups) 23)
+       (> (sched-state 'get-ctx-switches) 0)
+       (= (length (sched-wake-histogram)) 12)
+       (>= (apply + (sched-wake-histogram)) 23)))
+
+(check (and (test-sleepers) (test-waiters) (test-timers)))
@@ -27,6 +27,7 @@
 #include "buffer.h"
 #include "lispbm.h"
 #include "mempools.h"
+#include "packet.h"
 #include "flash_helper.h"
 #include "lbm_prof.h"
 #include "esp_timer.h"
@@ -45,6 +46,12 @@
 #define USER_EXTENSION_STORAGE_SIZE 0
 #endif
 #define PROF_DATA_NUM			30
+#define PROF_STACK_NUM			32
+// Size of the lbm_memory free-extent index in words, 0 to disable it. It
+// makes large array allocations faster, but small allocations slower.
+#ifndef MEM_INDEX_SIZE
+#define MEM_INDEX_SIZE			0
+#endif
 #define EXT_LOAD_CALLBACK_LEN	10
 
 static size_t heap_size = 0;
@@ -55,6 +62,9 @@ static lbm_cons_t *heap;
 static uint32_t *memory_array;
 static uint32_t *bitmap_array;
 static lbm_extension_t extension_storage[EXTENSION_STORAGE_SIZE + USER_EXTENSION_STORAGE_SIZE];
+#if MEM_INDEX_SIZE > 0
+static lbm_uint mem_index[MEM_INDEX_SIZE];
+#endif
 
 static bool string_tok_valid = false;
 static volatile lbm_uint *image_ptr = 0;
@@ -74,6 +84,7 @@ static int restart_cnt = 0;
 static esp_timer_handle_t prof_timer;
 static void prof_timer_callback(void* arg);
 static lbm_prof_t prof_data[PROF_DATA_NUM];
+static lbm_prof_stack_t prof_stacks[PROF_STACK_NUM];
 static volatile bool prof_running = false;
 const esp_timer_create_args_t periodic_timer_args = {
 		.callback = &prof_timer_callback,
@@ -89,6 +100,7 @@ void(*ext_load_callbacks[EXT_LOAD_CALLBACK_LEN])(bool) = {0};
 
 // Private functions
 static void sleep_callback(uint32_t us);
+static uint32_t timestamp_callback(void);
 static bool image_write(uint32_t w, int32_t ix, bool const_heap);
 static void eval_thread(void *arg);
 
@@ -294,6 +306,12 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 			print_all = data[0];
 		}
 
+		// Newer clients can ask for the GC telemetry blob in place of the bindings.
+		bool gc_telemetry = false;
+		if (len > 1) {
+			gc_telemetry = data[1];
+		}
+
 		if (lbm_heap_state.gc_num > 0) {
 			heap_use = 100.0 * (float)(heap_size - lbm_heap_state.gc_last_free) / (float)heap_size;
 		}
@@ -314,7 +332,11 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 		// Result. Currently unused.
 		send_buffer_global[ind++] = '\0';
 
-		if (pause_eval(0, 2000)) {
+		if (gc_telemetry) {
+			if (pause_eval(0, 2000)) {
+				ind += lbm_heap_gc_telemetry(send_buffer_global + ind, PACKET_MAX_PL_LEN - ind);
+			}
+		} else if (pause_eval(0, 2000)) {
 			lbm_value *glob_env = lbm_get_global_env();
 			for (int i = 0; i < GLOBAL_ENV_ROOTS; i ++) {
 				if (ind > 300) {
@@ -383,6 +405,9 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 				commands_printf_lisp(
 						":prof report\n"
 						"  Print profiler report");
+				commands_printf_lisp(
+						":prof flame\n"
+						"  Print the sampled call stacks in the collapsed format of flamegraph tools");
 				commands_printf_lisp(
 						":env\n"
 						"  Print current environment and variables");
@@ -449,9 +474,11 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 			} else if (strncmp(str, ":prof start", 11) == 0) {
 				if (prof_running) {
 					lbm_prof_init(prof_data, PROF_DATA_NUM);
+					lbm_prof_stacks_init(prof_stacks, PROF_STACK_NUM);
 					commands_printf_lisp("Profiler restarted\n");
 				} else {
 					lbm_prof_init(prof_data, PROF_DATA_NUM);
+					lbm_prof_stacks_init(prof_stacks, PROF_STACK_NUM);
 					prof_running = true;
 					esp_timer_create(&periodic_timer_args, &prof_timer);
 					// Use a period that isn't a multiple if the eval thread periods
@@ -463,7 +490,21 @@ void lispif_process_cmd(unsigned char *data, unsigned int len,
 					prof_running = false;
 					esp_timer_stop(prof_timer);
 				}
+				lbm_prof_stacks_stop();
 				commands_printf_lisp("Profiler stopped. Issue command ':prof report' for statistics\n");
+			} else if (strncmp(str, ":prof flame", 11) == 0) {
+				if (pause_eval(0, 1000)) {
+					char line[256];
+					for (int i = 0; i < PROF_STACK_NUM; i ++) {
+						if (lbm_prof_stack_collapsed(i, line, sizeof(line)) > 0) {
+							commands_printf_lisp("%s", line);
+						}
+					}
+					if (lbm_prof_get_num_dropped_stack_samples() > 0) {
+						commands_printf_lisp("%u samples did not fit in the stack table\n",
+								lbm_prof_get_num_dropped_stack_samples());
+					}
+				}
 			} else if (strncmp(str, ":prof report", 12) == 0) {
 				lbm_uint num_sleep = lbm_prof_get_num_sleep_samples();
 				lbm_uint num_system = lbm_prof_get_num_system_samples();
@@ -810,6 +851,7 @@ bool lispif_restart(bool print, bool load_code, bool load_imports) {
 	if (prof_running) {
 		prof_running = false;
 		esp_timer_stop(prof_timer);
+		lbm_prof_stacks_stop();
 	}
 
 	char *code_data = (char*)flash_helper_code_data_ptr(CODE_IND_LISP);
@@ -855,7 +897,13 @@ bool lispif_restart(bool print, bool load_code, bool load_imports) {
 				return false;
 			}
 
+#if MEM_INDEX_SIZE > 0
+			// Array allocation in logarithmic time instead of scanning the bitmap
+			lbm_memory_init_index(mem_index, MEM_INDEX_SIZE);
+#endif
+
 			lbm_set_usleep_callback(sleep_callback);
+			lbm_set_timestamp_us_callback(timestamp_callback);
 			lbm_set_printf_callback(commands_printf_lisp);
 			lbm_set_ctx_done_callback(done_callback);
 
@@ -1009,6 +1057,10 @@ static void sleep_callback(uint32_t us) {
 	vTaskDelay(t);
 }
 
+static uint32_t timestamp_callback(void) {
+	return (uint32_t)esp_timer_get_time();
+}
+
 static bool image_write(uint32_t w, int32_t ix, bool const_heap) {
 	if (const_heap && ix > image_max_ind) {
 		image_max_ind = ix;
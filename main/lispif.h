@@ -45,6 +45,7 @@ void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext);
 #ifdef CONFIG_IDF_TARGET_ESP32C6
 void lispif_process_can2(uint32_t can_id, uint8_t *data8, int len, bool is_ext);
 #endif
+void lispif_process_can_batch_timeout(void);
 void lispif_process_custom_app_data(unsigned char *data, unsigned int len);
 void lispif_process_rmsg(int slot, unsigned char *data, unsigned int len);
 void lispif_add_ext_load_callback(void (*p_func)(bool));
@@ -15,6 +15,8 @@ volatile bool event_cmds_data_tx_en = false;
 volatile bool event_touch_int_en = false;
 volatile bool event_can2_sid_en = false;
 volatile bool event_can2_eid_en = false;
+volatile bool event_can_batch_en = false;
+volatile bool event_can2_batch_en = false;
 
 volatile bool event_bms_bal_ovr_en = false;
 volatile bool event_bms_chg_allow_en = false;
@@ -32,6 +34,8 @@ lbm_uint sym_event_cmds_data_tx = 0;
 lbm_uint sym_event_touch_int = 0;
 lbm_uint sym_event_can2_sid = 0;
 lbm_uint sym_event_can2_eid = 0;
+lbm_uint sym_event_can_batch = 0;
+lbm_uint sym_event_can2_batch = 0;
 
 lbm_uint sym_bms_chg_allow = 0;
 lbm_uint sym_bms_bal_ovr = 0;
@@ -50,6 +54,8 @@ void lispif_events_load_symbols() {
 	lbm_add_symbol_const("event-touch-int", &sym_event_touch_int);
 	lbm_add_symbol_const("event-can2-sid", &sym_event_can2_sid);
 	lbm_add_symbol_const("event-can2-eid", &sym_event_can2_eid);
+	lbm_add_symbol_const("event-can-batch", &sym_event_can_batch);
+	lbm_add_symbol_const("event-can2-batch", &sym_event_can2_batch);
 
 	lbm_add_symbol_const("event-bms-chg-allow", &sym_bms_chg_allow);
 	lbm_add_symbol_const("event-bms-bal-ovr", &sym_bms_bal_ovr);
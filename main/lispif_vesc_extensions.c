@@ -1262,54 +1262,54 @@ static lbm_value ext_can_msg_age(lbm_value *args, lbm_uint argn) {
 
 	switch (msg) {
 	case 1: {
-		can_status_msg *stat = comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]));
-		if (stat) {
-			return lbm_enc_float(UTILS_AGE_S(stat->rx_time));
+		can_status_msg stat;
+		if (comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]), &stat)) {
+			return lbm_enc_float(UTILS_AGE_S(stat.rx_time));
 		} else {
 			return ENC_SYM_NIL;
 		}
 	}
 
 	case 2: {
-		can_status_msg_2 *stat = comm_can_get_status_msg_2_id(lbm_dec_as_i32(args[0]));
-		if (stat) {
-			return lbm_enc_float(UTILS_AGE_S(stat->rx_time));
+		can_status_msg_2 stat;
+		if (comm_can_get_status_msg_2_id(lbm_dec_as_i32(args[0]), &stat)) {
+			return lbm_enc_float(UTILS_AGE_S(stat.rx_time));
 		} else {
 			return ENC_SYM_NIL;
 		}
 	}
 
 	case 3: {
-		can_status_msg_3 *stat = comm_can_get_status_msg_3_id(lbm_dec_as_i32(args[0]));
-		if (stat) {
-			return lbm_enc_float(UTILS_AGE_S(stat->rx_time));
+		can_status_msg_3 stat;
+		if (comm_can_get_status_msg_3_id(lbm_dec_as_i32(args[0]), &stat)) {
+			return lbm_enc_float(UTILS_AGE_S(stat.rx_time));
 		} else {
 			return ENC_SYM_NIL;
 		}
 	}
 
 	case 4: {
-		can_status_msg_4 *stat = comm_can_get_status_msg_4_id(lbm_dec_as_i32(args[0]));
-		if (stat) {
-			return lbm_enc_float(UTILS_AGE_S(stat->rx_time));
+		can_status_msg_4 stat;
+		if (comm_can_get_status_msg_4_id(lbm_dec_as_i32(args[0]), &stat)) {
+			return lbm_enc_float(UTILS_AGE_S(stat.rx_time));
 		} else {
 			return ENC_SYM_NIL;
 		}
 	}
 
 	case 5: {
-		can_status_msg_5 *stat = comm_can_get_status_msg_5_id(lbm_dec_as_i32(args[0]));
-		if (stat) {
-			return lbm_enc_float(UTILS_AGE_S(stat->rx_time));
+		can_status_msg_5 stat;
+		if (comm_can_get_status_msg_5_id(lbm_dec_as_i32(args[0]), &stat)) {
+			return lbm_enc_float(UTILS_AGE_S(stat.rx_time));
 		} else {
 			return ENC_SYM_NIL;
 		}
 	}
 
 	case 6: {
-		can_status_msg_6 *stat = comm_can_get_status_msg_6_id(lbm_dec_as_i32(args[0]));
-		if (stat) {
-			return lbm_enc_float(UTILS_AGE_S(stat->rx_time));
+		can_status_msg_6 stat;
+		if (comm_can_get_status_msg_6_id(lbm_dec_as_i32(args[0]), &stat)) {
+			return lbm_enc_float(UTILS_AGE_S(stat.rx_time));
 		} else {
 			return ENC_SYM_NIL;
 		}
@@ -1322,9 +1322,9 @@ static lbm_value ext_can_msg_age(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_current(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg *stat0 = comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]));
-	if (stat0) {
-		return lbm_enc_float(stat0->current);
+	can_status_msg stat0;
+	if (comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]), &stat0)) {
+		return lbm_enc_float(stat0.current);
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1332,9 +1332,9 @@ static lbm_value ext_can_get_current(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_current_dir(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg *stat0 = comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]));
-	if (stat0) {
-		return lbm_enc_float(stat0->current * SIGN(stat0->duty));
+	can_status_msg stat0;
+	if (comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]), &stat0)) {
+		return lbm_enc_float(stat0.current * SIGN(stat0.duty));
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1342,9 +1342,9 @@ static lbm_value ext_can_get_current_dir(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_current_in(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg_4 *stat4 = comm_can_get_status_msg_4_id(lbm_dec_as_i32(args[0]));
-	if (stat4) {
-		return lbm_enc_float((float)stat4->current_in);
+	can_status_msg_4 stat4;
+	if (comm_can_get_status_msg_4_id(lbm_dec_as_i32(args[0]), &stat4)) {
+		return lbm_enc_float((float)stat4.current_in);
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1352,9 +1352,9 @@ static lbm_value ext_can_get_current_in(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_duty(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg *stat0 = comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]));
-	if (stat0) {
-		return lbm_enc_float(stat0->duty);
+	can_status_msg stat0;
+	if (comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]), &stat0)) {
+		return lbm_enc_float(stat0.duty);
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1362,9 +1362,9 @@ static lbm_value ext_can_get_duty(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_rpm(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg *stat0 = comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]));
-	if (stat0) {
-		return lbm_enc_float(stat0->rpm);
+	can_status_msg stat0;
+	if (comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]), &stat0)) {
+		return lbm_enc_float(stat0.rpm);
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1372,9 +1372,9 @@ static lbm_value ext_can_get_rpm(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_temp_fet(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg_4 *stat4 = comm_can_get_status_msg_4_id(lbm_dec_as_i32(args[0]));
-	if (stat4) {
-		return lbm_enc_float((float)stat4->temp_fet);
+	can_status_msg_4 stat4;
+	if (comm_can_get_status_msg_4_id(lbm_dec_as_i32(args[0]), &stat4)) {
+		return lbm_enc_float((float)stat4.temp_fet);
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1382,9 +1382,9 @@ static lbm_value ext_can_get_temp_fet(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_temp_motor(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg_4 *stat4 = comm_can_get_status_msg_4_id(lbm_dec_as_i32(args[0]));
-	if (stat4) {
-		return lbm_enc_float((float)stat4->temp_motor);
+	can_status_msg_4 stat4;
+	if (comm_can_get_status_msg_4_id(lbm_dec_as_i32(args[0]), &stat4)) {
+		return lbm_enc_float((float)stat4.temp_motor);
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1392,9 +1392,9 @@ static lbm_value ext_can_get_temp_motor(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_speed(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg *stat0 = comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]));
-	if (stat0) {
-		return lbm_enc_float(stat0->rpm);
+	can_status_msg stat0;
+	if (comm_can_get_status_msg_id(lbm_dec_as_i32(args[0]), &stat0)) {
+		return lbm_enc_float(stat0.rpm);
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1402,10 +1402,10 @@ static lbm_value ext_can_get_speed(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_dist(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg_5 *stat5 = comm_can_get_status_msg_5_id(lbm_dec_as_i32(args[0]));
-	if (stat5) {
+	can_status_msg_5 stat5;
+	if (comm_can_get_status_msg_5_id(lbm_dec_as_i32(args[0]), &stat5)) {
 		const float tacho_scale = 1.0;
-		return lbm_enc_float((float)stat5->tacho_value * tacho_scale);
+		return lbm_enc_float((float)stat5.tacho_value * tacho_scale);
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1413,9 +1413,9 @@ static lbm_value ext_can_get_dist(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_ppm(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg_6 *stat6 = comm_can_get_status_msg_6_id(lbm_dec_as_i32(args[0]));
-	if (stat6) {
-		return lbm_enc_float((float)stat6->ppm);
+	can_status_msg_6 stat6;
+	if (comm_can_get_status_msg_6_id(lbm_dec_as_i32(args[0]), &stat6)) {
+		return lbm_enc_float((float)stat6.ppm);
 	} else {
 		return lbm_enc_float(0.0);
 	}
@@ -1433,15 +1433,15 @@ static lbm_value ext_can_get_adc(lbm_value *args, lbm_uint argn) {
 		channel = lbm_dec_as_i32(args[1]);
 	}
 
-	can_status_msg_6 *stat6 = comm_can_get_status_msg_6_id(lbm_dec_as_i32(args[0]));
+	can_status_msg_6 stat6;
 
-	if (stat6) {
+	if (comm_can_get_status_msg_6_id(lbm_dec_as_i32(args[0]), &stat6)) {
 		if (channel == 0) {
-			return lbm_enc_float(stat6->adc_1);
+			return lbm_enc_float(stat6.adc_1);
 		} else if (channel == 1) {
-			return lbm_enc_float(stat6->adc_2);
+			return lbm_enc_float(stat6.adc_2);
 		} else if (channel == 2) {
-			return lbm_enc_float(stat6->adc_3);
+			return lbm_enc_float(stat6.adc_3);
 		} else {
 			return ENC_SYM_EERROR;
 		}
@@ -1452,49 +1452,30 @@ static lbm_value ext_can_get_adc(lbm_value *args, lbm_uint argn) {
 
 static lbm_value ext_can_get_vin(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
-	can_status_msg_5 *stat5 = comm_can_get_status_msg_5_id(lbm_dec_as_i32(args[0]));
-	if (stat5) {
-		return lbm_enc_float(stat5->v_in);
+	can_status_msg_5 stat5;
+	if (comm_can_get_status_msg_5_id(lbm_dec_as_i32(args[0]), &stat5)) {
+		return lbm_enc_float(stat5.v_in);
 	} else {
 		return lbm_enc_float(0.0);
 	}
 }
 
-static int cmp_int (const void * a, const void * b) {
-	return ( *(int*)a - *(int*)b );
-}
-
 static lbm_value ext_can_list_devs(lbm_value *args, lbm_uint argn) {
 	(void)args; (void)argn;
 
 	int dev_num = 0;
-	can_status_msg *msg = comm_can_get_status_msg_index(dev_num);
-
-	while (msg && msg->id >= 0) {
-		dev_num++;
-		msg = comm_can_get_status_msg_index(dev_num);
-	}
+	uint8_t devs[256];
 
-	int devs[dev_num];
-
-	for (int i = 0;i < dev_num;i++) {
-		msg = comm_can_get_status_msg_index(i);
-		if (msg) {
-			devs[i] = msg->id;
-		} else {
-			devs[i] = -1;
-		}
+	int id = comm_can_get_status_msg_next_id(-1);
+	while (id >= 0 && dev_num < 256) {
+		devs[dev_num++] = id;
+		id = comm_can_get_status_msg_next_id(id);
 	}
 
-	qsort(devs, dev_num, sizeof(int), cmp_int);
 	lbm_value dev_list = ENC_SYM_NIL;
 
 	for (int i = (dev_num - 1);i >= 0;i--) {
-		if (devs[i] >= 0) {
-			dev_list = lbm_cons(lbm_enc_i(devs[i]), dev_list);
-		} else {
-			break;
-		}
+		dev_list = lbm_cons(lbm_enc_i(devs[i]), dev_list);
 	}
 
 	return dev_list;
@@ -1505,6 +1486,234 @@ static lbm_value ext_can_local_id(lbm_value *args, lbm_uint argn) {
 	return lbm_enc_i(backup.config.controller_id);
 }
 
+// (can-rx-stats optBus) -> (rx-std rx-ext drop-std drop-ext high-water size)
+static lbm_value ext_can_rx_stats(lbm_value *args, lbm_uint argn) {
+	if (argn > 1 || (argn == 1 && !lbm_is_number(args[0]))) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_TERROR;
+	}
+
+	int bus = 1;
+	if (argn == 1) {
+		bus = lbm_dec_as_i32(args[0]);
+	}
+
+	can_rx_stats stats;
+	if (!comm_can_get_rx_stats(bus, &stats)) {
+		return ENC_SYM_EERROR;
+	}
+
+	lbm_value res = ENC_SYM_NIL;
+	res = lbm_cons(lbm_enc_i(stats.size), res);
+	res = lbm_cons(lbm_enc_i(stats.high_water), res);
+	res = lbm_cons(lbm_enc_u32(stats.drop_cnt[CAN_ID_CLASS_EXT]), res);
+	res = lbm_cons(lbm_enc_u32(stats.drop_cnt[CAN_ID_CLASS_STD]), res);
+	res = lbm_cons(lbm_enc_u32(stats.rx_cnt[CAN_ID_CLASS_EXT]), res);
+	res = lbm_cons(lbm_enc_u32(stats.rx_cnt[CAN_ID_CLASS_STD]), res);
+	return res;
+}
+
+static lbm_value ext_can_rx_stats_reset(lbm_value *args, lbm_uint argn) {
+	(void)args; (void)argn;
+	comm_can_reset_rx_stats();
+	return ENC_SYM_TRUE;
+}
+
+// Acceptance filter for frames passed to the CAN events and can-recv. When
+// no filter is set all frames pass.
+
+// (can-filter-add-range first last optExt)
+static lbm_value ext_can_filter_add_range(lbm_value *args, lbm_uint argn) {
+	if ((argn != 2 && argn != 3) || !lbm_is_number(args[0]) || !lbm_is_number(args[1])) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_TERROR;
+	}
+
+	bool is_ext = argn == 3 && lbm_is_symbol_true(args[2]);
+	return comm_can_filter_add_range(lbm_dec_as_u32(args[0]), lbm_dec_as_u32(args[1]), is_ext) ?
+			ENC_SYM_TRUE : ENC_SYM_NIL;
+}
+
+// (can-filter-add-mask id mask optExt)
+static lbm_value ext_can_filter_add_mask(lbm_value *args, lbm_uint argn) {
+	if ((argn != 2 && argn != 3) || !lbm_is_number(args[0]) || !lbm_is_number(args[1])) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_TERROR;
+	}
+
+	bool is_ext = argn == 3 && lbm_is_symbol_true(args[2]);
+	return comm_can_filter_add_mask(lbm_dec_as_u32(args[0]), lbm_dec_as_u32(args[1]), is_ext) ?
+			ENC_SYM_TRUE : ENC_SYM_NIL;
+}
+
+static lbm_value ext_can_filter_clear(lbm_value *args, lbm_uint argn) {
+	(void)args; (void)argn;
+	comm_can_filter_clear();
+	return ENC_SYM_TRUE;
+}
+
+// (can-filter-stats optReset) -> (passed rejected)
+static lbm_value ext_can_filter_stats(lbm_value *args, lbm_uint argn) {
+	uint32_t passed, rejected;
+	comm_can_filter_get_stats(&passed, &rejected);
+
+	if (argn == 1 && lbm_is_symbol_true(args[0])) {
+		comm_can_filter_reset_stats();
+	}
+
+	lbm_value res = ENC_SYM_NIL;
+	res = lbm_cons(lbm_enc_u32(rejected), res);
+	res = lbm_cons(lbm_enc_u32(passed), res);
+	return res;
+}
+
+// Batched CAN events. Frames are packed into records of CAN_BATCH_REC_SIZE
+// bytes and sent as one byte array per batch:
+// [0 - 3]  id, big endian, bit 31 is set for extended ids
+// [4 - 7]  receive time in milliseconds, big endian
+// [8]      data length
+// [9 - 16] data
+//
+// While event-can-batch is enabled it replaces event-can-sid and
+// event-can-eid: frames go into batches only, so that there is one event
+// per batch instead of one per frame. The same goes for event-can2-batch
+// and the can2 events. If a batch cannot be delivered its frames are
+// counted as dropped in can-rx-stats, like frames that did not fit in
+// the receive queue.
+#define CAN_BATCH_REC_SIZE			17
+#define CAN_BATCH_MAX_FRAMES		64
+
+typedef struct {
+	uint8_t buf[CAN_BATCH_MAX_FRAMES * CAN_BATCH_REC_SIZE];
+	int num;
+	uint32_t start_time;
+} can_batch_t;
+
+static can_batch_t can_batch;
+#ifdef CONFIG_IDF_TARGET_ESP32C6
+static can_batch_t can2_batch;
+#endif
+static volatile int can_batch_frames = 16;
+static volatile int can_batch_ms = 10;
+
+static lbm_value ext_can_batch_config(lbm_value *args, lbm_uint argn) {
+	LBM_CHECK_ARGN_NUMBER(2);
+
+	int frames = lbm_dec_as_i32(args[0]);
+	int ms = lbm_dec_as_i32(args[1]);
+
+	if (frames < 1 || frames > CAN_BATCH_MAX_FRAMES || ms < 1) {
+		lbm_set_error_reason((char*)lbm_error_str_incorrect_arg);
+		return ENC_SYM_EERROR;
+	}
+
+	can_batch_frames = frames;
+	can_batch_ms = ms;
+	return ENC_SYM_TRUE;
+}
+
+// Returns the record at args[1] in the batch array args[0], or null if
+// the arguments are invalid.
+static uint8_t *can_batch_get_rec(lbm_value *args, lbm_uint argn) {
+	if (argn < 2 || !lbm_is_array_r(args[0]) || !lbm_is_number(args[1])) {
+		return 0;
+	}
+
+	lbm_array_header_t *array = (lbm_array_header_t *)lbm_car(args[0]);
+	uint32_t ind = lbm_dec_as_u32(args[1]);
+
+	if (ind >= (array->size / CAN_BATCH_REC_SIZE)) {
+		return 0;
+	}
+
+	return (uint8_t*)array->data + ind * CAN_BATCH_REC_SIZE;
+}
+
+// (can-batch-num arr)
+static lbm_value ext_can_batch_num(lbm_value *args, lbm_uint argn) {
+	if (argn != 1 || !lbm_is_array_r(args[0])) {
+		return ENC_SYM_TERROR;
+	}
+
+	lbm_array_header_t *array = (lbm_array_header_t *)lbm_car(args[0]);
+	return lbm_enc_i(array->size / CAN_BATCH_REC_SIZE);
+}
+
+// (can-batch-id arr ind)
+static lbm_value ext_can_batch_id(lbm_value *args, lbm_uint argn) {
+	uint8_t *rec = can_batch_get_rec(args, argn);
+	if (argn != 2 || !rec) {
+		return ENC_SYM_TERROR;
+	}
+
+	int32_t ind = 0;
+	return lbm_enc_u32(buffer_get_uint32(rec, &ind) & 0x7FFFFFFF);
+}
+
+// (can-batch-ext arr ind)
+static lbm_value ext_can_batch_ext(lbm_value *args, lbm_uint argn) {
+	uint8_t *rec = can_batch_get_rec(args, argn);
+	if (argn != 2 || !rec) {
+		return ENC_SYM_TERROR;
+	}
+
+	return (rec[0] & 0x80) ? ENC_SYM_TRUE : ENC_SYM_NIL;
+}
+
+// (can-batch-time arr ind)
+static lbm_value ext_can_batch_time(lbm_value *args, lbm_uint argn) {
+	uint8_t *rec = can_batch_get_rec(args, argn);
+	if (argn != 2 || !rec) {
+		return ENC_SYM_TERROR;
+	}
+
+	int32_t ind = 4;
+	return lbm_enc_u32(buffer_get_uint32(rec, &ind));
+}
+
+// (can-batch-len arr ind)
+static lbm_value ext_can_batch_len(lbm_value *args, lbm_uint argn) {
+	uint8_t *rec = can_batch_get_rec(args, argn);
+	if (argn != 2 || !rec) {
+		return ENC_SYM_TERROR;
+	}
+
+	return lbm_enc_i(rec[8]);
+}
+
+// (can-batch-data arr ind optByte)
+// Returns one data byte, or all data bytes in a new array when optByte is left out.
+static lbm_value ext_can_batch_data(lbm_value *args, lbm_uint argn) {
+	uint8_t *rec = can_batch_get_rec(args, argn);
+	if ((argn != 2 && argn != 3) || !rec) {
+		return ENC_SYM_TERROR;
+	}
+
+	int len = rec[8];
+
+	if (argn == 3) {
+		if (!lbm_is_number(args[2])) {
+			return ENC_SYM_TERROR;
+		}
+
+		int byte = lbm_dec_as_i32(args[2]);
+		if (byte < 0 || byte >= len) {
+			return ENC_SYM_EERROR;
+		}
+
+		return lbm_enc_i(rec[9 + byte]);
+	}
+
+	lbm_value res;
+	if (!lbm_create_array(&res, len)) {
+		return ENC_SYM_MERROR;
+	}
+
+	lbm_array_header_t *array = (lbm_array_header_t *)lbm_car(res);
+	memcpy(array->data, rec + 9, len);
+	return res;
+}
+
 static lbm_value ext_can_update_baud(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN(1);
 	int kbits = lbm_dec_as_i32(args[0]);
@@ -2129,6 +2338,10 @@ static lbm_value ext_enable_event(lbm_value *args, lbm_uint argn) {
 		event_can2_sid_en = en;
 	} else if (name == sym_event_can2_eid) {
 		event_can2_eid_en = en;
+	} else if (name == sym_event_can_batch) {
+		event_can_batch_en = en;
+	} else if (name == sym_event_can2_batch) {
+		event_can2_batch_en = en;
 	} else if (name == sym_event_data_rx) {
 		event_data_rx_en = en;
 	} else if (name == sym_event_esp_now_rx) {
@@ -2166,13 +2379,30 @@ static lbm_value ext_enable_event(lbm_value *args, lbm_uint argn) {
 }
 
 static lbm_value ext_lbm_set_quota(lbm_value *args, lbm_uint argn) {
-	LBM_CHECK_ARGN_NUMBER(1);
+	if (argn != 1 && argn != 2) {
+		return ENC_SYM_TERROR;
+	}
+	LBM_CHECK_NUMBER_ALL();
 	uint32_t q = lbm_dec_as_u32(args[0]);
 
 	if (q < 1) {
 		return ENC_SYM_EERROR;
 	}
 
+	// Optional second argument: only set the quota of one priority level.
+	if (argn == 2) {
+		uint32_t prio = lbm_dec_as_u32(args[1]);
+		if (prio >= LBM_PRIO_LEVELS) {
+			return ENC_SYM_EERROR;
+		}
+#ifdef LBM_USE_TIME_QUOTA
+		lbm_set_eval_time_quota_prio(prio, q);
+#else
+		lbm_set_eval_step_quota_prio(prio, q);
+#endif
+		return ENC_SYM_TRUE;
+	}
+
 #ifdef LBM_USE_TIME_QUOTA
 	lbm_set_eval_time_quota(q);
 #else
@@ -2262,16 +2492,17 @@ static lbm_value ext_ioboard_get_adc(lbm_value *args, lbm_uint argn) {
 		return ENC_SYM_EERROR;
 	}
 
-	io_board_adc_values *val = 0;
+	io_board_adc_values val;
+	bool found = false;
 	if (channel >= 5) {
-		val = comm_can_get_io_board_adc_5_8_id(id);
+		found = comm_can_get_io_board_adc_5_8_id(id, &val);
 		channel -= 4;
 	} else {
-		val = comm_can_get_io_board_adc_1_4_id(id);
+		found = comm_can_get_io_board_adc_1_4_id(id, &val);
 	}
 
-	if (val) {
-		return lbm_enc_float(val->adc_voltages[channel - 1]);
+	if (found) {
+		return lbm_enc_float(val.adc_voltages[channel - 1]);
 	} else {
 		return lbm_enc_float(-1.0);
 	}
@@ -2288,10 +2519,10 @@ static lbm_value ext_ioboard_get_digital(lbm_value *args, lbm_uint argn) {
 		return ENC_SYM_EERROR;
 	}
 
-	io_board_digial_inputs *val = comm_can_get_io_board_digital_in_id(id);
+	io_board_digial_inputs val;
 
-	if (val) {
-		return lbm_enc_i(val->inputs >> (channel - 1));
+	if (comm_can_get_io_board_digital_in_id(id, &val)) {
+		return lbm_enc_i(val.inputs >> (channel - 1));
 	} else {
 		return lbm_enc_i(-1);
 	}
@@ -3262,13 +3493,18 @@ static lbm_value ext_buf_resize(lbm_value *args, lbm_uint argn) {
 // Logging
 
 static lbm_value ext_log_start(lbm_value *args, lbm_uint argn) {
-	LBM_CHECK_ARGN(5);
+	if (argn < 5 || argn > 7) {
+		lbm_set_error_reason((char*)lbm_error_str_num_args);
+		return ENC_SYM_EERROR;
+	}
 
 	if (!lbm_is_number(args[0]) ||
 			!lbm_is_number(args[1]) ||
 			!lbm_is_number(args[2]) ||
 			!is_symbol_true_false(args[3]) ||
-			!is_symbol_true_false(args[4])) {
+			!is_symbol_true_false(args[4]) ||
+			(argn >= 6 && !is_symbol_true_false(args[5])) ||
+			(argn == 7 && !is_symbol_true_false(args[6]))) {
 		return ENC_SYM_EERROR;
 	}
 
@@ -3278,11 +3514,28 @@ static lbm_value ext_log_start(lbm_value *args, lbm_uint argn) {
 			lbm_dec_as_float(args[2]),
 			lbm_is_symbol_true(args[3]),
 			lbm_is_symbol_true(args[4]),
-			lbm_is_symbol_true(args[4]));
+			lbm_is_symbol_true(args[4]),
+			argn >= 6 && lbm_is_symbol_true(args[5]),
+			argn == 7 && lbm_is_symbol_true(args[6]));
 
 	return ENC_SYM_TRUE;
 }
 
+// (log-event-stats) -> (depth depth-max dropped written)
+static lbm_value ext_log_event_stats(lbm_value *args, lbm_uint argn) {
+	(void)args; (void)argn;
+
+	log_event_stats stats;
+	log_get_event_stats(&stats);
+
+	lbm_value res = ENC_SYM_NIL;
+	res = lbm_cons(lbm_enc_u32(stats.written), res);
+	res = lbm_cons(lbm_enc_u32(stats.dropped), res);
+	res = lbm_cons(lbm_enc_u32(stats.depth_max), res);
+	res = lbm_cons(lbm_enc_u32(stats.depth), res);
+	return res;
+}
+
 static lbm_value ext_log_stop(lbm_value *args, lbm_uint argn) {
 	LBM_CHECK_ARGN_NUMBER(1);
 	log_comm_stop(lbm_dec_as_i32(args[0]));
@@ -6856,6 +7109,19 @@ void lispif_load_vesc_extensions(bool main_found) {
 		lbm_add_extension("can-list-devs", ext_can_list_devs);
 		lbm_add_extension("can-local-id", ext_can_local_id);
 		lbm_add_extension("can-update-baud", ext_can_update_baud);
+		lbm_add_extension("can-rx-stats", ext_can_rx_stats);
+		lbm_add_extension("can-rx-stats-reset", ext_can_rx_stats_reset);
+		lbm_add_extension("can-filter-add-range", ext_can_filter_add_range);
+		lbm_add_extension("can-filter-add-mask", ext_can_filter_add_mask);
+		lbm_add_extension("can-filter-clear", ext_can_filter_clear);
+		lbm_add_extension("can-filter-stats", ext_can_filter_stats);
+		lbm_add_extension("can-batch-config", ext_can_batch_config);
+		lbm_add_extension("can-batch-num", ext_can_batch_num);
+		lbm_add_extension("can-batch-id", ext_can_batch_id);
+		lbm_add_extension("can-batch-ext", ext_can_batch_ext);
+		lbm_add_extension("can-batch-time", ext_can_batch_time);
+		lbm_add_extension("can-batch-len", ext_can_batch_len);
+		lbm_add_extension("can-batch-data", ext_can_batch_data);
 
 #ifdef CONFIG_IDF_TARGET_ESP32C6
 		lbm_add_extension("can2-start",       ext_can2_start);
@@ -6946,6 +7212,7 @@ void lispif_load_vesc_extensions(bool main_found) {
 
 		// Logging
 		lbm_add_extension("log-start", ext_log_start);
+		lbm_add_extension("log-event-stats", ext_log_event_stats);
 		lbm_add_extension("log-stop", ext_log_stop);
 		lbm_add_extension("log-config-field", ext_log_config_field);
 		lbm_add_extension("log-send-f32", ext_log_send_f32);
@@ -7128,6 +7395,9 @@ void lispif_disable_all_events(void) {
 	event_can_eid_en = false;
 	event_can2_sid_en = false;
 	event_can2_eid_en = false;
+	event_can_batch_en = false;
+	event_can2_batch_en = false;
+	comm_can_filter_clear();
 
 	event_data_rx_en = false;
 	event_esp_now_rx_en = false;
@@ -7177,7 +7447,104 @@ void lispif_disable_all_events(void) {
 	vTaskDelay(pdMS_TO_TICKS(5));
 }
 
+// Count the frames of a batch that could not be delivered as dropped
+static void can_batch_drop(can_batch_t *batch, int bus) {
+	uint32_t ext = 0;
+	for (int i = 0;i < batch->num;i++) {
+		if (batch->buf[i * CAN_BATCH_REC_SIZE] & 0x80) {
+			ext++;
+		}
+	}
+
+	comm_can_add_rx_drops(bus, false, batch->num - ext);
+	comm_can_add_rx_drops(bus, true, ext);
+}
+
+static void can_batch_flush(can_batch_t *batch, lbm_uint sym, int bus) {
+	if (batch->num == 0) {
+		return;
+	}
+
+	int len = batch->num * CAN_BATCH_REC_SIZE;
+	bool sent = false;
+
+	lbm_flat_value_t v;
+	if (start_flatten_with_gc(&v, 50 + len)) {
+		f_cons(&v);
+		f_sym(&v, sym);
+		f_lbm_array(&v, len, batch->buf);
+		lbm_finish_flatten(&v);
+
+		sent = lbm_event(&v);
+		if (!sent) {
+			lbm_free(v.buf);
+		}
+	}
+
+	if (!sent) {
+		can_batch_drop(batch, bus);
+	}
+
+	batch->num = 0;
+}
+
+static void can_batch_add(can_batch_t *batch, lbm_uint sym, int bus,
+		uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
+	uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+	if (batch->num == 0) {
+		batch->start_time = now;
+	}
+
+	if (len > 8) {
+		len = 8;
+	}
+
+	int32_t ind = batch->num * CAN_BATCH_REC_SIZE;
+	uint8_t *rec = batch->buf;
+	buffer_append_uint32(rec, can_id | (is_ext ? 0x80000000 : 0), &ind);
+	buffer_append_uint32(rec, now, &ind);
+	rec[ind++] = len;
+	memset(rec + ind, 0, 8);
+	memcpy(rec + ind, data8, len);
+	batch->num++;
+
+	int frames = can_batch_frames;
+	if (batch->num >= frames || batch->num >= CAN_BATCH_MAX_FRAMES) {
+		can_batch_flush(batch, sym, bus);
+	}
+}
+
+/**
+ * Send batches that are older than the configured batch time. Called
+ * periodically from the CAN process task, which is the only place where
+ * frames are added to the batches.
+ */
+void lispif_process_can_batch_timeout(void) {
+	uint32_t now = xTaskGetTickCount() * portTICK_PERIOD_MS;
+
+	if (!event_can_batch_en) {
+		can_batch.num = 0;
+	} else if (can_batch.num > 0 && (now - can_batch.start_time) >= (uint32_t)can_batch_ms) {
+		can_batch_flush(&can_batch, sym_event_can_batch, 1);
+	}
+
+#ifdef CONFIG_IDF_TARGET_ESP32C6
+	if (!event_can2_batch_en) {
+		can2_batch.num = 0;
+	} else if (can2_batch.num > 0 && (now - can2_batch.start_time) >= (uint32_t)can_batch_ms) {
+		can_batch_flush(&can2_batch, sym_event_can2_batch, 2);
+	}
+#endif
+}
+
 void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
+	if (event_can_batch_en &&
+			((is_ext && can_recv_eid_cid < 0) || (!is_ext && can_recv_sid_cid < 0))) {
+		can_batch_add(&can_batch, sym_event_can_batch, 1, can_id, data8, len, is_ext);
+		return;
+	}
+
 	if (is_ext) {
 		if (can_recv_eid_cid < 0 && !event_can_eid_en)  {
 			return;
@@ -7226,6 +7593,12 @@ void lispif_process_can(uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
 
 #ifdef CONFIG_IDF_TARGET_ESP32C6
 void lispif_process_can2(uint32_t can_id, uint8_t *data8, int len, bool is_ext) {
+	if (event_can2_batch_en &&
+			((is_ext && can2_recv_eid_cid < 0) || (!is_ext && can2_recv_sid_cid < 0))) {
+		can_batch_add(&can2_batch, sym_event_can2_batch, 2, can_id, data8, len, is_ext);
+		return;
+	}
+
 	if (is_ext) {
 		if (can2_recv_eid_cid < 0 && !event_can2_eid_en) return;
 	} else {
@@ -29,6 +29,7 @@
 #include "esp_vfs.h"
 #include "buffer.h"
 #include "utils.h"
+#include "crc.h"
 #include "esp_vfs_fat_nand.h"
 
 #include <string.h>
@@ -47,10 +48,93 @@ typedef struct {
 	bool is_timestamp;
 	double value;
 	bool updated;
+	bool is_f64;
 } log_header;
 
 #define LOG_MAX_FIELDS		120
 
+/*
+ * Binary log format, converted back to CSV by tools/log_bin_to_csv.py.
+ * All numbers are big endian.
+ *
+ * The file starts with a header that is padded to a multiple of the block
+ * size, so that all blocks after it are aligned:
+ * "VLOG", version u8, header length u32, block size u16, rate f32,
+ * column count u16 and for each column key, name and unit as
+ * null-terminated strings followed by precision i8, is_relative u8,
+ * is_timestamp u8 and the number of decimals used in the CSV data u8.
+ * The header ends with a crc16 of everything before it.
+ *
+ * Blocks of LOG_BIN_BLOCK_SIZE bytes follow: sync u32, block index u32,
+ * payload length u16, row count u16, rows and at the very end of the
+ * block a crc16 of everything before it. A block is written every time it
+ * is full and every LOG_BIN_SYNC_S seconds, so at most that much data is
+ * lost on a crash. Blocks that fail the check are skipped by the converter.
+ *
+ * Each row starts with two bits per column, 0 for empty, 1 for float32
+ * and 2 for float64, followed by the values of the non-empty columns.
+ */
+#define LOG_BIN_VERSION			1
+#define LOG_BIN_BLOCK_SIZE		4096
+#define LOG_BIN_BLOCK_SYNC		0x564C4253
+#define LOG_BIN_BLOCK_HDR		12
+#define LOG_BIN_PAYLOAD_MAX		(LOG_BIN_BLOCK_SIZE - LOG_BIN_BLOCK_HDR - 2)
+#define LOG_BIN_MAX_COLS		(LOG_MAX_FIELDS + 7)
+#define LOG_BIN_SYNC_S			2.0
+
+typedef enum {
+	LOG_FORMAT_CSV = 0,
+	LOG_FORMAT_BIN
+} LOG_FORMAT;
+
+/*
+ * In event mode every field update is queued with the time it arrived,
+ * and the log task writes one row per data packet containing only the
+ * fields from that packet. GNSS updates get rows of their own.
+ *
+ * Log packets can come from several tasks, so the queue is a bounded
+ * multi-producer queue where each cell has a sequence number that tells
+ * whether it is free for the producer that claimed its position or ready
+ * for the consumer. A packet claims all its cells with one compare and
+ * swap, so the cells of a packet are always next to each other and the
+ * log task only takes a packet once all of its cells are ready.
+ */
+#ifndef LOG_EVENT_QUEUE_LEN
+#define LOG_EVENT_QUEUE_LEN		256 // Must be a power of two
+#endif
+
+typedef struct {
+	volatile uint32_t seq;
+	uint16_t num; // Number of cells in the packet
+	uint16_t field;
+	int32_t time_ms;
+	bool is_f64;
+	double value;
+} log_event;
+
+typedef struct {
+	log_event *cells;
+	uint32_t head; // Claimed by producers with compare and swap
+	uint32_t tail; // Only advanced by the log task
+	volatile uint32_t depth_max;
+	uint32_t dropped;
+	volatile uint32_t written;
+} log_event_queue;
+
+// The log task fills one block while the writer task writes the other
+typedef struct {
+	FILE *f;
+	uint8_t *block[2];
+	int fill_ind;
+	int32_t len;
+	int rows;
+	uint32_t block_cnt;
+	volatile int write_ind;
+	volatile bool write_sync;
+	SemaphoreHandle_t sem_full;
+	SemaphoreHandle_t sem_free;
+} log_bin_writer;
+
 char *file_basepath = "/sdcard/";
 
 // Private variables
@@ -76,6 +160,10 @@ static volatile float m_rate_hz = 10.0;
 static volatile bool m_append_time = false;
 static volatile bool m_append_gnss = false;
 static volatile bool m_append_gnss_time = false;
+static volatile LOG_FORMAT m_format = LOG_FORMAT_CSV;
+static volatile bool m_event_mode = false;
+static log_bin_writer m_bin;
+static log_event_queue m_events;
 
 static void print_header(log_header *h, FILE *file) {
 	fprintf(file, "%s:%s:%s:%d:%d:%d",
@@ -83,8 +171,409 @@ static void print_header(log_header *h, FILE *file) {
 			h->precision, h->is_relative, h->is_timestamp);
 }
 
+static void log_bin_write_task(void *arg) {
+	(void)arg;
+
+	for (;;) {
+		xSemaphoreTake(m_bin.sem_full, portMAX_DELAY);
+
+		fwrite(m_bin.block[m_bin.write_ind], 1, LOG_BIN_BLOCK_SIZE, m_bin.f);
+		if (m_bin.write_sync) {
+			fflush(m_bin.f);
+			fsync(fileno(m_bin.f));
+		}
+
+		xSemaphoreGive(m_bin.sem_free);
+	}
+}
+
+static void log_bin_append_header(uint8_t *buffer, log_header *h, int decimals, int32_t *ind) {
+	strcpy((char*)buffer + *ind, h->key);
+	*ind += strlen(h->key) + 1;
+	strcpy((char*)buffer + *ind, h->name);
+	*ind += strlen(h->name) + 1;
+	strcpy((char*)buffer + *ind, h->unit);
+	*ind += strlen(h->unit) + 1;
+	buffer[(*ind)++] = h->precision;
+	buffer[(*ind)++] = h->is_relative;
+	buffer[(*ind)++] = h->is_timestamp;
+	buffer[(*ind)++] = decimals;
+}
+
+static bool log_bin_open(FILE *f) {
+	int cols = m_field_num;
+	int hdr_max = 32 + LOG_BIN_MAX_COLS * (sizeof(log_header) + 4);
+	hdr_max = (hdr_max + LOG_BIN_BLOCK_SIZE - 1) / LOG_BIN_BLOCK_SIZE * LOG_BIN_BLOCK_SIZE;
+
+	uint8_t *hdr = calloc(1, hdr_max);
+	m_bin.block[0] = malloc(LOG_BIN_BLOCK_SIZE);
+	m_bin.block[1] = malloc(LOG_BIN_BLOCK_SIZE);
+
+	if (!hdr || !m_bin.block[0] || !m_bin.block[1]) {
+		free(hdr);
+		free(m_bin.block[0]);
+		free(m_bin.block[1]);
+		m_bin.block[0] = 0;
+		m_bin.block[1] = 0;
+		return false;
+	}
+
+	int32_t ind = 0;
+	memcpy(hdr, "VLOG", 4);
+	ind += 4;
+	hdr[ind++] = LOG_BIN_VERSION;
+	int32_t len_ind = ind;
+	ind += 4;
+	buffer_append_uint16(hdr, LOG_BIN_BLOCK_SIZE, &ind);
+	float rate = m_rate_hz;
+	uint32_t rate_u;
+	memcpy(&rate_u, &rate, 4);
+	buffer_append_uint32(hdr, rate_u, &ind);
+	int32_t cols_ind = ind;
+	ind += 2;
+
+	for (int i = 0;i < m_field_num;i++) {
+		log_header *h = (log_header*)&m_headers[i];
+		log_bin_append_header(hdr, h, h->precision, &ind);
+	}
+
+	if (m_append_time) {
+		log_bin_append_header(hdr, &m_header_ts, 3, &ind);
+		cols++;
+	}
+
+	if (m_append_gnss_time) {
+		log_bin_append_header(hdr, &m_header_ts_gnss, 3, &ind);
+		cols++;
+	}
+
+	if (m_append_gnss) {
+		log_bin_append_header(hdr, &m_header_lat, 8, &ind);
+		log_bin_append_header(hdr, &m_header_lon, 8, &ind);
+		log_bin_append_header(hdr, &m_header_alt, 2, &ind);
+		log_bin_append_header(hdr, &m_header_hacc, 2, &ind);
+		log_bin_append_header(hdr, &m_header_hvel, 2, &ind);
+		cols += 5;
+	}
+
+	int32_t hdr_len = (ind + 2 + LOG_BIN_BLOCK_SIZE - 1) / LOG_BIN_BLOCK_SIZE * LOG_BIN_BLOCK_SIZE;
+	buffer_append_uint32(hdr, hdr_len, &len_ind);
+	buffer_append_uint16(hdr, cols, &cols_ind);
+	buffer_append_uint16(hdr, crc16(hdr, ind), &ind);
+
+	fwrite(hdr, 1, hdr_len, f);
+	free(hdr);
+
+	m_bin.f = f;
+	m_bin.fill_ind = 0;
+	m_bin.len = 0;
+	m_bin.rows = 0;
+	m_bin.block_cnt = 0;
+	xSemaphoreTake(m_bin.sem_free, 0);
+	xSemaphoreGive(m_bin.sem_free);
+
+	return true;
+}
+
+// Hand the block that is being filled over to the writer task
+static void log_bin_flush(bool sync) {
+	uint8_t *b = m_bin.block[m_bin.fill_ind];
+
+	int32_t ind = 0;
+	buffer_append_uint32(b, LOG_BIN_BLOCK_SYNC, &ind);
+	buffer_append_uint32(b, m_bin.block_cnt++, &ind);
+	buffer_append_uint16(b, m_bin.len, &ind);
+	buffer_append_uint16(b, m_bin.rows, &ind);
+	memset(b + LOG_BIN_BLOCK_HDR + m_bin.len, 0, LOG_BIN_PAYLOAD_MAX - m_bin.len);
+	ind = LOG_BIN_BLOCK_SIZE - 2;
+	buffer_append_uint16(b, crc16(b, LOG_BIN_BLOCK_SIZE - 2), &ind);
+
+	xSemaphoreTake(m_bin.sem_free, portMAX_DELAY);
+	m_bin.write_ind = m_bin.fill_ind;
+	m_bin.write_sync = sync;
+	xSemaphoreGive(m_bin.sem_full);
+
+	m_bin.fill_ind ^= 1;
+	m_bin.len = 0;
+	m_bin.rows = 0;
+}
+
+static void log_bin_close(void) {
+	if (m_bin.rows > 0) {
+		log_bin_flush(true);
+	}
+
+	// Wait for the writer to finish the last block
+	xSemaphoreTake(m_bin.sem_free, portMAX_DELAY);
+	xSemaphoreGive(m_bin.sem_free);
+
+	free(m_bin.block[0]);
+	free(m_bin.block[1]);
+	m_bin.block[0] = 0;
+	m_bin.block[1] = 0;
+	m_bin.f = 0;
+}
+
+static void log_bin_add_row(const double *values, const uint8_t *types, int cols) {
+	int map_len = (cols + 3) / 4;
+	int row_len = map_len;
+	for (int i = 0;i < cols;i++) {
+		row_len += types[i] * 4;
+	}
+
+	if ((m_bin.len + row_len) > LOG_BIN_PAYLOAD_MAX) {
+		log_bin_flush(false);
+	}
+
+	uint8_t *b = m_bin.block[m_bin.fill_ind] + LOG_BIN_BLOCK_HDR;
+	int32_t ind = m_bin.len;
+
+	memset(b + ind, 0, map_len);
+	for (int i = 0;i < cols;i++) {
+		b[ind + i / 4] |= types[i] << (2 * (i % 4));
+	}
+	ind += map_len;
+
+	for (int i = 0;i < cols;i++) {
+		if (types[i] == 1) {
+			float f = values[i];
+			uint32_t u;
+			memcpy(&u, &f, 4);
+			buffer_append_uint32(b, u, &ind);
+		} else if (types[i] == 2) {
+			uint64_t u;
+			memcpy(&u, &values[i], 8);
+			buffer_append_uint64(b, u, &ind);
+		}
+	}
+
+	m_bin.len = ind;
+	m_bin.rows++;
+}
+
+// Allocate the queue the first time event mode is used. The queue is
+// never reinitialized after that, so producers that are still pushing
+// when logging is restarted cannot see the indices move under them.
+static bool log_event_init(void) {
+	if (m_events.cells) {
+		return true;
+	}
+
+	m_events.cells = malloc(sizeof(log_event) * LOG_EVENT_QUEUE_LEN);
+	if (!m_events.cells) {
+		return false;
+	}
+
+	for (int i = 0;i < LOG_EVENT_QUEUE_LEN;i++) {
+		m_events.cells[i].seq = i;
+	}
+
+	m_events.head = 0;
+	m_events.tail = 0;
+	return true;
+}
+
+// Claim num consecutive cells for one packet. The cells are free once the
+// last of them is, as the log task frees cells in order.
+static bool log_event_claim(int num, uint32_t *pos_res) {
+	if (num <= 0 || num > LOG_EVENT_QUEUE_LEN) {
+		return false;
+	}
+
+	uint32_t pos = __atomic_load_n(&m_events.head, __ATOMIC_RELAXED);
+
+	for (;;) {
+		uint32_t last = pos + num - 1;
+		log_event *e = &m_events.cells[last & (LOG_EVENT_QUEUE_LEN - 1)];
+		int32_t dif = (int32_t)(__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) - last);
+
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&m_events.head, &pos, pos + num,
+					true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				break;
+			}
+		} else if (dif < 0) {
+			__atomic_fetch_add(&m_events.dropped, num, __ATOMIC_RELAXED);
+			return false;
+		} else {
+			pos = __atomic_load_n(&m_events.head, __ATOMIC_RELAXED);
+		}
+	}
+
+	// The depth peaks here, the log task only ever lowers it
+	uint32_t depth = pos + num - __atomic_load_n(&m_events.tail, __ATOMIC_ACQUIRE);
+	uint32_t depth_max = __atomic_load_n(&m_events.depth_max, __ATOMIC_RELAXED);
+	while (depth > depth_max &&
+			!__atomic_compare_exchange_n(&m_events.depth_max, &depth_max, depth,
+					true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+
+	*pos_res = pos;
+	return true;
+}
+
+// Fill and publish one cell of a claimed packet
+static void log_event_set(uint32_t pos, int num, int32_t time_ms, int field, double value, bool is_f64) {
+	log_event *e = &m_events.cells[pos & (LOG_EVENT_QUEUE_LEN - 1)];
+	e->num = num;
+	e->field = field;
+	e->time_ms = time_ms;
+	e->value = value;
+	e->is_f64 = is_f64;
+	__atomic_store_n(&e->seq, pos + 1, __ATOMIC_RELEASE);
+}
+
+// Number of cells in the packet at the tail, or 0 if it is not complete yet
+static int log_event_peek(void) {
+	uint32_t tail = m_events.tail;
+	log_event *e = &m_events.cells[tail & (LOG_EVENT_QUEUE_LEN - 1)];
+	if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != (tail + 1)) {
+		return 0;
+	}
+
+	int num = e->num;
+	for (int i = 1;i < num;i++) {
+		e = &m_events.cells[(tail + i) & (LOG_EVENT_QUEUE_LEN - 1)];
+		if (__atomic_load_n(&e->seq, __ATOMIC_ACQUIRE) != (tail + i + 1)) {
+			return 0;
+		}
+	}
+
+	return num;
+}
+
+static log_event *log_event_cell(int ind) {
+	return &m_events.cells[(m_events.tail + ind) & (LOG_EVENT_QUEUE_LEN - 1)];
+}
+
+static void log_event_pop(int num) {
+	uint32_t tail = m_events.tail;
+	for (int i = 0;i < num;i++) {
+		__atomic_store_n(&log_event_cell(i)->seq, tail + i + LOG_EVENT_QUEUE_LEN, __ATOMIC_RELEASE);
+	}
+	__atomic_store_n(&m_events.tail, tail + num, __ATOMIC_RELEASE);
+}
+
+// Drop what is left from the previous log and clear the counters. Only
+// called from the log task, which is the only consumer.
+static void log_event_discard(void) {
+	int num;
+	while ((num = log_event_peek()) > 0) {
+		log_event_pop(num);
+	}
+
+	__atomic_store_n(&m_events.depth_max, 0, __ATOMIC_RELAXED);
+	__atomic_store_n(&m_events.dropped, 0, __ATOMIC_RELAXED);
+	m_events.written = 0;
+}
+
+static void log_csv_row(FILE *f, const double *values, const uint8_t *types, const uint8_t *decimals, int cols) {
+	for (int i = 0;i < cols;i++) {
+		if (types[i]) {
+			fprintf(f, "%.*f", decimals[i], values[i]);
+		}
+		fprintf(f, i == (cols - 1) ? "\n" : ";");
+	}
+}
+
+// Number of decimals used in the data of each column
+static int log_col_decimals(uint8_t *decimals) {
+	int cols = 0;
+
+	for (int i = 0;i < m_field_num;i++) {
+		decimals[cols++] = m_headers[i].precision;
+	}
+
+	if (m_append_time) {
+		decimals[cols++] = 3;
+	}
+
+	if (m_append_gnss_time) {
+		decimals[cols++] = 3;
+	}
+
+	if (m_append_gnss) {
+		decimals[cols++] = 8;
+		decimals[cols++] = 8;
+		decimals[cols++] = 2;
+		decimals[cols++] = 2;
+		decimals[cols++] = 2;
+	}
+
+	return cols;
+}
+
+// Write all queued updates, and a GNSS row if there is a new position
+static void log_event_write(FILE *f, LOG_FORMAT format, nmea_state_t *s, bool gga_updated, bool rmc_updated) {
+	static double values[LOG_BIN_MAX_COLS];
+	static uint8_t types[LOG_BIN_MAX_COLS];
+	static uint8_t decimals[LOG_BIN_MAX_COLS];
+
+	int cols = log_col_decimals(decimals);
+	int time_col = m_field_num;
+
+	int num;
+	while ((num = log_event_peek()) > 0) {
+		memset(types, 0, cols);
+
+		values[time_col] = (double)log_event_cell(0)->time_ms / 1000.0;
+		types[time_col] = 2;
+
+		for (int i = 0;i < num;i++) {
+			log_event *e = log_event_cell(i);
+			if (e->field < m_field_num) {
+				values[e->field] = e->value;
+				types[e->field] = e->is_f64 ? 2 : 1;
+			}
+		}
+
+		log_event_pop(num);
+		m_events.written += num;
+
+		if (format == LOG_FORMAT_BIN) {
+			log_bin_add_row(values, types, cols);
+		} else {
+			log_csv_row(f, values, types, decimals, cols);
+		}
+	}
+
+	if ((m_append_gnss_time || m_append_gnss) && (gga_updated || rmc_updated)) {
+		memset(types, 0, cols);
+		int col = time_col;
+
+		values[col] = (double)utils_ms_today() / 1000.0;
+		types[col++] = 2;
+
+		if (m_append_gnss_time) {
+			values[col] = (double)s->gga.ms_today / 1000.0;
+			types[col++] = gga_updated ? 2 : 0;
+		}
+
+		if (m_append_gnss) {
+			values[col] = s->gga.lat;
+			types[col++] = gga_updated ? 2 : 0;
+			values[col] = s->gga.lon;
+			types[col++] = gga_updated ? 2 : 0;
+			values[col] = s->gga.height;
+			types[col++] = gga_updated ? 2 : 0;
+			values[col] = s->gga.h_dop * 4.0;
+			types[col++] = gga_updated ? 2 : 0;
+			values[col] = s->rmc.speed * 3.6;
+			types[col++] = rmc_updated ? 2 : 0;
+		}
+
+		if (format == LOG_FORMAT_BIN) {
+			log_bin_add_row(values, types, cols);
+		} else {
+			log_csv_row(f, values, types, decimals, cols);
+		}
+	}
+}
+
 static void log_task(void *arg) {
 	FILE *f_log = 0;
+	LOG_FORMAT format = LOG_FORMAT_CSV;
+	bool event_mode = false;
 	int gga_cnt_last = 0;
 	int rmc_cnt_last = 0;
 	int64_t ms_last = utils_ms_tot();
@@ -149,23 +638,39 @@ static void log_task(void *arg) {
 				}
 				closedir(dir);
 
+				format = m_format;
+				event_mode = m_event_mode;
+				if (event_mode) {
+					log_event_discard();
+				}
+				const char *ext = format == LOG_FORMAT_BIN ? "bin" : "csv";
+
 				if (date_valid) {
 					sprintf(
 						path,
-						"%slog_can/log_%03d_%02d-%02d-%02d_%02d-%02d-%02d.csv",
+						"%slog_can/log_%03d_%02d-%02d-%02d_%02d-%02d-%02d.%s",
 						file_basepath, highest_index + 1, s->rmc.yy, s->rmc.mo,
-						s->rmc.dd, s->rmc.hh, s->rmc.mm, s->rmc.ss
+						s->rmc.dd, s->rmc.hh, s->rmc.mm, s->rmc.ss, ext
 					);
 				} else {
 					sprintf(
-						path, "%slog_can/log_%03d.csv", file_basepath,
-						highest_index + 1
+						path, "%slog_can/log_%03d.%s", file_basepath,
+						highest_index + 1, ext
 					);
 				}
 				f_log = fopen(path, "w");
 			}
 
-			if (f_log) {
+			if (f_log && format == LOG_FORMAT_BIN) {
+				gga_updated = true;
+				rmc_updated = true;
+
+				if (!log_bin_open(f_log)) {
+					fclose(f_log);
+					f_log = 0;
+					m_field_num = 0;
+				}
+			} else if (f_log) {
 				// To get the first sample
 				gga_updated = true;
 				rmc_updated = true;
@@ -216,11 +721,69 @@ static void log_task(void *arg) {
 		}
 
 		if (m_field_num <= 0 && f_log) {
+			if (format == LOG_FORMAT_BIN) {
+				log_bin_close();
+			}
+
 			fclose(f_log);
 			f_log = 0;
 		}
 
-		if (f_log) {
+		if (f_log && event_mode) {
+			log_event_write(f_log, format, s, gga_updated, rmc_updated);
+
+			if (UTILS_AGE_S(tick_last_fsync) > LOG_BIN_SYNC_S) {
+				tick_last_fsync = xTaskGetTickCount();
+				if (format == LOG_FORMAT_BIN) {
+					if (m_bin.rows > 0) {
+						log_bin_flush(true);
+					}
+				} else {
+					fsync(fileno(f_log));
+				}
+			}
+		} else if (f_log && format == LOG_FORMAT_BIN) {
+			static double values[LOG_BIN_MAX_COLS];
+			static uint8_t types[LOG_BIN_MAX_COLS];
+			int cols = 0;
+
+			for (int i = 0;i < m_field_num;i++) {
+				log_header *h = (log_header*)&m_headers[i];
+				values[cols] = h->value;
+				types[cols++] = h->updated ? (h->is_f64 ? 2 : 1) : 0;
+				h->updated = false;
+			}
+
+			if (m_append_time) {
+				values[cols] = (float)utils_ms_today() / 1000.0;
+				types[cols++] = 2;
+			}
+
+			if (m_append_gnss_time) {
+				values[cols] = (float)s->gga.ms_today / 1000.0;
+				types[cols++] = gga_updated ? 2 : 0;
+			}
+
+			if (m_append_gnss) {
+				values[cols] = s->gga.lat;
+				types[cols++] = gga_updated ? 2 : 0;
+				values[cols] = s->gga.lon;
+				types[cols++] = gga_updated ? 2 : 0;
+				values[cols] = s->gga.height;
+				types[cols++] = gga_updated ? 2 : 0;
+				values[cols] = s->gga.h_dop * 4.0;
+				types[cols++] = gga_updated ? 2 : 0;
+				values[cols] = s->rmc.speed * 3.6;
+				types[cols++] = rmc_updated ? 2 : 0;
+			}
+
+			log_bin_add_row(values, types, cols);
+
+			if (UTILS_AGE_S(tick_last_fsync) > LOG_BIN_SYNC_S) {
+				tick_last_fsync = xTaskGetTickCount();
+				log_bin_flush(true);
+			}
+		} else if (f_log) {
 			for (int i = 0;i < m_field_num;i++) {
 				log_header *h = (log_header*)&m_headers[i];
 				if (h->updated) {
@@ -286,6 +849,12 @@ static void log_task(void *arg) {
 			}
 		}
 
+		if (f_log && event_mode) {
+			vTaskDelay(configTICK_RATE_HZ / 100);
+			ms_last = utils_ms_tot();
+			continue;
+		}
+
 		if (m_rate_hz < 0.1) {
 			m_rate_hz = 10.0;
 		}
@@ -435,6 +1004,22 @@ esp_err_t log_storage_info(size_t *total, size_t *used) {
 }
 #endif
 
+/**
+ * Get the counters for event mode logging.
+ *
+ * @param stats
+ * Current queue depth, highest queue depth, updates dropped because the
+ * queue was full and updates written since logging was started.
+ */
+void log_get_event_stats(log_event_stats *stats) {
+	stats->depth = __atomic_load_n(&m_events.head, __ATOMIC_RELAXED) -
+			__atomic_load_n(&m_events.tail, __ATOMIC_RELAXED);
+	stats->depth_max = m_events.depth_max;
+	stats->dropped = m_events.dropped;
+	stats->written = m_events.written;
+	stats->queue_len = LOG_EVENT_QUEUE_LEN;
+}
+
 bool log_init(void) {
 	for (int i = 0;i < LOG_MAX_FIELDS;i++) {
 		sprintf((char*)m_headers[i].key, "key_h%d", i);
@@ -445,6 +1030,7 @@ bool log_init(void) {
 		m_headers[i].is_timestamp = false;
 		m_headers[i].value = 0.0;
 		m_headers[i].updated = false;
+		m_headers[i].is_f64 = false;
 	}
 
 	// Special headers
@@ -511,7 +1097,11 @@ bool log_init(void) {
 	m_header_hvel.value = 0.0;
 	m_header_hvel.updated = false;
 
+	m_bin.sem_full = xSemaphoreCreateBinary();
+	m_bin.sem_free = xSemaphoreCreateBinary();
+
 	xTaskCreatePinnedToCore(log_task, "log", 3072, NULL, 8, NULL, tskNO_AFFINITY);
+	xTaskCreatePinnedToCore(log_bin_write_task, "log_wr", 3072, NULL, 7, NULL, tskNO_AFFINITY);
 
 	return true;
 }
@@ -532,11 +1122,33 @@ void log_process_packet(unsigned char *data, unsigned int len) {
 		mkdir(path, 0775);
 
 		int32_t ind = 0;
-		m_field_num = buffer_get_int16(data, &ind);
+		int field_num = buffer_get_int16(data, &ind);
 		m_rate_hz = buffer_get_float32_auto(data, &ind);
 		m_append_time = data[ind++];
 		m_append_gnss = data[ind++];
 		m_append_gnss_time = data[ind++];
+
+		// Optional flags, bit 0: binary format, bit 1: event mode
+		uint8_t flags = 0;
+		if (ind < (int32_t)len) {
+			flags = data[ind++];
+		}
+
+		m_format = (flags & 1) ? LOG_FORMAT_BIN : LOG_FORMAT_CSV;
+		m_event_mode = (flags & 2) != 0;
+
+		if (m_event_mode && !log_event_init()) {
+			m_event_mode = false;
+		}
+
+		// Event rows are only useful with their arrival time, so the
+		// time column is always there in event mode.
+		if (m_event_mode) {
+			m_append_time = true;
+		}
+
+		// Set last, the log task starts when this is above 0
+		m_field_num = field_num;
 	} break;
 
 	case COMM_LOG_STOP: {
@@ -573,9 +1185,26 @@ void log_process_packet(unsigned char *data, unsigned int len) {
 			break;
 		}
 
-		while (field_ind < LOG_MAX_FIELDS && ind < len) {
+		// Claim cells for the whole packet so that it ends up in one row
+		bool event = false;
+		uint32_t pos = 0;
+		int num = 0;
+		int32_t time_ms = 0;
+		if (m_event_mode && m_field_num > 0) {
+			num = MIN(LOG_MAX_FIELDS - field_ind, ((int)len - ind + 3) / 4);
+			event = log_event_claim(num, &pos);
+			time_ms = utils_ms_today();
+		}
+
+		for (int i = 0;field_ind < LOG_MAX_FIELDS && ind < len;i++) {
 			m_headers[field_ind].value = buffer_get_float32_auto(data, &ind);
+			m_headers[field_ind].is_f64 = false;
 			m_headers[field_ind].updated = true;
+
+			if (event) {
+				log_event_set(pos + i, num, time_ms, field_ind, m_headers[field_ind].value, false);
+			}
+
 			field_ind++;
 		}
 	} break;
@@ -588,9 +1217,26 @@ void log_process_packet(unsigned char *data, unsigned int len) {
 			break;
 		}
 
-		while (field_ind < LOG_MAX_FIELDS && ind < len) {
+		// Claim cells for the whole packet so that it ends up in one row
+		bool event = false;
+		uint32_t pos = 0;
+		int num = 0;
+		int32_t time_ms = 0;
+		if (m_event_mode && m_field_num > 0) {
+			num = MIN(LOG_MAX_FIELDS - field_ind, ((int)len - ind + 7) / 8);
+			event = log_event_claim(num, &pos);
+			time_ms = utils_ms_today();
+		}
+
+		for (int i = 0;field_ind < LOG_MAX_FIELDS && ind < len;i++) {
 			m_headers[field_ind].value = buffer_get_float64_auto(data, &ind);
+			m_headers[field_ind].is_f64 = true;
 			m_headers[field_ind].updated = true;
+
+			if (event) {
+				log_event_set(pos + i, num, time_ms, field_ind, m_headers[field_ind].value, true);
+			}
+
 			field_ind++;
 		}
 	} break;
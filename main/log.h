@@ -25,6 +25,14 @@
 #include "esp_vfs_fat.h"
 #include "sdmmc_cmd.h"
 
+typedef struct {
+	uint32_t depth;
+	uint32_t depth_max;
+	uint32_t dropped;
+	uint32_t written;
+	uint32_t queue_len;
+} log_event_stats;
+
 // Functions
 bool log_init(void);
 esp_err_t log_mount_card(int pin_mosi, int pin_miso, int pin_sck, int pin_cs, int freq);
@@ -37,6 +45,7 @@ void log_unmount_storage(void);
 esp_err_t log_storage_info(size_t *total, size_t *used);
 #endif
 void log_process_packet(unsigned char *data, unsigned int len);
+void log_get_event_stats(log_event_stats *stats);
 
 // Global variables
 extern char *file_basepath;
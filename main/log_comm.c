@@ -32,7 +32,9 @@ void log_comm_start(
 		float rate_hz,
 		bool append_time,
 		bool append_gnss,
-		bool append_gnss_time) {
+		bool append_gnss_time,
+		bool binary,
+		bool event) {
 
 	int32_t ind = 0;
 	uint8_t buffer[20];
@@ -43,6 +45,7 @@ void log_comm_start(
 	buffer[ind++] = append_time;
 	buffer[ind++] = append_gnss;
 	buffer[ind++] = append_gnss_time;
+	buffer[ind++] = (binary ? 1 : 0) | (event ? 2 : 0);
 
 	log_comm_send(can_id, buffer, ind);
 }
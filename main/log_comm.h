@@ -30,7 +30,9 @@ void log_comm_start(
 		float rate_hz,
 		bool append_time,
 		bool append_gnss,
-		bool append_gnss_time);
+		bool append_gnss_time,
+		bool binary,
+		bool event);
 void log_comm_stop(int can_id);
 void log_comm_config_field(
 		int can_id,
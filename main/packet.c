@@ -131,6 +131,73 @@ void packet_process_byte(uint8_t rx_data, PACKET_STATE_t *state) {
 	}
 }
 
+/**
+ * Process a block of received bytes. This is equivalent to calling
+ * packet_process_byte on every byte, but complete packets are decoded
+ * in place without being copied to the receive buffer first. Only
+ * incomplete packets at the end of the block are kept in the state.
+ *
+ * @param data
+ * The received bytes. Note that process_func gets a pointer into this
+ * buffer, so it must remain valid while processing.
+ *
+ * @param len
+ * The number of bytes in data.
+ *
+ * @param state
+ * The packet state.
+ */
+void packet_process_buffer(uint8_t *data, unsigned int len, PACKET_STATE_t *state) {
+	unsigned int ind = 0;
+
+	// Finish the packet that is already in the receive buffer first
+	while (ind < len && state->rx_write_ptr != state->rx_read_ptr) {
+		// Bytes that cannot complete the packet can be copied directly
+		unsigned int chunk = state->bytes_left > 1 ? state->bytes_left - 1 : 0;
+
+		if (chunk > (len - ind)) {
+			chunk = len - ind;
+		}
+
+		if (chunk > (PACKET_BUFFER_LEN - state->rx_write_ptr)) {
+			chunk = PACKET_BUFFER_LEN - state->rx_write_ptr;
+		}
+
+		if (chunk > 0) {
+			memcpy(state->rx_buffer + state->rx_write_ptr, data + ind, chunk);
+			state->rx_write_ptr += chunk;
+			state->bytes_left -= chunk;
+			ind += chunk;
+		} else {
+			packet_process_byte(data[ind++], state);
+		}
+	}
+
+	while (ind < len) {
+		int bytes_left = 0;
+		int res = try_decode_packet(data + ind, len - ind,
+				state->process_func, &bytes_left);
+
+		if (res > 0) {
+			ind += res;
+		} else if (res == -1) {
+			// Something went wrong. Skip to the next possible start byte.
+			ind++;
+			while (ind < len && (data[ind] < 2 || data[ind] > 4)) {
+				ind++;
+			}
+		} else {
+			// Incomplete packet, keep the rest for the next call. It always
+			// fits as the packet is shorter than the receive buffer.
+			state->rx_read_ptr = 0;
+			state->rx_write_ptr = len - ind;
+			state->bytes_left = bytes_left;
+			memcpy(state->rx_buffer, data + ind, len - ind);
+			break;
+		}
+	}
+}
+
 /**
  * Try if it is possible to decode a packet from a buffer.
  *
@@ -34,6 +34,7 @@
 #endif
 #include "comm_ble.h"
 #include "comm_wifi.h"
+#include "log.h"
 #include "nvs_flash.h"
 #include "esp_partition.h"
 #include "esp_ota_ops.h"
@@ -175,18 +176,86 @@ void terminal_process_string(char *str) {
 		commands_printf(" ");
 	} else if (strcmp(argv[0], "can_devs") == 0) {
 		commands_printf("CAN devices seen on the bus the past second:\n");
-		for (int i = 0;i < CAN_STATUS_MSGS_TO_STORE;i++) {
-			can_status_msg *msg = comm_can_get_status_msg_index(i);
-
-			if (msg->id >= 0 && UTILS_AGE_S(msg->rx_time) < 1.0) {
-				commands_printf("ID                   : %i", msg->id);
-				commands_printf("RX Time              : %i", msg->rx_time);
-				commands_printf("Age (milliseconds)   : %.2f", (double)(UTILS_AGE_S(msg->rx_time) * 1000.0));
-				commands_printf("RPM                  : %.2f", (double)msg->rpm);
-				commands_printf("Current              : %.2f", (double)msg->current);
-				commands_printf("Duty                 : %.2f\n", (double)msg->duty);
+		for (int id = comm_can_get_status_msg_next_id(-1);id >= 0;id = comm_can_get_status_msg_next_id(id)) {
+			can_status_msg msg;
+
+			if (comm_can_get_status_msg_id(id, &msg) && UTILS_AGE_S(msg.rx_time) < 1.0) {
+				commands_printf("ID                   : %i", msg.id);
+				commands_printf("RX Time              : %i", msg.rx_time);
+				commands_printf("Age (milliseconds)   : %.2f", (double)(UTILS_AGE_S(msg.rx_time) * 1000.0));
+				commands_printf("RPM                  : %.2f", (double)msg.rpm);
+				commands_printf("Current              : %.2f", (double)msg.current);
+				commands_printf("Duty                 : %.2f\n", (double)msg.duty);
 			}
 		}
+	} else if (strcmp(argv[0], "can_rx_stats") == 0) {
+		for (int bus = 1;bus <= 2;bus++) {
+			can_rx_stats stats;
+			if (!comm_can_get_rx_stats(bus, &stats)) {
+				continue;
+			}
+
+			commands_printf("CAN%d RX", bus);
+			commands_printf("Standard frames      : %lu", stats.rx_cnt[CAN_ID_CLASS_STD]);
+			commands_printf("Extended frames      : %lu", stats.rx_cnt[CAN_ID_CLASS_EXT]);
+			commands_printf("Standard dropped     : %lu", stats.drop_cnt[CAN_ID_CLASS_STD]);
+			commands_printf("Extended dropped     : %lu", stats.drop_cnt[CAN_ID_CLASS_EXT]);
+			commands_printf("Buffer high water    : %lu / %lu\n", stats.high_water, stats.size);
+		}
+
+		uint32_t filter_passed, filter_rejected;
+		comm_can_filter_get_stats(&filter_passed, &filter_rejected);
+		commands_printf("LispBM filter passed : %lu", filter_passed);
+		commands_printf("LispBM filter reject : %lu\n", filter_rejected);
+
+		if (argc == 2 && strcmp(argv[1], "reset") == 0) {
+			comm_can_reset_rx_stats();
+			comm_can_filter_reset_stats();
+			commands_printf("Statistics reset\n");
+		}
+	} else if (strcmp(argv[0], "can_win") == 0) {
+		if (argc == 2) {
+			if (strcmp(argv[1], "reset") == 0) {
+				comm_can_reset_win_stats();
+				commands_printf("Statistics reset\n");
+				return;
+			}
+
+			int window = -1;
+			sscanf(argv[1], "%d", &window);
+
+			if (window < 0) {
+				commands_printf("Invalid window size\n");
+				return;
+			}
+
+			comm_can_set_buffer_window(window);
+		}
+
+		can_win_stats stats;
+		comm_can_get_win_stats(&stats);
+
+		commands_printf("Window size          : %d", comm_can_get_buffer_window());
+		commands_printf("TX transfers         : %lu", stats.tx_transfers);
+		commands_printf("TX failed            : %lu", stats.tx_failed);
+		commands_printf("TX plain fallback    : %lu", stats.tx_fallback);
+		commands_printf("TX frames            : %lu", stats.tx_frames);
+		commands_printf("TX retransmits       : %lu", stats.tx_retransmits);
+		commands_printf("TX timeouts          : %lu", stats.tx_timeouts);
+		commands_printf("TX throughput        : %.1f kB/s",
+				stats.tx_time_ms > 0 ? (double)stats.tx_bytes / (double)stats.tx_time_ms : 0.0);
+		commands_printf("RX transfers         : %lu", stats.rx_transfers);
+		commands_printf("RX frames            : %lu", stats.rx_frames);
+		commands_printf("RX duplicates        : %lu", stats.rx_duplicates);
+		commands_printf("RX CRC errors        : %lu\n", stats.rx_crc_errors);
+	} else if (strcmp(argv[0], "log_stats") == 0) {
+		log_event_stats stats;
+		log_get_event_stats(&stats);
+
+		commands_printf("Event queue depth    : %lu / %lu", stats.depth, stats.queue_len);
+		commands_printf("Event queue max      : %lu", stats.depth_max);
+		commands_printf("Events dropped       : %lu", stats.dropped);
+		commands_printf("Events written       : %lu\n", stats.written);
 	} else if (strcmp(argv[0], "hw_status") == 0) {
 		commands_printf("Firmware          : %d.%d", FW_VERSION_MAJOR, FW_VERSION_MINOR);
 		commands_printf("Hardware          : %s", HW_NAME);
@@ -292,6 +361,16 @@ void terminal_process_string(char *str) {
 		commands_printf("can_devs");
 		commands_printf("  Print all CAN devices seen on the bus the past second.");
 
+		commands_printf("can_rx_stats [reset]");
+		commands_printf("  Print CAN receive buffer usage, dropped frames and LispBM filter counters, optionally resetting the counters.");
+
+		commands_printf("can_win [window|reset]");
+		commands_printf("  Print windowed CAN buffer transfer counters, optionally setting the window");
+		commands_printf("  size (0 disables windowed transfers) or resetting the counters.");
+
+		commands_printf("log_stats");
+		commands_printf("  Print queue depth and dropped updates for event mode logging.");
+
 		commands_printf("hw_status");
 		commands_printf("  Print some hardware status information.");
 
@@ -0,0 +1,256 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Host stress test of the CAN RX ring in main/can_rx_ring.h, with one
+ * pthread as the rx task and one as the process task.
+ *
+ * - Fill: single-threaded check that the ring holds exactly RXBUF_LEN
+ *   frames and counts the first frame that does not fit.
+ * - Lossless: the producer never gets more than RXBUF_LEN frames ahead,
+ *   so nothing may be dropped. Every frame must arrive intact and in
+ *   order.
+ * - Overflow: the producer pushes bursts without waiting while the
+ *   consumer is slower. Frames that arrive must be intact and in order.
+ *   The per-class drop counters must match the pushes that failed, and
+ *   received plus dropped must equal sent.
+ *
+ * Build and run from the repository root:
+ * gcc -O2 -pthread -Imain tools/can_rx_ring_test.c -o can_rx_ring_test
+ * ./can_rx_ring_test [frames]
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+// Stand-in for the frame type from driver/twai.h, with the fields the ring uses
+typedef struct {
+	uint32_t extd;
+	uint32_t identifier;
+	uint8_t data_length_code;
+	uint8_t data[8];
+} twai_message_t;
+
+#include "can_rx_ring.h"
+
+typedef struct {
+	can_rx_ring ring;
+	unsigned int frames;
+	bool flow_control;
+	unsigned int burst;
+	volatile bool done;
+	uint32_t push_failed[CAN_ID_CLASS_NUM];
+	uint32_t received;
+	uint32_t errors;
+} ring_test;
+
+static void frame_make(twai_message_t *msg, uint32_t seq) {
+	msg->extd = seq % 3 == 0;
+	msg->identifier = seq & (msg->extd ? 0x1FFFFFFF : 0x7FF);
+	msg->data_length_code = 8;
+	for (int i = 0;i < 8;i++) {
+		msg->data[i] = (uint8_t)(seq >> ((i % 4) * 8)) ^ i;
+	}
+}
+
+static bool frame_check(const twai_message_t *msg, uint32_t seq) {
+	twai_message_t ref;
+	frame_make(&ref, seq);
+	return msg->extd == ref.extd && msg->identifier == ref.identifier &&
+			msg->data_length_code == ref.data_length_code &&
+			memcmp(msg->data, ref.data, 8) == 0;
+}
+
+// The sequence number is not in the frame for standard ids, so recover it from the data
+static uint32_t frame_seq(const twai_message_t *msg) {
+	uint32_t seq = 0;
+	for (int i = 0;i < 4;i++) {
+		seq |= (uint32_t)(msg->data[i] ^ i) << (i * 8);
+	}
+	return seq;
+}
+
+static void *producer(void *arg) {
+	ring_test *t = (ring_test*)arg;
+	twai_message_t msg;
+
+	for (uint32_t seq = 0;seq < t->frames;seq++) {
+		if (t->flow_control) {
+			while ((t->ring.write - __atomic_load_n(&t->ring.read, __ATOMIC_ACQUIRE)) >= RXBUF_LEN) {
+				sched_yield();
+			}
+		}
+
+		frame_make(&msg, seq);
+		if (!rx_ring_push(&t->ring, &msg)) {
+			t->push_failed[msg.extd ? CAN_ID_CLASS_EXT : CAN_ID_CLASS_STD]++;
+		}
+
+		if (t->burst && (seq % t->burst) == (t->burst - 1)) {
+			sched_yield();
+		}
+	}
+
+	__atomic_store_n(&t->done, true, __ATOMIC_RELEASE);
+	return 0;
+}
+
+static void *consumer(void *arg) {
+	ring_test *t = (ring_test*)arg;
+	int64_t seq_last = -1;
+	unsigned int cnt = 0;
+
+	for (;;) {
+		twai_message_t *msg = rx_ring_peek(&t->ring);
+
+		if (!msg) {
+			if (__atomic_load_n(&t->done, __ATOMIC_ACQUIRE) && !rx_ring_peek(&t->ring)) {
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+
+		uint32_t seq = frame_seq(msg);
+		if ((int64_t)seq <= seq_last || !frame_check(msg, seq)) {
+			if (t->errors < 10) {
+				printf("  Bad frame %u after %lld\n", seq, (long long)seq_last);
+			}
+			t->errors++;
+		}
+
+		if (t->flow_control && (int64_t)seq != seq_last + 1) {
+			t->errors++;
+		}
+
+		seq_last = seq;
+		rx_ring_pop(&t->ring);
+		t->received++;
+
+		// Make the consumer slower than the producer when testing overflow
+		if (!t->flow_control && (++cnt % 16) == 0) {
+			sched_yield();
+		}
+	}
+
+	return 0;
+}
+
+static int run(const char *name, unsigned int frames, bool flow_control, unsigned int burst) {
+	static ring_test t;
+	memset(&t, 0, sizeof(t));
+	t.frames = frames;
+	t.flow_control = flow_control;
+	t.burst = burst;
+
+	pthread_t th_prod, th_cons;
+	pthread_create(&th_cons, 0, consumer, &t);
+	pthread_create(&th_prod, 0, producer, &t);
+	pthread_join(th_prod, 0);
+	pthread_join(th_cons, 0);
+
+	uint32_t rx = t.ring.stats.rx_cnt[CAN_ID_CLASS_STD] + t.ring.stats.rx_cnt[CAN_ID_CLASS_EXT];
+	uint32_t drop = t.ring.stats.drop_cnt[CAN_ID_CLASS_STD] + t.ring.stats.drop_cnt[CAN_ID_CLASS_EXT];
+	int errors = t.errors;
+
+	if (t.ring.stats.drop_cnt[CAN_ID_CLASS_STD] != t.push_failed[CAN_ID_CLASS_STD] ||
+			t.ring.stats.drop_cnt[CAN_ID_CLASS_EXT] != t.push_failed[CAN_ID_CLASS_EXT]) {
+		printf("  Drop count does not match failed pushes\n");
+		errors++;
+	}
+
+	if (rx != t.received || rx + drop != frames) {
+		printf("  Counts do not add up\n");
+		errors++;
+	}
+
+	if (flow_control && drop != 0) {
+		printf("  Frames dropped below capacity\n");
+		errors++;
+	}
+
+	if (t.ring.stats.high_water > RXBUF_LEN) {
+		printf("  High water above capacity\n");
+		errors++;
+	}
+
+	printf("%-10s sent %u received %u dropped %u (std %u ext %u) high water %u: %s\n",
+			name, frames, t.received, drop,
+			t.ring.stats.drop_cnt[CAN_ID_CLASS_STD], t.ring.stats.drop_cnt[CAN_ID_CLASS_EXT],
+			t.ring.stats.high_water, errors ? "FAILED" : "ok");
+
+	return errors;
+}
+
+static int run_fill(void) {
+	static can_rx_ring ring;
+	twai_message_t msg;
+	int errors = 0;
+
+	memset(&ring, 0, sizeof(ring));
+
+	for (uint32_t seq = 0;seq < RXBUF_LEN;seq++) {
+		frame_make(&msg, seq);
+		if (!rx_ring_push(&ring, &msg)) {
+			errors++;
+		}
+	}
+
+	frame_make(&msg, 1);
+	if (rx_ring_push(&ring, &msg) || ring.stats.drop_cnt[CAN_ID_CLASS_STD] != 1 ||
+			ring.stats.high_water != RXBUF_LEN) {
+		errors++;
+	}
+
+	for (uint32_t seq = 0;seq < RXBUF_LEN;seq++) {
+		twai_message_t *m = rx_ring_peek(&ring);
+		if (!m || !frame_check(m, seq)) {
+			errors++;
+			break;
+		}
+		rx_ring_pop(&ring);
+	}
+
+	if (rx_ring_peek(&ring)) {
+		errors++;
+	}
+
+	printf("%-10s capacity %d: %s\n", "Fill", RXBUF_LEN, errors ? "FAILED" : "ok");
+	return errors;
+}
+
+int main(int argc, char **argv) {
+	unsigned int frames = 2000000;
+
+	if (argc > 1) {
+		frames = atoi(argv[1]);
+	}
+
+	int errors = 0;
+	errors += run_fill();
+	errors += run("Lossless", frames, true, 0);
+	errors += run("Overflow", frames, false, RXBUF_LEN * 4);
+
+	return errors ? 1 : 0;
+}
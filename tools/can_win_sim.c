@@ -0,0 +1,231 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Host simulation of the windowed CAN buffer transfer in main/can_win.c on
+ * a lossy bus. Every frame, in both directions, is lost with the given
+ * probability. The bus is modeled as serial with a fixed time per frame,
+ * and a lost ack is only noticed by the sender after the ack timeout.
+ *
+ * For comparison the plain transfer from comm_can_send_buffer is modeled
+ * too. It has no acks, so a single lost frame means that the whole buffer
+ * has to be sent again by the layer above.
+ *
+ * Build and run from the repository root:
+ * gcc -O2 -Imain tools/can_win_sim.c main/can_win.c main/crc.c -o can_win_sim
+ * ./can_win_sim [loss] [window] [len] [transfers]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "can_win.h"
+
+#define FRAME_US			260 // 29-bit id and 8 bytes at 500 kbit/s
+#define ACK_TIMEOUT_US		20000
+#define QUEUE_LEN			(CAN_WIN_MAX_WINDOW * 4)
+
+typedef struct {
+	unsigned int seq[QUEUE_LEN];
+	int num;
+} frame_queue;
+
+static double loss = 0.01;
+
+static bool frame_lost(void) {
+	return ((double)rand() / RAND_MAX) < loss;
+}
+
+static void queue_frame(unsigned int seq, const uint8_t *data, unsigned int len, void *arg) {
+	(void)data; (void)len;
+	frame_queue *q = (frame_queue*)arg;
+	if (q->num < QUEUE_LEN) {
+		q->seq[q->num++] = seq;
+	}
+}
+
+// Returns true if the buffer arrived intact. Time spent is added to time_us.
+static bool run_transfer(const uint8_t *data, unsigned int len, unsigned int window,
+		can_win_stats *stats, can_win_rx *rx, double *time_us) {
+	can_win_tx tx;
+	uint8_t frame[8];
+
+	if (!can_win_tx_init(&tx, data, len, window, stats)) {
+		return false;
+	}
+
+	// Start frame and its ack. The firmware falls back to the plain
+	// transfer here, the simulation just tries again.
+	for (;;) {
+		int start_len = can_win_tx_encode_start(&tx, 2, 0, frame);
+		*time_us += FRAME_US;
+		if (!frame_lost() && can_win_rx_start(rx, frame, start_len)) {
+			*time_us += FRAME_US;
+			if (!frame_lost()) {
+				break;
+			}
+		}
+		*time_us += ACK_TIMEOUT_US;
+	}
+
+	frame_queue q;
+	q.num = 0;
+	can_win_tx_fill(&tx, queue_frame, &q);
+
+	while (!can_win_tx_finished(&tx)) {
+		if (q.num == 0) {
+			*time_us += ACK_TIMEOUT_US;
+			if (!can_win_tx_timeout(&tx)) {
+				stats->tx_failed++;
+				return false;
+			}
+			can_win_tx_fill(&tx, queue_frame, &q);
+			continue;
+		}
+
+		unsigned int seq = q.seq[0];
+		q.num--;
+		memmove(q.seq, q.seq + 1, q.num * sizeof(q.seq[0]));
+
+		*time_us += FRAME_US;
+		if (frame_lost()) {
+			continue;
+		}
+
+		unsigned int offset = seq * CAN_WIN_FRAME_DATA;
+		unsigned int flen = len - offset;
+		if (flen > CAN_WIN_FRAME_DATA) {
+			flen = CAN_WIN_FRAME_DATA;
+		}
+
+		frame[0] = seq >> 8;
+		frame[1] = seq & 0xFF;
+		memcpy(frame + 2, data + offset, flen);
+
+		CAN_WIN_RX_RES res = can_win_rx_data(rx, frame, flen + 2);
+		if (res == CAN_WIN_RX_NONE) {
+			continue;
+		}
+
+		if (res == CAN_WIN_RX_DONE && memcmp(rx->buffer, data, len) != 0) {
+			printf("Buffer mismatch\n");
+			exit(1);
+		}
+
+		int ack_len = can_win_rx_encode_ack(rx, 1, frame);
+		*time_us += FRAME_US;
+		if (frame_lost()) {
+			continue;
+		}
+
+		can_win_tx_ack(&tx, frame, ack_len);
+		can_win_tx_fill(&tx, queue_frame, &q);
+	}
+
+	if (tx.status != CAN_WIN_STATUS_DONE) {
+		stats->tx_failed++;
+		return false;
+	}
+
+	stats->tx_transfers++;
+	stats->tx_bytes += len;
+	return true;
+}
+
+// Frames used by comm_can_send_buffer for a buffer of len bytes
+static unsigned int plain_frames(unsigned int len) {
+	if (len <= 6) {
+		return 1;
+	}
+
+	unsigned int short_bytes = len < 259 ? len : 259;
+	unsigned int frames = (short_bytes + 6) / 7;
+	if (len > short_bytes) {
+		frames += (len - short_bytes + 5) / 6;
+	}
+
+	return frames + 1;
+}
+
+int main(int argc, char **argv) {
+	unsigned int window = 8;
+	unsigned int len = CAN_WIN_MAX_LEN;
+	int transfers = 1000;
+
+	if (argc > 1) {
+		loss = atof(argv[1]);
+	}
+
+	if (argc > 2) {
+		window = atoi(argv[2]);
+	}
+
+	if (argc > 3) {
+		len = atoi(argv[3]);
+	}
+
+	if (argc > 4) {
+		transfers = atoi(argv[4]);
+	}
+
+	if (len < 1 || len > CAN_WIN_MAX_LEN) {
+		printf("len must be 1 to %d\n", CAN_WIN_MAX_LEN);
+		return 1;
+	}
+
+	srand(1234);
+
+	static uint8_t data[CAN_WIN_MAX_LEN];
+	static can_win_rx rx;
+	can_win_stats stats;
+	memset(&stats, 0, sizeof(stats));
+	can_win_rx_init(&rx, &stats);
+
+	double time_us = 0.0;
+	for (int i = 0;i < transfers;i++) {
+		for (unsigned int j = 0;j < len;j++) {
+			data[j] = rand();
+		}
+
+		run_transfer(data, len, window, &stats, &rx, &time_us);
+	}
+
+	// The plain transfer is retried until all frames get through
+	unsigned int frames = plain_frames(len);
+	double p_ok = 1.0;
+	for (unsigned int i = 0;i < frames;i++) {
+		p_ok *= 1.0 - loss;
+	}
+
+	printf("Loss %.3f, window %u, %u bytes, %d transfers\n", loss, window, len, transfers);
+	printf("Windowed\n");
+	printf("  Completed      : %u\n", stats.tx_transfers);
+	printf("  Failed         : %u\n", stats.tx_failed);
+	printf("  Frames         : %u\n", stats.tx_frames);
+	printf("  Retransmits    : %u\n", stats.tx_retransmits);
+	printf("  Timeouts       : %u\n", stats.tx_timeouts);
+	printf("  RX duplicates  : %u\n", stats.rx_duplicates);
+	printf("  Throughput     : %.1f kB/s\n", stats.tx_bytes / time_us * 1e3);
+	printf("Plain\n");
+	printf("  Success rate   : %.3f\n", p_ok);
+	printf("  Throughput     : %.1f kB/s\n", p_ok > 0.0 ? len * p_ok / (frames * FRAME_US) * 1e3 : 0.0);
+
+	return stats.tx_failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,240 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Host check and benchmark of main/crc.c for every CRC_TABLE_SLICES
+ * setting. crc.c is included once per setting with the functions renamed,
+ * so that all of them end up in the same program.
+ *
+ * Each setting is compared against the one-table (byte-wise) version and
+ * against a bit-wise reference on random lengths, alignments and start
+ * values. The throughput of each setting is then measured on a large
+ * buffer.
+ *
+ * Build and run from the repository root:
+ * gcc -O2 -Imain tools/crc_bench.c -o crc_bench
+ * ./crc_bench [tests] [bench_mb]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CRC_TABLE_SLICES	1
+#define crc16				crc16_s1
+#define crc16_with_init		crc16_with_init_s1
+#define crc32_with_init		crc32_with_init_s1
+#define crc16_tab			crc16_tab_s1
+#define crc32_tab			crc32_tab_s1
+#include "crc.c"
+#undef CRC_TABLE_SLICES
+#undef crc16
+#undef crc16_with_init
+#undef crc32_with_init
+#undef crc16_tab
+#undef crc32_tab
+#undef CRC_H_
+
+#define CRC_TABLE_SLICES	4
+#define crc16				crc16_s4
+#define crc16_with_init		crc16_with_init_s4
+#define crc32_with_init		crc32_with_init_s4
+#define crc16_tab			crc16_tab_s4
+#define crc32_tab			crc32_tab_s4
+#include "crc.c"
+#undef CRC_TABLE_SLICES
+#undef crc16
+#undef crc16_with_init
+#undef crc32_with_init
+#undef crc16_tab
+#undef crc32_tab
+#undef CRC_H_
+
+#define CRC_TABLE_SLICES	8
+#define crc16				crc16_s8
+#define crc16_with_init		crc16_with_init_s8
+#define crc32_with_init		crc32_with_init_s8
+#define crc16_tab			crc16_tab_s8
+#define crc32_tab			crc32_tab_s8
+#include "crc.c"
+#undef CRC_TABLE_SLICES
+#undef crc16
+#undef crc16_with_init
+#undef crc32_with_init
+#undef crc16_tab
+#undef crc32_tab
+
+#define MAX_LEN				4096
+#define ALIGN_MAX			8
+
+typedef struct {
+	const char *name;
+	unsigned short (*crc16)(unsigned char *buf, unsigned int len, unsigned short cksum);
+	uint32_t (*crc32)(const uint8_t *buf, uint32_t len, uint32_t cksum);
+} crc_impl;
+
+static const crc_impl impls[] = {
+	{"1", crc16_with_init_s1, crc32_with_init_s1},
+	{"4", crc16_with_init_s4, crc32_with_init_s4},
+	{"8", crc16_with_init_s8, crc32_with_init_s8},
+};
+
+#define IMPL_NUM			((int)(sizeof(impls) / sizeof(impls[0])))
+
+// CRC16-CCITT (XMODEM), one bit at a time
+static unsigned short crc16_ref(const uint8_t *buf, unsigned int len, unsigned short cksum) {
+	while (len--) {
+		cksum ^= (unsigned short)*buf++ << 8;
+		for (int i = 0;i < 8;i++) {
+			cksum = (cksum & 0x8000) ? (cksum << 1) ^ 0x1021 : cksum << 1;
+		}
+	}
+	return cksum;
+}
+
+// CRC32 as in zlib, one bit at a time
+static uint32_t crc32_ref(const uint8_t *buf, uint32_t len, uint32_t cksum) {
+	cksum = ~cksum;
+	while (len--) {
+		cksum ^= *buf++;
+		for (int i = 0;i < 8;i++) {
+			cksum = (cksum & 1) ? (cksum >> 1) ^ 0xEDB88320 : cksum >> 1;
+		}
+	}
+	return ~cksum;
+}
+
+static double time_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static int check(int tests) {
+	static uint8_t data[MAX_LEN + ALIGN_MAX];
+	int errors = 0;
+
+	for (unsigned int i = 0;i < sizeof(data);i++) {
+		data[i] = rand();
+	}
+
+	// The known check values for "123456789"
+	const uint8_t *check_str = (const uint8_t*)"123456789";
+	for (int i = 0;i < IMPL_NUM;i++) {
+		if (impls[i].crc16((unsigned char*)check_str, 9, 0) != 0x31C3 ||
+				impls[i].crc32(check_str, 9, 0) != 0xCBF43926) {
+			printf("Slices %s: wrong check value\n", impls[i].name);
+			errors++;
+		}
+	}
+
+	for (int t = 0;t < tests;t++) {
+		// Mostly short lengths, where the tail loop matters most
+		unsigned int len = (t % 4) ? rand() % 64 : rand() % (MAX_LEN + 1);
+		unsigned int align = rand() % ALIGN_MAX;
+		unsigned short init16 = rand();
+		uint32_t init32 = ((uint32_t)rand() << 16) ^ rand();
+		uint8_t *buf = data + align;
+
+		unsigned short ref16 = crc16_ref(buf, len, init16);
+		uint32_t ref32 = crc32_ref(buf, len, init32);
+		unsigned short byte16 = impls[0].crc16(buf, len, init16);
+		uint32_t byte32 = impls[0].crc32(buf, len, init32);
+
+		for (int i = 0;i < IMPL_NUM;i++) {
+			unsigned short c16 = impls[i].crc16(buf, len, init16);
+			uint32_t c32 = impls[i].crc32(buf, len, init32);
+
+			if (c16 != ref16 || c16 != byte16 || c32 != ref32 || c32 != byte32) {
+				if (errors < 10) {
+					printf("Slices %s: mismatch at len %u align %u: "
+							"crc16 0x%04X (byte 0x%04X ref 0x%04X) "
+							"crc32 0x%08X (byte 0x%08X ref 0x%08X)\n",
+							impls[i].name, len, align, c16, byte16, ref16,
+							(unsigned int)c32, (unsigned int)byte32, (unsigned int)ref32);
+				}
+				errors++;
+			}
+		}
+	}
+
+	return errors;
+}
+
+static void bench(int mb) {
+	const unsigned int len = 64 * 1024;
+	int rounds = mb * 16;
+	uint8_t *buf = malloc(len + 1);
+
+	for (unsigned int i = 0;i < len + 1;i++) {
+		buf[i] = rand();
+	}
+
+	printf("%-8s %-8s %12s %12s\n", "Slices", "Align", "CRC16 MB/s", "CRC32 MB/s");
+
+	for (int i = 0;i < IMPL_NUM;i++) {
+		for (int align = 0;align < 2;align++) {
+			volatile uint32_t sink = 0;
+
+			double t0 = time_s();
+			for (int r = 0;r < rounds;r++) {
+				sink += impls[i].crc16(buf + align, len, r);
+			}
+			double t16 = time_s() - t0;
+
+			t0 = time_s();
+			for (int r = 0;r < rounds;r++) {
+				sink += impls[i].crc32(buf + align, len, r);
+			}
+			double t32 = time_s() - t0;
+
+			double total_mb = (double)len * rounds / (1024.0 * 1024.0);
+			printf("%-8s %-8d %12.1f %12.1f\n", impls[i].name, align,
+					total_mb / t16, total_mb / t32);
+			(void)sink;
+		}
+	}
+
+	free(buf);
+}
+
+int main(int argc, char **argv) {
+	int tests = 100000;
+	int bench_mb = 64;
+
+	if (argc > 1) {
+		tests = atoi(argv[1]);
+	}
+
+	if (argc > 2) {
+		bench_mb = atoi(argv[2]);
+	}
+
+	srand(1234);
+
+	int errors = check(tests);
+	printf("%d random tests, %d errors\n\n", tests, errors);
+
+	if (bench_mb > 0) {
+		bench(bench_mb);
+	}
+
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""
+Convert binary CAN logs (log_*.bin) written by main/log.c to the same CSV
+layout as the text logs.
+
+Blocks that are truncated or fail the CRC check, for example after a power
+loss while logging, are skipped and reported on stderr.
+
+Usage:
+    python log_bin_to_csv.py <input.bin> [output.csv]
+
+If output.csv is not specified, the output is written next to the input
+with the extension changed to .csv.
+"""
+
+import sys
+import os
+import struct
+
+BLOCK_SYNC = 0x564C4253
+BLOCK_HDR_LEN = 12
+
+
+def crc16(data: bytes) -> int:
+    """CRC-16/XMODEM, same as crc16 in main/crc.c."""
+    crc = 0
+    for b in data:
+        crc ^= b << 8
+        for _ in range(8):
+            if crc & 0x8000:
+                crc = ((crc << 1) ^ 0x1021) & 0xFFFF
+            else:
+                crc = (crc << 1) & 0xFFFF
+    return crc
+
+
+def read_cstr(data: bytes, ind: int):
+    end = data.index(b"\0", ind)
+    return data[ind:end].decode("utf-8", errors="replace"), end + 1
+
+
+def parse_header(data: bytes):
+    if data[0:4] != b"VLOG":
+        raise ValueError("Not a binary log file")
+
+    version = data[4]
+    if version != 1:
+        raise ValueError(f"Unsupported version {version}")
+
+    hdr_len, block_size = struct.unpack_from(">IH", data, 5)
+    rate = struct.unpack_from(">f", data, 11)[0]
+    cols = struct.unpack_from(">H", data, 15)[0]
+
+    ind = 17
+    columns = []
+    for _ in range(cols):
+        key, ind = read_cstr(data, ind)
+        name, ind = read_cstr(data, ind)
+        unit, ind = read_cstr(data, ind)
+        precision = struct.unpack_from(">b", data, ind)[0]
+        is_relative, is_timestamp, decimals = data[ind + 1:ind + 4]
+        ind += 4
+        columns.append((key, name, unit, precision, is_relative, is_timestamp, decimals))
+
+    crc = struct.unpack_from(">H", data, ind)[0]
+    if crc16(data[:ind]) != crc:
+        raise ValueError("Header CRC mismatch")
+
+    return hdr_len, block_size, rate, columns
+
+
+def decode_rows(payload: bytes, rows: int, columns):
+    cols = len(columns)
+    map_len = (cols + 3) // 4
+    ind = 0
+
+    for _ in range(rows):
+        types = payload[ind:ind + map_len]
+        ind += map_len
+
+        cells = []
+        for i in range(cols):
+            t = (types[i // 4] >> (2 * (i % 4))) & 3
+            if t == 0:
+                cells.append("")
+                continue
+
+            if t == 1:
+                value = struct.unpack_from(">f", payload, ind)[0]
+                ind += 4
+            else:
+                value = struct.unpack_from(">d", payload, ind)[0]
+                ind += 8
+
+            cells.append(f"{value:.{columns[i][6]}f}")
+
+        yield ";".join(cells)
+
+
+def convert(path_in: str, path_out: str) -> int:
+    with open(path_in, "rb") as f:
+        data = f.read()
+
+    hdr_len, block_size, _, columns = parse_header(data)
+
+    bad_blocks = 0
+    rows_tot = 0
+
+    with open(path_out, "w") as out:
+        out.write(";".join(
+            f"{c[0]}:{c[1]}:{c[2]}:{c[3]}:{c[4]}:{c[5]}" for c in columns) + "\n")
+
+        for start in range(hdr_len, len(data), block_size):
+            block = data[start:start + block_size]
+
+            if len(block) < block_size:
+                bad_blocks += 1
+                continue
+
+            sync, _, length, rows = struct.unpack_from(">IIHH", block, 0)
+            crc = struct.unpack_from(">H", block, block_size - 2)[0]
+
+            if sync != BLOCK_SYNC or crc16(block[:block_size - 2]) != crc:
+                bad_blocks += 1
+                continue
+
+            payload = block[BLOCK_HDR_LEN:BLOCK_HDR_LEN + length]
+            for line in decode_rows(payload, rows, columns):
+                out.write(line + "\n")
+                rows_tot += 1
+
+    if bad_blocks > 0:
+        print(f"Skipped {bad_blocks} damaged block(s)", file=sys.stderr)
+
+    print(f"Wrote {rows_tot} rows to {path_out}")
+    return 0
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        return 1
+
+    path_in = sys.argv[1]
+    if len(sys.argv) > 2:
+        path_out = sys.argv[2]
+    else:
+        path_out = os.path.splitext(path_in)[0] + ".csv"
+
+    try:
+        return convert(path_in, path_out)
+    except ValueError as e:
+        print(f"Error: {e}", file=sys.stderr)
+        return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,396 @@
+/*
+	Copyright 2024 Benjamin Vedder	benjamin@vedder.se
+
+	This file is part of the VESC firmware.
+
+	The VESC firmware is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    The VESC firmware is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+    */
+
+/*
+ * Host benchmark of the packet decoder in main/packet.c. A stream of
+ * encoded packets is fed to packet_process_byte one byte at a time and to
+ * packet_process_buffer in blocks of different sizes, as they would come
+ * from a UART or a TCP socket.
+ *
+ * Three things are measured:
+ * - Throughput in MB/s and time per packet for a few payload sizes.
+ * - Latency from the start of the call that receives the last byte of a
+ *   packet until the packet is handed to process_func.
+ * - Resync on a corrupted stream. Some packets get a byte changed and
+ *   some get garbage in front of them. Every intact packet should still
+ *   come through, and both paths should deliver the same packets.
+ *
+ * Build and run from the repository root:
+ * gcc -O2 -Imain tools/packet_bench.c main/packet.c main/crc.c -o packet_bench
+ * ./packet_bench [packets] [corrupt_percent]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "packet.h"
+
+#define STREAM_MAX			(64 * 1024 * 1024)
+
+typedef struct {
+	uint8_t *data;
+	unsigned int len;
+	int packets;
+	uint8_t *intact; // Packets that were not corrupted
+} packet_stream;
+
+typedef struct {
+	int received;
+	int bad; // Payload that does not match what was sent
+	int out_of_order;
+	int last_seq;
+	uint8_t *seen;
+	int seen_len;
+	uint32_t *order; // Sequence numbers in the order they arrived
+	int order_len;
+	double call_start;
+	double lat_sum;
+	double lat_max;
+	double *lat;
+	int lat_len;
+} packet_rx;
+
+static packet_stream m_stream;
+static packet_rx m_rx;
+static bool m_measure_latency = false;
+
+static double time_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static uint8_t payload_byte(uint32_t seq, unsigned int i) {
+	return (uint8_t)(seq * 31 + i * 7);
+}
+
+static void stream_append(unsigned char *data, unsigned int len) {
+	if (m_stream.len + len <= STREAM_MAX) {
+		memcpy(m_stream.data + m_stream.len, data, len);
+		m_stream.len += len;
+	}
+}
+
+static void rx_packet(unsigned char *data, unsigned int len) {
+	if (m_measure_latency) {
+		double lat = time_s() - m_rx.call_start;
+		m_rx.lat_sum += lat;
+		if (lat > m_rx.lat_max) {
+			m_rx.lat_max = lat;
+		}
+		if (m_rx.lat_len < m_stream.packets) {
+			m_rx.lat[m_rx.lat_len++] = lat;
+		}
+	}
+
+	m_rx.received++;
+
+	if (len < 4) {
+		m_rx.bad++;
+		return;
+	}
+
+	uint32_t seq = (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 |
+			(uint32_t)data[2] << 8 | (uint32_t)data[3];
+
+	for (unsigned int i = 4;i < len;i++) {
+		if (data[i] != payload_byte(seq, i)) {
+			m_rx.bad++;
+			return;
+		}
+	}
+
+	if ((int)seq >= m_stream.packets) {
+		m_rx.bad++;
+		return;
+	}
+
+	if ((int)seq <= m_rx.last_seq) {
+		m_rx.out_of_order++;
+	}
+
+	m_rx.last_seq = seq;
+	m_rx.seen[seq] = 1;
+
+	if (m_rx.order && m_rx.order_len < m_stream.packets) {
+		m_rx.order[m_rx.order_len++] = seq;
+	}
+}
+
+/*
+ * Encode packets with payloads between len_min and len_max bytes. With
+ * corrupt_percent above 0 that share of the packets gets either one byte
+ * changed or up to 16 garbage bytes in front of it.
+ */
+static void stream_make(int packets, unsigned int len_min, unsigned int len_max, int corrupt_percent) {
+	static PACKET_STATE_t tx;
+	static uint8_t payload[PACKET_MAX_PL_LEN];
+
+	packet_init(stream_append, 0, &tx);
+	m_stream.len = 0;
+	m_stream.packets = packets;
+	memset(m_stream.intact, 1, packets);
+
+	for (int p = 0;p < packets;p++) {
+		unsigned int len = len_min + (len_max > len_min ? rand() % (len_max - len_min + 1) : 0);
+		payload[0] = p >> 24;
+		payload[1] = p >> 16;
+		payload[2] = p >> 8;
+		payload[3] = p;
+		for (unsigned int i = 4;i < len;i++) {
+			payload[i] = payload_byte(p, i);
+		}
+
+		bool corrupt = corrupt_percent > 0 && (rand() % 100) < corrupt_percent;
+		bool garbage = corrupt && (rand() & 1);
+
+		if (garbage) {
+			int n = 1 + rand() % 16;
+			for (int i = 0;i < n;i++) {
+				uint8_t b = rand();
+				stream_append(&b, 1);
+			}
+		}
+
+		unsigned int start = m_stream.len;
+		packet_send_packet(payload, len, &tx);
+
+		if (corrupt && !garbage) {
+			unsigned int pos = start + rand() % (m_stream.len - start);
+			m_stream.data[pos] ^= 1 + rand() % 255;
+			m_stream.intact[p] = 0;
+		}
+	}
+}
+
+static void rx_reset(void) {
+	m_rx.received = 0;
+	m_rx.bad = 0;
+	m_rx.out_of_order = 0;
+	m_rx.last_seq = -1;
+	m_rx.order_len = 0;
+	m_rx.lat_sum = 0.0;
+	m_rx.lat_max = 0.0;
+	m_rx.lat_len = 0;
+	memset(m_rx.seen, 0, m_rx.seen_len);
+}
+
+// Feed the whole stream. block 0 means one byte at a time with packet_process_byte.
+static double stream_feed(unsigned int block) {
+	static PACKET_STATE_t rx;
+	packet_init(0, rx_packet, &rx);
+	rx_reset();
+
+	double t0 = time_s();
+
+	if (block == 0) {
+		for (unsigned int i = 0;i < m_stream.len;i++) {
+			m_rx.call_start = m_measure_latency ? time_s() : 0.0;
+			packet_process_byte(m_stream.data[i], &rx);
+		}
+	} else {
+		for (unsigned int i = 0;i < m_stream.len;i += block) {
+			unsigned int len = m_stream.len - i < block ? m_stream.len - i : block;
+			m_rx.call_start = m_measure_latency ? time_s() : 0.0;
+			packet_process_buffer(m_stream.data + i, len, &rx);
+		}
+	}
+
+	return time_s() - t0;
+}
+
+static const unsigned int blocks[] = {0, 1, 16, 64, 512, 4096};
+#define BLOCK_NUM			((int)(sizeof(blocks) / sizeof(blocks[0])))
+
+static const char *block_name(unsigned int block, char *buf) {
+	if (block == 0) {
+		return "byte";
+	}
+	sprintf(buf, "buf %u", block);
+	return buf;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double da = *(const double*)a;
+	double db = *(const double*)b;
+	return da < db ? -1 : (da > db ? 1 : 0);
+}
+
+static void bench_throughput(int packets) {
+	static const unsigned int sizes[][2] = {{8, 8}, {64, 64}, {PACKET_MAX_PL_LEN, PACKET_MAX_PL_LEN}, {4, PACKET_MAX_PL_LEN}};
+	char name[20];
+
+	printf("Throughput\n");
+	printf("%-12s %-10s %10s %10s\n", "Payload", "Input", "MB/s", "ns/packet");
+
+	for (unsigned int s = 0;s < sizeof(sizes) / sizeof(sizes[0]);s++) {
+		stream_make(packets, sizes[s][0], sizes[s][1], 0);
+
+		char size_name[20];
+		if (sizes[s][0] == sizes[s][1]) {
+			sprintf(size_name, "%u", sizes[s][0]);
+		} else {
+			sprintf(size_name, "%u-%u", sizes[s][0], sizes[s][1]);
+		}
+
+		for (int b = 0;b < BLOCK_NUM;b++) {
+			// Best of three to reduce noise from other processes
+			double t = 1e9;
+			for (int r = 0;r < 3;r++) {
+				double tr = stream_feed(blocks[b]);
+				if (tr < t) {
+					t = tr;
+				}
+			}
+
+			if (m_rx.received != packets || m_rx.bad || m_rx.out_of_order) {
+				printf("%-12s %-10s received %d of %d, %d bad, %d out of order\n",
+						size_name, block_name(blocks[b], name), m_rx.received, packets,
+						m_rx.bad, m_rx.out_of_order);
+				continue;
+			}
+
+			printf("%-12s %-10s %10.1f %10.1f\n", size_name, block_name(blocks[b], name),
+					(double)m_stream.len / t / (1024.0 * 1024.0), t * 1e9 / packets);
+		}
+	}
+
+	printf("\n");
+}
+
+static void bench_latency(int packets) {
+	char name[20];
+
+	printf("Latency from the start of the call to process_func, payload 4-%d\n", PACKET_MAX_PL_LEN);
+	printf("%-10s %10s %10s %10s\n", "Input", "avg ns", "p99 ns", "max ns");
+
+	stream_make(packets, 4, PACKET_MAX_PL_LEN, 0);
+	m_measure_latency = true;
+
+	for (int b = 0;b < BLOCK_NUM;b++) {
+		stream_feed(blocks[b]);
+
+		if (m_rx.lat_len == 0) {
+			continue;
+		}
+
+		qsort(m_rx.lat, m_rx.lat_len, sizeof(double), cmp_double);
+		printf("%-10s %10.1f %10.1f %10.1f\n", block_name(blocks[b], name),
+				m_rx.lat_sum / m_rx.lat_len * 1e9,
+				m_rx.lat[(int)(m_rx.lat_len * 0.99)] * 1e9,
+				m_rx.lat_max * 1e9);
+	}
+
+	m_measure_latency = false;
+	printf("\n");
+}
+
+static int bench_resync(int packets, int corrupt_percent) {
+	char name[20];
+	int errors = 0;
+
+	stream_make(packets, 4, PACKET_MAX_PL_LEN, corrupt_percent);
+
+	int intact = 0;
+	for (int p = 0;p < packets;p++) {
+		intact += m_stream.intact[p];
+	}
+
+	printf("Resync with %d %% corrupted packets, %d of %d intact\n",
+			corrupt_percent, intact, packets);
+	printf("%-10s %10s %10s %10s %10s %8s\n",
+			"Input", "received", "bad", "lost", "MB/s", "same");
+
+	static uint32_t *order_ref = 0;
+	static int order_ref_len = 0;
+	if (!order_ref) {
+		order_ref = malloc(sizeof(uint32_t) * packets);
+	}
+
+	m_rx.order = malloc(sizeof(uint32_t) * packets);
+
+	for (int b = 0;b < BLOCK_NUM;b++) {
+		double t = stream_feed(blocks[b]);
+
+		int lost = 0;
+		for (int p = 0;p < packets;p++) {
+			if (m_stream.intact[p] && !m_rx.seen[p]) {
+				lost++;
+			}
+		}
+
+		// All inputs should deliver exactly the same packets as the byte path
+		bool same = true;
+		if (b == 0) {
+			memcpy(order_ref, m_rx.order, sizeof(uint32_t) * m_rx.order_len);
+			order_ref_len = m_rx.order_len;
+		} else {
+			same = m_rx.order_len == order_ref_len &&
+					memcmp(order_ref, m_rx.order, sizeof(uint32_t) * order_ref_len) == 0;
+		}
+
+		if (!same || m_rx.bad) {
+			errors++;
+		}
+
+		printf("%-10s %10d %10d %10d %10.1f %8s\n", block_name(blocks[b], name),
+				m_rx.received, m_rx.bad, lost,
+				(double)m_stream.len / t / (1024.0 * 1024.0), same ? "yes" : "NO");
+	}
+
+	free(m_rx.order);
+	m_rx.order = 0;
+	printf("\n");
+
+	return errors;
+}
+
+int main(int argc, char **argv) {
+	int packets = 100000;
+	int corrupt_percent = 5;
+
+	if (argc > 1) {
+		packets = atoi(argv[1]);
+	}
+
+	if (argc > 2) {
+		corrupt_percent = atoi(argv[2]);
+	}
+
+	srand(1234);
+
+	m_stream.data = malloc(STREAM_MAX);
+	m_stream.intact = malloc(packets);
+	m_rx.seen = malloc(packets);
+	m_rx.seen_len = packets;
+	m_rx.lat = malloc(sizeof(double) * packets);
+
+	bench_throughput(packets);
+	bench_latency(packets);
+	int errors = bench_resync(packets, corrupt_percent);
+
+	free(m_stream.data);
+	free(m_stream.intact);
+	free(m_rx.seen);
+	free(m_rx.lat);
+
+	return errors ? 1 : 0;
+}